@@ -0,0 +1,176 @@
+// ClosedLoopMonitor.cpp
+#include "ClosedLoopMonitor.h"
+
+// Constructor
+ClosedLoopMonitor::ClosedLoopMonitor(TimerStepperControl* controller, int pinA, int pinB) :
+    _controller(controller),
+    _pinA(pinA),
+    _pinB(pinB),
+    _numerator(1),
+    _denominator(1),
+    _anchorCount(0),
+    _anchorPosition(0),
+    _errorLimit(32),
+    _lastCheck(0),
+    _overChecks(0),
+    _error(0),
+    _maxError(0),
+    _positionLost(false),
+    _stallCount(0),
+    _autoCorrect(false),
+    _correctionSpeed(400),
+    _correction(CORRECTION_IDLE),
+    _hasMakeUpTarget(false),
+    _makeUpTarget(0),
+    _corrections(0),
+    _correctionCount(0),
+    _moveStart(0)
+{
+}
+
+// Set up the pulse counter for full quadrature decoding (4 counts per line)
+bool ClosedLoopMonitor::begin() {
+    if (_counter.isStarted()) return true;
+    if (_pinA < 0 || _pinB < 0) {
+        Serial.println("Shaft encoder pins not configured");
+        return false;
+    }
+
+    if (!_counter.begin(CLOSED_LOOP_PCNT_LIMIT, CLOSED_LOOP_GLITCH_NS)) {
+        Serial.println("Shaft encoder: no free pulse counter");
+        return false;
+    }
+
+    // Each channel counts the edges of one phase, the other phase's level
+    // gives the direction
+    _counter.addChannel(_pinA, _pinB, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+    _counter.addChannel(_pinB, _pinA, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+    _counter.start();
+
+    anchor(_controller->getCurrentPosition());
+    return true;
+}
+
+// Motor steps per encoder count, keeps the current measured position
+bool ClosedLoopMonitor::setScale(long numerator, long denominator) {
+    if (numerator == 0 || denominator <= 0) return false;
+
+    long position = getMeasuredPosition();
+    _numerator = numerator;
+    _denominator = denominator;
+    anchor(position);
+    return true;
+}
+
+// Make the current encoder count correspond to the given step position
+void ClosedLoopMonitor::anchor(long position) {
+    _anchorCount = getEncoderCount();
+    _anchorPosition = position;
+    _overChecks = 0;
+    _error = 0;
+}
+
+// Make-up moves on or off and how fast they go
+void ClosedLoopMonitor::setAutoCorrect(bool enabled, int speed) {
+    _autoCorrect = enabled;
+    if (speed > 0) _correctionSpeed = speed;
+    if (!enabled) _correction = CORRECTION_IDLE;
+}
+
+// Forget the last stall
+void ClosedLoopMonitor::clearFault() {
+    _positionLost = false;
+    _maxError = 0;
+}
+
+// Step position the encoder says the motor is at
+long ClosedLoopMonitor::getMeasuredPosition() {
+    int64_t counts = getEncoderCount() - _anchorCount;
+    return _anchorPosition + (long)scaleRounded(counts, _numerator, _denominator);
+}
+
+// Check at the verification rate
+bool ClosedLoopMonitor::service() {
+    if (!_counter.isStarted()) return false;
+
+    unsigned long now = millis();
+    if (now - _lastCheck < CLOSED_LOOP_CHECK_INTERVAL_MS) return false;
+    _lastCheck = now;
+    return check();
+}
+
+// Compare the encoder with the step count and run the recovery
+bool ClosedLoopMonitor::check() {
+    long measured = getMeasuredPosition();
+    long commanded = _controller->getCurrentPosition();
+    bool running = _controller->isRunning();
+
+    _error = commanded - measured;
+    if (labs(_error) > _maxError) _maxError = labs(_error);
+    bool over = labs(_error) > _errorLimit;
+    _overChecks = over ? _overChecks + 1 : 0;
+
+    switch (_correction) {
+        case CORRECTION_STOPPING:
+            if (running) return false;
+
+            // Stopped: the encoder is right, carry on from where the motor really is
+            _controller->setCurrentPosition(measured);
+            _error = 0;
+            _overChecks = 0;
+            _correction = CORRECTION_IDLE;
+            if (!_hasMakeUpTarget) return false;
+            if (_corrections >= CLOSED_LOOP_MAX_CORRECTIONS) {
+                Serial.println("Closed loop: still stalling, make-up moves abandoned");
+                return false;
+            }
+            sendMakeUpMove(measured);
+            return false;
+
+        case CORRECTION_MOVING:
+            // A stall during the make-up move is handled like any other
+            if (!running && millis() - _moveStart >= CLOSED_LOOP_COMMAND_WAIT_MS) {
+                _correction = CORRECTION_IDLE;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // Report each stall once
+    if (_overChecks != CLOSED_LOOP_STALL_CHECKS) return false;
+
+    _positionLost = true;
+    _stallCount++;
+
+    if (_autoCorrect && running && !_controller->isFaulted()) {
+        if (_correction == CORRECTION_IDLE) _corrections = 0;
+
+        // Only a point-to-point move has a target worth going back to
+        _hasMakeUpTarget = !_controller->isContinuous() && !_controller->isTracking();
+        _makeUpTarget = _controller->getTargetPosition();
+
+        MotorCommand_t cmd;
+        cmd.cmd_type = CMD_STOP_MOTOR;
+        _controller->sendCommand(&cmd);
+        _correction = CORRECTION_STOPPING;
+    }
+    return true;
+}
+
+// Move on to the target the stall interrupted
+void ClosedLoopMonitor::sendMakeUpMove(long from) {
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_MOVE_TO;
+    cmd.position = _makeUpTarget;
+    cmd.speed = _correctionSpeed;
+    cmd.direction = _makeUpTarget >= from;
+    cmd.fixedSpeed = true;
+    if (!_controller->sendCommand(&cmd)) return;
+
+    _corrections++;
+    _correctionCount++;
+    _moveStart = millis();
+    _correction = CORRECTION_MOVING;
+}
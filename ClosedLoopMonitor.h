@@ -0,0 +1,114 @@
+// ClosedLoopMonitor.h
+#ifndef CLOSED_LOOP_MONITOR_H
+#define CLOSED_LOOP_MONITOR_H
+
+#include <Arduino.h>
+#include "TimerStepperControl.h"
+#include "PcntCounter.h"
+#include "PositionMath.h"
+
+// PCNT counter limits, overflows are folded into the running count by the driver
+#define CLOSED_LOOP_PCNT_LIMIT 32000
+
+// Ignore encoder edges shorter than this
+#define CLOSED_LOOP_GLITCH_NS 1000
+
+// Verification rate and how many checks in a row must be over the limit
+// before the position counts as lost (rides out a single noisy reading)
+#define CLOSED_LOOP_CHECK_INTERVAL_MS 10
+#define CLOSED_LOOP_STALL_CHECKS 3
+
+// Make-up moves tried for one stall before giving up
+#define CLOSED_LOOP_MAX_CORRECTIONS 3
+
+// How long a make-up move may take to show up as running after it was sent
+#define CLOSED_LOOP_COMMAND_WAIT_MS 50
+
+// Recovery after a stall
+typedef enum {
+    CORRECTION_IDLE = 0,   // Nothing to do
+    CORRECTION_STOPPING,   // Stall stop sent, waiting for the motor to stop
+    CORRECTION_MOVING      // Make-up move to the original target
+} CorrectionState;
+
+// Counts a quadrature encoder on the motor or output shaft with PCNT and
+// compares it with the step count the controller believes in. The check
+// runs from the main loop at a fixed rate, never per step, so it costs
+// nothing in the step interrupt. A following error over the limit for a few
+// checks in a row marks the position as lost. With auto-correct on, a stall
+// during a move stops the motor, takes the encoder position as the real one
+// and moves on to the original target.
+class ClosedLoopMonitor {
+public:
+    // Constructor
+    ClosedLoopMonitor(TimerStepperControl* controller, int pinA, int pinB);
+
+    // Set up the pulse counter, returns false if the pins aren't configured
+    bool begin();
+    bool isActive() { return _counter.isStarted(); }
+
+    // Motor steps per encoder count as a fraction (negative = reversed encoder)
+    bool setScale(long numerator, long denominator);
+
+    // Make the current encoder count correspond to the given step position
+    void anchor(long position);
+
+    // Settings
+    void setErrorLimit(long steps) { if (steps > 0) _errorLimit = steps; }
+    long getErrorLimit() { return _errorLimit; }
+    void setAutoCorrect(bool enabled, int speed);
+    bool isAutoCorrect() { return _autoCorrect; }
+
+    // Call from the main loop, returns true when the position was just lost
+    bool service();
+
+    // Status
+    int64_t getEncoderCount() { return _counter.read(); }
+    long getMeasuredPosition();
+    long getError() { return _error; }              // Commanded minus measured at the last check
+    long getMaxError() { return _maxError; }
+    bool isPositionLost() { return _positionLost; }
+    unsigned long getStallCount() { return _stallCount; }
+    unsigned long getCorrectionCount() { return _correctionCount; }
+    CorrectionState getCorrectionState() { return _correction; }
+    bool isCorrecting() { return _correction != CORRECTION_IDLE; }
+    void clearFault();
+
+private:
+    TimerStepperControl* _controller;
+    int _pinA;
+    int _pinB;
+    PcntCounter _counter;
+
+    // Scaling
+    long _numerator;
+    long _denominator;
+    int64_t _anchorCount;     // Encoder count at the anchor
+    long _anchorPosition;     // Step position at the anchor
+
+    // Checking
+    long _errorLimit;
+    unsigned long _lastCheck;
+    int _overChecks;          // Checks in a row over the limit
+    long _error;
+    long _maxError;
+    bool _positionLost;
+    unsigned long _stallCount;
+
+    // Recovery
+    bool _autoCorrect;
+    int _correctionSpeed;
+    CorrectionState _correction;
+    bool _hasMakeUpTarget;
+    long _makeUpTarget;
+    int _corrections;              // Make-up moves for the current stall
+    unsigned long _correctionCount; // Make-up moves since start-up
+    unsigned long _moveStart;
+
+    // Compare the encoder with the step count once
+    bool check();
+    // Send the make-up move to the original target
+    void sendMakeUpMove(long from);
+};
+
+#endif // CLOSED_LOOP_MONITOR_H
@@ -0,0 +1,22 @@
+// Crc32.h
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC32 (IEEE 802.3, reflected), shared by the settings blob and the RTC
+// position checkpoint. Always inlined so the copy in the step ISR is in
+// IRAM with it.
+static inline __attribute__((always_inline)) uint32_t crc32Ieee(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFUL;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320UL : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+#endif // CRC32_H
@@ -181,6 +181,22 @@ public:
         return _microstepMode;
     }
     
+    // SLEEP/RESET floats low while the ESP32 resets, which resets the
+    // indexer. Without the pin it is tied high and the indexer keeps its
+    // place.
+    bool indexerResetsWithHost() override {
+        return _sleepResetPin != -1;
+    }
+    
+    // Step, direction and enable are plain pins
+    bool getStepPins(StepPins_t* pins) override {
+        pins->stepPin = _stepPin;
+        pins->dirPin = _dirPin;
+        pins->enablePin = _enablePin;
+        pins->pulseWidthUs = _pulseWidthUs;
+        return true;
+    }
+    
     // Set the step pulse width (in microseconds)
     void setPulseWidth(int microseconds) {
         _pulseWidthUs = microseconds;
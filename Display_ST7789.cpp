@@ -44,16 +44,62 @@ void LCD_WriteData_nbyte(uint8_t* SetData,uint8_t* ReadData,uint32_t Size)
   SPI.endTransaction();
 } 
 
-void LCD_Reset(void)
+// ST7789 register set-up: command, number of data bytes, data bytes.
+// Sent as one SPI transaction with DC switched between command and data.
+static const uint8_t LCD_InitTable[] = {
+  0x36, 1,  HORIZONTAL ? 0x00 : 0x70,                  // Memory access control
+  0x3A, 1,  0x05,                                      // 16-bit colour
+  0xB0, 2,  0x00, 0xE8,
+  0xB2, 5,  0x0C, 0x0C, 0x00, 0x33, 0x33,              // Porch
+  0xB7, 1,  0x35,
+  0xBB, 1,  0x35,
+  0xC0, 1,  0x2C,
+  0xC2, 1,  0x01,
+  0xC3, 1,  0x13,
+  0xC4, 1,  0x20,
+  0xC6, 1,  0x0F,
+  0xD0, 2,  0xA4, 0xA1,
+  0xD6, 1,  0xA1,
+  0xE0, 14, 0xF0, 0x00, 0x04, 0x04, 0x04, 0x05, 0x29,  // Positive gamma
+            0x33, 0x3E, 0x38, 0x12, 0x12, 0x28, 0x30,
+  0xE1, 14, 0xF0, 0x07, 0x0A, 0x0D, 0x0B, 0x07, 0x28,  // Negative gamma
+            0x33, 0x3E, 0x36, 0x14, 0x14, 0x29, 0x32,
+  0x21, 0,                                             // Inversion on
+};
+
+// millis() at which the panel takes its next command
+static unsigned long LCD_ReadyAt = 0;
+
+static void LCD_WaitReady(void)
 {
-  digitalWrite(EXAMPLE_PIN_NUM_LCD_CS, LOW);       
-  delay(50);
-  digitalWrite(EXAMPLE_PIN_NUM_LCD_RST, LOW); 
-  delay(50);
-  digitalWrite(EXAMPLE_PIN_NUM_LCD_RST, HIGH); 
-  delay(50);
+  while ((long)(LCD_ReadyAt - millis()) > 0) {
+    delay(1);
+  }
 }
-void LCD_Init(void)
+
+// Send a command table in one transaction
+static void LCD_WriteTable(const uint8_t* Table, uint32_t Size)
+{
+  SPI.beginTransaction(SPISettings(SPIFreq, MSBFIRST, SPI_MODE0));
+  digitalWrite(EXAMPLE_PIN_NUM_LCD_CS, LOW);
+  uint32_t i = 0;
+  while (i + 1 < Size) {
+    uint8_t Count = Table[i + 1];
+    digitalWrite(EXAMPLE_PIN_NUM_LCD_DC, LOW);
+    SPI_WRITE(Table[i]);
+    if (Count > 0) {
+      digitalWrite(EXAMPLE_PIN_NUM_LCD_DC, HIGH);
+      SPI.writeBytes(Table + i + 2, Count);
+    }
+    i += 2 + Count;
+  }
+  digitalWrite(EXAMPLE_PIN_NUM_LCD_CS, HIGH);
+  SPI.endTransaction();
+}
+
+// Pins, SPI and the reset pulse. Returns straight away, the panel needs
+// LCD_RESET_WAIT_MS before LCD_Configure() can talk to it.
+void LCD_Begin(void)
 {
   pinMode(EXAMPLE_PIN_NUM_LCD_CS, OUTPUT);
   pinMode(EXAMPLE_PIN_NUM_LCD_DC, OUTPUT);
@@ -61,95 +107,37 @@ void LCD_Init(void)
   Backlight_Init();
   SPI_Init();
 
-  LCD_Reset();
-  //************* Start Initial Sequence **********// 
-  LCD_WriteCommand(0x11);
-  delay(120);
-  LCD_WriteCommand(0x36);
-  if (HORIZONTAL)
-      LCD_WriteData(0x00);
-  else
-      LCD_WriteData(0x70);
-
-  LCD_WriteCommand(0x3A);
-  LCD_WriteData(0x05);
-
-  LCD_WriteCommand(0xB0);
-  LCD_WriteData(0x00);
-  LCD_WriteData(0xE8);
-  
-  LCD_WriteCommand(0xB2);
-  LCD_WriteData(0x0C);
-  LCD_WriteData(0x0C);
-  LCD_WriteData(0x00);
-  LCD_WriteData(0x33);
-  LCD_WriteData(0x33);
-
-  LCD_WriteCommand(0xB7);
-  LCD_WriteData(0x35);
-
-  LCD_WriteCommand(0xBB);
-  LCD_WriteData(0x35);
-
-  LCD_WriteCommand(0xC0);
-  LCD_WriteData(0x2C);
-
-  LCD_WriteCommand(0xC2);
-  LCD_WriteData(0x01);
-
-  LCD_WriteCommand(0xC3);
-  LCD_WriteData(0x13);
-
-  LCD_WriteCommand(0xC4);
-  LCD_WriteData(0x20);
-
-  LCD_WriteCommand(0xC6);
-  LCD_WriteData(0x0F);
-
-  LCD_WriteCommand(0xD0);
-  LCD_WriteData(0xA4);
-  LCD_WriteData(0xA1);
-
-  LCD_WriteCommand(0xD6);
-  LCD_WriteData(0xA1);
-
-  LCD_WriteCommand(0xE0);
-  LCD_WriteData(0xF0);
-  LCD_WriteData(0x00);
-  LCD_WriteData(0x04);
-  LCD_WriteData(0x04);
-  LCD_WriteData(0x04);
-  LCD_WriteData(0x05);
-  LCD_WriteData(0x29);
-  LCD_WriteData(0x33);
-  LCD_WriteData(0x3E);
-  LCD_WriteData(0x38);
-  LCD_WriteData(0x12);
-  LCD_WriteData(0x12);
-  LCD_WriteData(0x28);
-  LCD_WriteData(0x30);
-
-  LCD_WriteCommand(0xE1);
-  LCD_WriteData(0xF0);
-  LCD_WriteData(0x07);
-  LCD_WriteData(0x0A);
-  LCD_WriteData(0x0D);
-  LCD_WriteData(0x0B);
-  LCD_WriteData(0x07);
-  LCD_WriteData(0x28);
-  LCD_WriteData(0x33);
-  LCD_WriteData(0x3E);
-  LCD_WriteData(0x36);
-  LCD_WriteData(0x14);
-  LCD_WriteData(0x14);
-  LCD_WriteData(0x29);
-  LCD_WriteData(0x32);
-
-  LCD_WriteCommand(0x21);
-
-  LCD_WriteCommand(0x11);
-  delay(120);
-  LCD_WriteCommand(0x29); 
+  digitalWrite(EXAMPLE_PIN_NUM_LCD_CS, HIGH);
+  digitalWrite(EXAMPLE_PIN_NUM_LCD_RST, LOW); 
+  delay(LCD_RESET_PULSE_MS);
+  digitalWrite(EXAMPLE_PIN_NUM_LCD_RST, HIGH); 
+  LCD_ReadyAt = millis() + LCD_RESET_WAIT_MS;
+}
+
+// Wake the panel and load its registers. Waits out whatever is left of the
+// reset time, the display stays dark until LCD_DisplayOn().
+void LCD_Configure(void)
+{
+  LCD_WaitReady();
+  LCD_WriteCommand(0x11);                                  // Sleep out
+  unsigned long SleepOutAt = millis();
+  delay(LCD_SLEEP_OUT_COMMAND_MS);
+  LCD_WriteTable(LCD_InitTable, sizeof(LCD_InitTable));
+  LCD_ReadyAt = SleepOutAt + LCD_SLEEP_OUT_WAIT_MS;
+}
+
+// Turn the display on once the supplies have settled after sleep out
+void LCD_DisplayOn(void)
+{
+  LCD_WaitReady();
+  LCD_WriteCommand(0x29);
+}
+
+void LCD_Init(void)
+{
+  LCD_Begin();
+  LCD_Configure();
+  LCD_DisplayOn();
 }
 /******************************************************************************
 function: Set the cursor position
@@ -161,36 +149,27 @@ parameter :
 ******************************************************************************/
 void LCD_SetCursor(uint16_t Xstart, uint16_t Ystart, uint16_t Xend, uint16_t  Yend)
 { 
+  uint16_t ColumnStart, ColumnEnd, RowStart, RowEnd;
   if (HORIZONTAL) {
-    // set the X coordinates
-    LCD_WriteCommand(0x2A);
-    LCD_WriteData(Xstart >> 8);
-    LCD_WriteData(Xstart + Offset_X);
-    LCD_WriteData(Xend >> 8);
-    LCD_WriteData(Xend + Offset_X);
-    
-    // set the Y coordinates
-    LCD_WriteCommand(0x2B);
-    LCD_WriteData(Ystart >> 8);
-    LCD_WriteData(Ystart + Offset_Y);
-    LCD_WriteData(Yend >> 8);
-    LCD_WriteData(Yend + Offset_Y);
+    ColumnStart = Xstart + Offset_X;
+    ColumnEnd = Xend + Offset_X;
+    RowStart = Ystart + Offset_Y;
+    RowEnd = Yend + Offset_Y;
   }
   else {
-    // set the X coordinates
-    LCD_WriteCommand(0x2A);
-    LCD_WriteData(Ystart >> 8);
-    LCD_WriteData(Ystart + Offset_Y);
-    LCD_WriteData(Yend >> 8);
-    LCD_WriteData(Yend + Offset_Y);
-    // set the Y coordinates
-    LCD_WriteCommand(0x2B);
-    LCD_WriteData(Xstart >> 8);
-    LCD_WriteData(Xstart + Offset_X);
-    LCD_WriteData(Xend >> 8);
-    LCD_WriteData(Xend + Offset_X);
+    ColumnStart = Ystart + Offset_Y;
+    ColumnEnd = Yend + Offset_Y;
+    RowStart = Xstart + Offset_X;
+    RowEnd = Xend + Offset_X;
   }
-  LCD_WriteCommand(0x2C);
+
+  // Column and row address, then memory write, in one transaction
+  const uint8_t Table[] = {
+    0x2A, 4, (uint8_t)(ColumnStart >> 8), (uint8_t)ColumnStart, (uint8_t)(ColumnEnd >> 8), (uint8_t)ColumnEnd,
+    0x2B, 4, (uint8_t)(RowStart >> 8), (uint8_t)RowStart, (uint8_t)(RowEnd >> 8), (uint8_t)RowEnd,
+    0x2C, 0,
+  };
+  LCD_WriteTable(Table, sizeof(Table));
 }
 /******************************************************************************
 function: Refresh the image in an area
@@ -21,9 +21,22 @@
 #define Offset_X 34
 #define Offset_Y 0
 
+// Panel timing from the ST7789 datasheet
+#define LCD_RESET_PULSE_MS        1     // RST low (at least 10 us)
+#define LCD_RESET_WAIT_MS         120   // Reset to the first command
+#define LCD_SLEEP_OUT_COMMAND_MS  5     // Sleep out to the next command
+#define LCD_SLEEP_OUT_WAIT_MS     120   // Sleep out to display on
+
 
 void LCD_SetCursor(uint16_t x1, uint16_t y1, uint16_t x2,uint16_t y2);
 
+// Split start-up so the panel's reset and sleep-out waits can overlap with
+// other work: LCD_Begin() starts the reset, LCD_Configure() loads the
+// registers and LCD_DisplayOn() turns it on, each waiting only for what is
+// left of its delay. LCD_Init() does all three back to back.
+void LCD_Begin(void);
+void LCD_Configure(void);
+void LCD_DisplayOn(void);
 void LCD_Init(void);
 void LCD_SetCursor(uint16_t Xstart, uint16_t Ystart, uint16_t Xend, uint16_t  Yend);
 void LCD_addWindow(uint16_t Xstart, uint16_t Ystart, uint16_t Xend, uint16_t Yend,uint16_t* color);
@@ -0,0 +1,262 @@
+// Homing.cpp
+#include "Homing.h"
+#include "hal/gpio_ll.h"
+
+// How long a move may take to show up as running after it was sent
+#define HOMING_COMMAND_WAIT_MS 50
+
+// Constructor
+Homing::Homing(TimerStepperControl* controller, int switchPin, bool activeLow) :
+    _controller(controller),
+    _switchPin(switchPin),
+    _activeLow(activeLow),
+    _attached(false),
+    _seekSpeed(1600),
+    _approachSpeed(100),
+    _backoffSteps(400),
+    _maxTravelSteps(100000),
+    _forward(false),
+    _homePosition(0),
+    _singlePass(false),
+    _state(HOMING_IDLE),
+    _homed(false),
+    _softLimitsWereEnabled(false),
+    _phaseStart(0),
+    _seekCapture(0),
+    _seekOvershoot(0),
+    _seekToApproach(0),
+    _moveStart(0),
+    _moveSeen(false),
+    _clearingSwitch(false),
+    _armed(false),
+    _captureOnRelease(false),
+    _captured(false),
+    _capturePosition(0)
+{
+    for (int i = 0; i < HOMING_PHASE_COUNT; i++) {
+        _phaseTime[i] = 0;
+    }
+}
+
+// Set up the switch input and its interrupt
+bool Homing::begin() {
+    if (_attached) return true;
+    if (_switchPin < 0) {
+        Serial.println("Home switch pin not configured");
+        return false;
+    }
+
+    pinMode(_switchPin, _activeLow ? INPUT_PULLUP : INPUT);
+    attachInterruptArg(digitalPinToInterrupt(_switchPin), switchISR, this, CHANGE);
+    _attached = true;
+    return true;
+}
+
+// Seek and approach speeds in steps/sec
+void Homing::setSpeeds(int seekSpeed, int approachSpeed) {
+    if (seekSpeed > 0) _seekSpeed = seekSpeed;
+    if (approachSpeed > 0) _approachSpeed = approachSpeed;
+}
+
+// Back-off distance and the furthest the seek may go looking for the switch
+void Homing::setDistances(long backoffSteps, long maxTravelSteps) {
+    if (backoffSteps > 0) _backoffSteps = backoffSteps;
+    if (maxTravelSteps > 0) _maxTravelSteps = maxTravelSteps;
+}
+
+// Switch state right now
+bool Homing::isSwitchActive() {
+    if (_switchPin < 0) return false;
+    return digitalRead(_switchPin) == (_activeLow ? LOW : HIGH);
+}
+
+// Capture the position at the armed switch edge and stop there. The pin is
+// read from the GPIO register, digitalRead() isn't in IRAM.
+void IRAM_ATTR Homing::switchISR(void* arg) {
+    Homing* homing = (Homing*)arg;
+    if (!homing->_armed) return;
+    bool active = gpio_ll_get_level(&GPIO, homing->_switchPin) == (homing->_activeLow ? 0 : 1);
+    if (active == homing->_captureOnRelease) return;
+
+    homing->_armed = false;
+    homing->_capturePosition = homing->_controller->getCurrentPosition();
+    homing->_captured = true;
+    homing->_controller->stopFromISR();
+}
+
+// Start the homing cycle
+bool Homing::start() {
+    if (!begin()) return false;
+    if (_controller->isRunning()) {
+        Serial.println("Stop the motor before homing");
+        return false;
+    }
+
+    // The old limits mean nothing until the zero is found again
+    _softLimitsWereEnabled = _controller->areSoftLimitsEnabled();
+    _controller->setSoftLimitsEnabled(false);
+    _homed = false;
+    _controller->setReferenced(false);
+    _clearingSwitch = false;
+    for (int i = 0; i < HOMING_PHASE_COUNT; i++) {
+        _phaseTime[i] = 0;
+    }
+    _seekOvershoot = 0;
+    _seekToApproach = 0;
+    _phaseStart = millis();
+
+    long position = _controller->getCurrentPosition();
+    long toward = _forward ? 1 : -1;
+
+    // Already on the switch: skip the seek and move off it first
+    if (!_singlePass && isSwitchActive()) {
+        _seekCapture = position;
+        _state = HOMING_BACKOFF;
+        _clearingSwitch = true;
+        moveTo(position - toward * _maxTravelSteps, _seekSpeed, true);
+        return true;
+    }
+
+    _state = HOMING_SEEK;
+    moveTo(position + toward * _maxTravelSteps, _seekSpeed, true);
+    return true;
+}
+
+// Stop the cycle where it is
+void Homing::abort() {
+    if (!isBusy()) return;
+
+    _armed = false;
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_STOP_MOTOR;
+    _controller->sendCommand(&cmd);
+    _controller->setSoftLimitsEnabled(_softLimitsWereEnabled);
+    _state = HOMING_IDLE;
+}
+
+// Move on once the current move has stopped
+void Homing::service() {
+    if (!isBusy()) return;
+
+    // Give the command task time to pick the move up
+    if (!_moveSeen) {
+        if (_controller->isRunning()) {
+            _moveSeen = true;
+        } else if (millis() - _moveStart < HOMING_COMMAND_WAIT_MS) {
+            return;
+        }
+    }
+    if (_controller->isRunning()) return;
+
+    long position = _controller->getCurrentPosition();
+    long toward = _forward ? 1 : -1;
+
+    switch (_state) {
+        case HOMING_SEEK:
+            if (!_captured) {
+                finish(HOMING_FAILED, "Homing failed: switch not found");
+                break;
+            }
+            _seekCapture = _capturePosition;
+            _seekOvershoot = (position - _seekCapture) * toward;
+            if (_singlePass) {
+                // A stall signal only works at speed, so the seek sets the zero
+                _controller->setCurrentPosition(_homePosition + (position - _seekCapture));
+                _homed = true;
+                _controller->setReferenced(true);
+                finish(HOMING_DONE, "Homing done");
+                break;
+            }
+            enterState(HOMING_BACKOFF);
+            moveTo(_seekCapture - toward * _backoffSteps, _seekSpeed, false);
+            break;
+
+        case HOMING_BACKOFF:
+            // Off the switch now, back off the usual distance from here
+            if (_clearingSwitch && _captured) {
+                _clearingSwitch = false;
+                _seekCapture = _capturePosition;
+                moveTo(position - toward * _backoffSteps, _seekSpeed, false);
+                break;
+            }
+            if (isSwitchActive()) {
+                finish(HOMING_FAILED, "Homing failed: switch still active after back-off");
+                break;
+            }
+            enterState(HOMING_APPROACH);
+            moveTo(position + toward * 2 * _backoffSteps, _approachSpeed, true);
+            break;
+
+        case HOMING_APPROACH:
+            if (!_captured) {
+                finish(HOMING_FAILED, "Homing failed: switch not found on approach");
+                break;
+            }
+
+            // The capture is the home position, keep whatever the motor
+            // moved past it while stopping
+            _seekToApproach = _seekCapture - _capturePosition;
+            _controller->setCurrentPosition(_homePosition + (position - _capturePosition));
+            _homed = true;
+            _controller->setReferenced(true);
+            finish(HOMING_DONE, "Homing done");
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Total time of the last cycle in milliseconds
+unsigned long Homing::getTotalTime() {
+    unsigned long total = 0;
+    for (int i = 0; i < HOMING_PHASE_COUNT; i++) {
+        total += _phaseTime[i];
+    }
+    return total;
+}
+
+// Printable state name
+const char* Homing::stateName(HomingState state) {
+    switch (state) {
+        case HOMING_SEEK:     return "seeking";
+        case HOMING_BACKOFF:  return "backing off";
+        case HOMING_APPROACH: return "approaching";
+        case HOMING_DONE:     return "done";
+        case HOMING_FAILED:   return "failed";
+        default:              return "idle";
+    }
+}
+
+// Arm the capture and send the move
+void Homing::moveTo(long target, int speed, bool armCapture) {
+    _captureOnRelease = _clearingSwitch;
+    _captured = false;
+    _armed = armCapture;
+    _moveSeen = false;
+    _moveStart = millis();
+
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_MOVE_TO;
+    cmd.position = target;
+    cmd.speed = speed;
+    cmd.direction = target >= _controller->getCurrentPosition();
+    cmd.fixedSpeed = true;
+    _controller->sendCommand(&cmd);
+}
+
+// Record how long the finished phase took and switch state
+void Homing::enterState(HomingState state) {
+    unsigned long now = millis();
+    _phaseTime[_state - HOMING_SEEK] = now - _phaseStart;
+    _phaseStart = now;
+    _state = state;
+}
+
+// End the cycle and put the soft limits back
+void Homing::finish(HomingState state, const char* message) {
+    _armed = false;
+    enterState(state);
+    _controller->setSoftLimitsEnabled(_softLimitsWereEnabled);
+    Serial.println(message);
+}
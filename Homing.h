@@ -0,0 +1,105 @@
+// Homing.h
+#ifndef HOMING_H
+#define HOMING_H
+
+#include <Arduino.h>
+#include "TimerStepperControl.h"
+
+// Homing cycle states
+typedef enum {
+    HOMING_IDLE = 0,   // Never run or aborted
+    HOMING_SEEK,       // Fast move toward the switch
+    HOMING_BACKOFF,    // Moving off the switch again
+    HOMING_APPROACH,   // Slow move back onto the switch
+    HOMING_DONE,       // Position zeroed
+    HOMING_FAILED      // Switch not found or stuck
+} HomingState;
+
+// Phases timed by the homing report
+#define HOMING_PHASE_COUNT 3
+
+// Finds the reference position with a home/limit switch: a fast seek until
+// the switch trips, a back-off, then a slow approach (starting on the switch
+// moves off it first instead of seeking). The switch interrupt
+// captures the step position at the edge and stops the motor right there,
+// so the reference is exact to the step whatever the main loop is doing.
+// The slow approach sets the zero, the seek only has to find the switch.
+class Homing {
+public:
+    // Constructor (activeLow: switch pulls the pin to ground, pull-up used)
+    Homing(TimerStepperControl* controller, int switchPin, bool activeLow = true);
+
+    // Set up the switch pin and interrupt, returns false if not configured
+    bool begin();
+
+    // Settings (speeds in steps/sec, distances in steps)
+    void setSpeeds(int seekSpeed, int approachSpeed);
+    void setDistances(long backoffSteps, long maxTravelSteps);
+    void setDirection(bool forward) { _forward = forward; }  // Direction toward the switch
+    void setHomePosition(long position) { _homePosition = position; }
+    void setSinglePass(bool singlePass) { _singlePass = singlePass; }  // Seek sets the zero (stall sensing)
+
+    // Run the cycle (call service() from the main loop until it's done)
+    bool start();
+    void abort();
+    void service();
+
+    // Status
+    HomingState getState() { return _state; }
+    bool isBusy() { return _state >= HOMING_SEEK && _state <= HOMING_APPROACH; }
+    bool isHomed() { return _homed; }
+    void restoreHomed() { _homed = _controller->isReferenced(); }  // After a checkpoint restore
+    bool isSwitchActive();
+    static const char* stateName(HomingState state);
+
+    // Timing and capture report of the last cycle
+    unsigned long getPhaseTime(int phase) { return _phaseTime[phase]; }
+    unsigned long getTotalTime();
+    long getSeekOvershoot() { return _seekOvershoot; }     // Steps past the switch after the fast stop
+    long getSeekToApproach() { return _seekToApproach; }   // Seek (or release) capture minus approach capture
+
+private:
+    TimerStepperControl* _controller;
+    int _switchPin;
+    bool _activeLow;
+    bool _attached;
+
+    // Settings
+    int _seekSpeed;
+    int _approachSpeed;
+    long _backoffSteps;
+    long _maxTravelSteps;
+    bool _forward;
+    long _homePosition;
+    bool _singlePass;
+
+    // Cycle state
+    HomingState _state;
+    bool _homed;
+    bool _softLimitsWereEnabled;
+    unsigned long _phaseStart;
+    unsigned long _phaseTime[HOMING_PHASE_COUNT];
+    long _seekCapture;
+    long _seekOvershoot;
+    long _seekToApproach;
+    unsigned long _moveStart;  // When the current move was sent
+    bool _moveSeen;            // The controller has picked the move up
+    bool _clearingSwitch;      // Started on the switch, moving off it
+
+    // Switch capture, written by the interrupt
+    volatile bool _armed;
+    volatile bool _captureOnRelease; // Capture the switch opening instead of closing
+    volatile bool _captured;
+    volatile long _capturePosition;
+
+    // Arm the capture and move toward a target
+    void moveTo(long target, int speed, bool armCapture);
+    // Move on to the next state and time it
+    void enterState(HomingState state);
+    // End the cycle
+    void finish(HomingState state, const char* message);
+
+    static void switchISR(void* arg);
+};
+
+#endif // HOMING_H
@@ -0,0 +1,94 @@
+// Indexer.cpp
+#include "Indexer.h"
+
+// Constructor
+Indexer::Indexer(TimerStepperControl* controller) :
+    _controller(controller),
+    _divisions(0),
+    _origin(0),
+    _stepsPerRevNumerator(0),
+    _stepsPerRevDenominator(1),
+    _index(0),
+    _stepsPerRev(0),
+    _useTable(false)
+{
+}
+
+// Set up the stations and precompute their offsets
+bool Indexer::configure(int divisions, int64_t stepsPerRevNumerator, int64_t stepsPerRevDenominator, long origin) {
+    if (divisions < 1 || divisions > INDEX_MAX_DIVISIONS ||
+        stepsPerRevNumerator <= 0 || stepsPerRevDenominator <= 0) {
+        Serial.println("Invalid index divisions");
+        return false;
+    }
+
+    _divisions = divisions;
+    _origin = origin;
+    _stepsPerRevNumerator = stepsPerRevNumerator;
+    _stepsPerRevDenominator = stepsPerRevDenominator;
+    _index = 0;
+
+    // With a whole number of steps per revolution every revolution repeats
+    // the same pattern, so one table covers all of them
+    _useTable = (stepsPerRevNumerator % stepsPerRevDenominator) == 0;
+    _stepsPerRev = stepsPerRevNumerator / stepsPerRevDenominator;
+    if (_useTable) {
+        for (int k = 0; k < divisions; k++) {
+            _stationOffsets[k] = divisionToSteps(k, _stepsPerRev, divisions);
+        }
+    }
+    return true;
+}
+
+// Absolute step position of an index
+long Indexer::indexToPosition(int64_t index) {
+    if (_useTable) {
+        int64_t revolutions = floorDiv(index, _divisions);
+        int station = (int)(index - revolutions * _divisions);
+        return _origin + revolutions * _stepsPerRev + _stationOffsets[station];
+    }
+    return _origin + scaleRounded(index, _stepsPerRevNumerator, _stepsPerRevDenominator * _divisions);
+}
+
+// Station the indexer is at (0 .. divisions - 1)
+int Indexer::getStation() {
+    if (_divisions == 0) return 0;
+    return (int)(_index - floorDiv(_index, _divisions) * _divisions);
+}
+
+// Move one station forward or back
+bool Indexer::next(bool forward, int speed) {
+    if (_divisions == 0) return false;
+    return moveToIndex(_index + (forward ? 1 : -1), speed);
+}
+
+// Move to a station, picking the way round
+bool Indexer::goTo(int station, IndexDirection direction, int speed) {
+    if (_divisions == 0 || station < 0 || station >= _divisions) return false;
+
+    int current = getStation();
+    int forwardStations = (station - current + _divisions) % _divisions;
+    int reverseStations = (current - station + _divisions) % _divisions;
+
+    if (direction == INDEX_SHORTEST) {
+        direction = (forwardStations <= reverseStations) ? INDEX_FORWARD : INDEX_REVERSE;
+    }
+
+    int64_t index = (direction == INDEX_FORWARD) ? _index + forwardStations : _index - reverseStations;
+    return moveToIndex(index, speed);
+}
+
+// Queue the move to an absolute index
+bool Indexer::moveToIndex(int64_t index, int speed) {
+    long target = indexToPosition(index);
+
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_MOVE_TO;
+    cmd.position = target;
+    cmd.speed = speed;
+    cmd.direction = target >= _controller->getCurrentPosition();
+    if (!_controller->sendCommand(&cmd)) return false;
+
+    _index = index;
+    return true;
+}
@@ -0,0 +1,70 @@
+// Indexer.h
+#ifndef INDEXER_H
+#define INDEXER_H
+
+#include <Arduino.h>
+#include "TimerStepperControl.h"
+#include "PositionMath.h"
+
+// Largest number of stations per revolution
+#define INDEX_MAX_DIVISIONS 1000
+
+// Which way to go to reach a station
+typedef enum {
+    INDEX_FORWARD = 0,  // Increasing step position
+    INDEX_REVERSE,      // Decreasing step position
+    INDEX_SHORTEST      // Whichever is fewer stations away (forward on a tie)
+} IndexDirection;
+
+// Rotary indexing table. Moves go to division k of N at
+// origin + round(k * stepsPerRev / N), counted from an absolute index that
+// keeps going across revolutions, so the remainder is spread over the
+// stations and N indexes end exactly one revolution from the start. Station
+// offsets within a revolution are worked out once when configured, an
+// advance only looks up its target and queues the move.
+class Indexer {
+public:
+    // Constructor
+    Indexer(TimerStepperControl* controller);
+
+    // Split one revolution (numerator / denominator steps) into divisions
+    // stations, with station 0 at origin
+    bool configure(int divisions, int64_t stepsPerRevNumerator, int64_t stepsPerRevDenominator, long origin);
+
+    // Move one station forward or back
+    bool next(bool forward, int speed);
+
+    // Move to a station (0 .. divisions - 1)
+    bool goTo(int station, IndexDirection direction, int speed);
+
+    // Absolute step position of an index (station + revolutions * divisions)
+    long indexToPosition(int64_t index);
+
+    // Status
+    bool isConfigured() { return _divisions > 0; }
+    int getDivisions() { return _divisions; }
+    int64_t getIndex() { return _index; }
+    int getStation();
+    long getOrigin() { return _origin; }
+    int64_t getStepsPerRevNumerator() { return _stepsPerRevNumerator; }
+
+private:
+    TimerStepperControl* _controller;
+
+    int _divisions;
+    long _origin;
+    int64_t _stepsPerRevNumerator;
+    int64_t _stepsPerRevDenominator;
+    int64_t _index;  // Stations moved since station 0 at the origin
+
+    // Station offsets within a revolution. Only usable when a revolution is
+    // a whole number of steps, otherwise every target is computed directly.
+    long _stationOffsets[INDEX_MAX_DIVISIONS];
+    long _stepsPerRev;
+    bool _useTable;
+
+    // Queue the move to an absolute index
+    bool moveToIndex(int64_t index, int speed);
+};
+
+#endif // INDEXER_H
@@ -0,0 +1,126 @@
+// InputShaper.h
+#ifndef INPUT_SHAPER_H
+#define INPUT_SHAPER_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Input shapers split every change in the commanded motion into a few
+// delayed, scaled copies so the vibration excited by one copy is cancelled
+// by the next. Only plain math lives here so it can also be compiled on a
+// host to try settings offline.
+
+// Supported shaper types
+typedef enum {
+    SHAPER_NONE = 0,  // Pass the motion through unchanged
+    SHAPER_ZV,        // Zero vibration (2 impulses, half a period long)
+    SHAPER_ZVD,       // Zero vibration and derivative (3 impulses, one period)
+    SHAPER_EI         // Extra insensitive (3 impulses, one period, 5% tolerance)
+} ShaperType;
+
+#define SHAPER_MAX_IMPULSES 3
+
+// Vibration allowed at the design frequency by the EI shaper
+#define SHAPER_EI_TOLERANCE 0.05f
+
+// Impulse sequence of a shaper (times in seconds, amplitudes add up to 1)
+typedef struct {
+    uint8_t count;
+    float times[SHAPER_MAX_IMPULSES];
+    float amplitudes[SHAPER_MAX_IMPULSES];
+} ShaperImpulses_t;
+
+// Short name for printing
+static inline const char* shaperName(ShaperType type) {
+    switch (type) {
+        case SHAPER_ZV:  return "ZV";
+        case SHAPER_ZVD: return "ZVD";
+        case SHAPER_EI:  return "EI";
+        default:         return "OFF";
+    }
+}
+
+// Build the impulse sequence for a resonance at frequencyHz with the given
+// damping ratio (0 <= damping < 1). Returns false for invalid settings.
+static inline bool computeShaperImpulses(ShaperType type, float frequencyHz, float damping,
+                                         ShaperImpulses_t* impulses) {
+    impulses->count = 1;
+    impulses->times[0] = 0.0f;
+    impulses->amplitudes[0] = 1.0f;
+    if (type == SHAPER_NONE) return true;
+    if (frequencyHz <= 0.0f || damping < 0.0f || damping >= 1.0f) return false;
+
+    float dampedFactor = sqrtf(1.0f - damping * damping);
+    float k = expf(-damping * (float)M_PI / dampedFactor);
+    float dampedPeriod = 1.0f / (frequencyHz * dampedFactor);
+
+    float a[SHAPER_MAX_IMPULSES];
+    switch (type) {
+        case SHAPER_ZV:
+            impulses->count = 2;
+            a[0] = 1.0f;
+            a[1] = k;
+            break;
+        case SHAPER_ZVD:
+            impulses->count = 3;
+            a[0] = 1.0f;
+            a[1] = 2.0f * k;
+            a[2] = k * k;
+            break;
+        case SHAPER_EI:
+            impulses->count = 3;
+            a[0] = 0.25f * (1.0f + SHAPER_EI_TOLERANCE);
+            a[1] = 0.5f * (1.0f - SHAPER_EI_TOLERANCE) * k;
+            a[2] = a[0] * k * k;
+            break;
+        default:
+            return false;
+    }
+
+    // Impulses are half a damped period apart and normalised to unit gain
+    float sum = 0.0f;
+    for (int i = 0; i < impulses->count; i++) sum += a[i];
+    for (int i = 0; i < impulses->count; i++) {
+        impulses->times[i] = 0.5f * dampedPeriod * i;
+        impulses->amplitudes[i] = a[i] / sum;
+    }
+    return true;
+}
+
+// Round an impulse sequence to a fixed tick: delays to whole ticks and
+// amplitudes to Q15 gains, the last gain taking the rounding so they add up
+// to exactly one. applied gets the impulses as they end up.
+static inline void quantizeShaperImpulses(const ShaperImpulses_t* impulses, float tickSeconds,
+                                          uint16_t* delays, int32_t* gains, ShaperImpulses_t* applied) {
+    int32_t remaining = 1 << 15;
+    for (int i = 0; i < impulses->count; i++) {
+        delays[i] = (uint16_t)lroundf(impulses->times[i] / tickSeconds);
+        gains[i] = (i == impulses->count - 1) ? remaining : lroundf(impulses->amplitudes[i] * (1 << 15));
+        remaining -= gains[i];
+
+        applied->times[i] = delays[i] * tickSeconds;
+        applied->amplitudes[i] = gains[i] / (float)(1 << 15);
+    }
+    applied->count = impulses->count;
+}
+
+// Residual vibration left by the impulse sequence on a mode at frequencyHz
+// with the given damping, relative to an unshaped command (1.0 = no
+// reduction). Evaluating it away from the design frequency shows how
+// tolerant a shaper is to a badly measured resonance.
+static inline float shaperResidualVibration(const ShaperImpulses_t* impulses, float frequencyHz, float damping) {
+    float omega = 2.0f * (float)M_PI * frequencyHz;
+    float dampedOmega = omega * sqrtf(1.0f - damping * damping);
+    float lastTime = impulses->times[impulses->count - 1];
+
+    float c = 0.0f;
+    float s = 0.0f;
+    for (int i = 0; i < impulses->count; i++) {
+        float decay = impulses->amplitudes[i] * expf(damping * omega * (impulses->times[i] - lastTime));
+        c += decay * cosf(dampedOmega * impulses->times[i]);
+        s += decay * sinf(dampedOmega * impulses->times[i]);
+    }
+    return sqrtf(c * c + s * s);
+}
+
+#endif // INPUT_SHAPER_H
@@ -5,13 +5,39 @@
 
 #include "StepperDriver.h"
 
+// PWM settings for the bridge enable pins
+#define L298N_PWM_FREQUENCY 20000 // Above the audible range
+#define L298N_PWM_RESOLUTION 10   // 10-bit duty (0-1023)
+#define L298N_PWM_MAX 1023
+
+// Finest supported microstep mode and phase table size
+#define L298N_MAX_MICROSTEP 32
+#define L298N_PHASE_STEPS (4 * L298N_MAX_MICROSTEP) // Table positions per electrical cycle
+
+// Quarter sine wave (0-90°) in 1/32 steps, scaled to the PWM range
+static const uint16_t L298N_SINE_TABLE[L298N_MAX_MICROSTEP + 1] = {
+    0, 50, 100, 150, 200, 249, 297, 345, 391, 437, 482, 526, 568, 609, 649, 687,
+    723, 758, 791, 822, 851, 877, 902, 925, 945, 963, 979, 992, 1003, 1012, 1018, 1022,
+    1023
+};
+
+// Drives the two bridges from the phase table, the enables by PWM. step()
+// writes the bridge through digitalWrite() and ledcWrite(), which run from
+// flash and take the LEDC lock, so this driver is not part of the IRAM step
+// path: it has no step pins, checkStepPath() reports it and a build with a
+// cache-safe step interrupt refuses to start with it. With the default
+// interrupt stepping pauses during flash writes instead.
 class L298NDriver : public StepperDriver {
 public:
     // Constructor
     L298NDriver(int pin1, int pin2, int pin3, int pin4, int enablePinA, int enablePinB) : 
         _pin1(pin1), _pin2(pin2), _pin3(pin3), _pin4(pin4),
         _enablePinA(enablePinA), _enablePinB(enablePinB),
-        _stepCount(0) {}
+        _phaseIndex(0), _microstepMode(1),
+        _holdCurrentPercent(50), _standstill(false) {}
+    
+    // The phase table starts again at its first entry after a reset
+    bool indexerResetsWithHost() override { return true; }
     
     // Initialize the driver
     void init() override {
@@ -19,8 +45,10 @@ public:
         pinMode(_pin2, OUTPUT);
         pinMode(_pin3, OUTPUT);
         pinMode(_pin4, OUTPUT);
-        pinMode(_enablePinA, OUTPUT);
-        pinMode(_enablePinB, OUTPUT);
+        
+        // Bridge enables are driven by PWM so the phase currents can be shaped
+        ledcAttach(_enablePinA, L298N_PWM_FREQUENCY, L298N_PWM_RESOLUTION);
+        ledcAttach(_enablePinB, L298N_PWM_FREQUENCY, L298N_PWM_RESOLUTION);
         
         // Start with driver disabled
         disable();
@@ -46,66 +74,117 @@ public:
     void step() override {
         if (!_enabled) return;
         
-        // If direction is counterclockwise, reverse the sequence
+        // Advance through the phase table by one step of the current mode
+        int increment = L298N_MAX_MICROSTEP / _microstepMode;
         if (!_direction) {
-            _stepCount--;
-            if (_stepCount < 0) _stepCount = 3;
+            _phaseIndex -= increment;
+            if (_phaseIndex < 0) _phaseIndex += L298N_PHASE_STEPS;
         } else {
-            _stepCount++;
-            if (_stepCount > 3) _stepCount = 0;
+            _phaseIndex += increment;
+            if (_phaseIndex >= L298N_PHASE_STEPS) _phaseIndex -= L298N_PHASE_STEPS;
         }
         
-        // Four-step sequence for full stepping
-        switch (_stepCount) {
-            case 0:  // 1010
-                digitalWrite(_pin1, HIGH);
-                digitalWrite(_pin2, LOW);
-                digitalWrite(_pin3, HIGH);
-                digitalWrite(_pin4, LOW);
-                break;
-            case 1:  // 0110
-                digitalWrite(_pin1, LOW);
-                digitalWrite(_pin2, HIGH);
-                digitalWrite(_pin3, HIGH);
-                digitalWrite(_pin4, LOW);
-                break;
-            case 2:  // 0101
-                digitalWrite(_pin1, LOW);
-                digitalWrite(_pin2, HIGH);
-                digitalWrite(_pin3, LOW);
-                digitalWrite(_pin4, HIGH);
-                break;
-            case 3:  // 1001
-                digitalWrite(_pin1, HIGH);
-                digitalWrite(_pin2, LOW);
-                digitalWrite(_pin3, LOW);
-                digitalWrite(_pin4, HIGH);
-                break;
-        }
+        // Stepping always runs at full current
+        _standstill = false;
+        applyPhase();
     }
     
     // Enable the driver
     void enable() override {
-        digitalWrite(_enablePinA, HIGH);
-        digitalWrite(_enablePinB, HIGH);
         _enabled = true;
+        applyPhase();
     }
     
     // Disable the driver
     void disable() override {
-        digitalWrite(_enablePinA, LOW);
-        digitalWrite(_enablePinB, LOW);
+        ledcWrite(_enablePinA, 0);
+        ledcWrite(_enablePinB, 0);
         _enabled = false;
     }
     
+    // Set microstepping mode (1, 2, 4, 8, 16 or 32)
+    void setMicrostepMode(int mode) override {
+        switch (mode) {
+            case 1: case 2: case 4: case 8: case 16: case 32:
+                _microstepMode = mode;
+                break;
+            default:
+                _microstepMode = 1;
+                break;
+        }
+    }
+    
+    // Get current microstepping mode
+    int getMicrostepMode() override {
+        return _microstepMode;
+    }
+    
+    // Reduce the PWM amplitude while holding position
+    void setStandstill(bool standstill) override {
+        if (_standstill == standstill) return;
+        _standstill = standstill;
+        if (_enabled) applyPhase();
+    }
+    
+    // Set hold current as a percentage of the running current
+    void setHoldCurrent(int percent) {
+        _holdCurrentPercent = constrain(percent, 0, 100);
+        if (_enabled && _standstill) applyPhase();
+    }
+    
+    // Signed phase current for a table position (-L298N_PWM_MAX to L298N_PWM_MAX).
+    // Positions are offset by 45° so multiples of a full step are the classic
+    // two-phase-on states.
+    static int phaseSine(int index) {
+        index = (index + L298N_MAX_MICROSTEP / 2) % L298N_PHASE_STEPS;
+        int quadrant = index / L298N_MAX_MICROSTEP;
+        int offset = index % L298N_MAX_MICROSTEP;
+        
+        switch (quadrant) {
+            case 0:  return L298N_SINE_TABLE[offset];
+            case 1:  return L298N_SINE_TABLE[L298N_MAX_MICROSTEP - offset];
+            case 2:  return -L298N_SINE_TABLE[offset];
+            default: return -L298N_SINE_TABLE[L298N_MAX_MICROSTEP - offset];
+        }
+    }
+    
+    // Phase A follows cosine and phase B follows sine of the electrical angle
+    static int phaseACurrent(int index) { return phaseSine(index + L298N_MAX_MICROSTEP); }
+    static int phaseBCurrent(int index) { return phaseSine(index); }
+    
 private:
+    // Drive both bridges for the current table position
+    void applyPhase() {
+        int currentA = phaseACurrent(_phaseIndex);
+        int currentB = phaseBCurrent(_phaseIndex);
+        
+        // Full stepping keeps the original full-current two-phase-on drive
+        if (_microstepMode == 1) {
+            currentA = currentA >= 0 ? L298N_PWM_MAX : -L298N_PWM_MAX;
+            currentB = currentB >= 0 ? L298N_PWM_MAX : -L298N_PWM_MAX;
+        }
+        
+        int amplitude = _standstill ? _holdCurrentPercent : 100;
+        
+        // Phase polarity on the bridge inputs, magnitude on the enables
+        digitalWrite(_pin1, currentA >= 0 ? HIGH : LOW);
+        digitalWrite(_pin2, currentA >= 0 ? LOW : HIGH);
+        digitalWrite(_pin3, currentB >= 0 ? HIGH : LOW);
+        digitalWrite(_pin4, currentB >= 0 ? LOW : HIGH);
+        ledcWrite(_enablePinA, abs(currentA) * amplitude / 100);
+        ledcWrite(_enablePinB, abs(currentB) * amplitude / 100);
+    }
+    
     int _pin1;       // Motor pin 1
     int _pin2;       // Motor pin 2
     int _pin3;       // Motor pin 3
     int _pin4;       // Motor pin 4
     int _enablePinA; // Enable pin A
     int _enablePinB; // Enable pin B
-    int _stepCount;  // Current step in the sequence
+    int _phaseIndex; // Current position in the phase table
+    int _microstepMode;      // Current microstepping mode
+    int _holdCurrentPercent; // Current while holding position (% of running)
+    bool _standstill;        // Holding position at reduced current
 };
 
-#endif // L298N_DRIVER_H
\ No newline at end of file
+#endif // L298N_DRIVER_H
@@ -0,0 +1,513 @@
+// MultiAxisScheduler.cpp
+#include "MultiAxisScheduler.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "hal/gpio_ll.h"
+#include "StepMath.h"
+
+// Constructor
+StepperAxis::StepperAxis(StepperDriver* driver) :
+    _driver(driver),
+    _queue(NULL),
+    _pins(),
+    _pinStepping(false),
+    _position(0),
+    _target(0),
+    _running(false),
+    _continuous(false),
+    _runForward(true),
+    _forward(true),
+    _speed(0.0f),
+    _maxSpeed(1000.0f),
+    _acceleration(3200.0f),
+    _minSpeed(sqrtf(2.0f * 3200.0f)),
+    _burstLevel(0)
+{
+}
+
+// Queue a command for the scheduler task
+bool StepperAxis::sendCommand(const AxisCommand_t* cmd) {
+    if (_queue == NULL) return false;
+    return xQueueSend(_queue, cmd, 0) == pdTRUE;
+}
+
+// Take a command into the motion state (scheduler lock held)
+void StepperAxis::applyCommand(const AxisCommand_t* cmd) {
+    switch (cmd->type) {
+        case AXIS_CMD_MOVE_TO:
+        case AXIS_CMD_MOVE_BY:
+            _target = (cmd->type == AXIS_CMD_MOVE_TO) ? cmd->position : _position + cmd->position;
+            _continuous = false;
+            if (cmd->speed > 0) _maxSpeed = cmd->speed;
+            break;
+
+        case AXIS_CMD_RUN:
+            _continuous = true;
+            _runForward = cmd->forward;
+            if (cmd->speed > 0) _maxSpeed = cmd->speed;
+            break;
+
+        case AXIS_CMD_STOP:
+            // Stop where the current speed can ramp down to
+            if (_running) {
+                long stopSteps = (long)ceilf(_speed * _speed / (2.0f * _acceleration));
+                _target = _position + (_forward ? stopSteps : -stopSteps);
+            } else {
+                _target = _position;
+            }
+            _continuous = false;
+            break;
+
+        case AXIS_CMD_SET_ACCELERATION:
+            if (cmd->acceleration > 0) {
+                _acceleration = cmd->acceleration;
+                _minSpeed = sqrtf(2.0f * _acceleration);
+            }
+            break;
+    }
+}
+
+// Start moving from standstill, returns the time to the first step. Also
+// called from the interrupt when a move follows straight on, with the
+// driver still enabled from the move before.
+uint32_t IRAM_ATTR StepperAxis::startMotion() {
+    if (!_continuous && _target == _position) return 0;
+
+    _forward = _continuous ? _runForward : (_target > _position);
+    driverDirection(_forward);
+    _speed = min(_minSpeed, _maxSpeed);
+    _burstLevel = 0;
+    _running = true;
+    return (uint32_t)(1000000.0f / _speed);
+}
+
+// Count the step just made and plan the next one. Speed changes by the
+// acceleration over one step (v² changes by 2a), slowing down once the
+// remaining distance is what it takes to stop, or when the target is
+// behind the motor.
+uint32_t IRAM_ATTR StepperAxis::advance() {
+    _position += _forward ? 1 : -1;
+
+    bool wrongWay;
+    float remaining;
+    if (_continuous) {
+        wrongWay = _forward != _runForward;
+        remaining = 3.4e38f;
+    } else {
+        long toGo = _target - _position;
+        if (toGo == 0) {
+            _running = false;
+            _speed = 0.0f;
+            return 0;
+        }
+        wrongWay = (toGo > 0) != _forward;
+        remaining = labs(toGo);
+    }
+
+    float twoA = 2.0f * _acceleration;
+    float slowest = min(_minSpeed, _maxSpeed);
+    float stopSteps = _speed * _speed / twoA;
+    if (wrongWay || stopSteps >= remaining) {
+        _speed = stepSqrtf(max(_speed * _speed - twoA, slowest * slowest));
+
+        // Turn round once slowed right down
+        if (wrongWay && _speed <= slowest) {
+            _forward = !_forward;
+        }
+    } else if (_speed < _maxSpeed) {
+        _speed = min(_maxSpeed, stepSqrtf(_speed * _speed + twoA));
+    } else if (_speed > _maxSpeed) {
+        _speed = max(_maxSpeed, stepSqrtf(max(_speed * _speed - twoA, 0.0f)));
+    }
+
+    uint32_t interval = (uint32_t)(1000000.0f / _speed);
+    return interval > 0 ? interval : 1;
+}
+
+// One pulse. DIR is set at the end of the interrupt before, so it has had
+// a whole step interval to settle.
+void IRAM_ATTR StepperAxis::driverStep() {
+    if (!_pinStepping) {
+        _driver->step();
+        return;
+    }
+    if (!_driver->_enabled) return;
+
+    gpio_ll_set_level(&GPIO, _pins.stepPin, 1);
+    esp_rom_delay_us(_pins.pulseWidthUs);
+    gpio_ll_set_level(&GPIO, _pins.stepPin, 0);
+}
+
+// DIR only changes on a reversal
+void IRAM_ATTR StepperAxis::driverDirection(bool forward) {
+    if (forward == _driver->_direction) return;
+    if (!_pinStepping) {
+        _driver->setDirection(forward);
+        return;
+    }
+
+    _driver->_direction = forward;
+    gpio_ll_set_level(&GPIO, _pins.dirPin, forward ? 1 : 0);
+}
+
+// Turn the driver off at the end of a move (enable is active low)
+void IRAM_ATTR StepperAxis::driverDisable() {
+    if (!_pinStepping) {
+        _driver->disable();
+        return;
+    }
+    if (_pins.enablePin >= 0) {
+        gpio_ll_set_level(&GPIO, _pins.enablePin, 1);
+    }
+    _driver->_enabled = false;
+}
+
+// Constructor
+MultiAxisScheduler::MultiAxisScheduler() :
+    _axisCount(0),
+    _heapSize(0),
+    _timer(nullptr),
+    _taskHandle(nullptr),
+    _faultLatched(false),
+    _burstEnabled(true),
+    _interruptCount(0),
+    _maxInterruptCycles(0),
+    _totalInterruptCycles(0),
+    _maxInterruptPulses(0)
+{
+    portMUX_INITIALIZE(&_lock);
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) {
+        _axes[i] = nullptr;
+        _heapIndex[i] = -1;
+    }
+    memset(_timing, 0, sizeof(_timing));
+    _burstRates[0] = AXIS_BURST_RATE_2;
+    _burstRates[1] = AXIS_BURST_RATE_4;
+    _burstRates[2] = AXIS_BURST_RATE_8;
+}
+
+// Add an axis before the scheduler starts
+int MultiAxisScheduler::addAxis(StepperAxis* axis) {
+    if (_timer != nullptr || _axisCount >= MULTI_AXIS_MAX) return -1;
+
+    axis->_driver->init();
+    axis->_pinStepping = axis->_driver->getStepPins(&axis->_pins);
+
+    // The interrupt only writes DIR when it changes, so it has to match now
+    if (axis->_pinStepping) {
+        axis->_driver->setDirection(axis->_driver->getDirection());
+    }
+    if (axis->_queue == NULL) {
+        axis->_queue = xQueueCreate(AXIS_QUEUE_LENGTH, sizeof(AxisCommand_t));
+    }
+    _axes[_axisCount] = axis;
+    return _axisCount++;
+}
+
+// Start the timer (free running, one-shot alarms) and the command task
+bool MultiAxisScheduler::begin() {
+    if (_timer != nullptr) return true;
+    if (_axisCount == 0) return false;
+
+    gptimer_config_t timerConfig = {};
+    timerConfig.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+    timerConfig.direction = GPTIMER_COUNT_UP;
+    timerConfig.resolution_hz = 1000000;  // Counts are microseconds
+    if (gptimer_new_timer(&timerConfig, &_timer) != ESP_OK) {
+        Serial.println("Multi-axis scheduler: no free timer");
+        _timer = nullptr;
+        return false;
+    }
+
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = alarmCallback,
+    };
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(_timer, &callbacks, this));
+    ESP_ERROR_CHECK(gptimer_enable(_timer));
+    ESP_ERROR_CHECK(gptimer_start(_timer));
+
+    xTaskCreate(commandTask, "axis_task", 4096, this, 10, &_taskHandle);
+    return true;
+}
+
+// Swap two heap entries and keep the index table in step
+void IRAM_ATTR MultiAxisScheduler::heapSwap(int a, int b) {
+    AxisEvent_t entry = _heap[a];
+    _heap[a] = _heap[b];
+    _heap[b] = entry;
+    _heapIndex[_heap[a].axis] = a;
+    _heapIndex[_heap[b].axis] = b;
+}
+
+void IRAM_ATTR MultiAxisScheduler::siftUp(int index) {
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (_heap[parent].time <= _heap[index].time) break;
+        heapSwap(parent, index);
+        index = parent;
+    }
+}
+
+void IRAM_ATTR MultiAxisScheduler::siftDown(int index) {
+    while (true) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < _heapSize && _heap[left].time < _heap[smallest].time) smallest = left;
+        if (right < _heapSize && _heap[right].time < _heap[smallest].time) smallest = right;
+        if (smallest == index) break;
+        heapSwap(index, smallest);
+        index = smallest;
+    }
+}
+
+// Schedule an idle axis
+void MultiAxisScheduler::heapPush(uint8_t axis, uint64_t time) {
+    int index = _heapSize++;
+    _heap[index].time = time;
+    _heap[index].axis = axis;
+    _heapIndex[axis] = index;
+    siftUp(index);
+}
+
+// Take an axis out of the schedule
+void IRAM_ATTR MultiAxisScheduler::heapRemove(uint8_t axis) {
+    int index = _heapIndex[axis];
+    if (index < 0) return;
+
+    int last = --_heapSize;
+    if (index != last) {
+        heapSwap(index, last);
+        siftDown(index);
+        siftUp(index);
+    }
+    _heapIndex[axis] = -1;
+}
+
+// Alarm for the earliest axis, never so close that it's already passed
+void IRAM_ATTR MultiAxisScheduler::armAlarm(uint64_t now) {
+    if (_heapSize == 0) return;
+
+    gptimer_alarm_config_t alarmConfig = {};
+    alarmConfig.alarm_count = max(_heap[0].time, now + AXIS_MIN_LEAD_US);
+    gptimer_set_alarm_action(_timer, &alarmConfig);
+}
+
+// Rates for each burst level. A level whose rate is 0 (or not above the one
+// below it) is not used, and nor are the levels above it.
+void MultiAxisScheduler::setBurstRates(float rate2, float rate4, float rate8) {
+    float rates[AXIS_BURST_LEVELS] = { rate2, rate4, rate8 };
+    portENTER_CRITICAL(&_lock);
+    for (int i = 0; i < AXIS_BURST_LEVELS; i++) {
+        bool usable = rates[i] > 0 && (i == 0 || (_burstRates[i - 1] > 0 && rates[i] > _burstRates[i - 1]));
+        _burstRates[i] = usable ? rates[i] : 0.0f;
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+// Pulses per interrupt for an axis at its current speed. A level is entered
+// at its rate and left below AXIS_BURST_HYSTERESIS of it, and a move never
+// bursts past its target.
+int IRAM_ATTR MultiAxisScheduler::selectBurst(StepperAxis* axis) {
+    int level = _burstEnabled ? axis->_burstLevel : 0;
+    while (_burstEnabled && level < AXIS_BURST_LEVELS && _burstRates[level] > 0 &&
+           axis->_speed >= _burstRates[level]) {
+        level++;
+    }
+    while (level > 0 && (_burstRates[level - 1] <= 0 ||
+           axis->_speed < _burstRates[level - 1] * AXIS_BURST_HYSTERESIS)) {
+        level--;
+    }
+    axis->_burstLevel = level;
+
+    int burst = 1 << level;
+    if (!axis->_continuous) {
+        long toGo = labs(axis->_target - axis->_position);
+        while (burst > 1 && burst > toGo) burst >>= 1;
+    }
+    return burst;
+}
+
+// Put out the pulses of one burst and return the time from the first one's
+// due time to the next interrupt. The profile still advances one step per
+// pulse, so the next burst is due exactly where single pulses would have
+// got to and the average rate is unchanged; only the pulses within a burst
+// come early. A burst ends early where the motor turns round or the move
+// ends, and is cut short when the interrupt's budget runs out. The first
+// pulse is always made, it is due now.
+uint32_t IRAM_ATTR MultiAxisScheduler::stepBurst(StepperAxis* axis, AxisTiming_t* timing,
+                                                 uint64_t due, uint64_t now, int* budget) {
+    uint32_t late = now > due ? (uint32_t)(now - due) : 0;
+    timing->totalLateUs += late;
+    if (late > timing->maxLateUs) timing->maxLateUs = late;
+    axis->driverStep();
+    timing->steps++;
+
+    int burst = min(selectBurst(axis), max(*budget, 1));
+    bool forward = axis->_forward;
+    uint32_t elapsed = 0;  // From the first pulse, as single pulses would go
+    uint32_t interval = axis->advance();
+    int pulses = 1;
+    while (pulses < burst && interval > 0 && axis->_forward == forward) {
+        elapsed += interval;
+        esp_rom_delay_us(AXIS_BURST_PULSE_GAP_US);
+        axis->driverStep();
+        timing->steps++;
+        pulses++;
+
+        uint64_t pulseTime;
+        gptimer_get_raw_count(_timer, &pulseTime);
+        int64_t offset = (int64_t)(due + elapsed) - (int64_t)pulseTime;
+        uint32_t error = (uint32_t)(offset < 0 ? -offset : offset);
+        timing->totalBurstErrorUs += error;
+        if (error > timing->maxBurstErrorUs) timing->maxBurstErrorUs = error;
+
+        interval = axis->advance();
+    }
+    if (pulses > 1) timing->bursts++;
+    *budget -= pulses;
+
+    // A move that came in while the last one was going out starts from here
+    if (interval == 0) {
+        interval = axis->startMotion();
+        if (interval == 0) axis->driverDisable();
+        return interval > 0 ? elapsed + interval : 0;
+    }
+    axis->driverDirection(axis->_forward);
+    return elapsed + interval;
+}
+
+// Step every axis that is due and set the alarm for the next one
+bool IRAM_ATTR MultiAxisScheduler::alarmCallback(gptimer_handle_t timer,
+                                                 const gptimer_alarm_event_data_t*,
+                                                 void* userData) {
+    MultiAxisScheduler* scheduler = (MultiAxisScheduler*)userData;
+    uint32_t startCycles = esp_cpu_get_cycle_count();
+
+    // Lateness is measured from when the interrupt actually runs, not the
+    // alarm count, so it includes the interrupt latency
+    uint64_t now;
+    gptimer_get_raw_count(timer, &now);
+
+    // Every pulse and the gap after it is spent with the lock held, so
+    // the pulses of one interrupt are shared out among the axes due in it
+    int budget = AXIS_BURST_MAX_PULSES;
+
+    portENTER_CRITICAL_ISR(&scheduler->_lock);
+    while (scheduler->_heapSize > 0 && scheduler->_heap[0].time <= now + AXIS_SCHEDULE_SLACK_US) {
+        AxisEvent_t event = scheduler->_heap[0];
+
+        // Next step is timed from when this one should have been, so
+        // lateness never adds up
+        uint32_t interval = scheduler->stepBurst(scheduler->_axes[event.axis],
+                                                 &scheduler->_timing[event.axis], event.time, now, &budget);
+        if (interval == 0) {
+            scheduler->heapRemove(event.axis);
+        } else {
+            scheduler->_heap[0].time = event.time + interval;
+            scheduler->siftDown(0);
+        }
+    }
+
+    uint64_t count;
+    gptimer_get_raw_count(timer, &count);
+    scheduler->armAlarm(count);
+    portEXIT_CRITICAL_ISR(&scheduler->_lock);
+
+    int pulses = AXIS_BURST_MAX_PULSES - budget;
+    if (pulses > scheduler->_maxInterruptPulses) scheduler->_maxInterruptPulses = pulses;
+
+    uint32_t cycles = esp_cpu_get_cycle_count() - startCycles;
+    scheduler->_interruptCount++;
+    scheduler->_totalInterruptCycles += cycles;
+    if (cycles > scheduler->_maxInterruptCycles) scheduler->_maxInterruptCycles = cycles;
+    return false;
+}
+
+// Stop every axis at once and latch the fault. Nothing is left in the
+// heap, so an alarm that is already set finds no axis due.
+void IRAM_ATTR MultiAxisScheduler::emergencyStop() {
+    portENTER_CRITICAL_SAFE(&_lock);
+    _faultLatched = true;
+    _heapSize = 0;
+    for (int i = 0; i < _axisCount; i++) {
+        StepperAxis* axis = _axes[i];
+        _heapIndex[i] = -1;
+        axis->_running = false;
+        axis->_continuous = false;
+        axis->_target = axis->_position;
+        axis->_speed = 0.0f;
+        axis->driverDisable();
+    }
+    portEXIT_CRITICAL_SAFE(&_lock);
+}
+
+// Accept motion commands again
+void MultiAxisScheduler::clearFault() {
+    _faultLatched = false;
+}
+
+// Apply queued commands, starting axes that were idle. While the fault is
+// latched only the acceleration is taken, moves are dropped.
+void MultiAxisScheduler::serviceCommands(uint64_t now) {
+    for (int i = 0; i < _axisCount; i++) {
+        StepperAxis* axis = _axes[i];
+        AxisCommand_t cmd;
+        while (xQueueReceive(axis->_queue, &cmd, 0) == pdTRUE) {
+            portENTER_CRITICAL(&_lock);
+            if (_faultLatched && cmd.type != AXIS_CMD_SET_ACCELERATION) {
+                portEXIT_CRITICAL(&_lock);
+                continue;
+            }
+            axis->applyCommand(&cmd);
+            if (_heapIndex[i] < 0) {
+                uint32_t interval = axis->startMotion();
+                if (interval > 0) {
+                    axis->_driver->enable();
+                    heapPush(i, now + interval);
+                    armAlarm(now);
+                }
+            }
+            portEXIT_CRITICAL(&_lock);
+        }
+    }
+}
+
+// Command task
+void MultiAxisScheduler::commandTask(void* parameters) {
+    MultiAxisScheduler* scheduler = (MultiAxisScheduler*)parameters;
+
+    while (1) {
+        uint64_t now;
+        gptimer_get_raw_count(scheduler->_timer, &now);
+        scheduler->serviceCommands(now);
+
+        // Allow other tasks to run
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+// Copy one axis's step timing
+void MultiAxisScheduler::getTiming(int index, AxisTiming_t* timing) {
+    if (index < 0 || index >= _axisCount) return;
+    portENTER_CRITICAL(&_lock);
+    *timing = _timing[index];
+    portEXIT_CRITICAL(&_lock);
+}
+
+// Mean interrupt duration in CPU cycles
+uint32_t MultiAxisScheduler::getMeanInterruptCycles() {
+    if (_interruptCount == 0) return 0;
+    return (uint32_t)(_totalInterruptCycles / _interruptCount);
+}
+
+// Start the timing statistics again
+void MultiAxisScheduler::resetTiming() {
+    portENTER_CRITICAL(&_lock);
+    memset(_timing, 0, sizeof(_timing));
+    _interruptCount = 0;
+    _maxInterruptCycles = 0;
+    _totalInterruptCycles = 0;
+    _maxInterruptPulses = 0;
+    portEXIT_CRITICAL(&_lock);
+}
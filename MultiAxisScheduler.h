@@ -0,0 +1,214 @@
+// MultiAxisScheduler.h
+#ifndef MULTI_AXIS_SCHEDULER_H
+#define MULTI_AXIS_SCHEDULER_H
+
+#include <Arduino.h>
+#include "driver/gptimer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "StepperDriver.h"
+
+// Scheduler limits
+#define MULTI_AXIS_MAX 4            // Axes on one timer
+#define AXIS_QUEUE_LENGTH 8         // Commands waiting per axis
+#define AXIS_SCHEDULE_SLACK_US 2    // Axes due this close together step in the same interrupt
+#define AXIS_MIN_LEAD_US 3          // Never arm the alarm closer than this to now
+
+// Burst mode. Above these step rates an axis puts out 2, 4 or 8 pulses in
+// one interrupt, AXIS_BURST_PULSE_GAP_US apart, and its next interrupt is
+// due where single pulses would have got to, so the interrupt rate drops by
+// the burst size while the average step rate is unchanged. A level is left
+// again below AXIS_BURST_HYSTERESIS of its rate. One interrupt puts out at
+// most AXIS_BURST_MAX_PULSES pulses over all the axes due in it, plus the
+// first pulse of any axis due after those are used up, which bounds how
+// long it holds the lock.
+#define AXIS_BURST_LEVELS 3
+#define AXIS_BURST_RATE_2 8000      // Steps/sec
+#define AXIS_BURST_RATE_4 16000
+#define AXIS_BURST_RATE_8 32000
+#define AXIS_BURST_HYSTERESIS 0.8f
+#define AXIS_BURST_PULSE_GAP_US 2     // Step low time between the pulses of a burst
+#define AXIS_BURST_MAX_PULSES 8       // Pulses per interrupt over all axes
+
+// Commands for one independent axis
+typedef enum {
+    AXIS_CMD_MOVE_TO,           // Move to absolute position
+    AXIS_CMD_MOVE_BY,           // Move relative number of steps
+    AXIS_CMD_RUN,               // Run continuously in one direction
+    AXIS_CMD_STOP,              // Ramp down and stop
+    AXIS_CMD_SET_ACCELERATION   // Acceleration for the following moves
+} AxisCommandType;
+
+typedef struct {
+    AxisCommandType type;
+    long position;      // Target or relative steps
+    int speed;          // Maximum speed (steps/sec)
+    bool forward;       // Direction for AXIS_CMD_RUN
+    int acceleration;   // Steps/sec²
+} AxisCommand_t;
+
+// Step timing of one axis. Lateness is measured against the ideal time of
+// the first pulse of each interrupt, burst error is how far the pulses that
+// follow it in the same burst are from where single pulses would have been.
+typedef struct {
+    unsigned long steps;
+    uint32_t maxLateUs;
+    uint64_t totalLateUs;
+    unsigned long bursts;         // Interrupts with more than one pulse
+    uint32_t maxBurstErrorUs;
+    uint64_t totalBurstErrorUs;
+} AxisTiming_t;
+
+// One stepper that moves on its own. The profile is event driven: after
+// each step the axis works out how long until the next one, accelerating
+// and decelerating by a fixed amount per step, so it can stop exactly on
+// its target and reverse smoothly when retargeted.
+class StepperAxis {
+public:
+    // Constructor
+    StepperAxis(StepperDriver* driver);
+
+    // Queue a command (from any task, never blocks)
+    bool sendCommand(const AxisCommand_t* cmd);
+
+    // Status
+    long getPosition() { return _position; }
+    bool isRunning() { return _running; }
+    float getSpeed() { return _running ? _speed : 0.0f; }
+    float getAcceleration() { return _acceleration; }
+    int getBurst() { return 1 << _burstLevel; }  // Pulses per interrupt
+
+private:
+    friend class MultiAxisScheduler;
+    friend class StepStream;
+
+    StepperDriver* _driver;
+    QueueHandle_t _queue;
+    StepPins_t _pins;     // Pins the interrupt drives itself
+    bool _pinStepping;    // Driver has step pins
+
+    // Motion state, only changed by the scheduler
+    volatile long _position;
+    volatile long _target;
+    volatile bool _running;
+    bool _continuous;
+    bool _runForward;     // Requested direction when continuous
+    bool _forward;        // Direction the motor is turning
+    float _speed;         // Steps/sec
+    float _maxSpeed;
+    float _acceleration;
+    float _minSpeed;      // Speed one step from standstill
+    uint8_t _burstLevel;  // Pulses per interrupt as a power of two
+
+    // Take a command from the queue into the motion state
+    void applyCommand(const AxisCommand_t* cmd);
+    // Microseconds to the first step from standstill, setting DIR but
+    // leaving the enable to the caller
+    uint32_t startMotion();
+    // Count the step just made and work out the time to the next one
+    // (0 = stopped), without touching the driver
+    uint32_t advance();
+
+    // The driver from the interrupt: through the GPIO registers for a
+    // step/direction driver, through its virtual functions otherwise
+    void driverStep();
+    void driverDirection(bool forward);
+    void driverDisable();
+};
+
+// Runs several StepperAxis on a single hardware timer. Each axis has a next
+// step time; a small binary heap keeps the earliest at the top and the alarm
+// is always set for it, so the interrupt only fires when some axis is due
+// and never polls the idle ones. Commands go through a queue per axis and
+// are applied by a task, the same way as for TimerStepperControl.
+class MultiAxisScheduler {
+public:
+    // Constructor
+    MultiAxisScheduler();
+
+    // Add an axis (before begin), returns its number or -1 when full
+    int addAxis(StepperAxis* axis);
+    int getAxisCount() { return _axisCount; }
+    StepperAxis* getAxis(int index) { return (index >= 0 && index < _axisCount) ? _axes[index] : nullptr; }
+
+    // Start the timer and the command task
+    bool begin();
+
+    // Burst mode on or off and the rates for 2, 4 and 8 pulses per interrupt
+    // (0 = level not used)
+    void setBurstMode(bool enabled) { _burstEnabled = enabled; }
+    bool isBurstMode() { return _burstEnabled; }
+    void setBurstRates(float rate2, float rate4, float rate8);
+    float getBurstRate(int level) { return _burstRates[level]; }
+
+    // Emergency stop: every axis stops where it is with its driver
+    // disabled, and motion commands are dropped until clearFault(). Safe
+    // from any context, including another interrupt.
+    void emergencyStop();
+    bool isFaulted() { return _faultLatched; }
+    void clearFault();
+
+    // Timing report
+    void getTiming(int index, AxisTiming_t* timing);
+    unsigned long getInterruptCount() { return _interruptCount; }
+    uint32_t getMaxInterruptCycles() { return _maxInterruptCycles; }
+    uint32_t getMeanInterruptCycles();
+    int getMaxInterruptPulses() { return _maxInterruptPulses; }
+    void resetTiming();
+
+private:
+    // Heap entry: when an axis steps next
+    typedef struct {
+        uint64_t time;    // Timer count (microseconds)
+        uint8_t axis;
+    } AxisEvent_t;
+
+    StepperAxis* _axes[MULTI_AXIS_MAX];
+    int _axisCount;
+
+    // Min-heap on time, plus where each axis sits in it (-1 = idle)
+    AxisEvent_t _heap[MULTI_AXIS_MAX];
+    int _heapSize;
+    int8_t _heapIndex[MULTI_AXIS_MAX];
+
+    gptimer_handle_t _timer;
+    TaskHandle_t _taskHandle;
+    portMUX_TYPE _lock;
+    volatile bool _faultLatched;
+
+    // Burst mode
+    bool _burstEnabled;
+    float _burstRates[AXIS_BURST_LEVELS];
+
+    // Timing statistics
+    AxisTiming_t _timing[MULTI_AXIS_MAX];
+    volatile unsigned long _interruptCount;
+    volatile uint32_t _maxInterruptCycles;
+    volatile uint64_t _totalInterruptCycles;
+    volatile int _maxInterruptPulses;    // Most pulses in one interrupt
+
+    // Heap operations (called with the lock held)
+    void heapSwap(int a, int b);
+    void siftUp(int index);
+    void siftDown(int index);
+    void heapPush(uint8_t axis, uint64_t time);
+    void heapRemove(uint8_t axis);
+
+    // Set the alarm for the earliest axis
+    void armAlarm(uint64_t now);
+
+    // Pulses for an axis in this interrupt, and the burst itself with the
+    // time from its first pulse's due time to the next, taking its pulses
+    // from what is left of the interrupt's budget (interrupt)
+    int selectBurst(StepperAxis* axis);
+    uint32_t stepBurst(StepperAxis* axis, AxisTiming_t* timing, uint64_t due, uint64_t now, int* budget);
+
+    // Apply queued commands (command task)
+    void serviceCommands(uint64_t now);
+
+    static bool alarmCallback(gptimer_handle_t timer, const gptimer_alarm_event_data_t* edata, void* userData);
+    static void commandTask(void* parameters);
+};
+
+#endif // MULTI_AXIS_SCHEDULER_H
@@ -0,0 +1,116 @@
+// Oscillator.cpp
+#include "Oscillator.h"
+
+int16_t Oscillator::_sineTable[OSCILLATOR_TABLE_SIZE + 1];
+
+// Constructor
+Oscillator::Oscillator() :
+    _active(false),
+    _stopping(false),
+    _center(0),
+    _phase(0),
+    _phasePerMicrosecond(0),
+    _frequency(0.0f),
+    _lastMicros(0),
+    _clockStarted(false),
+    _cycles(0),
+    _amplitude(0.0f),
+    _targetAmplitude(0.0f),
+    _amplitudeRamp(OSCILLATOR_DEFAULT_RAMP),
+    _velocity(0.0f)
+{
+    portMUX_INITIALIZE(&_lock);
+    
+    // One full cycle plus the wrap-around entry for interpolation
+    for (int i = 0; i <= OSCILLATOR_TABLE_SIZE; i++) {
+        _sineTable[i] = (int16_t)lroundf(32767.0f * sinf(2.0f * (float)M_PI * i / OSCILLATOR_TABLE_SIZE));
+    }
+}
+
+// Start around a center position
+void Oscillator::start(long center) {
+    _center = center;
+    _phase = 0;
+    _cycles = 0;
+    _amplitude = 0.0f;
+    _velocity = 0.0f;
+    _clockStarted = false;
+    _stopping = false;
+    _active = true;
+}
+
+// Ramp the amplitude down and stop at the center
+void Oscillator::stop() {
+    _stopping = true;
+}
+
+// Frequency in Hz, the phase carries on from where it is
+void Oscillator::setFrequency(float hertz) {
+    if (hertz < 0.0f) hertz = 0.0f;
+    
+    // 2^64 phase units per cycle, 10^6 microseconds per second
+    uint64_t phasePerMicrosecond = (uint64_t)(hertz * 18446744073709.551616);
+    
+    portENTER_CRITICAL(&_lock);
+    _frequency = hertz;
+    _phasePerMicrosecond = phasePerMicrosecond;
+    portEXIT_CRITICAL(&_lock);
+}
+
+// Peak distance from the center in steps
+void Oscillator::setAmplitude(long steps) {
+    _targetAmplitude = labs(steps);
+}
+
+// How fast the amplitude may change
+void Oscillator::setAmplitudeRamp(long stepsPerSecond) {
+    _amplitudeRamp = max(stepsPerSecond, 1L);
+}
+
+// Sine of the phase in Q15
+int32_t Oscillator::sineQ15(uint64_t phase) {
+    uint32_t index = (uint32_t)(phase >> (64 - OSCILLATOR_TABLE_BITS));
+    uint32_t fraction = (uint32_t)(phase >> (48 - OSCILLATOR_TABLE_BITS)) & 0xFFFF;
+    int32_t from = _sineTable[index];
+    int32_t to = _sineTable[index + 1];
+    return from + (((to - from) * (int32_t)fraction) >> 16);
+}
+
+// Position on the sine for the current phase
+long Oscillator::getTrackingTarget() {
+    if (!_active) return _center;
+    
+    unsigned long now = micros();
+    if (!_clockStarted) {
+        _lastMicros = now;
+        _clockStarted = true;
+    }
+    unsigned long elapsed = now - _lastMicros;
+    _lastMicros = now;
+    
+    portENTER_CRITICAL_ISR(&_lock);
+    uint64_t phasePerMicrosecond = _phasePerMicrosecond;
+    float frequency = _frequency;
+    portEXIT_CRITICAL_ISR(&_lock);
+    
+    // Advance the phase, counting completed cycles
+    uint64_t previous = _phase;
+    _phase += phasePerMicrosecond * elapsed;
+    if (_phase < previous) _cycles++;
+    
+    // Ramp the amplitude
+    float target = _stopping ? 0.0f : _targetAmplitude;
+    float change = _amplitudeRamp * (elapsed / 1000000.0f);
+    if (_amplitude < target) {
+        _amplitude = min(target, _amplitude + change);
+    } else if (_amplitude > target) {
+        _amplitude = max(target, _amplitude - change);
+    }
+    
+    // Feed-forward velocity: amplitude * 2*pi*f * cos(phase)
+    int32_t cosine = sineQ15(_phase + (1ULL << 62));
+    _velocity = _amplitude * 2.0f * (float)M_PI * frequency * cosine / 32768.0f;
+    
+    int32_t sine = sineQ15(_phase);
+    return _center + lroundf(_amplitude * sine / 32768.0f);
+}
@@ -0,0 +1,77 @@
+// Oscillator.h
+#ifndef OSCILLATOR_H
+#define OSCILLATOR_H
+
+#include <Arduino.h>
+#include "TimerStepperControl.h"
+
+// Sine table size (one full cycle, must be a power of two)
+#define OSCILLATOR_TABLE_BITS 8
+#define OSCILLATOR_TABLE_SIZE (1 << OSCILLATOR_TABLE_BITS)
+
+// Default amplitude change rate when starting, stopping or resizing
+#define OSCILLATOR_DEFAULT_RAMP 2000  // Steps per second
+
+// Back-and-forth motion around a center position as a tracking target.
+// The phase is a 64-bit accumulator advanced by the elapsed time on every
+// timer tick (direct digital synthesis), so the frequency is exact and can
+// change at any moment without a jump. Position is computed from the phase
+// and amplitude alone, never summed up, so there is no drift however long
+// it runs. Amplitude changes ramp so the target never jumps either.
+class Oscillator : public TrackingSource {
+public:
+    // Constructor
+    Oscillator();
+    
+    // Start around a center position, the amplitude ramps up from zero
+    void start(long center);
+    
+    // Ramp the amplitude down to zero and stop at the center
+    void stop();
+    
+    // Settings, safe to change while running
+    void setFrequency(float hertz);
+    void setAmplitude(long steps);
+    void setAmplitudeRamp(long stepsPerSecond);
+    
+    // Status
+    bool isActive() { return _active; }
+    bool isStopped() { return !_active || (_stopping && _amplitude == 0.0f); }
+    long getCenter() { return _center; }
+    float getFrequency() { return _frequency; }
+    unsigned long getCycles() { return _cycles; }
+    
+    // TrackingSource (called from the step ISR)
+    long getTrackingTarget() override;
+    float getTrackingVelocity() override { return _velocity; }
+    
+private:
+    // Sine of the phase in Q15 with linear interpolation between table entries
+    static int32_t sineQ15(uint64_t phase);
+    static int16_t _sineTable[OSCILLATOR_TABLE_SIZE + 1];
+    
+    volatile bool _active;
+    volatile bool _stopping;
+    long _center;
+    
+    // Phase accumulator: a full cycle is 2^64, advanced per microsecond.
+    // The increment is two words on a 32-bit core, so it and the frequency
+    // are only read and written under the lock.
+    uint64_t _phase;
+    uint64_t _phasePerMicrosecond;
+    float _frequency;
+    portMUX_TYPE _lock;
+    unsigned long _lastMicros;
+    bool _clockStarted;
+    volatile unsigned long _cycles;
+    
+    // Amplitude in steps, ramping toward the requested one
+    float _amplitude;
+    volatile float _targetAmplitude;
+    volatile float _amplitudeRamp;   // Steps per second
+    
+    // Velocity of the target for the tracking feed-forward
+    float _velocity;
+};
+
+#endif // OSCILLATOR_H
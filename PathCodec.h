@@ -0,0 +1,99 @@
+// PathCodec.h
+#ifndef PATH_CODEC_H
+#define PATH_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Recorded paths are stored as a small header followed by one record per
+// sample: the time since the previous sample in milliseconds and the change
+// in position, each as a variable length integer (7 bits per byte, low
+// bits first, top bit set on all but the last byte). Position changes are
+// zigzag encoded so small moves in either direction fit in one byte.
+
+#define PATH_FILE_MAGIC 0x48544150UL  // "PATH" little endian
+#define PATH_FILE_VERSION 1
+#define PATH_HEADER_SIZE 9            // Magic, version, start position
+#define PATH_MAX_VARINT_BYTES 5       // Longest encoding of a 32-bit value
+#define PATH_MAX_RECORD_BYTES (2 * PATH_MAX_VARINT_BYTES)
+
+// One recorded point
+typedef struct {
+    uint32_t timeMs;   // Time since recording started
+    long position;     // Absolute position in steps
+} PathSample_t;
+
+// Map signed values to unsigned so small magnitudes stay small
+static inline uint32_t zigzagEncode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigzagDecode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Write a varint, returns the number of bytes used
+static inline size_t varintEncode(uint32_t value, uint8_t* out) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+// Read a varint, returns the number of bytes used (0 if incomplete or invalid)
+static inline size_t varintDecode(const uint8_t* in, size_t available, uint32_t* value) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < available && i < PATH_MAX_VARINT_BYTES; i++) {
+        result |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+        if ((in[i] & 0x80) == 0) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Encode a sample relative to the previous one, returns bytes written
+static inline size_t pathEncodeRecord(const PathSample_t* previous, const PathSample_t* sample, uint8_t* out) {
+    size_t length = varintEncode(sample->timeMs - previous->timeMs, out);
+    length += varintEncode(zigzagEncode((int32_t)(sample->position - previous->position)), out + length);
+    return length;
+}
+
+// Decode the sample following previous, returns bytes used (0 if incomplete)
+static inline size_t pathDecodeRecord(const uint8_t* in, size_t available, const PathSample_t* previous, PathSample_t* sample) {
+    uint32_t deltaTime;
+    uint32_t deltaPosition;
+    size_t used = varintDecode(in, available, &deltaTime);
+    if (used == 0) return 0;
+    size_t positionBytes = varintDecode(in + used, available - used, &deltaPosition);
+    if (positionBytes == 0) return 0;
+
+    sample->timeMs = previous->timeMs + deltaTime;
+    sample->position = previous->position + zigzagDecode(deltaPosition);
+    return used + positionBytes;
+}
+
+// Header: magic, version and the position the recording started at
+static inline void pathEncodeHeader(long startPosition, uint8_t* out) {
+    uint32_t magic = PATH_FILE_MAGIC;
+    uint32_t start = (uint32_t)startPosition;
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(magic >> (8 * i));
+    out[4] = PATH_FILE_VERSION;
+    for (int i = 0; i < 4; i++) out[5 + i] = (uint8_t)(start >> (8 * i));
+}
+
+static inline bool pathDecodeHeader(const uint8_t* in, long* startPosition) {
+    uint32_t magic = 0;
+    uint32_t start = 0;
+    for (int i = 0; i < 4; i++) magic |= (uint32_t)in[i] << (8 * i);
+    for (int i = 0; i < 4; i++) start |= (uint32_t)in[5 + i] << (8 * i);
+    if (magic != PATH_FILE_MAGIC || in[4] != PATH_FILE_VERSION) return false;
+    *startPosition = (long)(int32_t)start;
+    return true;
+}
+
+#endif // PATH_CODEC_H
@@ -0,0 +1,65 @@
+// PathPlayer.cpp
+#include "PathPlayer.h"
+
+// Constructor
+PathPlayer::PathPlayer(fs::FS* fs) :
+    _fs(fs),
+    _readLength(0),
+    _readOffset(0)
+{
+    _lastDecoded.timeMs = 0;
+    _lastDecoded.position = 0;
+}
+
+// Open a recording and pre-load the first samples
+bool PathPlayer::open(const char* path) {
+    close();
+    
+    _file = _fs->open(path, FILE_READ);
+    if (!_file) {
+        Serial.print("Path player: can't open ");
+        Serial.println(path);
+        return false;
+    }
+    
+    uint8_t header[PATH_HEADER_SIZE];
+    long startPosition;
+    if (_file.read(header, PATH_HEADER_SIZE) != PATH_HEADER_SIZE ||
+        !pathDecodeHeader(header, &startPosition)) {
+        Serial.println("Path player: not a path recording");
+        _file.close();
+        return false;
+    }
+    
+    _readLength = 0;
+    _readOffset = 0;
+    _lastDecoded.timeMs = 0;
+    _lastDecoded.position = startPosition;
+    return beginStream();
+}
+
+// Stop playback and close the file
+void PathPlayer::close() {
+    if (_open) {
+        _file.close();
+    }
+    SamplePlayer::close();
+}
+
+// Decode the next record, reading another chunk when one may be cut off
+bool PathPlayer::readSample(PathSample_t* sample) {
+    if (_readLength - _readOffset < PATH_MAX_RECORD_BYTES) {
+        // Move the leftover bytes to the front and top up from the file
+        size_t remaining = _readLength - _readOffset;
+        memmove(_readBuffer, _readBuffer + _readOffset, remaining);
+        _readLength = remaining + _file.read(_readBuffer + remaining, PATH_READ_CHUNK_SIZE - remaining);
+        _readOffset = 0;
+    }
+    
+    size_t used = pathDecodeRecord(_readBuffer + _readOffset, _readLength - _readOffset, &_lastDecoded, sample);
+    if (used == 0) return false;
+    
+    _readOffset += used;
+    _lastDecoded = *sample;
+    return true;
+}
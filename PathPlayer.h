@@ -0,0 +1,37 @@
+// PathPlayer.h
+#ifndef PATH_PLAYER_H
+#define PATH_PLAYER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "PathCodec.h"
+#include "SamplePlayer.h"
+
+// Bytes read from the file at a time
+#define PATH_READ_CHUNK_SIZE 128
+
+// Streams a recording made by PathRecorder back from its file
+class PathPlayer : public SamplePlayer {
+public:
+    // Constructor
+    PathPlayer(fs::FS* fs);
+    
+    // Open a recording and pre-load the first samples
+    bool open(const char* path);
+    void close() override;
+    
+protected:
+    bool readSample(PathSample_t* sample) override;
+    
+private:
+    fs::FS* _fs;
+    File _file;
+    
+    // File reading and decoding (main loop)
+    uint8_t _readBuffer[PATH_READ_CHUNK_SIZE];
+    size_t _readLength;
+    size_t _readOffset;
+    PathSample_t _lastDecoded;
+};
+
+#endif // PATH_PLAYER_H
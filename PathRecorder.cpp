@@ -0,0 +1,118 @@
+// PathRecorder.cpp
+#include "PathRecorder.h"
+
+// Constructor
+PathRecorder::PathRecorder(fs::FS* fs) :
+    _fs(fs),
+    _recording(false),
+    _startTime(0),
+    _lastSampleTime(0),
+    _holding(false),
+    _bufferLength(0),
+    _sampleCount(0),
+    _bytesWritten(0)
+{
+    _lastSample.timeMs = 0;
+    _lastSample.position = 0;
+    _holdSample = _lastSample;
+}
+
+// Start recording to a file, the current position becomes the start
+bool PathRecorder::start(const char* path, long position) {
+    if (_recording) stop();
+    
+    _file = _fs->open(path, FILE_WRITE);
+    if (!_file) {
+        Serial.print("Path recorder: can't create ");
+        Serial.println(path);
+        return false;
+    }
+    
+    pathEncodeHeader(position, _buffer);
+    _bufferLength = PATH_HEADER_SIZE;
+    _bytesWritten = 0;
+    _sampleCount = 0;
+    
+    // First sample is the start position at time zero
+    _startTime = millis();
+    _lastSampleTime = _startTime;
+    _lastSample.timeMs = 0;
+    _lastSample.position = position;
+    writeSample(&_lastSample);
+    _holding = false;
+    
+    _recording = true;
+    return true;
+}
+
+// Stop recording and close the file
+void PathRecorder::stop() {
+    if (!_recording) return;
+    
+    // Keep the end of a final pause
+    if (_holding) {
+        writeSample(&_holdSample);
+        _holding = false;
+    }
+    
+    flush();
+    _file.close();
+    _recording = false;
+    
+    Serial.print("Path recorded: ");
+    Serial.print(_sampleCount);
+    Serial.print(" samples, ");
+    Serial.print(_lastSample.timeMs);
+    Serial.print(" ms, ");
+    Serial.print(_bytesWritten);
+    Serial.println(" bytes");
+}
+
+// Sample the position (call frequently from the main loop)
+void PathRecorder::service(long position) {
+    if (!_recording) return;
+    
+    unsigned long now = millis();
+    if (now - _lastSampleTime < PATH_SAMPLE_INTERVAL_MS) return;
+    _lastSampleTime = now;
+    
+    PathSample_t sample;
+    sample.timeMs = now - _startTime;
+    sample.position = position;
+    
+    // While the position holds, only remember the latest time
+    if (position == _lastSample.position) {
+        _holdSample = sample;
+        _holding = true;
+        return;
+    }
+    
+    // Movement resumed, close the pause first
+    if (_holding) {
+        writeSample(&_holdSample);
+        _holding = false;
+    }
+    
+    writeSample(&sample);
+}
+
+// Delta encode a sample into the write buffer
+void PathRecorder::writeSample(const PathSample_t* sample) {
+    if (_bufferLength + PATH_MAX_RECORD_BYTES > PATH_WRITE_BUFFER_SIZE) {
+        flush();
+    }
+    
+    // The first sample is encoded against itself (zero deltas)
+    const PathSample_t* previous = (_sampleCount == 0) ? sample : &_lastSample;
+    _bufferLength += pathEncodeRecord(previous, sample, _buffer + _bufferLength);
+    _lastSample = *sample;
+    _sampleCount++;
+}
+
+// Write the buffered bytes to the file
+void PathRecorder::flush() {
+    if (_bufferLength == 0) return;
+    
+    _bytesWritten += _file.write(_buffer, _bufferLength);
+    _bufferLength = 0;
+}
@@ -0,0 +1,62 @@
+// PathRecorder.h
+#ifndef PATH_RECORDER_H
+#define PATH_RECORDER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "PathCodec.h"
+
+// How often the position is sampled while recording
+#define PATH_SAMPLE_INTERVAL_MS 10
+
+// Bytes collected in RAM before they are written to the file
+#define PATH_WRITE_BUFFER_SIZE 256
+
+// Records the motor position over time into a file. Samples are only
+// stored when the position changes, plus the last point of every pause so
+// playback holds still instead of creeping across it.
+class PathRecorder {
+public:
+    // Constructor
+    PathRecorder(fs::FS* fs);
+    
+    // Start recording to a file, the current position becomes the start
+    bool start(const char* path, long position);
+    
+    // Stop recording and close the file
+    void stop();
+    
+    // Sample the position (call frequently from the main loop)
+    void service(long position);
+    
+    // Status
+    bool isRecording() { return _recording; }
+    unsigned long getSampleCount() { return _sampleCount; }
+    unsigned long getBytesWritten() { return _bytesWritten; }
+    uint32_t getDurationMs() { return _lastSample.timeMs; }
+    
+private:
+    fs::FS* _fs;
+    File _file;
+    bool _recording;
+    
+    // Timing
+    unsigned long _startTime;
+    unsigned long _lastSampleTime;
+    
+    // Delta encoding state
+    PathSample_t _lastSample;   // Last sample written
+    bool _holding;              // Position hasn't changed since the last sample
+    PathSample_t _holdSample;   // Latest point of the current pause
+    
+    // Output buffering
+    uint8_t _buffer[PATH_WRITE_BUFFER_SIZE];
+    size_t _bufferLength;
+    unsigned long _sampleCount;
+    unsigned long _bytesWritten;
+    
+    void writeSample(const PathSample_t* sample);
+    void flush();
+};
+
+#endif // PATH_RECORDER_H
@@ -0,0 +1,64 @@
+// PcntCounter.cpp
+#include "PcntCounter.h"
+
+// Constructor
+PcntCounter::PcntCounter() :
+    _unit(nullptr),
+    _channelCount(0),
+    _lastRawCount(0),
+    _count(0)
+{
+    for (int i = 0; i < PCNT_COUNTER_CHANNELS; i++) {
+        _channels[i] = nullptr;
+    }
+}
+
+// Create the unit, overflows at the limits are accumulated by the driver
+bool PcntCounter::begin(int limit, int glitchNs) {
+    if (_unit != nullptr) return true;
+
+    pcnt_unit_config_t unitConfig = {};
+    unitConfig.low_limit = -limit;
+    unitConfig.high_limit = limit;
+    unitConfig.flags.accum_count = 1;
+    if (pcnt_new_unit(&unitConfig, &_unit) != ESP_OK) {
+        _unit = nullptr;
+        return false;
+    }
+
+    pcnt_glitch_filter_config_t filterConfig = {};
+    filterConfig.max_glitch_ns = glitchNs;
+    pcnt_unit_set_glitch_filter(_unit, &filterConfig);
+
+    pcnt_unit_add_watch_point(_unit, limit);
+    pcnt_unit_add_watch_point(_unit, -limit);
+    return true;
+}
+
+// One pin's edges, the other pin's level reverses them when low
+bool PcntCounter::addChannel(int edgePin, int levelPin, pcnt_channel_edge_action_t rising,
+                             pcnt_channel_edge_action_t falling) {
+    if (_unit == nullptr || _channelCount >= PCNT_COUNTER_CHANNELS) return false;
+
+    pcnt_chan_config_t channelConfig = {};
+    channelConfig.edge_gpio_num = edgePin;
+    channelConfig.level_gpio_num = levelPin;
+    pcnt_channel_handle_t channel = nullptr;
+    if (pcnt_new_channel(_unit, &channelConfig, &channel) != ESP_OK) return false;
+
+    pcnt_channel_set_edge_action(channel, rising, falling);
+    pcnt_channel_set_level_action(channel, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    _channels[_channelCount++] = channel;
+    return true;
+}
+
+// Clear the count and start counting
+void PcntCounter::start() {
+    if (_unit == nullptr) return;
+
+    pcnt_unit_enable(_unit);
+    pcnt_unit_clear_count(_unit);
+    pcnt_unit_start(_unit);
+    _lastRawCount = 0;
+    _count = 0;
+}
@@ -0,0 +1,56 @@
+// PcntCounter.h
+#ifndef PCNT_COUNTER_H
+#define PCNT_COUNTER_H
+
+#include <Arduino.h>
+#include "driver/pulse_cnt.h"
+
+// Channels a unit can have
+#define PCNT_COUNTER_CHANNELS 2
+
+// A PCNT unit with its count kept 64 bits wide. The driver folds each
+// overflow at the limits into its 32-bit count (one interrupt per limit,
+// never one per pulse) and read() extends that by the difference since the
+// last read, which is right even across a wrap. Shared by the step/dir
+// follower and the closed-loop shaft encoder.
+class PcntCounter {
+public:
+    // Constructor
+    PcntCounter();
+
+    // Create the unit counting up to +-limit with a glitch filter, false
+    // when no unit is free
+    bool begin(int limit, int glitchNs);
+    bool isStarted() { return _unit != nullptr; }
+
+    // Count edges on edgePin, the given actions for a rising and a falling
+    // edge while levelPin is high and the opposite while it is low
+    bool addChannel(int edgePin, int levelPin, pcnt_channel_edge_action_t rising,
+                    pcnt_channel_edge_action_t falling);
+
+    // Clear the count and start counting
+    void start();
+
+    // Counts since start(), brought up to date. Not locked, callers that
+    // read from more than one context hold their own lock.
+    int64_t read() {
+        if (_unit == nullptr) return _count;
+
+        int rawCount = 0;
+        pcnt_unit_get_count(_unit, &rawCount);
+        _count += (int32_t)((uint32_t)rawCount - (uint32_t)_lastRawCount);
+        _lastRawCount = rawCount;
+        return _count;
+    }
+
+private:
+    pcnt_unit_handle_t _unit;
+    pcnt_channel_handle_t _channels[PCNT_COUNTER_CHANNELS];
+    int _channelCount;
+
+    // Count kept wider than the driver's 32-bit count
+    int _lastRawCount;
+    int64_t _count;
+};
+
+#endif // PCNT_COUNTER_H
@@ -0,0 +1,98 @@
+// PositionCheckpoint.h
+#ifndef POSITION_CHECKPOINT_H
+#define POSITION_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Crc32.h"
+
+// The controller keeps a checkpoint of where the motor is in RTC memory
+// that survives a reset (not a power cycle). The step ISR rewrites it when
+// a move starts and when the motor comes to rest, so after a watchdog,
+// panic, brownout or software reset the position can be taken up again
+// without homing. There is one copy: a reset in the middle of a write
+// leaves a bad CRC, which is treated as no checkpoint rather than falling
+// back to an older position that may no longer be true.
+
+#define CHECKPOINT_MAGIC 0x31504B43UL  // "CKP1" little endian
+
+// Checkpoint flags
+#define CHECKPOINT_DEENERGIZED 0x01    // Driver outputs were off
+#define CHECKPOINT_REFERENCED 0x02     // Position was relative to a home reference
+
+// What was known when the checkpoint was written
+typedef struct {
+    uint32_t magic;
+    uint32_t count;             // Checkpoints written since it was last lost
+    int32_t position;           // Base microsteps
+    int32_t electricalOrigin;   // Position the driver indexer was last at home
+    uint32_t segmentsStarted;   // Sequence progress
+    uint8_t mode;               // MotionMode, anything but idle means moving
+    uint8_t flags;              // CHECKPOINT_*
+    uint8_t microstepMode;      // Base microstep mode the positions are in
+    uint8_t reserved;
+    uint32_t crc;               // CRC32 of everything before it
+} PositionCheckpoint_t;
+
+// Outcome of checkpointEvaluate
+enum CheckpointRestore {
+    CHECKPOINT_RESTORED,    // Position taken up as it was
+    CHECKPOINT_NONE,        // Nothing valid stored (power-on or damaged)
+    CHECKPOINT_MOVING,      // Reset during a move, the position is unknown
+    CHECKPOINT_HOLDING,     // Reset cut the holding current, the rotor may have moved
+    CHECKPOINT_RESOLUTION   // Stored in a finer microstep mode than can be shown now
+};
+
+// CRC32 of the checkpoint up to its crc field
+static inline __attribute__((always_inline)) uint32_t checkpointCrc32(const PositionCheckpoint_t* checkpoint) {
+    return crc32Ieee((const uint8_t*)checkpoint, offsetof(PositionCheckpoint_t, crc));
+}
+
+static inline bool checkpointValid(const PositionCheckpoint_t* checkpoint) {
+    return checkpoint->magic == CHECKPOINT_MAGIC && checkpoint->crc == checkpointCrc32(checkpoint);
+}
+
+// Decide whether the checkpoint can be trusted after a reset. A restore
+// is only safe from rest with the driver already off: the reset then
+// changed nothing at the motor. A motor that was moving or holding lost
+// its drive at an unknown point. Positions are converted to the current
+// microstep mode, which fails if that is coarser and the position falls
+// between its steps. On success *position and *electricalOrigin are set.
+static inline CheckpointRestore checkpointEvaluate(const PositionCheckpoint_t* checkpoint, int microstepMode,
+                                                   long* position, long* electricalOrigin) {
+    if (!checkpointValid(checkpoint) || checkpoint->microstepMode == 0 || microstepMode <= 0) {
+        return CHECKPOINT_NONE;
+    }
+    if (checkpoint->mode != 0) return CHECKPOINT_MOVING;
+    if ((checkpoint->flags & CHECKPOINT_DEENERGIZED) == 0) return CHECKPOINT_HOLDING;
+
+    long storedPosition = checkpoint->position;
+    long storedOrigin = checkpoint->electricalOrigin;
+    if (microstepMode >= checkpoint->microstepMode) {
+        long scale = microstepMode / checkpoint->microstepMode;
+        *position = storedPosition * scale;
+        *electricalOrigin = storedOrigin * scale;
+    } else {
+        long scale = checkpoint->microstepMode / microstepMode;
+        if (storedPosition % scale != 0 || storedOrigin % scale != 0) return CHECKPOINT_RESOLUTION;
+        *position = storedPosition / scale;
+        *electricalOrigin = storedOrigin / scale;
+    }
+    return CHECKPOINT_RESTORED;
+}
+
+// For a driver whose indexer is reset along with the ESP32 (a DRV8825 with
+// its sleep/reset line wired, the L298N phase table), the indexer comes
+// back at home. Once enabled it pulls the rotor to the nearest position
+// with the home phase, a whole number of electrical cycles (four full
+// steps) from where the indexer was at home before. Returns that position,
+// which is also the new electrical origin. A TMC2209 keeps its microstep
+// counter through the reset and needs no such correction.
+static inline long checkpointIndexerHome(long position, long electricalOrigin, int microstepMode) {
+    long cycle = 4L * microstepMode;
+    long offset = (position - electricalOrigin) % cycle;
+    if (offset < 0) offset += cycle;
+    return offset > cycle / 2 ? position - offset + cycle : position - offset;
+}
+
+#endif // POSITION_CHECKPOINT_H
@@ -0,0 +1,45 @@
+// PositionMath.h
+#ifndef POSITION_MATH_H
+#define POSITION_MATH_H
+
+#include <stdint.h>
+
+// Integer position helpers. Targets are always computed from an absolute
+// count (position units, division index, ...) instead of adding up rounded
+// per-move step counts, so repeated moves never drift.
+
+// Number of position units in one output revolution (0.01% resolution)
+#define POSITION_UNITS_PER_REV 10000L
+
+// Gear ratios are stored as thousandths so the step scale stays rational
+#define GEAR_RATIO_SCALE 1000L
+
+// Floor division that also rounds toward negative infinity for negative values
+static inline int64_t floorDiv(int64_t numerator, int64_t denominator) {
+    int64_t quotient = numerator / denominator;
+    if ((numerator % denominator != 0) && ((numerator < 0) != (denominator < 0))) {
+        quotient--;
+    }
+    return quotient;
+}
+
+// value * numerator / denominator rounded to the nearest integer. Applied to
+// an absolute count this spreads the remainder Bresenham-style: the k-th of
+// N divisions lands on round(k * total / N), so the gaps between consecutive
+// targets differ by at most one step and N divisions add up exactly.
+static inline int64_t scaleRounded(int64_t value, int64_t numerator, int64_t denominator) {
+    return floorDiv(2 * value * numerator + denominator, 2 * denominator);
+}
+
+// Absolute step position of division k when total steps are split N ways
+static inline int64_t divisionToSteps(int64_t k, int64_t totalSteps, int64_t divisions) {
+    return scaleRounded(k, totalSteps, divisions);
+}
+
+// Convert rational steps-per-revolution to a rounded integer step count
+// for an absolute position given in POSITION_UNITS_PER_REV units
+static inline int64_t unitsToSteps(int64_t units, int64_t stepsPerRevNumerator, int64_t stepsPerRevDenominator) {
+    return scaleRounded(units, stepsPerRevNumerator, stepsPerRevDenominator * POSITION_UNITS_PER_REV);
+}
+
+#endif // POSITION_MATH_H
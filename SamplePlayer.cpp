@@ -0,0 +1,235 @@
+// SamplePlayer.cpp
+#include "SamplePlayer.h"
+#include <limits.h>
+
+// Constructor
+SamplePlayer::SamplePlayer() :
+    _open(false),
+    _sampleHead(0),
+    _sampleTail(0),
+    _hasPrevious(false),
+    _endOfStream(false),
+    _playing(false),
+    _finished(false),
+    _clockStarted(false),
+    _lastMicros(0),
+    _playbackUs(0),
+    _clockRemainder(0),
+    _timeScalePercent(100),
+    _underruns(0),
+    _starved(false),
+    _minMarginMs(0),
+    _interpolation(PLAYER_INTERPOLATE_LINEAR),
+    _smoothingUs(0),
+    _smoothedTarget(0.0f)
+{
+    _firstSample.timeMs = 0;
+    _firstSample.position = 0;
+    _lastRead = _firstSample;
+    _previousSample = _firstSample;
+}
+
+// Reset the buffer and pre-load the first samples
+bool SamplePlayer::beginStream() {
+    _sampleHead = 0;
+    _sampleTail = 0;
+    _hasPrevious = false;
+    _endOfStream = false;
+    _playing = false;
+    _finished = false;
+    _underruns = 0;
+    _starved = false;
+    _open = true;
+    
+    service();
+    if (bufferedSamples(_sampleHead) == 0) {
+        Serial.println("Player: nothing to play");
+        close();
+        return false;
+    }
+    
+    _firstSample = *sampleAt(0);
+    _smoothedTarget = _firstSample.position;
+    return true;
+}
+
+// Stop playback
+void SamplePlayer::close() {
+    _playing = false;
+    _open = false;
+}
+
+// Playback speed in percent of the recorded speed
+void SamplePlayer::setTimeScale(int percent) {
+    _timeScalePercent = constrain(percent, 1, 1000);
+}
+
+// Low-pass time constant applied to the target
+void SamplePlayer::setSmoothing(uint32_t milliseconds) {
+    _smoothingUs = milliseconds * 1000UL;
+}
+
+// Start the playback clock
+void SamplePlayer::start() {
+    if (!_open) return;
+    
+    _playbackUs = (uint64_t)sampleAt(0)->timeMs * 1000ULL;
+    _clockRemainder = 0;
+    _clockStarted = false;
+    _smoothedTarget = sampleAt(0)->position;
+    _minMarginMs = LONG_MAX;
+    _finished = false;
+    _playing = true;
+}
+
+// Keep the sample buffer filled
+void SamplePlayer::service() {
+    if (!_open || _endOfStream) return;
+    
+    while (bufferedSamples(_sampleHead) < PLAYER_BUFFER_SIZE - 1) {
+        PathSample_t sample;
+        if (!readSample(&sample)) {
+            // Only after the last head, so the ISR never takes the end for
+            // a buffer it hasn't seen all of
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            _endOfStream = true;
+            break;
+        }
+        
+        _samples[_sampleHead] = sample;
+        _lastRead = sample;
+        
+        // The slot has to be written before the ISR can see the new head
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        _sampleHead = (_sampleHead + 1) & (PLAYER_BUFFER_SIZE - 1);
+    }
+}
+
+// Position between the tail sample and the next one. Cubic uses Hermite
+// segments with slopes from the neighbouring samples. A slope is zero where
+// the path turns around or holds, and is otherwise held to three times the
+// shallower of the two segments it joins (Fritsch-Carlson). Each segment is
+// then monotone, so the curve never overshoots a sample, and both segments
+// clamp a shared sample the same way, so the velocity stays continuous.
+float SamplePlayer::interpolate(int64_t intoUs, uint8_t buffered) {
+    PathSample_t* from = sampleAt(0);
+    PathSample_t* to = sampleAt(1);
+    float span = (float)(to->timeMs - from->timeMs) * 1000.0f;
+    float delta = (float)(to->position - from->position);
+    if (span <= 0.0f) return from->position;
+    
+    float s = intoUs / span;
+    if (_interpolation == PLAYER_INTERPOLATE_LINEAR) {
+        return from->position + delta * s;
+    }
+    
+    // Slopes in steps/us, scaled to this segment's length at the end
+    float rate = delta / span;
+    float startSlope = delta;
+    if (_hasPrevious) {
+        float before = (float)(from->position - _previousSample.position);
+        float beforeSpan = (float)(from->timeMs - _previousSample.timeMs) * 1000.0f;
+        if (before * delta <= 0.0f || beforeSpan <= 0.0f) {
+            startSlope = 0.0f;
+        } else {
+            float slope = (to->position - _previousSample.position) /
+                          ((to->timeMs - _previousSample.timeMs) * 1000.0f);
+            float limit = 3.0f * fminf(fabsf(before / beforeSpan), fabsf(rate));
+            startSlope = copysignf(fminf(fabsf(slope), limit), delta) * span;
+        }
+    }
+    
+    float endSlope = delta;
+    if (buffered >= 3) {
+        PathSample_t* next = sampleAt(2);
+        float after = (float)(next->position - to->position);
+        float afterSpan = (float)(next->timeMs - to->timeMs) * 1000.0f;
+        if (after * delta <= 0.0f || afterSpan <= 0.0f) {
+            endSlope = 0.0f;
+        } else {
+            float slope = (next->position - from->position) /
+                          ((next->timeMs - from->timeMs) * 1000.0f);
+            float limit = 3.0f * fminf(fabsf(after / afterSpan), fabsf(rate));
+            endSlope = copysignf(fminf(fabsf(slope), limit), delta) * span;
+        }
+    }
+    
+    float s2 = s * s;
+    float s3 = s2 * s;
+    return from->position + (s3 - 2.0f * s2 + s) * startSlope +
+           (-2.0f * s3 + 3.0f * s2) * delta + (s3 - s2) * endSlope;
+}
+
+// Interpolated, smoothed position on the scaled playback clock
+long SamplePlayer::getTrackingTarget() {
+    if (!_playing) return lroundf(_smoothedTarget);
+    
+    // Pairs with the releases in service(): the end flag is read before the
+    // head and the slots only after the head that published them
+    bool endOfStream = _endOfStream;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint8_t head = _sampleHead;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    
+    unsigned long now = micros();
+    if (!_clockStarted) {
+        _lastMicros = now;
+        _clockStarted = true;
+    }
+    unsigned long elapsed = now - _lastMicros;
+    _lastMicros = now;
+    
+    // Scaled clock, keeping the remainder so no time is lost
+    _clockRemainder += elapsed * _timeScalePercent;
+    _playbackUs += _clockRemainder / 100;
+    _clockRemainder %= 100;
+    
+    // Drop samples the clock has passed, keeping the one we're after
+    while (bufferedSamples(head) >= 2 && (uint64_t)sampleAt(1)->timeMs * 1000ULL <= _playbackUs) {
+        _previousSample = *sampleAt(0);
+        _hasPrevious = true;
+        _sampleTail = (_sampleTail + 1) & (PLAYER_BUFFER_SIZE - 1);
+    }
+    
+    PathSample_t* from = sampleAt(0);
+    long target = from->position;
+    
+    uint8_t buffered = bufferedSamples(head);
+    if (buffered >= 2) {
+        target = lroundf(interpolate((int64_t)_playbackUs - (int64_t)from->timeMs * 1000, buffered));
+        _starved = false;
+        
+        // How far ahead the buffer reaches, only meaningful while streaming
+        if (!endOfStream) {
+            PathSample_t* newest = &_samples[(head - 1) & (PLAYER_BUFFER_SIZE - 1)];
+            long margin = (long)(newest->timeMs - _playbackUs / 1000);
+            if (margin < _minMarginMs) _minMarginMs = margin;
+        }
+    } else if (endOfStream) {
+        // Past the last sample
+        _finished = true;
+    } else {
+        // Buffer ran dry, hold the clock here until more samples arrive
+        _playbackUs = (uint64_t)from->timeMs * 1000ULL;
+        if (!_starved) _underruns++;
+        _starved = true;
+        _minMarginMs = 0;
+    }
+    
+    // First order low-pass so corners and jog steps are rounded off
+    uint32_t smoothing = _smoothingUs;
+    if (smoothing == 0) {
+        _smoothedTarget = target;
+    } else {
+        _smoothedTarget += (target - _smoothedTarget) * elapsed / (float)(smoothing + elapsed);
+    }
+    
+    long smoothed = lroundf(_smoothedTarget);
+    
+    // Land exactly on the final position
+    if (_finished && labs(smoothed - target) <= 1) {
+        _smoothedTarget = target;
+        smoothed = target;
+    }
+    return smoothed;
+}
@@ -0,0 +1,106 @@
+// SamplePlayer.h
+#ifndef SAMPLE_PLAYER_H
+#define SAMPLE_PLAYER_H
+
+#include <Arduino.h>
+#include "PathCodec.h"
+#include "TimerStepperControl.h"
+
+// Samples decoded ahead of the step ISR (must be a power of two)
+#define PLAYER_BUFFER_SIZE 64
+
+// How points between samples are filled in
+typedef enum {
+    PLAYER_INTERPOLATE_LINEAR = 0, // Straight lines between samples
+    PLAYER_INTERPOLATE_CUBIC       // Smooth monotone curve through the samples (no overshoot)
+} PlayerInterpolation;
+
+// Plays a stream of (time, position) samples back as a tracking target.
+// Derived classes read the samples from wherever they are stored. The main
+// loop decodes a few samples ahead into a small ring buffer and the step
+// ISR interpolates between them on a scaled clock, so RAM use doesn't grow
+// with the length of the recording. If the buffer ever runs dry the clock
+// waits instead of jumping.
+class SamplePlayer : public TrackingSource {
+public:
+    // Constructor
+    SamplePlayer();
+    virtual ~SamplePlayer() {}
+    
+    // Stop playback and release the source
+    virtual void close();
+    
+    // Playback speed in percent of the recorded speed (100 = as recorded)
+    void setTimeScale(int percent);
+    int getTimeScale() { return _timeScalePercent; }
+    
+    // Low-pass time constant applied to the target (0 = off)
+    void setSmoothing(uint32_t milliseconds);
+    
+    // Interpolation between samples
+    void setInterpolation(PlayerInterpolation interpolation) { _interpolation = interpolation; }
+    
+    // Start the playback clock (the motor should already be at the start)
+    void start();
+    
+    // Keep the sample buffer filled (call frequently from the main loop)
+    void service();
+    
+    // Status
+    bool isOpen() { return _open; }
+    bool isFinished() { return _finished; }
+    long getStartPosition() { return _firstSample.position; }
+    long getFinalPosition() { return _lastRead.position; }
+    unsigned long getUnderruns() { return _underruns; }  // Times the buffer ran dry
+    long getMinMarginMs() { return _minMarginMs; }        // Least playback time buffered ahead
+    
+    // TrackingSource (called from the step ISR)
+    long getTrackingTarget() override;
+    
+protected:
+    // Read the next sample from the source, false at the end
+    virtual bool readSample(PathSample_t* sample) = 0;
+    
+    // Called by derived classes once their source is ready
+    bool beginStream();
+    
+    bool _open;
+    
+private:
+    // Sample ring buffer (main loop produces, ISR consumes)
+    PathSample_t _samples[PLAYER_BUFFER_SIZE];
+    volatile uint8_t _sampleHead;
+    volatile uint8_t _sampleTail;
+    PathSample_t _previousSample;     // Sample before the tail (for cubic slopes)
+    bool _hasPrevious;
+    volatile bool _endOfStream;
+    PathSample_t _firstSample;
+    PathSample_t _lastRead;
+    
+    // Playback clock (ISR)
+    volatile bool _playing;
+    volatile bool _finished;
+    bool _clockStarted;
+    unsigned long _lastMicros;
+    uint64_t _playbackUs;
+    uint32_t _clockRemainder;
+    volatile int _timeScalePercent;
+    volatile unsigned long _underruns;
+    bool _starved;                    // Waiting for the main loop to decode more
+    volatile long _minMarginMs;
+    
+    // Interpolation and smoothing (ISR)
+    volatile PlayerInterpolation _interpolation;
+    volatile uint32_t _smoothingUs;
+    float _smoothedTarget;
+    
+    // Samples in the ring buffer up to a head. The ISR passes the head it
+    // read once, with a fence after it, never _sampleHead again.
+    uint8_t bufferedSamples(uint8_t head) { return (head - _sampleTail) & (PLAYER_BUFFER_SIZE - 1); }
+    PathSample_t* sampleAt(uint8_t offset) { return &_samples[(_sampleTail + offset) & (PLAYER_BUFFER_SIZE - 1)]; }
+    
+    // Position between the tail sample and the next one
+    float interpolate(int64_t intoUs, uint8_t buffered);
+};
+
+#endif // SAMPLE_PLAYER_H
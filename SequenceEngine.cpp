@@ -0,0 +1,332 @@
+// SequenceEngine.cpp
+#include "SequenceEngine.h"
+
+// Constructor
+SequenceEngine::SequenceEngine(TimerStepperControl* controller) :
+    _controller(controller),
+    _instructionCount(0),
+    _unitNumerator(1),
+    _unitDenominator(1),
+    _startPosition(0),
+    _defaultSpeed(0),
+    _defaultAcceleration(0),
+    _compiled(false),
+    _running(false),
+    _started(false),
+    _finished(false),
+    _pc(0),
+    _loopDepth(0),
+    _target(0),
+    _repeatTarget(0),
+    _cycleOffset(0),
+    _speed(0),
+    _acceleration(0),
+    _pendingDwell(0),
+    _segmentsQueued(0)
+{
+}
+
+// Remove all instructions from the program (units go back to plain steps)
+void SequenceEngine::clearProgram() {
+    _instructionCount = 0;
+    _unitNumerator = 1;
+    _unitDenominator = 1;
+    _compiled = false;
+}
+
+// Append one instruction to the program
+bool SequenceEngine::addInstruction(uint8_t opcode, int32_t operand) {
+    if (_instructionCount >= SEQ_MAX_INSTRUCTIONS) {
+        Serial.println("Sequence program full");
+        return false;
+    }
+
+    _program[_instructionCount].opcode = opcode;
+    _program[_instructionCount].operand = operand;
+    _instructionCount++;
+    _compiled = false;
+    return true;
+}
+
+// Set how many steps one program unit is (numerator / denominator)
+void SequenceEngine::setUnitScale(int64_t numerator, int64_t denominator) {
+    if (numerator <= 0 || denominator <= 0) return;
+    _unitNumerator = numerator;
+    _unitDenominator = denominator;
+}
+
+// Check the program once before it runs. Finite loops are run by counting
+// them down, the endless loop (count 0) is replayed with its net movement
+// added to every pass. Targets stay in program units and are only turned
+// into steps when queued, so fractional unit scales never accumulate
+// rounding error.
+bool SequenceEngine::compile(long startPosition, int defaultSpeed, int defaultAcceleration) {
+    struct {
+        bool endless;    // Loop count 0
+        bool output;     // Body produces a segment (a move or a dwell)
+    } loopStack[SEQ_MAX_LOOP_DEPTH];
+    int loopDepth = 0;
+    bool output = false;
+
+    _compiled = false;
+
+    int pc = 0;
+    while (pc < _instructionCount) {
+        SequenceInstruction_t* instruction = &_program[pc++];
+
+        switch (instruction->opcode) {
+            case SEQ_OP_END:
+                pc = _instructionCount;
+                break;
+
+            case SEQ_OP_MOVE_TO:
+            case SEQ_OP_MOVE_BY:
+                output = true;
+                for (int i = 0; i < loopDepth; i++) loopStack[i].output = true;
+                break;
+
+            case SEQ_OP_SPEED:
+                if (instruction->operand <= 0) {
+                    Serial.println("Sequence compile error: speed must be positive");
+                    return false;
+                }
+                break;
+
+            case SEQ_OP_ACCEL:
+                if (instruction->operand <= 0) {
+                    Serial.println("Sequence compile error: acceleration must be positive");
+                    return false;
+                }
+                break;
+
+            case SEQ_OP_DWELL:
+                if (instruction->operand > 0) {
+                    output = true;
+                    for (int i = 0; i < loopDepth; i++) loopStack[i].output = true;
+                }
+                break;
+
+            case SEQ_OP_LOOP:
+                if (loopDepth >= SEQ_MAX_LOOP_DEPTH || instruction->operand < 0) {
+                    Serial.println("Sequence compile error: bad loop");
+                    return false;
+                }
+
+                // The endless loop has to be the outermost block
+                if (instruction->operand == 0 && loopDepth > 0) {
+                    Serial.println("Sequence compile error: endless loop must be outermost");
+                    return false;
+                }
+
+                loopStack[loopDepth].endless = instruction->operand == 0;
+                loopStack[loopDepth].output = false;
+                loopDepth++;
+                break;
+
+            case SEQ_OP_END_LOOP:
+                if (loopDepth == 0) {
+                    Serial.println("Sequence compile error: END_LOOP without LOOP");
+                    return false;
+                }
+
+                loopDepth--;
+                if (loopStack[loopDepth].endless) {
+                    // An endless pass that queues nothing would never end
+                    if (!loopStack[loopDepth].output) {
+                        Serial.println("Sequence compile error: no moves");
+                        return false;
+                    }
+                    pc = _instructionCount; // Nothing after an endless loop can run
+                }
+                break;
+
+            default:
+                Serial.print("Sequence compile error: unknown opcode ");
+                Serial.println(instruction->opcode);
+                return false;
+        }
+    }
+
+    if (loopDepth > 0) {
+        Serial.println("Sequence compile error: LOOP without END_LOOP");
+        return false;
+    }
+
+    if (!output) {
+        Serial.println("Sequence compile error: no moves");
+        return false;
+    }
+
+    _startPosition = startPosition;
+    _defaultSpeed = defaultSpeed;
+    _defaultAcceleration = defaultAcceleration;
+    _compiled = true;
+
+    Serial.print("Sequence compiled: ");
+    Serial.print(_instructionCount);
+    Serial.println(" instructions");
+    return true;
+}
+
+// Start running the compiled program
+bool SequenceEngine::start() {
+    if (!_compiled) return false;
+
+    _controller->clearSegments();
+    _pc = 0;
+    _loopDepth = 0;
+    _target = 0;
+    _repeatTarget = 0;
+    _cycleOffset = 0;
+    _speed = _defaultSpeed;
+    _acceleration = _defaultAcceleration;
+    _pendingDwell = 0;
+    _segmentsQueued = 0;
+    _started = false;
+    _finished = false;
+    _running = true;
+
+    // Pre-load the first segments and start the motor
+    service();
+    return true;
+}
+
+// Stop feeding the controller and drop anything still queued
+void SequenceEngine::stop() {
+    _running = false;
+    _controller->clearSegments();
+}
+
+// Segment to the current target, carrying the pending dwell
+void SequenceEngine::makeSegment(MotionSegment_t* segment) {
+    segment->targetPosition = _startPosition +
+        scaleRounded(_target + _cycleOffset, _unitNumerator, _unitDenominator);
+    segment->speed = _speed;
+    segment->acceleration = _acceleration;
+    segment->dwellMs = _pendingDwell;
+    _pendingDwell = 0;
+}
+
+// Run the program up to its next segment. Where a dwell has to become a
+// segment of its own the instruction is left in place and runs again with
+// the dwell taken.
+bool SequenceEngine::nextSegment(MotionSegment_t* segment, int* budget) {
+    while (_pc < _instructionCount && *budget > 0) {
+        (*budget)--;
+        SequenceInstruction_t* instruction = &_program[_pc];
+
+        switch (instruction->opcode) {
+            case SEQ_OP_END:
+                _pc = _instructionCount;
+                break;
+
+            case SEQ_OP_MOVE_TO:
+            case SEQ_OP_MOVE_BY:
+                if (instruction->opcode == SEQ_OP_MOVE_TO) {
+                    _target = instruction->operand;
+                } else {
+                    _target += instruction->operand;
+                }
+                _pc++;
+                makeSegment(segment);
+                return true;
+
+            case SEQ_OP_SPEED:
+                _speed = instruction->operand;
+                _pc++;
+                break;
+
+            case SEQ_OP_ACCEL:
+                _acceleration = instruction->operand;
+                _pc++;
+                break;
+
+            case SEQ_OP_DWELL:
+                _pendingDwell += max((int32_t)0, instruction->operand);
+                _pc++;
+                break;
+
+            case SEQ_OP_LOOP:
+                if (instruction->operand == 0) {
+                    // A dwell before the endless loop belongs to the first pass only
+                    if (_pendingDwell > 0) {
+                        makeSegment(segment);
+                        return true;
+                    }
+                    _repeatTarget = _target;
+                }
+
+                _pc++;
+                _loopStack[_loopDepth].startPc = _pc;
+                _loopStack[_loopDepth].remaining = instruction->operand;
+                _loopDepth++;
+                break;
+
+            case SEQ_OP_END_LOOP:
+                if (_loopStack[_loopDepth - 1].remaining == 0) {
+                    // End of an endless pass, a trailing dwell repeats every pass
+                    if (_pendingDwell > 0) {
+                        makeSegment(segment);
+                        return true;
+                    }
+
+                    // The next pass starts where this one ended
+                    _cycleOffset += _target - _repeatTarget;
+                    _target = _repeatTarget;
+                    _pc = _loopStack[_loopDepth - 1].startPc;
+                } else if (--_loopStack[_loopDepth - 1].remaining > 0) {
+                    _pc = _loopStack[_loopDepth - 1].startPc;
+                } else {
+                    _loopDepth--;
+                    _pc++;
+                }
+                break;
+
+            default:
+                _pc = _instructionCount;
+                break;
+        }
+    }
+
+    if (_pc < _instructionCount) return false;
+
+    // Trailing dwell holds position at the end of the program
+    if (_pendingDwell > 0) {
+        makeSegment(segment);
+        return true;
+    }
+    _finished = true;
+    return false;
+}
+
+// Top up the controller's segment queue and detect completion. Only this
+// loop produces segments, so a free slot stays free until it is filled.
+void SequenceEngine::service() {
+    if (!_running) return;
+
+    int budget = SEQ_STEPS_PER_SERVICE;
+    MotionSegment_t segment;
+    while (_controller->getFreeSegmentSlots() > 0 && nextSegment(&segment, &budget)) {
+        _controller->queueSegment(&segment);
+        _segmentsQueued++;
+    }
+
+    if (!_started) {
+        if (_segmentsQueued == 0) return;
+        MotorCommand_t cmd;
+        cmd.cmd_type = CMD_RUN_SEGMENTS;
+        _started = _controller->sendCommand(&cmd);
+        return;
+    }
+
+    // Done once every segment has been started and the last one finished
+    if (_finished && _controller->getStartedSegments() >= _segmentsQueued &&
+        !_controller->isRunning()) {
+        _running = false;
+    }
+}
+
+// Number of segments the controller has started since the program began
+unsigned long SequenceEngine::getSegmentsStarted() {
+    return _controller->getStartedSegments();
+}
@@ -0,0 +1,105 @@
+// SequenceEngine.h
+#ifndef SEQUENCE_ENGINE_H
+#define SEQUENCE_ENGINE_H
+
+#include <Arduino.h>
+#include "TimerStepperControl.h"
+#include "PositionMath.h"
+
+// Program limits
+#define SEQ_MAX_INSTRUCTIONS 128  // Instructions in one program
+#define SEQ_MAX_LOOP_DEPTH 4      // Nested loop levels
+#define SEQ_STEPS_PER_SERVICE 256 // Instructions run per service() call at most
+
+// Sequence program opcodes
+typedef enum {
+    SEQ_OP_END = 0,   // End of program
+    SEQ_OP_MOVE_TO,   // Move to position (units from where the program started)
+    SEQ_OP_MOVE_BY,   // Move relative number of units
+    SEQ_OP_SPEED,     // Speed for the following moves (steps/sec)
+    SEQ_OP_ACCEL,     // Acceleration for the following moves (steps/sec²)
+    SEQ_OP_DWELL,     // Hold position before the next move (milliseconds)
+    SEQ_OP_LOOP,      // Repeat block up to the matching END_LOOP (0 = forever)
+    SEQ_OP_END_LOOP   // End of a loop block
+} SequenceOpcode;
+
+// One program instruction
+typedef struct {
+    uint8_t opcode;   // SequenceOpcode
+    int32_t operand;  // Units, speed, acceleration, milliseconds or loop count
+} SequenceInstruction_t;
+
+// Runs step programs, turning them into absolute step targets as they go and
+// keeping the controller's segment queue topped up, so moves chain without
+// stopping in between. Loops are counted down as they run rather than
+// unrolled, so a program's length doesn't depend on its loop counts.
+class SequenceEngine {
+public:
+    // Constructor
+    SequenceEngine(TimerStepperControl* controller);
+
+    // Program building
+    void clearProgram();
+    bool addInstruction(uint8_t opcode, int32_t operand = 0);
+    int getInstructionCount() { return _instructionCount; }
+
+    // Steps per program unit as a fraction (default 1/1, units are steps)
+    void setUnitScale(int64_t numerator, int64_t denominator);
+
+    // Check the program and anchor its targets at startPosition
+    bool compile(long startPosition, int defaultSpeed, int defaultAcceleration);
+
+    // Execution control
+    bool start();
+    void stop();
+
+    // Keep the controller fed (call frequently from the main loop)
+    void service();
+
+    // Status
+    bool isRunning() { return _running; }
+    unsigned long getSegmentsStarted();
+
+private:
+    TimerStepperControl* _controller;
+
+    // Program storage
+    SequenceInstruction_t _program[SEQ_MAX_INSTRUCTIONS];
+    int _instructionCount;
+
+    // Unit to step conversion
+    int64_t _unitNumerator;
+    int64_t _unitDenominator;
+
+    // Set by compile()
+    long _startPosition;          // Controller position the program is anchored to
+    int _defaultSpeed;
+    int _defaultAcceleration;
+    bool _compiled;
+
+    // Execution state
+    bool _running;
+    bool _started;             // Run command has been sent to the controller
+    bool _finished;            // Every segment of the program has been queued
+    int _pc;                   // Next instruction to run
+    struct {
+        int startPc;           // First instruction inside the loop
+        int32_t remaining;     // Passes left (0 = endless)
+    } _loopStack[SEQ_MAX_LOOP_DEPTH];
+    int _loopDepth;
+    int64_t _target;           // Target in units from the start of the current endless pass
+    int64_t _repeatTarget;     // _target where the endless loop begins
+    int64_t _cycleOffset;      // Units moved by the endless passes done so far
+    int _speed;
+    int _acceleration;
+    uint32_t _pendingDwell;    // Dwell for the next segment (milliseconds)
+    unsigned long _segmentsQueued;
+
+    // Run instructions up to the next segment, returns false when the
+    // program has ended or the instruction budget is used up
+    bool nextSegment(MotionSegment_t* segment, int* budget);
+    // Segment to the current target with the pending dwell
+    void makeSegment(MotionSegment_t* segment);
+};
+
+#endif // SEQUENCE_ENGINE_H
@@ -0,0 +1,132 @@
+// SettingsCodec.h
+#ifndef SETTINGS_CODEC_H
+#define SETTINGS_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Crc32.h"
+
+// The operator settings are stored as one blob, all fields little endian:
+//
+//   0  uint16      magic 'MS'
+//   2  uint8       schema version
+//   3  uint8       payload length in bytes
+//   4  ...         payload, the fields below in order
+//   n  uint32      CRC32 of everything before it
+//
+// Payload, version 1:
+//   0  int32       speed in steps/sec (at the stored microstep mode)
+//   4  int32       step mode rotation in 0.01% units
+//   8  int32       acceleration in steps/sec^2
+//   12 uint8       microstep mode
+//   13 int32 x5    sequence positions in 0.01% units
+//
+// Fields are only ever added at the end of the payload and never change
+// meaning, so a newer schema is the older one plus a tail. A blob from an
+// older version is read up to its length and the fields it doesn't have
+// keep their defaults; one from a newer version is read up to the fields
+// this version knows. A blob with a bad magic, length or CRC is ignored.
+
+#define SETTINGS_MAGIC 0x534D          // "MS" little endian
+#define SETTINGS_VERSION 1
+#define SETTINGS_HEADER_SIZE 4
+#define SETTINGS_CRC_SIZE 4
+#define SETTINGS_SEQUENCE_POSITIONS 5
+#define SETTINGS_PAYLOAD_SIZE (13 + 4 * SETTINGS_SEQUENCE_POSITIONS)
+#define SETTINGS_BLOB_SIZE (SETTINGS_HEADER_SIZE + SETTINGS_PAYLOAD_SIZE + SETTINGS_CRC_SIZE)
+#define SETTINGS_MAX_BLOB_SIZE (SETTINGS_HEADER_SIZE + 255 + SETTINGS_CRC_SIZE)
+
+// Result of settingsDecode
+enum SettingsLoadResult {
+    SETTINGS_LOADED,     // Every field came from the blob
+    SETTINGS_MIGRATED,   // Older schema, the newer fields are defaults
+    SETTINGS_EMPTY,      // Nothing stored, all defaults
+    SETTINGS_CORRUPT     // Blob rejected, all defaults
+};
+
+// The persisted settings
+typedef struct {
+    int32_t speed;
+    int32_t rotationUnits;
+    int32_t acceleration;
+    uint8_t microstepMode;
+    int32_t sequencePositions[SETTINGS_SEQUENCE_POSITIONS];
+} StoredSettings_t;
+
+static inline void settingsPut32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static inline uint32_t settingsGet32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) value |= (uint32_t)in[i] << (8 * i);
+    return value;
+}
+
+static inline bool settingsEqual(const StoredSettings_t* a, const StoredSettings_t* b) {
+    if (a->speed != b->speed || a->rotationUnits != b->rotationUnits ||
+        a->acceleration != b->acceleration || a->microstepMode != b->microstepMode) {
+        return false;
+    }
+    for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+        if (a->sequencePositions[i] != b->sequencePositions[i]) return false;
+    }
+    return true;
+}
+
+// Encode the settings as a current version blob, returns its size
+static inline size_t settingsEncode(const StoredSettings_t* settings, uint8_t* out) {
+    out[0] = (uint8_t)SETTINGS_MAGIC;
+    out[1] = (uint8_t)(SETTINGS_MAGIC >> 8);
+    out[2] = SETTINGS_VERSION;
+    out[3] = SETTINGS_PAYLOAD_SIZE;
+
+    uint8_t* payload = out + SETTINGS_HEADER_SIZE;
+    settingsPut32(payload, (uint32_t)settings->speed);
+    settingsPut32(payload + 4, (uint32_t)settings->rotationUnits);
+    settingsPut32(payload + 8, (uint32_t)settings->acceleration);
+    payload[12] = settings->microstepMode;
+    for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+        settingsPut32(payload + 13 + 4 * i, (uint32_t)settings->sequencePositions[i]);
+    }
+
+    size_t size = SETTINGS_HEADER_SIZE + SETTINGS_PAYLOAD_SIZE;
+    settingsPut32(out + size, crc32Ieee(out, size));
+    return size + SETTINGS_CRC_SIZE;
+}
+
+// Decode a blob of size bytes. Starts from the defaults and overwrites
+// the fields the blob holds, so settings is always usable.
+static inline SettingsLoadResult settingsDecode(const uint8_t* in, size_t size,
+                                                const StoredSettings_t* defaults, StoredSettings_t* settings) {
+    *settings = *defaults;
+    if (size == 0) return SETTINGS_EMPTY;
+    if (size < SETTINGS_HEADER_SIZE + SETTINGS_CRC_SIZE) return SETTINGS_CORRUPT;
+
+    uint16_t magic = (uint16_t)(in[0] | (in[1] << 8));
+    uint8_t version = in[2];
+    size_t length = in[3];
+    if (magic != SETTINGS_MAGIC || version == 0 ||
+        size != SETTINGS_HEADER_SIZE + length + SETTINGS_CRC_SIZE) {
+        return SETTINGS_CORRUPT;
+    }
+    if (crc32Ieee(in, size - SETTINGS_CRC_SIZE) != settingsGet32(in + size - SETTINGS_CRC_SIZE)) {
+        return SETTINGS_CORRUPT;
+    }
+
+    // Each field is taken only if the payload reaches its end
+    const uint8_t* payload = in + SETTINGS_HEADER_SIZE;
+    if (length >= 4) settings->speed = (int32_t)settingsGet32(payload);
+    if (length >= 8) settings->rotationUnits = (int32_t)settingsGet32(payload + 4);
+    if (length >= 12) settings->acceleration = (int32_t)settingsGet32(payload + 8);
+    if (length >= 13) settings->microstepMode = payload[12];
+    for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+        if (length >= (size_t)(17 + 4 * i)) {
+            settings->sequencePositions[i] = (int32_t)settingsGet32(payload + 13 + 4 * i);
+        }
+    }
+
+    return length < SETTINGS_PAYLOAD_SIZE ? SETTINGS_MIGRATED : SETTINGS_LOADED;
+}
+
+#endif // SETTINGS_CODEC_H
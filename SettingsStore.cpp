@@ -0,0 +1,90 @@
+// SettingsStore.cpp
+#include "SettingsStore.h"
+
+#define SETTINGS_KEY "settings"
+
+// Constructor
+SettingsStore::SettingsStore(const char* nvsNamespace) :
+    _namespace(nvsNamespace),
+    _open(false),
+    _pending(false),
+    _changedAt(0),
+    _pendingSince(0),
+    _settleMs(0),
+    _maxDelayMs(0),
+    _writeCount(0),
+    _writeErrors(0)
+{
+}
+
+// Open the namespace and read the blob once
+SettingsLoadResult SettingsStore::begin(const StoredSettings_t* defaults, StoredSettings_t* settings,
+                                        unsigned long settleMs, unsigned long maxDelayMs) {
+    _settleMs = settleMs;
+    _maxDelayMs = max(maxDelayMs, settleMs);
+
+    uint8_t blob[SETTINGS_MAX_BLOB_SIZE];
+    size_t size = 0;
+    _open = _preferences.begin(_namespace, false);
+    if (_open) {
+        size = _preferences.getBytes(SETTINGS_KEY, blob, sizeof(blob));
+    } else {
+        Serial.println("Settings: NVS unavailable, using defaults");
+    }
+
+    SettingsLoadResult result = settingsDecode(blob, size, defaults, settings);
+    if (result == SETTINGS_CORRUPT) {
+        Serial.println("Settings: stored settings are corrupt, using defaults");
+    }
+
+    // A migrated or rejected blob is rewritten in the current layout at
+    // the next flush
+    _stored = *settings;
+    _latest = *settings;
+    _pending = (result == SETTINGS_MIGRATED || result == SETTINGS_CORRUPT);
+    _changedAt = millis();
+    _pendingSince = _changedAt;
+    return result;
+}
+
+// Note the current settings and write them once they have settled
+void SettingsStore::update(const StoredSettings_t* settings, unsigned long now, bool idle) {
+    if (!settingsEqual(settings, &_latest)) {
+        _latest = *settings;
+        _changedAt = now;
+        bool wasPending = _pending;
+        _pending = !settingsEqual(&_latest, &_stored);
+        if (_pending && !wasPending) _pendingSince = now;
+    }
+    // Never while the motor runs: a flash write stalls the cache, and with
+    // it anything running from flash, for milliseconds
+    if (!_pending || !idle) return;
+
+    bool settled = now - _changedAt >= _settleMs;
+    bool overdue = now - _pendingSince >= _maxDelayMs;
+    if (settled || overdue) {
+        // A failed write is tried again after another settle time
+        if (!flush()) {
+            _changedAt = now;
+            _pendingSince = now;
+        }
+    }
+}
+
+// Write the latest settings
+bool SettingsStore::flush() {
+    if (!_pending) return true;
+    if (!_open) return false;
+
+    uint8_t blob[SETTINGS_BLOB_SIZE];
+    size_t size = settingsEncode(&_latest, blob);
+    if (_preferences.putBytes(SETTINGS_KEY, blob, size) != size) {
+        _writeErrors++;
+        return false;
+    }
+
+    _stored = _latest;
+    _pending = false;
+    _writeCount++;
+    return true;
+}
@@ -0,0 +1,56 @@
+// SettingsStore.h
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "SettingsCodec.h"
+
+// Keeps the operator settings in NVS as one versioned, CRC-checked blob
+// (see SettingsCodec.h). Changes are written behind: the loop hands over
+// the current settings as often as it likes, and the blob is only written
+// with the motor idle, once they have stopped changing for the settle time
+// or have been pending for the longest delay. Turning a knob through a
+// hundred values costs one flash write, and settings that end where they
+// started cost none.
+class SettingsStore {
+public:
+    // Constructor
+    SettingsStore(const char* nvsNamespace);
+
+    // Open the namespace and restore the settings with a single read. The
+    // defaults fill in whatever the stored blob lacks or if it is unusable.
+    SettingsLoadResult begin(const StoredSettings_t* defaults, StoredSettings_t* settings,
+                             unsigned long settleMs, unsigned long maxDelayMs);
+
+    // Note the current settings, writes them when they are due and idle
+    void update(const StoredSettings_t* settings, unsigned long now, bool idle);
+
+    // Write pending changes now, returns false if the write failed. Only
+    // call it with the motor idle.
+    bool flush();
+
+    // Status
+    bool isPending() { return _pending; }
+    unsigned long getWriteCount() { return _writeCount; }
+    unsigned long getWriteErrors() { return _writeErrors; }
+
+private:
+    const char* _namespace;
+    Preferences _preferences;
+    bool _open;
+
+    StoredSettings_t _stored;     // What the blob holds
+    StoredSettings_t _latest;     // What the loop last handed over
+    bool _pending;                // _latest differs from _stored
+    unsigned long _changedAt;     // Last change
+    unsigned long _pendingSince;  // First change not yet written
+    unsigned long _settleMs;
+    unsigned long _maxDelayMs;
+
+    // Statistics
+    unsigned long _writeCount;
+    unsigned long _writeErrors;
+};
+
+#endif // SETTINGS_STORE_H
@@ -0,0 +1,77 @@
+// StepDirFollower.cpp
+#include "StepDirFollower.h"
+
+// Constructor
+StepDirFollower::StepDirFollower(int stepPin, int dirPin) :
+    _stepPin(stepPin),
+    _dirPin(dirPin),
+    _numerator(1),
+    _denominator(1),
+    _anchorCount(0),
+    _anchorPosition(0)
+{
+    portMUX_INITIALIZE(&_countLock);
+}
+
+// Set up the pulse counter: STEP rising edges count up, DIR low reverses them
+bool StepDirFollower::begin() {
+    if (_counter.isStarted()) return true;
+    if (_stepPin < 0 || _dirPin < 0) {
+        Serial.println("Step/dir follower pins not configured");
+        return false;
+    }
+    
+    if (!_counter.begin(STEP_DIR_PCNT_LIMIT, STEP_DIR_GLITCH_NS)) {
+        Serial.println("Step/dir follower: no free pulse counter");
+        return false;
+    }
+    _counter.addChannel(_stepPin, _dirPin, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD);
+    _counter.start();
+    return true;
+}
+
+// Output steps per input pulse as a fraction, keeps the current target. The
+// scale and the anchor change in one critical section, so the step ISR
+// never combines the new scale with the old anchor.
+bool StepDirFollower::setScale(long numerator, long denominator) {
+    if (numerator == 0 || denominator <= 0) return false;
+    
+    portENTER_CRITICAL_SAFE(&_countLock);
+    int64_t count = _counter.read();
+    long position = countToPosition(count);
+    _numerator = numerator;
+    _denominator = denominator;
+    _anchorCount = count;
+    _anchorPosition = position;
+    portEXIT_CRITICAL_SAFE(&_countLock);
+    return true;
+}
+
+// Make the current input count correspond to the given output position
+void StepDirFollower::anchor(long position) {
+    portENTER_CRITICAL_SAFE(&_countLock);
+    _anchorCount = _counter.read();
+    _anchorPosition = position;
+    portEXIT_CRITICAL_SAFE(&_countLock);
+}
+
+// Input pulses counted since begin()
+int64_t StepDirFollower::getInputCount() {
+    portENTER_CRITICAL_SAFE(&_countLock);
+    int64_t count = _counter.read();
+    portEXIT_CRITICAL_SAFE(&_countLock);
+    return count;
+}
+
+// Output position for an input count
+long StepDirFollower::countToPosition(int64_t count) {
+    return _anchorPosition + (long)scaleRounded(count - _anchorCount, _numerator, _denominator);
+}
+
+// Output position for the pulses counted so far
+long StepDirFollower::getTrackingTarget() {
+    portENTER_CRITICAL_SAFE(&_countLock);
+    long target = countToPosition(_counter.read());
+    portEXIT_CRITICAL_SAFE(&_countLock);
+    return target;
+}
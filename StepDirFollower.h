@@ -0,0 +1,61 @@
+// StepDirFollower.h
+#ifndef STEP_DIR_FOLLOWER_H
+#define STEP_DIR_FOLLOWER_H
+
+#include <Arduino.h>
+#include "TimerStepperControl.h"
+#include "PcntCounter.h"
+#include "PositionMath.h"
+
+// PCNT counter limits. The driver folds each overflow into the running
+// count, so this only sets how often that happens (one interrupt per limit,
+// never one per pulse).
+#define STEP_DIR_PCNT_LIMIT 32000
+
+// Ignore input pulses shorter than this (must stay below the shortest step pulse)
+#define STEP_DIR_GLITCH_NS 500
+
+// Counts STEP/DIR pulses from an external controller in hardware and turns
+// them into a tracking target: every input pulse moves the target by
+// numerator / denominator steps. The target is always computed from the
+// absolute pulse count, so fractional scales never drift.
+class StepDirFollower : public TrackingSource {
+public:
+    // Constructor
+    StepDirFollower(int stepPin, int dirPin);
+    
+    // Set up the pulse counter, returns false if the pins aren't configured
+    bool begin();
+    
+    // Output steps per input pulse as a fraction
+    bool setScale(long numerator, long denominator);
+    long getScaleNumerator() { return _numerator; }
+    long getScaleDenominator() { return _denominator; }
+    
+    // Make the current input count correspond to the given output position
+    void anchor(long position);
+    
+    // Input pulses counted since begin() (DIR low counts down)
+    int64_t getInputCount();
+    
+    // TrackingSource (called from the step ISR)
+    long getTrackingTarget() override;
+    
+private:
+    int _stepPin;
+    int _dirPin;
+    PcntCounter _counter;
+    portMUX_TYPE _countLock;  // Guards the count, the scale and the anchor
+    
+    // Scaling, changed together under _countLock while the ISR may be
+    // reading them
+    long _numerator;
+    long _denominator;
+    int64_t _anchorCount;     // Input count at the anchor
+    long _anchorPosition;     // Output position at the anchor
+    
+    // Output position for an input count (with _countLock held)
+    long countToPosition(int64_t count);
+};
+
+#endif // STEP_DIR_FOLLOWER_H
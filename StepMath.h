@@ -0,0 +1,22 @@
+// StepMath.h
+#ifndef STEP_MATH_H
+#define STEP_MATH_H
+
+#include <stdint.h>
+#include "esp_attr.h"
+
+// Square root for the step interrupts, sqrtf() is in libm in flash (the
+// soft-float routines are in ROM). Three Newton steps from the bit-level
+// estimate get to full float precision.
+static inline float IRAM_ATTR stepSqrtf(float x) {
+    if (x <= 0.0f) return 0.0f;
+    union { float f; uint32_t i; } bits = { x };
+    bits.i = (bits.i >> 1) + 0x1FBD1DF5;  // Halve the exponent
+    float root = bits.f;
+    for (int i = 0; i < 3; i++) {
+        root = 0.5f * (root + x / root);
+    }
+    return root;
+}
+
+#endif // STEP_MATH_H
@@ -0,0 +1,268 @@
+// StepStream.cpp
+#include "StepStream.h"
+#include "esp_heap_caps.h"
+
+// Steps closer than this would run two pulses together
+#define STEP_STREAM_MIN_INTERVAL_US (2 * STEP_STREAM_PULSE_SAMPLES * STEP_STREAM_SAMPLE_US)
+
+// Constructor
+StepStream::StepStream() :
+    _axisCount(0),
+    _sliceStart(0),
+    _freeBuffers(NULL),
+    _taskHandle(nullptr),
+    _faultLatched(false),
+#if SOC_PARLIO_SUPPORTED
+    _unit(nullptr),
+#endif
+    _inFlight(0),
+    _sliceCount(0),
+    _underruns(0),
+    _maxRenderUs(0)
+{
+    portMUX_INITIALIZE(&_lock);
+    _buffers[0] = nullptr;
+    _buffers[1] = nullptr;
+    for (int i = 0; i < 2 * STEP_STREAM_MAX_AXES; i++) {
+        _dataPins[i] = -1;
+    }
+}
+
+// Add an axis before the stream starts. Its STEP and DIR pins become data
+// lines 2n and 2n+1 of the parallel bus.
+int StepStream::addAxis(StepperAxis* axis) {
+    if (_taskHandle != nullptr || _axisCount >= STEP_STREAM_MAX_AXES) return -1;
+
+    axis->_driver->init();
+    StepPins_t pins;
+    if (!axis->_driver->getStepPins(&pins)) {
+        Serial.println("Step stream: driver has no step pins");
+        return -1;
+    }
+    if (axis->_queue == NULL) {
+        axis->_queue = xQueueCreate(AXIS_QUEUE_LENGTH, sizeof(AxisCommand_t));
+    }
+
+    StreamAxis_t* stream = &_axes[_axisCount];
+    stream->axis = axis;
+    stream->stepMask = 1 << (2 * _axisCount);
+    stream->dirMask = 1 << (2 * _axisCount + 1);
+    stream->nextStep = 0;
+    stream->dirLevel = axis->_driver->getDirection();
+    stream->pulseCarry = 0;
+    _dataPins[2 * _axisCount] = pins.stepPin;
+    _dataPins[2 * _axisCount + 1] = pins.dirPin;
+    return _axisCount++;
+}
+
+// Set up the parallel IO unit with two DMA buffers and start rendering
+bool StepStream::begin() {
+#if SOC_PARLIO_SUPPORTED
+    if (_taskHandle != nullptr) return true;
+    if (_axisCount == 0) return false;
+
+    for (int i = 0; i < 2; i++) {
+        _buffers[i] = (uint8_t*)heap_caps_calloc(STEP_STREAM_SLICE_SAMPLES, 1, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (_buffers[i] == nullptr) {
+            Serial.println("Step stream: no DMA memory for the buffers");
+            return false;
+        }
+    }
+
+    parlio_tx_unit_config_t config = {};
+    config.clk_src = PARLIO_CLK_SRC_DEFAULT;
+    config.clk_in_gpio_num = (gpio_num_t)-1;
+    config.output_clk_freq_hz = STEP_STREAM_SAMPLE_HZ;
+    config.data_width = 8;
+    for (int i = 0; i < 8; i++) {
+        config.data_gpio_nums[i] = (gpio_num_t)(i < 2 * STEP_STREAM_MAX_AXES ? _dataPins[i] : -1);
+    }
+    config.clk_out_gpio_num = (gpio_num_t)-1;
+    config.valid_gpio_num = (gpio_num_t)-1;
+    config.trans_queue_depth = 2;
+    config.max_transfer_size = STEP_STREAM_SLICE_SAMPLES;
+    config.sample_edge = PARLIO_SAMPLE_EDGE_POS;
+    config.bit_pack_order = PARLIO_BIT_PACK_ORDER_LSB;
+    if (parlio_new_tx_unit(&config, &_unit) != ESP_OK) {
+        Serial.println("Step stream: no free parallel IO unit");
+        _unit = nullptr;
+        return false;
+    }
+
+    parlio_tx_event_callbacks_t callbacks = {};
+    callbacks.on_trans_done = transmitDone;
+    ESP_ERROR_CHECK(parlio_tx_unit_register_event_callbacks(_unit, &callbacks, this));
+    ESP_ERROR_CHECK(parlio_tx_unit_enable(_unit));
+
+    _freeBuffers = xSemaphoreCreateCounting(2, 2);
+    xTaskCreate(streamTask, "step_stream", 4096, this, 10, &_taskHandle);
+    return true;
+#else
+    Serial.println("Step stream: this chip has no parallel IO");
+    return false;
+#endif
+}
+
+// DIR bits of every axis as they stand, STEP low
+uint8_t StepStream::idleLevel() {
+    uint8_t level = 0;
+    for (int i = 0; i < _axisCount; i++) {
+        if (_axes[i].dirLevel) level |= _axes[i].dirMask;
+    }
+    return level;
+}
+
+// Latch the fault and take the drivers off at once. The buffers already
+// handed to the peripheral still go out, but with the outputs disabled;
+// the render task stops the axes at the next slice.
+void IRAM_ATTR StepStream::emergencyStop() {
+    _faultLatched = true;
+    for (int i = 0; i < _axisCount; i++) {
+        _axes[i].axis->_driver->disable();
+    }
+}
+
+// Apply queued commands, starting axes that were idle. While the fault is
+// latched only the acceleration is taken, moves are dropped.
+void StepStream::serviceCommands() {
+    for (int i = 0; i < _axisCount; i++) {
+        StreamAxis_t* stream = &_axes[i];
+        AxisCommand_t cmd;
+        while (xQueueReceive(stream->axis->_queue, &cmd, 0) == pdTRUE) {
+            if (_faultLatched && cmd.type != AXIS_CMD_SET_ACCELERATION) continue;
+            stream->axis->applyCommand(&cmd);
+            if (!stream->axis->_running) {
+                // The first pulse leaves room for DIR to settle
+                uint32_t interval = stream->axis->startMotion();
+                if (interval > 0) {
+                    stream->axis->_driver->enable();
+                    stream->nextStep = _sliceStart + max(interval, (uint32_t)STEP_STREAM_MIN_INTERVAL_US);
+                }
+            }
+        }
+    }
+}
+
+// Fill one slice. Every sample starts with the DIR levels and STEP low, then
+// each axis's steps that fall in the slice are drawn in at their sample.
+// DIR changes a sample after the previous pulse is over and leads the next
+// rising edge by at least a pulse width.
+void StepStream::renderSlice(uint8_t* samples) {
+    uint64_t sliceEnd = _sliceStart + STEP_STREAM_SLICE_US;
+    memset(samples, idleLevel(), STEP_STREAM_SLICE_SAMPLES);
+
+    for (int i = 0; i < _axisCount; i++) {
+        StreamAxis_t* stream = &_axes[i];
+        StepperAxis* axis = stream->axis;
+
+        // Rest of a pulse that started at the end of the last slice
+        int pulseEnd = stream->pulseCarry;
+        for (int s = 0; s < pulseEnd; s++) {
+            samples[s] |= stream->stepMask;
+        }
+        stream->pulseCarry = 0;
+
+        // Faulted: stop where the axis is and draw no more steps
+        if (_faultLatched) {
+            if (axis->_running) {
+                axis->_running = false;
+                axis->_continuous = false;
+                axis->_target = axis->_position;
+                axis->_speed = 0.0f;
+                axis->_driver->disable();
+            }
+            continue;
+        }
+
+        while (axis->_running && stream->nextStep < sliceEnd) {
+            int index = (int)((stream->nextStep - _sliceStart) / STEP_STREAM_SAMPLE_US);
+
+            if (axis->_forward != stream->dirLevel) {
+                // One sample of hold after the pulse, then a pulse width of
+                // setup before the next one
+                int dirAt = pulseEnd + 1;
+                stream->dirLevel = axis->_forward;
+                for (int s = dirAt; s < STEP_STREAM_SLICE_SAMPLES; s++) {
+                    samples[s] ^= stream->dirMask;
+                }
+                if (index < dirAt + STEP_STREAM_PULSE_SAMPLES) {
+                    stream->nextStep = _sliceStart + (dirAt + STEP_STREAM_PULSE_SAMPLES) * STEP_STREAM_SAMPLE_US;
+                    continue;
+                }
+            }
+
+            pulseEnd = index + STEP_STREAM_PULSE_SAMPLES;
+            for (int s = index; s < pulseEnd && s < STEP_STREAM_SLICE_SAMPLES; s++) {
+                samples[s] |= stream->stepMask;
+            }
+            if (pulseEnd > STEP_STREAM_SLICE_SAMPLES) {
+                stream->pulseCarry = pulseEnd - STEP_STREAM_SLICE_SAMPLES;
+            }
+
+            // Faster than the bus can show is stretched, the position stays exact
+            uint32_t interval = axis->advance();
+            if (interval == 0) {
+                axis->_driver->disable();
+                break;
+            }
+            stream->nextStep += max(interval, (uint32_t)STEP_STREAM_MIN_INTERVAL_US);
+        }
+    }
+
+    _sliceStart = sliceEnd;
+}
+
+// Start the statistics again
+void StepStream::resetStats() {
+    portENTER_CRITICAL(&_lock);
+    _sliceCount = 0;
+    _underruns = 0;
+    _maxRenderUs = 0;
+    portEXIT_CRITICAL(&_lock);
+}
+
+#if SOC_PARLIO_SUPPORTED
+// A buffer has gone out, hand it back to the render task
+bool IRAM_ATTR StepStream::transmitDone(parlio_tx_unit_handle_t,
+                                        const parlio_tx_done_event_data_t*,
+                                        void* userData) {
+    StepStream* stream = (StepStream*)userData;
+    BaseType_t woken = pdFALSE;
+
+    portENTER_CRITICAL_ISR(&stream->_lock);
+    stream->_sliceCount++;
+    // Nothing queued behind it, the outputs sit at the idle level
+    if (--stream->_inFlight == 0) stream->_underruns++;
+    portEXIT_CRITICAL_ISR(&stream->_lock);
+
+    xSemaphoreGiveFromISR(stream->_freeBuffers, &woken);
+    return woken == pdTRUE;
+}
+
+// Render task, one slice per free buffer
+void StepStream::streamTask(void* parameters) {
+    StepStream* stream = (StepStream*)parameters;
+    int next = 0;
+
+    while (1) {
+        xSemaphoreTake(stream->_freeBuffers, portMAX_DELAY);
+
+        unsigned long start = micros();
+        stream->serviceCommands();
+        stream->renderSlice(stream->_buffers[next]);
+        uint32_t renderUs = micros() - start;
+        if (renderUs > stream->_maxRenderUs) stream->_maxRenderUs = renderUs;
+
+        // Between buffers the bus holds the DIR levels the slice ended on
+        parlio_transmit_config_t transmitConfig = {};
+        transmitConfig.idle_value = stream->idleLevel();
+
+        portENTER_CRITICAL(&stream->_lock);
+        stream->_inFlight++;
+        portEXIT_CRITICAL(&stream->_lock);
+        parlio_tx_unit_transmit(stream->_unit, stream->_buffers[next], STEP_STREAM_SLICE_SAMPLES * 8, &transmitConfig);
+
+        next ^= 1;
+    }
+}
+#endif
@@ -0,0 +1,109 @@
+// StepStream.h
+#ifndef STEP_STREAM_H
+#define STEP_STREAM_H
+
+#include <Arduino.h>
+#include "soc/soc_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "MultiAxisScheduler.h"
+#if SOC_PARLIO_SUPPORTED
+#include "driver/parlio_tx.h"
+#endif
+
+// Waveform timing. Each sample is one byte on the parallel bus, bit 2n is
+// axis n's STEP and bit 2n+1 its DIR. A step pulse is high for
+// STEP_STREAM_PULSE_SAMPLES and steps are at least twice that apart, which
+// caps an axis at 125k steps/s with these settings.
+#define STEP_STREAM_MAX_AXES 4
+#define STEP_STREAM_SAMPLE_HZ 500000
+#define STEP_STREAM_SAMPLE_US (1000000 / STEP_STREAM_SAMPLE_HZ)
+#define STEP_STREAM_PULSE_SAMPLES 2
+#define STEP_STREAM_SLICE_SAMPLES 1000  // 2 ms per buffer
+#define STEP_STREAM_SLICE_US (STEP_STREAM_SLICE_SAMPLES * STEP_STREAM_SAMPLE_US)
+
+// Streams the STEP and DIR signals of several StepperAxis out of the
+// parallel IO (PARLIO) peripheral. A task renders the next slice of the
+// waveform into one of two DMA buffers while the other is being sent, so
+// the CPU works once per buffer whatever the step rate. The axes plan their
+// steps exactly as on the MultiAxisScheduler and take the same commands;
+// their drivers only have to report their step pins and look after enable.
+// Commands are picked up at the next slice, about two buffers ahead of the
+// outputs.
+class StepStream {
+public:
+    // Constructor
+    StepStream();
+
+    // Add an axis (before begin) whose driver has step pins, returns its
+    // number or -1
+    int addAxis(StepperAxis* axis);
+    int getAxisCount() { return _axisCount; }
+    StepperAxis* getAxis(int index) { return (index >= 0 && index < _axisCount) ? _axes[index].axis : nullptr; }
+
+    // Set up the peripheral and start the render task
+    bool begin();
+    bool isActive() { return _taskHandle != nullptr; }
+
+    // Render the next slice of the waveform (render task)
+    void renderSlice(uint8_t* samples);
+
+    // Emergency stop: the drivers are disabled at once and every slice
+    // from the next one on holds the idle level, with commands dropped,
+    // until clearFault(). Safe from any context.
+    void emergencyStop();
+    bool isFaulted() { return _faultLatched; }
+    void clearFault() { _faultLatched = false; }
+
+    // Status
+    unsigned long getSliceCount() { return _sliceCount; }
+    unsigned long getUnderrunCount() { return _underruns; }  // Outputs idled waiting for a buffer
+    uint32_t getMaxRenderUs() { return _maxRenderUs; }
+    void resetStats();
+
+private:
+    // An axis and where it sits on the bus
+    typedef struct {
+        StepperAxis* axis;
+        uint8_t stepMask;
+        uint8_t dirMask;
+        uint64_t nextStep;     // Stream time of the next step (microseconds)
+        bool dirLevel;         // DIR as rendered so far
+        int pulseCarry;        // Samples of a pulse still to go at the next slice
+    } StreamAxis_t;
+
+    StreamAxis_t _axes[STEP_STREAM_MAX_AXES];
+    int _axisCount;
+    int _dataPins[2 * STEP_STREAM_MAX_AXES];
+
+    // Stream time at the start of the next slice
+    uint64_t _sliceStart;
+
+    uint8_t* _buffers[2];
+    SemaphoreHandle_t _freeBuffers;
+    TaskHandle_t _taskHandle;
+    portMUX_TYPE _lock;
+    volatile bool _faultLatched;
+#if SOC_PARLIO_SUPPORTED
+    parlio_tx_unit_handle_t _unit;
+#endif
+
+    // Statistics
+    volatile int _inFlight;            // Buffers handed to the peripheral
+    volatile unsigned long _sliceCount;
+    volatile unsigned long _underruns;
+    uint32_t _maxRenderUs;
+
+    // Apply queued commands, starting axes that were idle
+    void serviceCommands();
+    // DIR bits of every axis as they stand, STEP low
+    uint8_t idleLevel();
+
+#if SOC_PARLIO_SUPPORTED
+    static bool transmitDone(parlio_tx_unit_handle_t unit, const parlio_tx_done_event_data_t* edata, void* userData);
+#endif
+    static void streamTask(void* parameters);
+};
+
+#endif // STEP_STREAM_H
@@ -3,6 +3,16 @@
 
 #include <Arduino.h>
 
+// Pins of a plain step/direction driver. The step interrupt drives these
+// itself: a virtual call goes through the vtable, which is in flash and
+// can't be read while flash is being written.
+typedef struct {
+    int stepPin;
+    int dirPin;
+    int enablePin;          // Active low, -1 if not connected
+    uint32_t pulseWidthUs;  // Step pulse width
+} StepPins_t;
+
 // Base class for all stepper motor drivers
 class StepperDriver {
 public:
@@ -29,7 +39,22 @@ public:
     virtual void setMicrostepMode(int mode) { /* Default does nothing */ }
     virtual int getMicrostepMode() { return 1; } // Default is full step
     
+    // For drivers that can reduce current while holding position
+    virtual void setStandstill(bool) { /* Default does nothing */ }
+    
+    // Whether the driver's indexer goes back to its home state when the
+    // ESP32 resets, so the rotor is pulled to the nearest home phase
+    virtual bool indexerResetsWithHost() { return false; }
+
+    // Step/direction drivers fill in their pins, others return false
+    virtual bool getStepPins(StepPins_t*) { return false; }
+    
 protected:
+    // The step ISRs keep _enabled and _direction up to date when they drive
+    // the pins themselves
+    friend class TimerStepperControl;
+    friend class StepperAxis;
+
     bool _enabled;    // Driver enabled state
     bool _direction;  // Rotation direction (true = clockwise)
     int _speed;       // Current speed setting
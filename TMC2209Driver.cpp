@@ -0,0 +1,360 @@
+// TMC2209Driver.cpp
+#include "TMC2209Driver.h"
+
+// Chip address of each cache slot
+static const uint8_t TMC2209_CACHE_ADDRESSES[TMC2209_CACHE_COUNT] = {
+    TMC2209_GCONF,
+    TMC2209_IHOLD_IRUN,
+    TMC2209_TPOWERDOWN,
+    TMC2209_TPWMTHRS,
+    TMC2209_TCOOLTHRS,
+    TMC2209_SGTHRS,
+    TMC2209_CHOPCONF,
+    TMC2209_PWMCONF
+};
+
+#define TMC2209_ALL_DIRTY ((1UL << TMC2209_CACHE_COUNT) - 1)
+
+// Constructor
+TMC2209Driver::TMC2209Driver(int stepPin, int dirPin, int enablePin, HardwareSerial* serial,
+                             int rxPin, int txPin, uint8_t address, float senseResistor) :
+    _stepPin(stepPin),
+    _dirPin(dirPin),
+    _enablePin(enablePin),
+    _serial(serial),
+    _rxPin(rxPin),
+    _txPin(txPin),
+    _address(address),
+    _senseResistor(senseResistor),
+    _dirty(TMC2209_ALL_DIRTY),
+    _microstepMode(1),
+    _spreadCycleTstep(0),
+    _stallGuardTstep(0),
+    _sensorlessHoming(false),
+    _connected(false),
+    _counterKnown(false),
+    _writeCounter(0),
+    _lastCheck(0),
+    _writeCount(0),
+    _errorCount(0)
+{
+    portMUX_INITIALIZE(&_cacheLock);
+
+    // Everything is written on the first flush
+    _registers[TMC2209_CACHE_GCONF] = TMC2209_GCONF_PDN_DISABLE | TMC2209_GCONF_MSTEP_REG_SELECT |
+                                      TMC2209_GCONF_MULTISTEP_FILT;
+    _registers[TMC2209_CACHE_IHOLD_IRUN] = (1UL << 16) | (16UL << 8) | 8;
+    _registers[TMC2209_CACHE_TPOWERDOWN] = TMC2209_DEFAULT_TPOWERDOWN;
+    _registers[TMC2209_CACHE_TPWMTHRS] = 0;
+    _registers[TMC2209_CACHE_TCOOLTHRS] = 0;
+    _registers[TMC2209_CACHE_SGTHRS] = 0;
+    _registers[TMC2209_CACHE_CHOPCONF] = (TMC2209_DEFAULT_CHOPCONF & ~TMC2209_CHOPCONF_MRES_MASK) |
+                                         (8UL << TMC2209_CHOPCONF_MRES_SHIFT);  // Full steps
+    _registers[TMC2209_CACHE_PWMCONF] = TMC2209_DEFAULT_PWMCONF;
+}
+
+// Initialize the pins and the UART, then write the whole configuration
+void TMC2209Driver::init() {
+    pinMode(_stepPin, OUTPUT);
+    pinMode(_dirPin, OUTPUT);
+    pinMode(_enablePin, OUTPUT);
+    disable();
+    digitalWrite(_dirPin, _direction ? HIGH : LOW);
+
+    _serial->begin(TMC2209_UART_BAUD, SERIAL_8N1, _rxPin, _txPin);
+
+    // The version register tells us a TMC2209 is listening
+    uint32_t ioin = 0;
+    _connected = readRegister(TMC2209_IOIN, &ioin) &&
+                 (ioin >> TMC2209_IOIN_VERSION_SHIFT) == TMC2209_VERSION;
+    if (!_connected) {
+        Serial.println("TMC2209 not responding on UART");
+        return;
+    }
+    flush();
+}
+
+// Set rotation direction
+void TMC2209Driver::setDirection(bool clockwise) {
+    _direction = clockwise;
+    digitalWrite(_dirPin, _direction ? HIGH : LOW);
+}
+
+// Execute one step (pins only, safe in the step interrupt)
+void IRAM_ATTR TMC2209Driver::step() {
+    if (!_enabled) return;
+
+    digitalWrite(_stepPin, HIGH);
+    delayMicroseconds(TMC2209_PULSE_WIDTH_US);
+    digitalWrite(_stepPin, LOW);
+}
+
+// Step, direction and enable are plain pins
+bool TMC2209Driver::getStepPins(StepPins_t* pins) {
+    pins->stepPin = _stepPin;
+    pins->dirPin = _dirPin;
+    pins->enablePin = _enablePin;
+    pins->pulseWidthUs = TMC2209_PULSE_WIDTH_US;
+    return true;
+}
+
+// Enable the driver (EN is active LOW)
+void TMC2209Driver::enable() {
+    digitalWrite(_enablePin, LOW);
+    _enabled = true;
+}
+
+// Disable the driver
+void TMC2209Driver::disable() {
+    digitalWrite(_enablePin, HIGH);
+    _enabled = false;
+}
+
+// Microsteps per full step (1 to 256) go into CHOPCONF.MRES
+void TMC2209Driver::setMicrostepMode(int mode) {
+    int resolution = 8;  // MRES 8 = full steps, 0 = 256 microsteps
+    while (resolution > 0 && (256 >> resolution) < mode) {
+        resolution--;
+    }
+    if ((256 >> resolution) != mode) {
+        resolution = 8;  // Not a power of two, fall back to full steps
+    }
+
+    _microstepMode = 256 >> resolution;
+    setRegisterBits(TMC2209_CACHE_CHOPCONF, TMC2209_CHOPCONF_MRES_MASK,
+                    (uint32_t)resolution << TMC2209_CHOPCONF_MRES_SHIFT);
+}
+
+// Current scale from the datasheet: I_rms = (CS + 1) / 32 * V_fs / (R_sense + 20 mΩ) / √2.
+// The low sense voltage range is used when the high one would leave less
+// than half the scale.
+void TMC2209Driver::setCurrent(int runMilliamps, int holdPercent) {
+    float amps = runMilliamps / 1000.0f;
+    float resistance = _senseResistor + 0.02f;
+    uint32_t vsense = 0;
+
+    int runScale = (int)(32.0f * 1.41421f * amps * resistance / 0.325f + 0.5f) - 1;
+    if (runScale < 16) {
+        vsense = TMC2209_CHOPCONF_VSENSE;
+        runScale = (int)(32.0f * 1.41421f * amps * resistance / 0.180f + 0.5f) - 1;
+    }
+    runScale = constrain(runScale, 0, 31);
+    int holdScale = constrain(runScale * holdPercent / 100, 0, 31);
+
+    setRegisterBits(TMC2209_CACHE_CHOPCONF, TMC2209_CHOPCONF_VSENSE, vsense);
+    setRegister(TMC2209_CACHE_IHOLD_IRUN, (1UL << 16) | ((uint32_t)runScale << 8) | (uint32_t)holdScale);
+}
+
+// StealthChop below the threshold, SpreadCycle above it
+void TMC2209Driver::setSpreadCycleThreshold(float fullStepsPerSec) {
+    _spreadCycleTstep = fullStepRateToTstep(fullStepsPerSec);
+    if (!_sensorlessHoming) {
+        setRegister(TMC2209_CACHE_TPWMTHRS, _spreadCycleTstep);
+    }
+}
+
+// StallGuard threshold and the speed it starts working at
+void TMC2209Driver::setStallGuard(uint8_t threshold, float minFullStepsPerSec) {
+    _stallGuardTstep = fullStepRateToTstep(minFullStepsPerSec);
+    setRegister(TMC2209_CACHE_SGTHRS, threshold);
+    setRegister(TMC2209_CACHE_TCOOLTHRS, _stallGuardTstep);
+}
+
+// StallGuard only works in StealthChop, so keep SpreadCycle off while homing
+void TMC2209Driver::setSensorlessHoming(bool active) {
+    _sensorlessHoming = active;
+    setRegister(TMC2209_CACHE_TPWMTHRS, active ? 0 : _spreadCycleTstep);
+}
+
+// Write pending settings, and check now and then that the chip still has them
+bool TMC2209Driver::service() {
+    unsigned long now = millis();
+    if (now - _lastCheck >= TMC2209_CHECK_INTERVAL_MS) {
+        _lastCheck = now;
+
+        // A reset (motor supply off and on) loses every setting
+        uint32_t status = 0;
+        _connected = readRegister(TMC2209_GSTAT, &status);
+        if (_connected && (status & TMC2209_GSTAT_RESET)) {
+            Serial.println("TMC2209 was reset, writing the settings again");
+            uint8_t frame[TMC2209_WRITE_LENGTH];
+            buildWrite(frame, TMC2209_GSTAT, 0x07);  // Write 1 to clear the flags
+            transfer(frame, TMC2209_WRITE_LENGTH);
+
+            portENTER_CRITICAL(&_cacheLock);
+            _dirty = TMC2209_ALL_DIRTY;
+            portEXIT_CRITICAL(&_cacheLock);
+            _counterKnown = false;
+        }
+    }
+    return flush();
+}
+
+// Send every dirty register back to back, then check the chip's count of
+// good writes went up by the same number. Anything not confirmed is sent
+// again next time.
+bool TMC2209Driver::flush() {
+    if (!_connected) return false;
+
+    uint8_t frames[TMC2209_CACHE_COUNT * TMC2209_WRITE_LENGTH];
+    int count = 0;
+
+    portENTER_CRITICAL(&_cacheLock);
+    uint32_t batch = _dirty;
+    for (int i = 0; i < TMC2209_CACHE_COUNT; i++) {
+        if (batch & (1UL << i)) {
+            buildWrite(&frames[count * TMC2209_WRITE_LENGTH], TMC2209_CACHE_ADDRESSES[i], _registers[i]);
+            count++;
+        }
+    }
+    _dirty = 0;
+    portEXIT_CRITICAL(&_cacheLock);
+
+    if (count == 0) return true;
+
+    if (!_counterKnown) {
+        _counterKnown = readWriteCounter(&_writeCounter);
+    }
+
+    uint8_t counter = 0;
+    bool sent = _counterKnown && transfer(frames, count * TMC2209_WRITE_LENGTH) &&
+                readWriteCounter(&counter);
+    if (!sent || (uint8_t)(counter - _writeCounter) != count) {
+        portENTER_CRITICAL(&_cacheLock);
+        _dirty |= batch;
+        portEXIT_CRITICAL(&_cacheLock);
+        _counterKnown = false;
+        _errorCount++;
+        return false;
+    }
+
+    _writeCounter = counter;
+    _writeCount += count;
+    return true;
+}
+
+// Read one register: request, echo, then the chip's 8-byte reply
+bool TMC2209Driver::readRegister(uint8_t address, uint32_t* value) {
+    uint8_t request[TMC2209_READ_REQUEST_LENGTH] = { TMC2209_SYNC, _address, address, 0 };
+    request[3] = crc8(request, 3);
+    if (!transfer(request, TMC2209_READ_REQUEST_LENGTH)) {
+        _errorCount++;
+        return false;
+    }
+
+    uint8_t reply[TMC2209_READ_REPLY_LENGTH];
+    int received = 0;
+    unsigned long start = micros();
+    while (received < TMC2209_READ_REPLY_LENGTH) {
+        if (_serial->available() > 0) {
+            reply[received++] = _serial->read();
+        } else if (micros() - start > TMC2209_REPLY_TIMEOUT_US) {
+            _errorCount++;
+            return false;
+        }
+    }
+
+    if (reply[0] != TMC2209_SYNC || reply[1] != TMC2209_MASTER_ADDRESS || reply[2] != address ||
+        reply[7] != crc8(reply, 7)) {
+        _errorCount++;
+        return false;
+    }
+
+    *value = ((uint32_t)reply[3] << 24) | ((uint32_t)reply[4] << 16) |
+             ((uint32_t)reply[5] << 8) | reply[6];
+    return true;
+}
+
+// StallGuard load measurement, lower = closer to stalling
+int TMC2209Driver::readStallGuardResult() {
+    uint32_t value;
+    if (!readRegister(TMC2209_SG_RESULT, &value)) return -1;
+    return value & 0x3FF;
+}
+
+// CRC8 as given in the datasheet
+uint8_t TMC2209Driver::crc8(const uint8_t* data, int length) {
+    uint8_t crc = 0;
+    for (int i = 0; i < length; i++) {
+        uint8_t currentByte = data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            if ((crc >> 7) ^ (currentByte & 0x01)) {
+                crc = (crc << 1) ^ 0x07;
+            } else {
+                crc = crc << 1;
+            }
+            currentByte >>= 1;
+        }
+    }
+    return crc;
+}
+
+// Change a cached register, marking it dirty only if it changed
+void TMC2209Driver::setRegister(TMC2209CacheSlot slot, uint32_t value) {
+    portENTER_CRITICAL_SAFE(&_cacheLock);
+    if (_registers[slot] != value) {
+        _registers[slot] = value;
+        _dirty |= 1UL << slot;
+    }
+    portEXIT_CRITICAL_SAFE(&_cacheLock);
+}
+
+void TMC2209Driver::setRegisterBits(TMC2209CacheSlot slot, uint32_t mask, uint32_t value) {
+    portENTER_CRITICAL_SAFE(&_cacheLock);
+    uint32_t updated = (_registers[slot] & ~mask) | (value & mask);
+    if (_registers[slot] != updated) {
+        _registers[slot] = updated;
+        _dirty |= 1UL << slot;
+    }
+    portEXIT_CRITICAL_SAFE(&_cacheLock);
+}
+
+// Write datagram: sync, chip address, register with the write bit, data MSB first, CRC
+void TMC2209Driver::buildWrite(uint8_t* frame, uint8_t address, uint32_t value) {
+    frame[0] = TMC2209_SYNC;
+    frame[1] = _address;
+    frame[2] = address | TMC2209_WRITE_BIT;
+    frame[3] = value >> 24;
+    frame[4] = value >> 16;
+    frame[5] = value >> 8;
+    frame[6] = value;
+    frame[7] = crc8(frame, 7);
+}
+
+// Send bytes on the single wire. Everything sent comes straight back on RX,
+// which is read off and compared to catch a collision or a broken line.
+bool TMC2209Driver::transfer(const uint8_t* data, int length) {
+    while (_serial->available() > 0) {
+        _serial->read();
+    }
+
+    _serial->write(data, length);
+    _serial->flush();
+
+    int echoed = 0;
+    unsigned long start = micros();
+    while (echoed < length) {
+        if (_serial->available() > 0) {
+            if (_serial->read() != data[echoed]) return false;
+            echoed++;
+        } else if (micros() - start > TMC2209_REPLY_TIMEOUT_US) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Interface counter, goes up by one for every write the chip accepted
+bool TMC2209Driver::readWriteCounter(uint8_t* counter) {
+    uint32_t value;
+    if (!readRegister(TMC2209_IFCNT, &value)) return false;
+    *counter = value & 0xFF;
+    return true;
+}
+
+// TSTEP is the time between 1/256 microsteps in clock cycles, whatever MRES is
+uint32_t TMC2209Driver::fullStepRateToTstep(float fullStepsPerSec) {
+    if (fullStepsPerSec <= 0) return 0;
+    float tstep = TMC2209_CLOCK_HZ / (fullStepsPerSec * 256.0f);
+    return (uint32_t)constrain(tstep, 1.0f, 1048575.0f);  // 20-bit register
+}
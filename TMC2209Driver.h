@@ -0,0 +1,166 @@
+// This code is only used if the TMC2209 driver is selected in motorcontrol.ino
+
+#ifndef TMC2209_DRIVER_H
+#define TMC2209_DRIVER_H
+
+#include "StepperDriver.h"
+#include "freertos/FreeRTOS.h"
+
+// Single-wire UART settings
+#define TMC2209_UART_BAUD 115200
+#define TMC2209_REPLY_TIMEOUT_US 3000    // Request, echo and reply take about 1.1 ms
+#define TMC2209_CHECK_INTERVAL_MS 1000   // How often the chip is checked for a reset
+#define TMC2209_CLOCK_HZ 12000000        // Internal clock, TSTEP is counted in it
+#define TMC2209_PULSE_WIDTH_US 2
+
+// Datagram framing
+#define TMC2209_SYNC 0x05
+#define TMC2209_MASTER_ADDRESS 0xFF
+#define TMC2209_WRITE_BIT 0x80
+#define TMC2209_WRITE_LENGTH 8
+#define TMC2209_READ_REQUEST_LENGTH 4
+#define TMC2209_READ_REPLY_LENGTH 8
+
+// Registers
+#define TMC2209_GCONF 0x00
+#define TMC2209_GSTAT 0x01
+#define TMC2209_IFCNT 0x02
+#define TMC2209_IOIN 0x06
+#define TMC2209_IHOLD_IRUN 0x10
+#define TMC2209_TPOWERDOWN 0x11
+#define TMC2209_TSTEP 0x12
+#define TMC2209_TPWMTHRS 0x13
+#define TMC2209_TCOOLTHRS 0x14
+#define TMC2209_SGTHRS 0x40
+#define TMC2209_SG_RESULT 0x41
+#define TMC2209_CHOPCONF 0x6C
+#define TMC2209_DRV_STATUS 0x6F
+#define TMC2209_PWMCONF 0x70
+
+// Register bits
+#define TMC2209_GCONF_EN_SPREADCYCLE (1UL << 2)
+#define TMC2209_GCONF_PDN_DISABLE (1UL << 6)      // PDN_UART pin is the UART
+#define TMC2209_GCONF_MSTEP_REG_SELECT (1UL << 7) // Microsteps from MRES, not MS1/MS2
+#define TMC2209_GCONF_MULTISTEP_FILT (1UL << 8)
+#define TMC2209_GSTAT_RESET (1UL << 0)
+#define TMC2209_CHOPCONF_MRES_SHIFT 24
+#define TMC2209_CHOPCONF_MRES_MASK (0x0FUL << TMC2209_CHOPCONF_MRES_SHIFT)
+#define TMC2209_CHOPCONF_VSENSE (1UL << 17)
+#define TMC2209_IOIN_VERSION_SHIFT 24
+#define TMC2209_VERSION 0x21
+
+// Reset values from the datasheet
+#define TMC2209_DEFAULT_CHOPCONF 0x10000053UL
+#define TMC2209_DEFAULT_PWMCONF 0xC10D0024UL
+#define TMC2209_DEFAULT_TPOWERDOWN 20    // About 0.4 s before dropping to hold current
+
+// Registers kept in the cache (most are write-only on the chip)
+typedef enum {
+    TMC2209_CACHE_GCONF = 0,
+    TMC2209_CACHE_IHOLD_IRUN,
+    TMC2209_CACHE_TPOWERDOWN,
+    TMC2209_CACHE_TPWMTHRS,
+    TMC2209_CACHE_TCOOLTHRS,
+    TMC2209_CACHE_SGTHRS,
+    TMC2209_CACHE_CHOPCONF,
+    TMC2209_CACHE_PWMCONF,
+    TMC2209_CACHE_COUNT
+} TMC2209CacheSlot;
+
+// TMC2209 on its single-wire UART. Step, direction and enable stay on pins
+// so the step interrupt only ever toggles a pin. Every setting goes into a
+// register cache and is marked dirty; service() from the main loop writes
+// the dirty registers in one batch and checks the chip's write counter, so
+// no register traffic ever happens in the step path. The chip switches
+// from StealthChop to SpreadCycle by itself above a velocity threshold, and
+// its StallGuard output (DIAG) can stand in for a home switch.
+class TMC2209Driver : public StepperDriver {
+public:
+    // Constructor (rxPin and txPin both go to PDN_UART, tx through 1k)
+    TMC2209Driver(int stepPin, int dirPin, int enablePin, HardwareSerial* serial,
+                  int rxPin, int txPin, uint8_t address = 0, float senseResistor = 0.11f);
+
+    // StepperDriver
+    void init() override;
+    void setDirection(bool clockwise) override;
+    void setSpeed(int speed) override { _speed = constrain(speed, 0, _maxSpeed); }
+    void step() override;
+    void enable() override;
+    void disable() override;
+    void setMicrostepMode(int mode) override;
+    int getMicrostepMode() override { return _microstepMode; }
+    bool getStepPins(StepPins_t* pins) override;
+
+    // Run current in mA RMS and hold current as a percentage of it
+    void setCurrent(int runMilliamps, int holdPercent);
+
+    // SpreadCycle above this many full steps per second, StealthChop below
+    // (0 = StealthChop at every speed)
+    void setSpreadCycleThreshold(float fullStepsPerSec);
+
+    // StallGuard: DIAG goes high when the load reaches the threshold (higher
+    // = more sensitive). Only works in StealthChop above minFullStepsPerSec.
+    void setStallGuard(uint8_t threshold, float minFullStepsPerSec);
+
+    // StealthChop with StallGuard active for the whole move, or back to the
+    // normal chopper settings
+    void setSensorlessHoming(bool active);
+
+    // Write the dirty registers and check the chip now and then (main loop)
+    bool service();
+    bool flush();
+
+    // Status
+    bool isConnected() { return _connected; }
+    bool readRegister(uint8_t address, uint32_t* value);
+    int readStallGuardResult();  // -1 when the read fails
+    unsigned long getWriteCount() { return _writeCount; }
+    unsigned long getErrorCount() { return _errorCount; }
+
+    // CRC8 of a datagram, polynomial x^8 + x^2 + x + 1, LSB of each byte first
+    static uint8_t crc8(const uint8_t* data, int length);
+
+private:
+    // Pins and UART
+    int _stepPin;
+    int _dirPin;
+    int _enablePin;
+    HardwareSerial* _serial;
+    int _rxPin;
+    int _txPin;
+    uint8_t _address;
+    float _senseResistor;
+
+    // Register cache, dirty bit per slot
+    uint32_t _registers[TMC2209_CACHE_COUNT];
+    uint32_t _dirty;
+    portMUX_TYPE _cacheLock;
+
+    // Settings the cache is worked out from
+    int _microstepMode;
+    uint32_t _spreadCycleTstep;  // TPWMTHRS outside sensorless homing
+    uint32_t _stallGuardTstep;   // TCOOLTHRS for StallGuard
+    bool _sensorlessHoming;
+
+    // Link state
+    bool _connected;
+    bool _counterKnown;
+    uint8_t _writeCounter;       // Last IFCNT seen
+    unsigned long _lastCheck;
+    unsigned long _writeCount;
+    unsigned long _errorCount;
+
+    // Change a cached register, marking it dirty only if it changed
+    void setRegister(TMC2209CacheSlot slot, uint32_t value);
+    void setRegisterBits(TMC2209CacheSlot slot, uint32_t mask, uint32_t value);
+
+    // Datagram helpers
+    void buildWrite(uint8_t* frame, uint8_t address, uint32_t value);
+    bool transfer(const uint8_t* data, int length);  // Write and swallow the echo
+    bool readWriteCounter(uint8_t* counter);
+
+    // TSTEP for a full-step rate (TSTEP counts clocks per 1/256 microstep)
+    static uint32_t fullStepRateToTstep(float fullStepsPerSec);
+};
+
+#endif // TMC2209_DRIVER_H
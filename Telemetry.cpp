@@ -0,0 +1,154 @@
+// Telemetry.cpp
+#include "Telemetry.h"
+
+// Constructor
+Telemetry::Telemetry(TimerStepperControl* controller, Print* output) :
+    _controller(controller),
+    _output(output),
+    _taskHandle(nullptr),
+    _rateHz(0),
+    _budget(0),
+    _streaming(false),
+    _haveLastSent(false),
+    _forceKey(true),
+    _sequence(0),
+    _framesSinceKey(0),
+    _lastIsrCycles(0),
+    _lastSampleUs(0),
+    _cyclesPerUs(1),
+    _credit(0),
+    _creditRemainder(0),
+    _frameCount(0),
+    _keyFrameCount(0),
+    _byteCount(0),
+    _budgetDrops(0),
+    _portDrops(0)
+{
+}
+
+// Start the sampling task at the nearest rate the tick allows
+bool Telemetry::begin(int rateHz, uint32_t budgetBytesPerSec) {
+    if (_taskHandle != nullptr) return true;
+    if (rateHz <= 0 || budgetBytesPerSec == 0) return false;
+
+    rateHz = min(rateHz, TELEMETRY_MAX_RATE_HZ);
+    TickType_t period = max((TickType_t)1, (TickType_t)(configTICK_RATE_HZ / rateHz));
+    _rateHz = configTICK_RATE_HZ / period;
+    _budget = budgetBytesPerSec;
+    _cyclesPerUs = getCpuFrequencyMhz();
+
+    // The smallest frame has to fit in what one sample period earns
+    if (_budget / _rateHz < TELEMETRY_DELTA_FRAME_SIZE) {
+        Serial.println("Telemetry: budget is below one frame per sample, frames will be dropped");
+    }
+
+    if (xTaskCreate(telemetryTask, "telemetry", 3072, this, TELEMETRY_TASK_PRIORITY, &_taskHandle) != pdPASS) {
+        _taskHandle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// Turning the stream on starts again with a key frame
+void Telemetry::setStreaming(bool streaming) {
+    if (streaming && !_streaming) {
+        _forceKey = true;
+        _credit = TELEMETRY_BURST_BYTES;
+    }
+    _streaming = streaming;
+}
+
+// Start the statistics again
+void Telemetry::resetStats() {
+    _frameCount = 0;
+    _keyFrameCount = 0;
+    _byteCount = 0;
+    _budgetDrops = 0;
+    _portDrops = 0;
+}
+
+// Read the controller's snapshot into a sample
+void Telemetry::takeSample(TelemetrySample_t* sample) {
+    MotionSnapshot_t snapshot;
+    _controller->getSnapshot(&snapshot);
+
+    sample->timeUs = snapshot.timeUs;
+    sample->position = snapshot.position;
+    sample->stepRate = (int32_t)snapshot.velocity;
+    sample->commandedSpeed = (uint16_t)constrain(snapshot.commandedSpeed, 0, UINT16_MAX);
+    sample->queueDepth = (uint8_t)min(_controller->getQueueDepth(), 255);
+
+    // Share of the time between snapshots spent in the step ISR
+    uint32_t elapsedUs = snapshot.timeUs - _lastSampleUs;
+    uint32_t load = 0;
+    if (elapsedUs > 0) {
+        load = (uint32_t)(200ULL * (snapshot.isrCycles - _lastIsrCycles) / ((uint64_t)elapsedUs * _cyclesPerUs));
+    }
+    sample->isrLoad = (uint8_t)min(load, (uint32_t)255);
+    _lastIsrCycles = snapshot.isrCycles;
+    _lastSampleUs = snapshot.timeUs;
+
+    sample->flags = 0;
+    if (snapshot.mode != MOTION_IDLE) sample->flags |= TELEMETRY_FLAG_RUNNING;
+    if (snapshot.mode == MOTION_CONTINUOUS) sample->flags |= TELEMETRY_FLAG_CONTINUOUS;
+    if (snapshot.mode == MOTION_TRACKING) sample->flags |= TELEMETRY_FLAG_TRACKING;
+    if (snapshot.faults & MOTION_FAULT_ESTOP) sample->flags |= TELEMETRY_FLAG_FAULT;
+}
+
+// Sample, encode and send one frame if the budget and the port have room
+void Telemetry::sendFrame() {
+    // Earn this period's share of the budget
+    _creditRemainder += _budget;
+    _credit += _creditRemainder / _rateHz;
+    _creditRemainder %= _rateHz;
+    if (_credit > TELEMETRY_BURST_BYTES) _credit = TELEMETRY_BURST_BYTES;
+
+    TelemetrySample_t sample;
+    takeSample(&sample);
+    if (!_streaming) return;
+
+    uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+    bool key = _forceKey || !_haveLastSent || _framesSinceKey >= TELEMETRY_KEY_INTERVAL - 1;
+    size_t size = telemetryEncode(_haveLastSent ? &_lastSent : NULL, &sample, _sequence, key, frame);
+
+    if (size > _credit) {
+        _budgetDrops++;
+        return;
+    }
+    if ((size_t)_output->availableForWrite() < size) {
+        _portDrops++;
+        return;
+    }
+
+    _output->write(frame, size);
+    _credit -= size;
+    _lastSent = sample;
+    _haveLastSent = true;
+    _forceKey = false;
+    _sequence++;
+    _frameCount++;
+    _byteCount += size;
+    if (frame[0] == TELEMETRY_KEY_FRAME) {
+        _keyFrameCount++;
+        _framesSinceKey = 0;
+    } else {
+        _framesSinceKey++;
+    }
+}
+
+// Sampling task, one frame per period
+void Telemetry::telemetryTask(void* parameters) {
+    Telemetry* telemetry = (Telemetry*)parameters;
+    TickType_t period = configTICK_RATE_HZ / telemetry->_rateHz;
+    TickType_t lastWake = xTaskGetTickCount();
+
+    MotionSnapshot_t snapshot;
+    telemetry->_controller->getSnapshot(&snapshot);
+    telemetry->_lastSampleUs = snapshot.timeUs;
+    telemetry->_lastIsrCycles = snapshot.isrCycles;
+
+    while (1) {
+        vTaskDelayUntil(&lastWake, period);
+        telemetry->sendFrame();
+    }
+}
@@ -0,0 +1,88 @@
+// Telemetry.h
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "TimerStepperControl.h"
+#include "TelemetryCodec.h"
+
+// Sampling task. It sits below the motor task so it can never hold up
+// a command.
+#define TELEMETRY_TASK_PRIORITY 2
+#define TELEMETRY_MAX_RATE_HZ 1000
+
+// Bytes the budget can save up while nothing is sent, about two key frames
+#define TELEMETRY_BURST_BYTES (2 * TELEMETRY_KEY_FRAME_SIZE)
+
+// Streams the controller's motion state as binary frames (see
+// TelemetryCodec.h) at a fixed rate. A task copies the controller's motion
+// snapshot, encodes a frame and hands it to the port only if the port has
+// room for all of it and the bandwidth budget allows it, so it never waits
+// on the port and never takes more of the link than it is given. Frames
+// that don't fit are dropped and counted; the next one carries its deltas.
+// The snapshot is renewed every millisecond, which caps the useful rate.
+class Telemetry {
+public:
+    // Constructor
+    Telemetry(TimerStepperControl* controller, Print* output);
+
+    // Start the sampling task. The budget is in bytes per second of the
+    // link that telemetry may use.
+    bool begin(int rateHz, uint32_t budgetBytesPerSec);
+
+    // Turn the stream on and off (the task keeps running)
+    void setStreaming(bool streaming);
+    bool isStreaming() { return _streaming; }
+    int getRate() { return _rateHz; }
+    uint32_t getBudget() { return _budget; }
+
+    // Status
+    unsigned long getFrameCount() { return _frameCount; }
+    unsigned long getKeyFrameCount() { return _keyFrameCount; }
+    unsigned long getByteCount() { return _byteCount; }
+    unsigned long getBudgetDrops() { return _budgetDrops; }  // Over the budget
+    unsigned long getPortDrops() { return _portDrops; }      // Port buffer full
+    void resetStats();
+
+private:
+    TimerStepperControl* _controller;
+    Print* _output;
+    TaskHandle_t _taskHandle;
+    int _rateHz;
+    uint32_t _budget;
+    volatile bool _streaming;
+
+    // Encoder state
+    TelemetrySample_t _lastSent;
+    bool _haveLastSent;
+    bool _forceKey;
+    uint8_t _sequence;
+    int _framesSinceKey;
+
+    // Load figure, from the ISR cycle count between snapshots
+    uint32_t _lastIsrCycles;
+    uint32_t _lastSampleUs;
+    uint32_t _cyclesPerUs;
+
+    // Bandwidth budget in bytes, topped up by the rate every sample
+    uint32_t _credit;
+    uint32_t _creditRemainder;   // Fraction of a byte carried over (budget units)
+
+    // Statistics
+    unsigned long _frameCount;
+    unsigned long _keyFrameCount;
+    unsigned long _byteCount;
+    unsigned long _budgetDrops;
+    unsigned long _portDrops;
+
+    // Read the controller's snapshot into a sample
+    void takeSample(TelemetrySample_t* sample);
+    // Sample, encode and send one frame if there is room
+    void sendFrame();
+
+    static void telemetryTask(void* parameters);
+};
+
+#endif // TELEMETRY_H
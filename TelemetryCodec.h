@@ -0,0 +1,216 @@
+// TelemetryCodec.h
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Telemetry goes out as fixed-size binary frames of two kinds, all fields
+// little endian:
+//
+// Key frame, 20 bytes, the whole sample:
+//   0  'K'         frame type
+//   1  uint8       sequence number
+//   2  uint8       flags (TELEMETRY_FLAG_*)
+//   3  uint8       queue depth (commands + segments)
+//   4  uint32      sample time in microseconds (wraps)
+//   8  int32       position in steps
+//   12 int32       actual step rate in steps/sec (signed)
+//   16 uint16      commanded speed in steps/sec
+//   18 uint8       step ISR load in half percent (200 = 100%)
+//   19 uint8       CRC8 of bytes 0-18
+//
+// Delta frame, 12 bytes, time, position and rate relative to the frame
+// before it:
+//   0  'D'         frame type
+//   1  uint8       sequence number
+//   2  uint8       flags
+//   3  uint8       queue depth
+//   4  uint16      microseconds since the previous frame
+//   6  int16       position change
+//   8  int16       step rate change
+//   10 uint8       step ISR load
+//   11 uint8       CRC8 of bytes 0-10
+//
+// A key frame is sent when a delta doesn't fit, when the commanded speed
+// changes and every TELEMETRY_KEY_INTERVAL frames. The sequence number
+// counts frames that were sent, so a gap means bytes were lost on the way
+// and the deltas can't be trusted until the next key frame. Samples the
+// sender skipped to stay in its bandwidth budget only show as a longer
+// time step. Text output shares the port; a decoder skips any byte that
+// doesn't start a frame with a good CRC.
+
+#define TELEMETRY_KEY_FRAME 'K'
+#define TELEMETRY_DELTA_FRAME 'D'
+#define TELEMETRY_KEY_FRAME_SIZE 20
+#define TELEMETRY_DELTA_FRAME_SIZE 12
+#define TELEMETRY_MAX_FRAME_SIZE TELEMETRY_KEY_FRAME_SIZE
+#define TELEMETRY_KEY_INTERVAL 50   // Longest run of frames without a key frame
+
+// Flags
+#define TELEMETRY_FLAG_RUNNING 0x01
+#define TELEMETRY_FLAG_CONTINUOUS 0x02
+#define TELEMETRY_FLAG_TRACKING 0x04
+#define TELEMETRY_FLAG_FAULT 0x08
+
+// One sample of the motion state
+typedef struct {
+    uint32_t timeUs;
+    int32_t position;
+    int32_t stepRate;
+    uint16_t commandedSpeed;
+    uint8_t queueDepth;
+    uint8_t isrLoad;      // Half percent
+    uint8_t flags;
+} TelemetrySample_t;
+
+// Decoder state for a byte stream
+typedef struct {
+    TelemetrySample_t sample;  // Last sample decoded
+    bool synced;               // A key frame has been seen since the last gap
+    uint8_t nextSequence;
+    unsigned long frames;
+    unsigned long gaps;        // Sequence breaks (frames lost on the link)
+} TelemetryDecoder_t;
+
+// CSV layout of telemetryFormatCsv
+#define TELEMETRY_CSV_HEADER "time_us,position,step_rate,commanded_speed,queue_depth,isr_load_pct,flags"
+
+// CRC8, polynomial x^8 + x^2 + x + 1
+static inline uint8_t telemetryCrc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static inline void telemetryPut16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static inline void telemetryPut32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static inline uint16_t telemetryGet16(const uint8_t* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static inline uint32_t telemetryGet32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) value |= (uint32_t)in[i] << (8 * i);
+    return value;
+}
+
+// Encode a sample, as a delta from previous when that fits and key is
+// false. Returns the frame size.
+static inline size_t telemetryEncode(const TelemetrySample_t* previous, const TelemetrySample_t* sample,
+                                     uint8_t sequence, bool key, uint8_t* out) {
+    if (!key && previous != NULL) {
+        uint32_t deltaTime = sample->timeUs - previous->timeUs;
+        int32_t deltaPosition = sample->position - previous->position;
+        int32_t deltaRate = sample->stepRate - previous->stepRate;
+        key = deltaTime > UINT16_MAX ||
+              deltaPosition < INT16_MIN || deltaPosition > INT16_MAX ||
+              deltaRate < INT16_MIN || deltaRate > INT16_MAX ||
+              sample->commandedSpeed != previous->commandedSpeed;
+
+        if (!key) {
+            out[0] = TELEMETRY_DELTA_FRAME;
+            out[1] = sequence;
+            out[2] = sample->flags;
+            out[3] = sample->queueDepth;
+            telemetryPut16(out + 4, (uint16_t)deltaTime);
+            telemetryPut16(out + 6, (uint16_t)(int16_t)deltaPosition);
+            telemetryPut16(out + 8, (uint16_t)(int16_t)deltaRate);
+            out[10] = sample->isrLoad;
+            out[11] = telemetryCrc8(out, TELEMETRY_DELTA_FRAME_SIZE - 1);
+            return TELEMETRY_DELTA_FRAME_SIZE;
+        }
+    }
+
+    out[0] = TELEMETRY_KEY_FRAME;
+    out[1] = sequence;
+    out[2] = sample->flags;
+    out[3] = sample->queueDepth;
+    telemetryPut32(out + 4, sample->timeUs);
+    telemetryPut32(out + 8, (uint32_t)sample->position);
+    telemetryPut32(out + 12, (uint32_t)sample->stepRate);
+    telemetryPut16(out + 16, sample->commandedSpeed);
+    out[18] = sample->isrLoad;
+    out[19] = telemetryCrc8(out, TELEMETRY_KEY_FRAME_SIZE - 1);
+    return TELEMETRY_KEY_FRAME_SIZE;
+}
+
+static inline void telemetryDecoderReset(TelemetryDecoder_t* decoder) {
+    const TelemetrySample_t empty = { 0, 0, 0, 0, 0, 0, 0 };
+    decoder->sample = empty;
+    decoder->synced = false;
+    decoder->nextSequence = 0;
+    decoder->frames = 0;
+    decoder->gaps = 0;
+}
+
+// Decode from the front of a byte stream. Returns the number of bytes used
+// (0 = wait for more) and sets *produced when decoder->sample holds a new
+// sample. Bytes that don't start a valid frame are used up one at a time.
+static inline size_t telemetryDecode(TelemetryDecoder_t* decoder, const uint8_t* in, size_t available, bool* produced) {
+    *produced = false;
+    if (available == 0) return 0;
+
+    size_t size;
+    if (in[0] == TELEMETRY_KEY_FRAME) {
+        size = TELEMETRY_KEY_FRAME_SIZE;
+    } else if (in[0] == TELEMETRY_DELTA_FRAME) {
+        size = TELEMETRY_DELTA_FRAME_SIZE;
+    } else {
+        return 1;
+    }
+    if (available < size) return 0;
+    if (telemetryCrc8(in, size - 1) != in[size - 1]) return 1;
+
+    if (decoder->synced && in[1] != decoder->nextSequence) {
+        decoder->synced = false;
+        decoder->gaps++;
+    }
+    decoder->nextSequence = (uint8_t)(in[1] + 1);
+    decoder->frames++;
+
+    TelemetrySample_t* sample = &decoder->sample;
+    if (in[0] == TELEMETRY_KEY_FRAME) {
+        sample->timeUs = telemetryGet32(in + 4);
+        sample->position = (int32_t)telemetryGet32(in + 8);
+        sample->stepRate = (int32_t)telemetryGet32(in + 12);
+        sample->commandedSpeed = telemetryGet16(in + 16);
+        sample->isrLoad = in[18];
+        decoder->synced = true;
+    } else if (decoder->synced) {
+        sample->timeUs += telemetryGet16(in + 4);
+        sample->position += (int16_t)telemetryGet16(in + 6);
+        sample->stepRate += (int16_t)telemetryGet16(in + 8);
+        sample->isrLoad = in[10];
+    } else {
+        return size;  // Nothing to add the delta to yet
+    }
+    sample->flags = in[2];
+    sample->queueDepth = in[3];
+    *produced = true;
+    return size;
+}
+
+// One CSV line (no newline) in the TELEMETRY_CSV_HEADER layout
+static inline int telemetryFormatCsv(const TelemetrySample_t* sample, char* out, size_t size) {
+    return snprintf(out, size, "%lu,%ld,%ld,%u,%u,%u.%u,%u",
+                    (unsigned long)sample->timeUs, (long)sample->position, (long)sample->stepRate,
+                    (unsigned)sample->commandedSpeed, (unsigned)sample->queueDepth,
+                    (unsigned)(sample->isrLoad / 2), (unsigned)(sample->isrLoad & 1) * 5,
+                    (unsigned)sample->flags);
+}
+
+#endif // TELEMETRY_CODEC_H
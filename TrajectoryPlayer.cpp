@@ -0,0 +1,126 @@
+// TrajectoryPlayer.cpp
+#include "TrajectoryPlayer.h"
+
+// Little endian field helpers
+static uint32_t readUint32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static void writeUint32(uint32_t value, uint8_t* out) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+// Constructor
+TrajectoryPlayer::TrajectoryPlayer(fs::FS* fs) :
+    _fs(fs),
+    _readLength(0),
+    _readOffset(0)
+{
+}
+
+// Open a keyframe file and pre-load the first keyframes
+bool TrajectoryPlayer::open(const char* path) {
+    close();
+    
+    _file = _fs->open(path, FILE_READ);
+    if (!_file) {
+        Serial.print("Trajectory player: can't open ");
+        Serial.println(path);
+        return false;
+    }
+    
+    uint8_t header[TRAJECTORY_HEADER_SIZE];
+    if (_file.read(header, TRAJECTORY_HEADER_SIZE) != TRAJECTORY_HEADER_SIZE ||
+        readUint32(header) != TRAJECTORY_FILE_MAGIC || header[4] != TRAJECTORY_FILE_VERSION) {
+        Serial.println("Trajectory player: not a keyframe file");
+        _file.close();
+        return false;
+    }
+    
+    setInterpolation(header[5] == PLAYER_INTERPOLATE_CUBIC ? PLAYER_INTERPOLATE_CUBIC : PLAYER_INTERPOLATE_LINEAR);
+    _readLength = 0;
+    _readOffset = 0;
+    return beginStream();
+}
+
+// Stop playback and close the file
+void TrajectoryPlayer::close() {
+    if (_open) {
+        _file.close();
+    }
+    SamplePlayer::close();
+}
+
+// Next keyframe, reading the file a chunk at a time
+bool TrajectoryPlayer::readSample(PathSample_t* sample) {
+    if (_readOffset + TRAJECTORY_KEYFRAME_SIZE > _readLength) {
+        _readLength = _file.read(_readBuffer, sizeof(_readBuffer));
+        _readOffset = 0;
+        if (_readLength < TRAJECTORY_KEYFRAME_SIZE) return false;
+    }
+    
+    sample->timeMs = readUint32(_readBuffer + _readOffset);
+    sample->position = (long)(int32_t)readUint32(_readBuffer + _readOffset + 4);
+    _readOffset += TRAJECTORY_KEYFRAME_SIZE;
+    return true;
+}
+
+// Read every keyframe of a file, checking that the times increase
+bool TrajectoryPlayer::scan(const char* path, unsigned long* keyframes, uint32_t* durationMs) {
+    if (!open(path)) return false;
+    
+    // Count from the start of the file rather than the pre-loaded buffer
+    _file.seek(TRAJECTORY_HEADER_SIZE);
+    _readLength = 0;
+    _readOffset = 0;
+    
+    PathSample_t sample;
+    PathSample_t first = {};
+    PathSample_t previous = {};
+    unsigned long count = 0;
+    bool valid = true;
+    while (readSample(&sample)) {
+        if (count == 0) {
+            first = sample;
+        } else if (sample.timeMs <= previous.timeMs) {
+            Serial.print("Keyframe ");
+            Serial.print(count);
+            Serial.println(" is not later than the one before");
+            valid = false;
+        }
+        previous = sample;
+        count++;
+    }
+    close();
+    
+    *keyframes = count;
+    *durationMs = count > 0 ? previous.timeMs - first.timeMs : 0;
+    return valid;
+}
+
+// Start a new, empty keyframe file
+bool TrajectoryPlayer::createFile(fs::FS* fs, const char* path, PlayerInterpolation interpolation) {
+    File file = fs->open(path, FILE_WRITE);
+    if (!file) return false;
+    
+    uint8_t header[TRAJECTORY_HEADER_SIZE];
+    writeUint32(TRAJECTORY_FILE_MAGIC, header);
+    header[4] = TRAJECTORY_FILE_VERSION;
+    header[5] = interpolation;
+    bool ok = file.write(header, TRAJECTORY_HEADER_SIZE) == TRAJECTORY_HEADER_SIZE;
+    file.close();
+    return ok;
+}
+
+// Add a keyframe to the end of a file
+bool TrajectoryPlayer::appendKeyframe(fs::FS* fs, const char* path, uint32_t timeMs, long position) {
+    File file = fs->open(path, FILE_APPEND);
+    if (!file) return false;
+    
+    uint8_t keyframe[TRAJECTORY_KEYFRAME_SIZE];
+    writeUint32(timeMs, keyframe);
+    writeUint32((uint32_t)position, keyframe + 4);
+    bool ok = file.write(keyframe, TRAJECTORY_KEYFRAME_SIZE) == TRAJECTORY_KEYFRAME_SIZE;
+    file.close();
+    return ok;
+}
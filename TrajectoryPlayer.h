@@ -0,0 +1,52 @@
+// TrajectoryPlayer.h
+#ifndef TRAJECTORY_PLAYER_H
+#define TRAJECTORY_PLAYER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "SamplePlayer.h"
+
+// Keyframe file layout (little endian):
+//   header:   "TRAJ", version (1 byte), interpolation (1 byte, PlayerInterpolation)
+//   keyframe: time in ms (uint32), absolute position in steps (int32)
+// Keyframe times must increase.
+#define TRAJECTORY_FILE_MAGIC 0x4A415254UL  // "TRAJ" little endian
+#define TRAJECTORY_FILE_VERSION 1
+#define TRAJECTORY_HEADER_SIZE 6
+#define TRAJECTORY_KEYFRAME_SIZE 8
+
+// Keyframes read from the file at a time
+#define TRAJECTORY_READ_KEYFRAMES 16
+
+// Streams a position-vs-time keyframe table from a file
+class TrajectoryPlayer : public SamplePlayer {
+public:
+    // Constructor
+    TrajectoryPlayer(fs::FS* fs);
+    
+    // Open a keyframe file and pre-load the first keyframes. The file's
+    // interpolation setting is applied.
+    bool open(const char* path);
+    void close() override;
+    
+    // Read every keyframe of a file to check it (not while playing)
+    bool scan(const char* path, unsigned long* keyframes, uint32_t* durationMs);
+    
+    // Keyframe file writing
+    static bool createFile(fs::FS* fs, const char* path, PlayerInterpolation interpolation);
+    static bool appendKeyframe(fs::FS* fs, const char* path, uint32_t timeMs, long position);
+    
+protected:
+    bool readSample(PathSample_t* sample) override;
+    
+private:
+    fs::FS* _fs;
+    File _file;
+    
+    // Chunked reading (main loop)
+    uint8_t _readBuffer[TRAJECTORY_READ_KEYFRAMES * TRAJECTORY_KEYFRAME_SIZE];
+    size_t _readLength;
+    size_t _readOffset;
+};
+
+#endif // TRAJECTORY_PLAYER_H
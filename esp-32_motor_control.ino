@@ -10,7 +10,23 @@
 #include "StepperDriver.h"
 #include "L298NDriver.h"
 #include "DRV8825Driver.h"
+#include "TMC2209Driver.h"
 #include "TimerStepperControl.h"
+#include "SequenceEngine.h"
+#include "PositionMath.h"
+#include "StepDirFollower.h"
+#include <LittleFS.h>
+#include "PathRecorder.h"
+#include "PathPlayer.h"
+#include "TrajectoryPlayer.h"
+#include "Oscillator.h"
+#include "Indexer.h"
+#include "Homing.h"
+#include "MultiAxisScheduler.h"
+#include "StepStream.h"
+#include "ClosedLoopMonitor.h"
+#include "Telemetry.h"
+#include "SettingsStore.h"
 
 //===============================================
 // MOTOR CONFIGURATION
@@ -18,6 +34,11 @@
 // Base motor characteristics
 #define BASE_STEPS_PER_REVOLUTION 200    // Standard for NEMA 17 (1.8° per step)
 #define DEFAULT_MICROSTEP_MODE 8         // Using 1/8 microstepping for smooth operation
+#define AUTO_MICROSTEP_ENABLED false     // Set to true to switch to coarser microstepping at high speed
+#define AUTO_MICROSTEP_MAX_SCALE 8       // Coarsest automatic switch (8 = from 1/8 down to full steps)
+#define INPUT_SHAPER_TYPE SHAPER_NONE    // SHAPER_ZV, SHAPER_ZVD or SHAPER_EI to suppress ringing
+#define INPUT_SHAPER_FREQUENCY 10.0f     // Resonance of the load (Hz)
+#define INPUT_SHAPER_DAMPING 0.1f        // Damping ratio of the resonance
 float gearRatio = 5.0;                   // Default 5:1 gear ratio
 
 //===============================================
@@ -29,11 +50,14 @@ float gearRatio = 5.0;                   // Default 5:1 gear ratio
 #define DEFAULT_RPM 5.0                  // Default starting speed in RPM
 #define RPM_FINE_ADJUST 0.1              // Fine adjustment increment in RPM
 #define RPM_COARSE_ADJUST 1.0            // Coarse adjustment increment in RPM
+#define FEED_FINE_ADJUST 1               // Feed override increment in percent (fine)
+#define FEED_COARSE_ADJUST 10            // Feed override increment in percent (coarse)
 
 // Step/rotation limits
 #define MIN_ROTATION_PERCENT 1.0         // Minimum rotation (1% of a full turn)
 #define MAX_ROTATION_PERCENT 1000.0      // Maximum rotation (10 full turns)
 #define DEFAULT_ROTATION_PERCENT 100.0   // Default rotation (1 full turn)
+#define DEFAULT_SEQUENCE_POSITIONS {0, 25, 50, 75, 100}  // Sequence positions in %
 #define ROTATION_FINE_ADJUST 1.0         // Fine adjustment increment (1% of rotation)
 #define ROTATION_COARSE_ADJUST 5.0       // Coarse adjustment increment (5% of rotation)
 
@@ -42,6 +66,7 @@ float gearRatio = 5.0;                   // Default 5:1 gear ratio
 #define ACCEL_MIN 400 // minimum acceleration in settings
 #define ACCEL_MAX 12800 // maximum acceleration in settings
 #define MOTOR_IDLE_TIMEOUT_MS 5000       // 5 seconds before motor power saving
+#define LIVE_READOUT_INTERVAL_MS 100     // Refresh of the position/RPM readout
 
 // Rotation Direction
 #define INVERT_STEP_MODE_DIRECTION true       // Set to true to invert direction in steps mode
@@ -62,6 +87,7 @@ float gearRatio = 5.0;                   // Default 5:1 gear ratio
 // Set this to choose which driver to use
 #define USE_L298N_DRIVER  0  // Set to 1 to use L298N
 #define USE_DRV8825_DRIVER 1 // Set to 1 to use DRV8825
+#define USE_TMC2209_DRIVER 0 // Set to 1 to use TMC2209 (UART configured)
 
 // L298N Pin definitions
 #define L298N_PIN1 1      // Connected to IN1 on L298N
@@ -70,6 +96,7 @@ float gearRatio = 5.0;                   // Default 5:1 gear ratio
 #define L298N_PIN4 20     // Connected to IN4 on L298N
 #define L298N_ENABLE_A 18 // Connected to ENA on L298N
 #define L298N_ENABLE_B 23 // Connected to ENB on L298N
+#define L298N_HOLD_CURRENT_PERCENT 50 // PWM amplitude while holding position
 
 // DRV8825 Pin definitions
 #define DRV8825_ENABLE_PIN 9  // Enable pin
@@ -83,6 +110,96 @@ float gearRatio = 5.0;                   // Default 5:1 gear ratio
 #define DRV8825_RESET_PIN -1   // Optional - connect if needed
 #define DRV8825_FAULT_PIN -1   // Optional - connect if needed
 
+// TMC2209 pin definitions (PDN_UART to both UART pins, TX through 1k)
+#define TMC2209_STEP_PIN 12
+#define TMC2209_DIR_PIN 13
+#define TMC2209_ENABLE_PIN 9
+#define TMC2209_UART_RX_PIN 18
+#define TMC2209_UART_TX_PIN 19
+#define TMC2209_DIAG_PIN 20            // StallGuard output for sensorless homing
+#define TMC2209_ADDRESS 0              // MS1/MS2 address pins
+#define TMC2209_SENSE_RESISTOR 0.11f   // Ohms, on most carrier boards
+#define TMC2209_RUN_CURRENT_MA 800     // RMS
+#define TMC2209_HOLD_CURRENT_PERCENT 50
+#define TMC2209_SPREADCYCLE_RPM 180.0f // Motor speed above which SpreadCycle takes over
+#define TMC2209_STALL_THRESHOLD 80     // StallGuard sensitivity (0-255, higher = more sensitive)
+#define TMC2209_STALL_MIN_RPM 60.0f    // Motor speed StallGuard needs to work
+
+#if USE_TMC2209_DRIVER && AUTO_MICROSTEP_ENABLED
+#error "Automatic microstepping changes the mode from the step interrupt, the TMC2209 can only change it over UART"
+#endif
+
+// Emergency stop input (-1 = not connected)
+#define ESTOP_PIN -1
+#define ESTOP_ACTIVE_LOW true            // Input pulled to ground when the e-stop is pressed
+#define ESTOP_DECELERATION 0             // Steps/sec² ramp-down, 0 = cut the steps at once
+
+// Position trigger output (camera/sensor trigger, -1 = not connected)
+#define TRIGGER_OUTPUT_PIN -1
+#define TRIGGER_PULSE_WIDTH_US 1000
+
+// Step/direction inputs for follower mode (-1 = not connected)
+#define FOLLOWER_STEP_PIN -1
+#define FOLLOWER_DIR_PIN -1
+
+// Home switch (-1 = not connected) and homing cycle settings
+#define HOME_SWITCH_PIN -1
+#define HOME_SWITCH_ACTIVE_LOW true     // Switch pulls the pin to ground
+#define HOMING_SENSORLESS false         // TMC2209 stall detection instead of a switch
+#define HOMING_TOWARD_CLOCKWISE false   // Direction the switch is in
+#define HOMING_SEEK_RPM 30.0f           // Fast search for the switch
+#define HOMING_APPROACH_RPM 2.0f        // Slow final approach that sets the zero
+#define HOMING_BACKOFF_PERCENT 5.0f     // Back-off between the two (% of a revolution)
+#define HOMING_MAX_TRAVEL_PERCENT 110.0f // Give up if the switch isn't found within this
+#define HOME_POSITION 0                 // Position assigned to the switch
+
+// Quadrature encoder for closed-loop position checks (-1 = not connected)
+#define SHAFT_ENCODER_A_PIN -1
+#define SHAFT_ENCODER_B_PIN -1
+#define SHAFT_ENCODER_COUNTS_PER_REV 4000   // Counts per revolution after 4x decoding
+#define SHAFT_ENCODER_ON_OUTPUT false       // true = on the output shaft after the gearbox
+#define SHAFT_ENCODER_REVERSED false        // Encoder counts down when the motor steps forward
+#define SHAFT_ENCODER_ERROR_LIMIT 32        // Following error in steps (4 full steps at 1/8)
+#define SHAFT_ENCODER_AUTO_CORRECT false    // Stop on a stall and make the move up
+#define SHAFT_ENCODER_CORRECTION_RPM 2.0f   // Speed of the make-up moves
+
+// Extra independent axes (DRV8825 step/dir/enable, -1 = not fitted)
+#define AUX_AXIS_1_STEP_PIN -1
+#define AUX_AXIS_1_DIR_PIN -1
+#define AUX_AXIS_1_ENABLE_PIN -1
+#define AUX_AXIS_2_STEP_PIN -1
+#define AUX_AXIS_2_DIR_PIN -1
+#define AUX_AXIS_2_ENABLE_PIN -1
+
+// Drive the extra axes from DMA-streamed waveforms on the parallel IO
+// peripheral instead of one timer interrupt per step
+#define AUX_AXES_STEP_STREAM false
+
+// Burst benchmark (AXIS BENCH): ramp time before each rate is measured,
+// measuring time and the acceleration used to change rate
+#define AXIS_BENCH_SETTLE_MS 500
+#define AXIS_BENCH_MEASURE_MS 1000
+#define AXIS_BENCH_ACCELERATION 200000
+
+// Teach-and-replay recording file
+#define PATH_RECORDING_FILE "/path.bin"
+
+// Keyframe file built with TRAJ commands
+#define TRAJECTORY_FILE "/traj.bin"
+
+// Binary telemetry stream (TELEM ON), frame format in TelemetryCodec.h.
+// The budget is about half of the 115200 baud link, the rest is left for
+// command replies.
+#define TELEMETRY_RATE_HZ 500
+#define TELEMETRY_BUDGET_BYTES_PER_SEC 6400
+
+// Settings saved to NVS, blob format in SettingsCodec.h. They are only
+// written with the motor stopped, once unchanged for the save delay or
+// after the longest delay if they keep changing.
+#define SETTINGS_NAMESPACE "motor"
+#define SETTINGS_SAVE_DELAY_MS 3000
+#define SETTINGS_MAX_SAVE_DELAY_MS 60000
+
 // Create the appropriate driver and controller
 #if USE_L298N_DRIVER
     L298NDriver driver(L298N_PIN1, L298N_PIN2, L298N_PIN3, L298N_PIN4, L298N_ENABLE_A, L298N_ENABLE_B);
@@ -90,8 +207,16 @@ float gearRatio = 5.0;                   // Default 5:1 gear ratio
     DRV8825Driver driver(DRV8825_STEP_PIN, DRV8825_DIR_PIN, DRV8825_ENABLE_PIN, 
                          DRV8825_M0_PIN, DRV8825_M1_PIN, DRV8825_M2_PIN,
                          DRV8825_SLEEP_RESET_PIN);
+#elif USE_TMC2209_DRIVER
+    TMC2209Driver driver(TMC2209_STEP_PIN, TMC2209_DIR_PIN, TMC2209_ENABLE_PIN, &Serial1,
+                         TMC2209_UART_RX_PIN, TMC2209_UART_TX_PIN, TMC2209_ADDRESS,
+                         TMC2209_SENSE_RESISTOR);
 #else
-    #error "No driver selected! Set either USE_L298N_DRIVER or USE_DRV8825_DRIVER to 1"
+    #error "No driver selected! Set USE_L298N_DRIVER, USE_DRV8825_DRIVER or USE_TMC2209_DRIVER to 1"
+#endif
+
+#if HOMING_SENSORLESS && !USE_TMC2209_DRIVER
+#error "Sensorless homing needs the TMC2209 driver"
 #endif
 
 //===============================================
@@ -100,6 +225,61 @@ float gearRatio = 5.0;                   // Default 5:1 gear ratio
 // Create the timer-based controller with the selected driver
 TimerStepperControl controller(&driver);
 
+// Sequence program runner that feeds the controller's segment queue
+SequenceEngine sequenceEngine(&controller);
+
+// Counts step/dir pulses from an external controller in follower mode
+StepDirFollower follower(FOLLOWER_STEP_PIN, FOLLOWER_DIR_PIN);
+
+// Teach-and-replay of jogged motion
+PathRecorder pathRecorder(&LittleFS);
+PathPlayer pathPlayer(&LittleFS);
+
+// Position-vs-time keyframe tables
+TrajectoryPlayer trajectoryPlayer(&LittleFS);
+
+// Reference search with the home switch, or with the stall output
+#if HOMING_SENSORLESS
+Homing homing(&controller, TMC2209_DIAG_PIN, false);  // DIAG goes high on a stall
+#else
+Homing homing(&controller, HOME_SWITCH_PIN, HOME_SWITCH_ACTIVE_LOW);
+#endif
+
+// Rotary indexing with N stations per revolution
+Indexer indexer(&controller);
+
+// Back-and-forth agitation around a center position
+Oscillator oscillator;
+bool oscillating = false;
+
+// Checks the step count against the shaft encoder
+ClosedLoopMonitor closedLoop(&controller, SHAFT_ENCODER_A_PIN, SHAFT_ENCODER_B_PIN);
+
+// Fixed-rate motion state frames for tuning
+Telemetry telemetry(&controller, &Serial);
+
+// Operator settings kept across power cycles
+SettingsStore settingsStore(SETTINGS_NAMESPACE);
+
+// Extra axes that move on their own, sharing one timer
+DRV8825Driver auxDriver1(AUX_AXIS_1_STEP_PIN, AUX_AXIS_1_DIR_PIN, AUX_AXIS_1_ENABLE_PIN);
+DRV8825Driver auxDriver2(AUX_AXIS_2_STEP_PIN, AUX_AXIS_2_DIR_PIN, AUX_AXIS_2_ENABLE_PIN);
+StepperAxis auxAxis1(&auxDriver1);
+StepperAxis auxAxis2(&auxDriver2);
+MultiAxisScheduler auxAxes;
+#if AUX_AXES_STEP_STREAM
+StepStream auxStream;
+#endif
+
+// Streamed playback of a recording or keyframe table
+typedef enum {
+    PLAYBACK_IDLE,             // Not playing
+    PLAYBACK_MOVING_TO_START,  // Moving to where the recording starts
+    PLAYBACK_PLAYING           // Following the recording
+} PlaybackState;
+PlaybackState playbackState = PLAYBACK_IDLE;
+SamplePlayer* activePlayer = NULL;
+
 // Motor operation state
 bool motorRunning = false;
 bool continuousMode = false;
@@ -117,6 +297,7 @@ static unsigned long jogModeEntryTime = 0;
 
 // Current settings (these get converted to/from user-friendly units)
 int targetSteps;                         // Target steps to move
+long targetRotationUnits;                // Step mode rotation in exact 0.01% units
 int speedSetting;                        // Current speed in steps/sec
 int accelerationSetting = DEFAULT_ACCELERATION; // Current acceleration in steps/sec²
 
@@ -156,7 +337,13 @@ void on_back_clicked();
 //===============================================
 // MOTOR CONTROL FUNCTIONS
 //===============================================
-void startStepperMotion(int steps, bool clockwise, int speed) {
+// Step mode keeps an exact running total so repeated moves never drift
+static long stepModeOrigin = 0;          // Controller position the total is anchored to
+static int64_t stepModeUnits = 0;        // Commanded rotation since the anchor (0.01% units)
+static long stepModeLastTarget = 0;      // Last absolute target sent
+static int64_t stepModeScale = 0;        // Step scale the anchor was taken with
+
+void startStepperMotion(long rotationUnits, bool clockwise, int speed) {
     // Ensure motor is in a clean state before starting
     if (motorRunning) {
         safelyStopAndResetMotor();
@@ -168,14 +355,27 @@ void startStepperMotion(int steps, bool clockwise, int speed) {
     controller.wake();
     #endif
     
-    // Set direction and steps with inversion flag
+    // Set direction with inversion flag
     bool effectiveDirection = INVERT_STEP_MODE_DIRECTION ? !clockwise : clockwise;
-    int relativeSteps = effectiveDirection ? steps : -steps;
+    
+    // Re-anchor if the motor was moved by anything else or the step scale changed
+    long currentPosition = controller.getCurrentPosition();
+    if (currentPosition != stepModeLastTarget || stepModeScale != getStepsPerRevNumerator()) {
+        stepModeOrigin = currentPosition;
+        stepModeUnits = 0;
+        stepModeScale = getStepsPerRevNumerator();
+    }
+    
+    // Resolve the move to an absolute step target
+    stepModeUnits += effectiveDirection ? rotationUnits : -rotationUnits;
+    long targetPosition = stepModeOrigin + rotationUnitsToSteps(stepModeUnits);
+    long steps = abs(targetPosition - currentPosition);
+    stepModeLastTarget = targetPosition;
     
     // Send command to move
     MotorCommand_t cmd;
-    cmd.cmd_type = CMD_MOVE_STEPS;
-    cmd.position = relativeSteps;
+    cmd.cmd_type = CMD_MOVE_TO;
+    cmd.position = targetPosition;
     cmd.speed = speed;
     cmd.direction = effectiveDirection;
     controller.sendCommand(&cmd);
@@ -352,14 +552,9 @@ void safelyStopAndResetMotor() {
 
 // Helper functions for unit conversions
 int getEffectiveStepsPerRevolution() {
-    #if USE_DRV8825_DRIVER
     // Get current microstepping mode from the driver
-    int microstepMode = driver.getMicrostepMode();
+    int microstepMode = controller.getMicrostepMode();
     return BASE_STEPS_PER_REVOLUTION * microstepMode;
-    #else
-    // For drivers without microstepping, use base steps
-    return BASE_STEPS_PER_REVOLUTION;
-    #endif
 }
 
 float stepsToRPM(int stepsPerSecond, float ratio) {
@@ -391,10 +586,25 @@ int rotationPercentToSteps(float percent, float ratio) {
     return (percent * effectiveSteps * ratio) / 100.0;
 }
 
+// Steps per output revolution as a fraction over GEAR_RATIO_SCALE
+int64_t getStepsPerRevNumerator() {
+    return (int64_t)getEffectiveStepsPerRevolution() * lround(gearRatio * GEAR_RATIO_SCALE);
+}
+
+// Convert an absolute rotation in 0.01% units to the nearest step
+long rotationUnitsToSteps(int64_t units) {
+    return unitsToSteps(units, getStepsPerRevNumerator(), GEAR_RATIO_SCALE);
+}
+
+// Convert a percentage to exact 0.01% units
+long rotationPercentToUnits(float percent) {
+    return lround(percent * 100.0f);
+}
+
 // Function to calculate maximum RPM based on current microstepping
 float getMaxRpmForCurrentMicrostepping() {
-    int microstepMode = driver.getMicrostepMode();
-    float maxStepsPerSec = 4000.0f; // Based on 0.25ms timer
+    int microstepMode = controller.getMicrostepMode();
+    float maxStepsPerSec = 4000.0f * controller.getMaxStepScale(); // 0.25ms timer, times the coarsest automatic mode
     int effectiveStepsPerRev = BASE_STEPS_PER_REVOLUTION * microstepMode * gearRatio;
     
     // Calculate theoretical max based on timer frequency
@@ -421,7 +631,7 @@ typedef struct {
 
 // Initialize with default values
 SequenceData_t sequenceData = {
-    .positions = {0, 25, 50, 75, 100},  // Default position values
+    .positions = DEFAULT_SEQUENCE_POSITIONS,
     .initialDirection = true,           // Default clockwise
     .speedSetting = 0,                  // Will be set from current speed
     .isRunning = false,
@@ -439,8 +649,6 @@ void startSequence();
 
 void stopSequence();
 
-void moveToNextSequencePosition();
-
 void updateSequencePositionLabels();
 
 void onPositionChange() {
@@ -466,49 +674,24 @@ void onPositionChange() {
     }
 }
 
-// Motor control code
-void moveToNextSequencePosition() {
-    // Increment step counter
-    sequenceData.currentStep++;
-    
-    // Check if we've reached the end
-    if (sequenceData.currentStep >= 5) {
-        if (sequenceData.loopSequence) {
-            sequenceData.currentStep = 1; // Loop back to position 1
-        } else {
-            stopSequence();
-            return;
-        }
-    }
-    
-    // Get current and target positions
-    float currentPosition = sequenceData.currentPosition;
-    float targetPosition = sequenceData.positions[sequenceData.currentStep];
+// Signed 0.01% units for one sequence move (clockwise moves are negative)
+long sequenceMoveUnits(long currentUnits, long targetUnits, bool moveClockwise) {
+    // Extract normalized positions (0-99.99%)
+    long currentNormalized = currentUnits % POSITION_UNITS_PER_REV;
+    if (currentNormalized < 0) currentNormalized += POSITION_UNITS_PER_REV;
     
-    // Determine direction (alternating based on step)
-    bool moveClockwise;
-    if (sequenceData.currentStep % 2 == 1) {
-        moveClockwise = sequenceData.initialDirection;
-    } else {
-        moveClockwise = !sequenceData.initialDirection;
-    }
-    
-    // Extract normalized positions (0-99%)
-    float currentNormalized = fmod(currentPosition, 100.0);
-    if (currentNormalized < 0) currentNormalized += 100.0;
-    
-    float targetNormalized = fmod(targetPosition, 100.0);
-    if (targetNormalized < 0) targetNormalized += 100.0;
+    long targetNormalized = targetUnits % POSITION_UNITS_PER_REV;
+    if (targetNormalized < 0) targetNormalized += POSITION_UNITS_PER_REV;
     
     // Calculate the angular movement needed
-    float angularMovement = 0;
+    long angularMovement = 0;
     
     // For clockwise movement
     if (moveClockwise) {
         if (targetNormalized >= currentNormalized) {
             angularMovement = targetNormalized - currentNormalized;
         } else {
-            angularMovement = (100.0 - currentNormalized) + targetNormalized;
+            angularMovement = (POSITION_UNITS_PER_REV - currentNormalized) + targetNormalized;
         }
     } 
     // For counter-clockwise movement
@@ -516,40 +699,74 @@ void moveToNextSequencePosition() {
         if (targetNormalized <= currentNormalized) {
             angularMovement = currentNormalized - targetNormalized;
         } else {
-            angularMovement = currentNormalized + (100.0 - targetNormalized);
+            angularMovement = currentNormalized + (POSITION_UNITS_PER_REV - targetNormalized);
         }
     }
     
-    // Extract rotation counts
-    int targetRotations = floor(targetPosition / 100.0);
-    float rotationMovement = targetRotations * 100.0;
+    // Add the target's full rotations
+    long rotationMovement = floorDiv(targetUnits, POSITION_UNITS_PER_REV) * POSITION_UNITS_PER_REV;
+    long totalMovement = angularMovement + rotationMovement;
+    
+    return moveClockwise ? -totalMovement : totalMovement;
+}
+
+// Add moves for positions 1-4 starting from the given position. Targets are
+// absolute units from the program start so every pass lands on the same steps.
+long addSequencePassToProgram(long currentUnits, int64_t* absoluteUnits) {
+    for (int step = 1; step < 5; step++) {
+        long targetUnits = rotationPercentToUnits(sequenceData.positions[step]);
+        
+        // Determine direction (alternating based on step)
+        bool moveClockwise = (step % 2 == 1) ? sequenceData.initialDirection : !sequenceData.initialDirection;
+        
+        long units = sequenceMoveUnits(currentUnits, targetUnits, moveClockwise);
+        if (units != 0) {
+            *absoluteUnits += units;
+            sequenceEngine.addInstruction(SEQ_OP_MOVE_TO, *absoluteUnits);
+        }
+        currentUnits = targetUnits;
+    }
+    return currentUnits;
+}
+
+// Build a sequence program from the five UI positions
+void buildSequenceProgram() {
+    sequenceEngine.clearProgram();
+    sequenceEngine.setUnitScale(getStepsPerRevNumerator(), GEAR_RATIO_SCALE * POSITION_UNITS_PER_REV);
+    sequenceEngine.addInstruction(SEQ_OP_SPEED, sequenceData.speedSetting);
     
-    // Calculate total movement
-    float totalMovement = angularMovement + rotationMovement;
+    // First pass starts from position 0
+    int64_t absoluteUnits = 0;
+    long position = addSequencePassToProgram(rotationPercentToUnits(sequenceData.positions[0]), &absoluteUnits);
     
-    // Skip if no movement needed
-    if (totalMovement < 0.1) {
-        Serial.println("Already at target position - no movement needed");
-        return;
+    // Looping sequences go back to position 1 after position 4
+    if (sequenceData.loopSequence) {
+        sequenceEngine.addInstruction(SEQ_OP_LOOP, 0);
+        position = addSequencePassToProgram(position, &absoluteUnits);
+        sequenceEngine.addInstruction(SEQ_OP_END_LOOP);
     }
     
-    // Calculate steps
-    int stepsToMove = rotationPercentToSteps(totalMovement, gearRatio);
+    sequenceData.currentPosition = position / 100.0f;
+}
+
+// Compile and start whatever program is loaded in the sequence engine
+bool runSequenceProgram() {
+    if (!sequenceEngine.compile(controller.getCurrentPosition(), speedSetting, accelerationSetting)) {
+        return false;
+    }
     
-    // Execute movement
-    MotorCommand_t cmd;
-    cmd.cmd_type = CMD_MOVE_STEPS;
-    cmd.position = moveClockwise ? -stepsToMove : stepsToMove;
-    cmd.speed = sequenceData.speedSetting;
-    controller.sendCommand(&cmd);
+    #if USE_DRV8825_DRIVER
+    controller.wake();
+    #endif
     
-    // Update current position
-    sequenceData.currentPosition = targetPosition;
+    if (!sequenceEngine.start()) {
+        return false;
+    }
     
-    Serial.print("Moving ");
-    Serial.print(totalMovement);
-    Serial.print("% ");
-    Serial.println(moveClockwise ? "CW" : "CCW");
+    sequenceData.isRunning = true;
+    motorRunning = true;
+    lastMotorActivityTime = millis();
+    return true;
 }
 
 void startSequence() {
@@ -559,26 +776,156 @@ void startSequence() {
     }
     
     // Initialize sequence
-    sequenceData.isRunning = true;
     sequenceData.currentStep = 0;  // Start with current step as 0
     sequenceData.speedSetting = speedSetting;
-    sequenceData.currentPosition = sequenceData.positions[0];  // Start at position 0's value
-    motorRunning = true;
     
-    // Move to the first position in the sequence
-    moveToNextSequencePosition();
+    // Compile the UI positions and run them as one chained program
+    buildSequenceProgram();
+    if (!runSequenceProgram()) {
+        Serial.println("Sequence has no moves");
+    }
     
     update_ui_labels();
 }
 
 // Stop sequence execution
 void stopSequence() {
+    sequenceEngine.stop();
     sequenceData.isRunning = false;
     motorRunning = false;
     stopMotor();
     update_ui_labels();
 }
 
+// Full screen notice while an emergency stop is latched
+static lv_obj_t* estopOverlay = NULL;
+static lv_obj_t* estopOverlayLabel = NULL;
+
+// Put every mode back to idle after the motor was stopped from outside
+// them (emergency stop or a stall stop), nothing here needs to stop it
+void abandonMotion() {
+    if (sequenceData.isRunning) {
+        sequenceEngine.stop();
+        sequenceData.isRunning = false;
+    }
+    if (playbackState != PLAYBACK_IDLE) {
+        playbackState = PLAYBACK_IDLE;
+        activePlayer->close();
+    }
+    homing.abort();
+    oscillating = false;
+    
+    motorRunning = false;
+    continuousMode = false;
+    encoderJogMode = false;
+    isFirstJogCheck = true;
+}
+
+// Stop the extra axes with the main motor, called from the e-stop interrupt
+void IRAM_ATTR stopAuxAxes(void* arg) {
+#if AUX_AXES_STEP_STREAM
+    auxStream.emergencyStop();
+#endif
+    auxAxes.emergencyStop();
+}
+
+// Show the e-stop overlay and clear the fault with the encoder button.
+// Returns true while the fault is latched.
+bool serviceEmergencyStop() {
+    if (!controller.isFaulted()) return false;
+    
+    if (estopOverlay == NULL) {
+        // Also covers an input that was already pressed at start-up
+        stopAuxAxes(NULL);
+        abandonMotion();
+        update_ui_labels();
+        Serial.println("EMERGENCY STOP");
+        
+        estopOverlay = lv_obj_create(lv_layer_top());
+        lv_obj_set_size(estopOverlay, LV_PCT(100), LV_PCT(100));
+        lv_obj_set_style_bg_color(estopOverlay, lv_color_hex(0xCC0000), LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_obj_set_style_bg_opa(estopOverlay, 230, LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_obj_set_style_border_width(estopOverlay, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_obj_set_style_radius(estopOverlay, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
+        
+        estopOverlayLabel = lv_label_create(estopOverlay);
+        lv_obj_set_style_text_color(estopOverlayLabel, lv_color_hex(0xFFFFFF), LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_obj_set_style_text_align(estopOverlayLabel, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_label_set_text(estopOverlayLabel, "EMERGENCY STOP\n\nRelease the e-stop,\nthen press to clear");
+        lv_obj_center(estopOverlayLabel);
+    }
+    
+    // Clearing has to be a deliberate press
+    if (buttonPressed) {
+        buttonPressed = false;
+        if (controller.clearFault()) {
+#if AUX_AXES_STEP_STREAM
+            auxStream.clearFault();
+#endif
+            auxAxes.clearFault();
+            lv_obj_del(estopOverlay);
+            estopOverlay = NULL;
+            estopOverlayLabel = NULL;
+            Serial.println("Emergency stop cleared");
+            update_ui_labels();
+            return false;
+        }
+        lv_label_set_text(estopOverlayLabel, "EMERGENCY STOP\n\nStill active,\nrelease it first");
+    }
+    return true;
+}
+
+// Live position and speed readout under the buttons of each motion page
+#define LIVE_READOUT_PAGES 4
+static lv_obj_t* liveReadouts[LIVE_READOUT_PAGES] = { NULL };
+static unsigned long lastLiveReadoutUpdate = 0;
+
+void createLiveReadouts() {
+    lv_obj_t* pages[LIVE_READOUT_PAGES] = {
+        objects.move_steps_page,
+        objects.manual_jog_page,
+        objects.continuous_rotation_page,
+        objects.sequence_page
+    };
+    
+    for (int i = 0; i < LIVE_READOUT_PAGES; i++) {
+        liveReadouts[i] = lv_label_create(pages[i]);
+        lv_obj_set_pos(liveReadouts[i], 21, 204);
+        lv_obj_set_width(liveReadouts[i], 130);
+        lv_obj_set_style_text_align(liveReadouts[i], LV_TEXT_ALIGN_CENTER, LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_label_set_text(liveReadouts[i], "");
+    }
+}
+
+// Refresh the readout on the page being shown from the controller's
+// snapshot, at most every LIVE_READOUT_INTERVAL_MS and only if it changed
+void updateLiveReadout(unsigned long currentMillis) {
+    if (currentMillis - lastLiveReadoutUpdate < LIVE_READOUT_INTERVAL_MS) return;
+    lastLiveReadoutUpdate = currentMillis;
+    
+    lv_obj_t* screen = lv_scr_act();
+    lv_obj_t* readout = NULL;
+    for (int i = 0; i < LIVE_READOUT_PAGES; i++) {
+        if (liveReadouts[i] != NULL && lv_obj_get_parent(liveReadouts[i]) == screen) {
+            readout = liveReadouts[i];
+        }
+    }
+    if (readout == NULL) return;
+    
+    MotionSnapshot_t snapshot;
+    controller.getSnapshot(&snapshot);
+    
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "Pos: %.1f%%\n%.1f RPM",
+             stepsToRotationPercent(snapshot.position, gearRatio),
+             stepsToRPM(lroundf(snapshot.velocity), gearRatio));
+    
+    // Setting the same text still redraws the label
+    if (strcmp(buffer, lv_label_get_text(readout)) != 0) {
+        lv_label_set_text(readout, buffer);
+    }
+}
+
 // Update the display of sequence position values
 void updateSequencePositionLabels() {
     lv_obj_t *posButtons[5] = {
@@ -641,7 +988,7 @@ void adjustValueByEncoder(lv_obj_t* obj, int delta) {
     // Check which value is being adjusted and modify accordingly
     if (obj == objects.step_num) {
         // Work with percentage of rotation instead of steps
-        float currentPercent = stepsToRotationPercent(targetSteps, gearRatio);
+        float currentPercent = targetRotationUnits / 100.0f;
         currentPercent += rotationDelta;
         
         // Apply bounds
@@ -651,8 +998,9 @@ void adjustValueByEncoder(lv_obj_t* obj, int delta) {
             currentPercent = MAX_ROTATION_PERCENT;
         }
         
-        // Convert back to steps
-        targetSteps = rotationPercentToSteps(currentPercent, gearRatio);
+        // Keep the exact rotation and convert to steps
+        targetRotationUnits = rotationPercentToUnits(currentPercent);
+        targetSteps = rotationUnitsToSteps(targetRotationUnits);
         
         // Update the label
         char buffer[20];
@@ -670,6 +1018,21 @@ void adjustValueByEncoder(lv_obj_t* obj, int delta) {
         else if (obj == objects.speed || obj == objects.speed_manual_jog || 
             obj == objects.continuous_rotation_speed_button ||
             obj == objects.sequence_speed_button) {
+            // While a move or sequence runs the encoder trims the feed
+            // override instead, the running move eases into the new pace
+            if (motorRunning && !continuousMode) {
+                int feedDelta = delta * (fineAdjustmentMode ? FEED_FINE_ADJUST : FEED_COARSE_ADJUST);
+                controller.setFeedOverride(controller.getFeedOverride() + feedDelta);
+                
+                char buffer[20];
+                snprintf(buffer, sizeof(buffer), "Feed: %d%%", controller.getFeedOverride());
+                lv_obj_t *label = lv_obj_get_child(obj, 0);
+                if (label) {
+                    lv_label_set_text(label, buffer);
+                }
+                return;
+            }
+            
             // Work with RPM instead of steps/second
             float currentRPM = stepsToRPM(speedSetting, gearRatio);
 
@@ -726,9 +1089,8 @@ void adjustValueByEncoder(lv_obj_t* obj, int delta) {
 
     // Microstepping adjustment
     else if (obj == objects.microstepping_button) {
-        #if USE_DRV8825_DRIVER
         // Get current microstepping mode
-        int currentMode = driver.getMicrostepMode();
+        int currentMode = controller.getMicrostepMode();
         int newMode = currentMode;
         
         // For microstepping, we just want to cycle through modes on each significant encoder change
@@ -768,7 +1130,7 @@ void adjustValueByEncoder(lv_obj_t* obj, int delta) {
         
         // Only update if we're actually changing the mode
         if (newMode != currentMode) {
-            driver.setMicrostepMode(newMode);
+            controller.setMicrostepMode(newMode);
             
             // Update the label
             char buffer[20];
@@ -781,7 +1143,6 @@ void adjustValueByEncoder(lv_obj_t* obj, int delta) {
             Serial.print("Microstepping adjusted to 1/");
             Serial.println(newMode);
         }
-        #endif
     }
     
     // Check if we're adjusting a sequence position
@@ -1104,40 +1465,40 @@ void update_ui_labels() {
     lv_obj_t *steps_label = lv_obj_get_child(objects.step_num, 0);
     if (steps_label) {
         char buffer[20];
-        float percentRotation = stepsToRotationPercent(targetSteps, gearRatio);
+        float percentRotation = targetRotationUnits / 100.0f;
         snprintf(buffer, sizeof(buffer), "Rot: %.1f%%", percentRotation);
         lv_label_set_text(steps_label, buffer);
     }
     
-    // Calculate RPM from current speed setting
+    // Calculate RPM from current speed setting. While a run is trimmed the
+    // speed buttons show the feed override instead, the RPM is not what
+    // the motor is doing.
     float rpm = stepsToRPM(speedSetting, gearRatio);
+    char speedText[20];
+    if (motorRunning && controller.getFeedOverride() != 100) {
+        snprintf(speedText, sizeof(speedText), "Feed: %d%%", controller.getFeedOverride());
+    } else {
+        snprintf(speedText, sizeof(speedText), "Speed: %.1f RPM", rpm);
+    }
     
     lv_obj_t *speed_label = lv_obj_get_child(objects.speed, 0);
     if (speed_label) {
-        char buffer[20];
-        snprintf(buffer, sizeof(buffer), "Speed: %.1f RPM", rpm);
-        lv_label_set_text(speed_label, buffer);
+        lv_label_set_text(speed_label, speedText);
     }
     
     lv_obj_t *speed_manual_label = lv_obj_get_child(objects.speed_manual_jog, 0);
     if (speed_manual_label) {
-        char buffer[20];
-        snprintf(buffer, sizeof(buffer), "Speed: %.1f RPM", rpm);
-        lv_label_set_text(speed_manual_label, buffer);
+        lv_label_set_text(speed_manual_label, speedText);
     }
     
     lv_obj_t *speed_cont_label = lv_obj_get_child(objects.continuous_rotation_speed_button, 0);
     if (speed_cont_label) {
-        char buffer[20];
-        snprintf(buffer, sizeof(buffer), "Speed: %.1f RPM", rpm);
-        lv_label_set_text(speed_cont_label, buffer);
+        lv_label_set_text(speed_cont_label, speedText);
     }
     
     lv_obj_t *seq_speed_label = lv_obj_get_child(objects.sequence_speed_button, 0);
     if (seq_speed_label) {
-        char buffer[20];
-        snprintf(buffer, sizeof(buffer), "Speed: %.1f RPM", rpm);
-        lv_label_set_text(seq_speed_label, buffer);
+        lv_label_set_text(seq_speed_label, speedText);
     }
 
     lv_obj_t *start_label = lv_obj_get_child(objects.start, 0);
@@ -1203,15 +1564,13 @@ void update_ui_labels() {
         }
     }
 
-    #if USE_DRV8825_DRIVER
     lv_obj_t *microstepping_label = lv_obj_get_child(objects.microstepping_button, 0);
     if (microstepping_label) {
-        int currentMode = driver.getMicrostepMode();
+        int currentMode = controller.getMicrostepMode();
         char buffer[20];
         snprintf(buffer, sizeof(buffer), "Microstep: 1/%d", currentMode);
         lv_label_set_text(microstepping_label, buffer);
     }
-    #endif
 
     // Update sequence direction button
     lv_obj_t *seq_dir_label = lv_obj_get_child(objects.sequence_direction_button, 0);
@@ -1238,11 +1597,10 @@ void on_back_clicked() {
         // Recalculate speed and steps based on current user-friendly values
         // This accounts for microstepping changes
         float currentRPM = stepsToRPM(speedSetting, gearRatio);
-        float currentRotationPercent = stepsToRotationPercent(targetSteps, gearRatio);
         
         // Update internal values with new microstepping factor
         speedSetting = safeRoundStepsPerSec(rpmToSteps(currentRPM, gearRatio));
-        targetSteps = rotationPercentToSteps(currentRotationPercent, gearRatio);
+        targetSteps = rotationUnitsToSteps(targetRotationUnits);
         
         // Update UI to reflect potentially changed values
         update_ui_labels();
@@ -1260,7 +1618,7 @@ void on_move_steps_start_clicked() {
         safelyStopAndResetMotor();
         delay(25); // Small delay to ensure reset is complete
         
-        startStepperMotion(targetSteps, clockwiseDirection, speedSetting);
+        startStepperMotion(targetRotationUnits, clockwiseDirection, speedSetting);
     }
 }
 
@@ -1292,6 +1650,7 @@ void on_move_steps_steps_clicked() {
     } else {
         targetSteps *= 2;
     }
+    targetRotationUnits = rotationPercentToUnits(stepsToRotationPercent(targetSteps, gearRatio));
     update_ui_labels();
     Serial.print("Steps set to: ");
     Serial.println(targetSteps);
@@ -1557,10 +1916,8 @@ void on_settings_acceleration_clicked() {
 }
 
 void update_microstepping_label() {
-    // Only applicable for DRV8825 driver
-    #if USE_DRV8825_DRIVER
     // Get current microstepping mode
-    int currentMode = driver.getMicrostepMode();
+    int currentMode = controller.getMicrostepMode();
     
     // Update the label on the microstepping button
     lv_obj_t *microstepping_label = lv_obj_get_child(objects.microstepping_button, 0);
@@ -1569,15 +1926,13 @@ void update_microstepping_label() {
         snprintf(buffer, sizeof(buffer), "Microstep: 1/%d", currentMode);
         lv_label_set_text(microstepping_label, buffer);
     }
-    #endif
 }
 
 void on_settings_microstepping_clicked() {
     // The actual adjustment is now handled through the encoder in value adjustment mode
     // This is just needed for direct button click handling if not using the encoder
-    #if USE_DRV8825_DRIVER
     if (!valueAdjustmentMode) {  // Only act on direct click if not in adjustment mode
-        int currentMode = driver.getMicrostepMode();
+        int currentMode = controller.getMicrostepMode();
         int newMode;
         
         // Cycle through microstepping modes
@@ -1590,103 +1945,1602 @@ void on_settings_microstepping_clicked() {
             case 32: default: newMode = DEFAULT_MICROSTEP_MODE; break;
         }
         
-        driver.setMicrostepMode(newMode);
+        controller.setMicrostepMode(newMode);
         update_ui_labels();
     }
-    #endif
 }
 
 //===============================================
-// SETUP & LOOP
+// SETTINGS PERSISTENCE
 //===============================================
-void setup() {
-    // Initialize serial communication
-    Serial.begin(115200);
+// Settings as they are at first boot, at the current microstep mode
+void defaultSettings(StoredSettings_t* settings) {
+    const float positions[SETTINGS_SEQUENCE_POSITIONS] = DEFAULT_SEQUENCE_POSITIONS;
     
-    // Initialize the display and UI
-    LCD_Init();
-    Set_Backlight(50); // Set LCD backlight to 50%
-    Lvgl_Init();
-    ui_init();
-    update_ui_labels();
-
-    // Attach event handlers to UI elements
-    attach_event_handlers();
+    settings->microstepMode = DEFAULT_MICROSTEP_MODE;
+    settings->speed = safeRoundStepsPerSec(rpmToSteps(DEFAULT_RPM, gearRatio));
+    settings->rotationUnits = rotationPercentToUnits(DEFAULT_ROTATION_PERCENT);
+    settings->acceleration = DEFAULT_ACCELERATION;
+    for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+        settings->sequencePositions[i] = rotationPercentToUnits(positions[i]);
+    }
+}
 
-    // Initialize the rotary encoder
-    setupEncoder();
+// The settings as they stand
+void captureSettings(StoredSettings_t* settings) {
+    settings->microstepMode = (uint8_t)controller.getMicrostepMode();
+    settings->speed = speedSetting;
+    settings->rotationUnits = targetRotationUnits;
+    settings->acceleration = accelerationSetting;
+    for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+        settings->sequencePositions[i] = rotationPercentToUnits(sequenceData.positions[i]);
+    }
+}
 
-    // Initialize our timer-based motor controller
-    controller.init();
+// Put settings into effect, anything out of range falls back to its
+// default or the nearest limit
+void applySettings(const StoredSettings_t* settings) {
+    int mode = settings->microstepMode;
+    if (mode != 1 && mode != 2 && mode != 4 && mode != 8 && mode != 16 && mode != 32) {
+        mode = DEFAULT_MICROSTEP_MODE;
+    }
+    if (mode != controller.getMicrostepMode()) {
+        controller.setMicrostepMode(mode);
+    }
     
-    // Set microstepping mode for DRV8825 if used
-    #if USE_DRV8825_DRIVER
-    driver.setMicrostepMode(DEFAULT_MICROSTEP_MODE);
-    // Explicitly wake the driver
-    controller.wake();
-    #endif
+    // Speed is in steps/sec at the microstep mode set above
+    int minSpeed = safeRoundStepsPerSec(rpmToSteps(MIN_RPM, gearRatio));
+    int maxSpeed = safeRoundStepsPerSec(rpmToSteps(getMaxRpmForCurrentMicrostepping(), gearRatio));
+    speedSetting = settings->speed > 0 ? constrain((int)settings->speed, minSpeed, maxSpeed)
+                                       : safeRoundStepsPerSec(rpmToSteps(DEFAULT_RPM, gearRatio));
+    
+    targetRotationUnits = constrain((long)settings->rotationUnits,
+                                    rotationPercentToUnits(MIN_ROTATION_PERCENT),
+                                    rotationPercentToUnits(MAX_ROTATION_PERCENT));
+    targetSteps = rotationUnitsToSteps(targetRotationUnits);
+    
+    accelerationSetting = constrain((int)settings->acceleration, ACCEL_MIN, ACCEL_MAX);
+    
+    for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+        // Same limits as the knob, up to 36 rotations
+        sequenceData.positions[i] = constrain((long)settings->sequencePositions[i], 0L, 360000L) / 100.0f;
+    }
+}
 
-    // Convert RPM to steps/sec for initial values
-    speedSetting = safeRoundStepsPerSec(rpmToSteps(DEFAULT_RPM, gearRatio));
-    targetSteps = rotationPercentToSteps(DEFAULT_ROTATION_PERCENT, gearRatio);
+// Note the settings every loop, the store decides when to write them
+void serviceSettings(unsigned long currentMillis) {
+    StoredSettings_t settings;
+    captureSettings(&settings);
+    settingsStore.update(&settings, currentMillis, !motorRunning && !controller.isRunning());
+}
 
-    // Set acceleration
-    MotorCommand_t cmd;
-    cmd.cmd_type = CMD_SET_ACCELERATION;
-    cmd.acceleration = accelerationSetting;
-    controller.sendCommand(&cmd);
-    
-    Serial.println("System ready!");
+//===============================================
+// POSITION CHECKPOINT
+//===============================================
+// Say what became of the checkpoint from before the reset
+void reportCheckpointRestore(CheckpointRestore result, const PositionCheckpoint_t* checkpoint) {
+    switch (result) {
+        case CHECKPOINT_RESTORED:
+            homing.restoreHomed();
+            Serial.printf("Position %ld restored from checkpoint %lu%s\n", controller.getCurrentPosition(),
+                          (unsigned long)checkpoint->count, homing.isHomed() ? ", still homed" : "");
+            break;
+        case CHECKPOINT_MOVING:
+            Serial.print("Reset during a move");
+            if (checkpoint->segmentsStarted > 0) {
+                Serial.printf(" (sequence move %lu)", (unsigned long)checkpoint->segmentsStarted);
+            }
+            Serial.println(", position lost");
+            break;
+        case CHECKPOINT_HOLDING:
+            Serial.println("Reset while holding position, position lost");
+            break;
+        case CHECKPOINT_RESOLUTION:
+            Serial.printf("Checkpoint was taken at 1/%d microstepping, position lost\n", checkpoint->microstepMode);
+            break;
+        default:
+            // Power-on, nothing to restore
+            break;
+    }
 }
 
-void loop() {
-    // Current time tracking
-    unsigned long currentMillis = millis();
+//===============================================
+// SERIAL COMMANDS
+//===============================================
+#define SERIAL_COMMAND_BUFFER_SIZE 256 // Long enough for a TRIG AT position list
+
+// Handle a "SEQ ..." command for building and running sequence programs
+void handleSequenceCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+    char* value = strtok(NULL, " ");
+    long operand = value ? atol(value) : 0;
+    
+    if (op == NULL) {
+        Serial.println("SEQ commands: CLEAR, MOVE, MOVETO, SPEED, ACCEL, DWELL, LOOP, ENDLOOP, RUN, STOP");
+    } else if (strcasecmp(op, "CLEAR") == 0) {
+        sequenceEngine.clearProgram();
+    } else if (strcasecmp(op, "MOVE") == 0) {
+        sequenceEngine.addInstruction(SEQ_OP_MOVE_BY, operand);
+    } else if (strcasecmp(op, "MOVETO") == 0) {
+        sequenceEngine.addInstruction(SEQ_OP_MOVE_TO, operand);
+    } else if (strcasecmp(op, "SPEED") == 0) {
+        sequenceEngine.addInstruction(SEQ_OP_SPEED, operand);
+    } else if (strcasecmp(op, "ACCEL") == 0) {
+        sequenceEngine.addInstruction(SEQ_OP_ACCEL, operand);
+    } else if (strcasecmp(op, "DWELL") == 0) {
+        sequenceEngine.addInstruction(SEQ_OP_DWELL, operand);
+    } else if (strcasecmp(op, "LOOP") == 0) {
+        sequenceEngine.addInstruction(SEQ_OP_LOOP, operand);
+    } else if (strcasecmp(op, "ENDLOOP") == 0) {
+        sequenceEngine.addInstruction(SEQ_OP_END_LOOP);
+    } else if (strcasecmp(op, "RUN") == 0) {
+        if (motorRunning) {
+            safelyStopAndResetMotor();
+        }
+        if (runSequenceProgram()) {
+            update_ui_labels();
+        }
+    } else if (strcasecmp(op, "STOP") == 0) {
+        stopSequence();
+    } else {
+        Serial.print("Unknown SEQ command: ");
+        Serial.println(op);
+    }
+}
+
+// Print the input shaper impulses and its predicted residual vibration
+void printInputShaper(float frequencyHz, float damping) {
+    const ShaperImpulses_t* impulses = controller.getShaperImpulses();
+    
+    Serial.print("Shaper ");
+    Serial.print(shaperName(controller.getInputShaper()));
+    Serial.print(":");
+    for (int i = 0; i < impulses->count; i++) {
+        Serial.print(" ");
+        Serial.print(impulses->amplitudes[i], 3);
+        Serial.print("@");
+        Serial.print(impulses->times[i] * 1000.0f, 2);
+        Serial.print("ms");
+    }
+    Serial.println();
+    
+    // Sweep around the given resonance to show how forgiving the shaper is
+    for (int percent = 50; percent <= 150; percent += 10) {
+        float frequency = frequencyHz * percent / 100.0f;
+        Serial.print("  ");
+        Serial.print(frequency, 2);
+        Serial.print(" Hz: ");
+        Serial.print(shaperResidualVibration(impulses, frequency, damping) * 100.0f, 1);
+        Serial.println("% residual vibration");
+    }
+}
+
+// Handle a "SHAPER ..." command. "SHAPER <ZV|ZVD|EI|OFF> <Hz> <damping>"
+// configures the shaper, "SHAPER TEST <Hz> <damping>" predicts the residual
+// vibration around a measured resonance.
+void handleShaperCommand(char* args) {
+    static float shaperFrequency = INPUT_SHAPER_FREQUENCY;
+    static float shaperDamping = INPUT_SHAPER_DAMPING;
+    
+    char* op = args ? strtok(args, " ") : NULL;
+    char* frequencyArg = strtok(NULL, " ");
+    char* dampingArg = strtok(NULL, " ");
+    float frequency = frequencyArg ? atof(frequencyArg) : shaperFrequency;
+    float damping = dampingArg ? atof(dampingArg) : shaperDamping;
+    
+    if (op == NULL || strcasecmp(op, "TEST") == 0) {
+        printInputShaper(frequency, damping);
+        return;
+    }
     
-    // Handle UI updates
-    Timer_Loop();
-    ui_tick();
+    ShaperType type;
+    if (strcasecmp(op, "ZV") == 0) {
+        type = SHAPER_ZV;
+    } else if (strcasecmp(op, "ZVD") == 0) {
+        type = SHAPER_ZVD;
+    } else if (strcasecmp(op, "EI") == 0) {
+        type = SHAPER_EI;
+    } else if (strcasecmp(op, "OFF") == 0) {
+        type = SHAPER_NONE;
+    } else {
+        Serial.print("Unknown SHAPER command: ");
+        Serial.println(op);
+        return;
+    }
     
-    // Handle encoder input (includes UI navigation and value adjustment)
-    handleEncoder();
+    if (controller.isRunning()) {
+        Serial.println("Stop the motor before changing the shaper");
+        return;
+    }
     
-    // Check if a long press was detected for toggling fine/coarse adjustment
-    if (longPressDetected) {
-        longPressDetected = false;
-        
-        // Only toggle if in value adjustment mode
-        if (valueAdjustmentMode) {
-            toggleAdjustmentPrecision();
-        }
+    if (controller.setInputShaper(type, frequency, damping)) {
+        shaperFrequency = frequency;
+        shaperDamping = damping;
+        printInputShaper(frequency, damping);
     }
+}
+
+// Handle a "TRIG ..." command for position triggers (positions in steps)
+void handleTriggerCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
     
-    if (motorRunning && encoderJogMode) {
-        checkEncoderJogMode();
+    if (op == NULL) {
+        Serial.print("Triggers fired: ");
+        Serial.println(controller.getTriggerCount());
+        return;
+    }
+    
+    if (controller.isRunning() && strcasecmp(op, "CLEAR") != 0) {
+        Serial.println("Stop the motor before changing triggers");
+        return;
+    }
+    
+    if (strcasecmp(op, "PIN") == 0) {
+        char* pinArg = strtok(NULL, " ");
+        char* widthArg = strtok(NULL, " ");
+        int pin = pinArg ? atoi(pinArg) : TRIGGER_OUTPUT_PIN;
+        uint32_t width = widthArg ? atol(widthArg) : TRIGGER_PULSE_WIDTH_US;
+        controller.setTriggerOutput(pin, width);
+    } else if (strcasecmp(op, "AT") == 0) {
+        long positions[TRIGGER_MAX_POSITIONS];
+        int count = 0;
+        char* value;
+        while ((value = strtok(NULL, " ")) != NULL && count < TRIGGER_MAX_POSITIONS) {
+            positions[count++] = atol(value);
+        }
+        controller.setTriggerPositions(positions, count);
+    } else if (strcasecmp(op, "EVERY") == 0) {
+        char* startArg = strtok(NULL, " ");
+        char* intervalArg = strtok(NULL, " ");
+        char* countArg = strtok(NULL, " ");
+        if (!startArg || !intervalArg) {
+            Serial.println("Usage: TRIG EVERY <start> <interval> [count]");
+            return;
+        }
+        if (!controller.setTriggerInterval(atol(startArg), atol(intervalArg), countArg ? atol(countArg) : 0)) {
+            Serial.println("Invalid trigger interval");
+        }
+    } else if (strcasecmp(op, "CLEAR") == 0) {
+        controller.clearTriggers();
+    } else {
+        Serial.print("Unknown TRIG command: ");
+        Serial.println(op);
     }
+}
 
-    // Check if sequence is running and motor has stopped (completed a step)
-    if (sequenceData.isRunning && !controller.isRunning() && 
-        sequenceData.currentStep > 0 && sequenceData.currentStep < 5) {
-        // Short delay to ensure the motor is really stopped
-        delay(50);
-        moveToNextSequencePosition();
+// Slave the motor to the step/dir inputs, scaled by numerator / denominator
+bool startFollowing(long numerator, long denominator) {
+    if (!follower.begin()) return false;
+    if (!follower.setScale(numerator, denominator)) {
+        Serial.println("Invalid follower scale");
+        return false;
     }
     
-    // Check for motor idle timeout - automatic shutdown after inactivity
-    if (enableMotorPowerSave && motorRunning && 
-        !encoderJogMode && !continuousMode && 
-        controller.isRunning() == false &&
-        currentMillis - lastMotorActivityTime > MOTOR_IDLE_TIMEOUT_MS) {
-        // Motor has been idle too long, disable it
-        motorRunning = false;
-        controller.sleep();
-        update_ui_labels();
+    if (motorRunning) {
+        safelyStopAndResetMotor();
+    }
+    
+    #if USE_DRV8825_DRIVER
+    controller.wake();
+    #endif
+    
+    // Start following from where the motor is now
+    follower.anchor(controller.getCurrentPosition());
+    controller.setTrackingSource(&follower);
+    
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_START_TRACKING;
+    cmd.speed = speedSetting;
+    cmd.acceleration = accelerationSetting;
+    if (!controller.sendCommand(&cmd)) return false;
+    
+    motorRunning = true;
+    lastMotorActivityTime = millis();
+    return true;
+}
+
+// Handle a "FOLLOW ..." command: "FOLLOW ON [num] [den]", "FOLLOW OFF" or
+// "FOLLOW" for the input count and following error
+void handleFollowCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+    
+    if (op == NULL) {
+        Serial.print("Follower input: ");
+        Serial.print((long)follower.getInputCount());
+        Serial.print(" pulses, target: ");
+        Serial.print(follower.getTrackingTarget());
+        Serial.print(", position: ");
+        Serial.println(controller.getCurrentPosition());
+    } else if (strcasecmp(op, "ON") == 0) {
+        char* numeratorArg = strtok(NULL, " ");
+        char* denominatorArg = strtok(NULL, " ");
+        long numerator = numeratorArg ? atol(numeratorArg) : follower.getScaleNumerator();
+        long denominator = denominatorArg ? atol(denominatorArg) : follower.getScaleDenominator();
+        if (startFollowing(numerator, denominator)) {
+            Serial.println("Following step/dir input");
+            update_ui_labels();
+        }
+    } else if (strcasecmp(op, "OFF") == 0) {
+        if (controller.isTracking()) {
+            stopMotor();
+        }
+    } else {
+        Serial.print("Unknown FOLLOW command: ");
+        Serial.println(op);
     }
+}
 
-    // Poll for motor status updates (completed movements)
-    if (motorRunning && !encoderJogMode && !controller.isRunning()) {
-        motorRunning = false;
-        Serial.println("Motor stopped (reached target)");
+// Start a homing cycle with speeds and distances for the current microstepping
+bool startHoming() {
+    if (motorRunning) {
+        safelyStopAndResetMotor();
+    }
+    
+    #if USE_DRV8825_DRIVER
+    controller.wake();
+    #endif
+    
+    bool toward = INVERT_STEP_MODE_DIRECTION ? !HOMING_TOWARD_CLOCKWISE : HOMING_TOWARD_CLOCKWISE;
+    homing.setDirection(toward);
+    homing.setSpeeds(safeRoundStepsPerSec(rpmToSteps(HOMING_SEEK_RPM, gearRatio)),
+                     safeRoundStepsPerSec(rpmToSteps(HOMING_APPROACH_RPM, gearRatio)));
+    homing.setDistances(rotationUnitsToSteps(rotationPercentToUnits(HOMING_BACKOFF_PERCENT)),
+                        rotationUnitsToSteps(rotationPercentToUnits(HOMING_MAX_TRAVEL_PERCENT)));
+    homing.setHomePosition(HOME_POSITION);
+    
+    #if HOMING_SENSORLESS
+    // Stall detection has to be on before the seek starts
+    driver.setSensorlessHoming(true);
+    driver.flush();
+    homing.setSinglePass(true);
+    #endif
+    
+    if (!homing.start()) return false;
+    
+    motorRunning = true;
+    lastMotorActivityTime = millis();
+    return true;
+}
+
+// Print how long each homing phase took and how the captures compare
+void printHomingReport() {
+    const char* phases[HOMING_PHASE_COUNT] = {"seek", "back-off", "approach"};
+    
+    Serial.print("Homing ");
+    Serial.print(Homing::stateName(homing.getState()));
+    Serial.print(" in ");
+    Serial.print(homing.getTotalTime());
+    Serial.print(" ms (");
+    for (int i = 0; i < HOMING_PHASE_COUNT; i++) {
+        if (i > 0) Serial.print(", ");
+        Serial.print(phases[i]);
+        Serial.print(" ");
+        Serial.print(homing.getPhaseTime(i));
+    }
+    Serial.println(" ms)");
+    
+    if (homing.isHomed()) {
+        Serial.print("Seek overshoot: ");
+        Serial.print(homing.getSeekOvershoot());
+        Serial.print(" steps, seek vs approach capture: ");
+        Serial.print(homing.getSeekToApproach());
+        Serial.println(" steps");
+    }
+}
+
+// Step the homing cycle along (called from the main loop)
+void serviceHoming() {
+    if (!homing.isBusy()) {
+        #if HOMING_SENSORLESS
+        // Normal chopper settings again (only written when they change)
+        driver.setSensorlessHoming(false);
+        #endif
+        return;
+    }
+    
+    homing.service();
+    lastMotorActivityTime = millis();
+    
+    if (!homing.isBusy()) {
+        motorRunning = false;
+        if (homing.isHomed()) {
+            // Positions just moved, the encoder has to follow
+            closedLoop.anchor(controller.getCurrentPosition());
+        }
+        printHomingReport();
+        update_ui_labels();
+    }
+}
+
+// Handle a "HOME ..." command: "HOME" runs the cycle, "HOME STOP" aborts it,
+// "HOME STATUS" prints the last report
+void handleHomeCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+    
+    if (op == NULL) {
+        if (startHoming()) {
+            Serial.println("Homing started");
+            update_ui_labels();
+        }
+    } else if (strcasecmp(op, "STOP") == 0) {
+        if (homing.isBusy()) {
+            homing.abort();
+            stopMotor();
+        }
+    } else if (strcasecmp(op, "STATUS") == 0) {
+        Serial.print("Home switch: ");
+        Serial.println(homing.isSwitchActive() ? "active" : "open");
+        printHomingReport();
+    } else {
+        Serial.print("Unknown HOME command: ");
+        Serial.println(op);
+    }
+}
+
+// Handle a "LIMITS ..." command: "LIMITS <min> <max>" in steps,
+// "LIMITS OFF" or "LIMITS" for the current range
+void handleLimitsCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+    
+    if (op == NULL) {
+        if (controller.areSoftLimitsEnabled()) {
+            Serial.print("Soft limits: ");
+            Serial.print(controller.getSoftLimitMin());
+            Serial.print(" to ");
+            Serial.print(controller.getSoftLimitMax());
+        } else {
+            Serial.print("Soft limits off");
+        }
+        Serial.print(", targets clamped: ");
+        Serial.println(controller.getSoftLimitHits());
+    } else if (strcasecmp(op, "OFF") == 0) {
+        controller.setSoftLimitsEnabled(false);
+    } else {
+        char* maxArg = strtok(NULL, " ");
+        if (maxArg == NULL || atol(op) > atol(maxArg)) {
+            Serial.println("Usage: LIMITS <min> <max>");
+            return;
+        }
+        if (!homing.isHomed()) {
+            Serial.println("Warning: not homed, limits are relative to the current zero");
+        }
+        controller.setSoftLimits(atol(op), atol(maxArg));
+    }
+}
+
+// Steps per encoder count as a fraction, from the motor or output revolution
+void configureClosedLoop() {
+    long numerator;
+    long denominator;
+    if (SHAFT_ENCODER_ON_OUTPUT) {
+        numerator = (long)getStepsPerRevNumerator();
+        denominator = SHAFT_ENCODER_COUNTS_PER_REV * GEAR_RATIO_SCALE;
+    } else {
+        numerator = getEffectiveStepsPerRevolution();
+        denominator = SHAFT_ENCODER_COUNTS_PER_REV;
+    }
+    if (SHAFT_ENCODER_REVERSED) numerator = -numerator;
+    closedLoop.setScale(numerator, denominator);
+}
+
+// Verify the position at the monitor's rate and report a stall. A stall
+// stop ends whatever was driving the motor; the make-up move runs on its own.
+void serviceClosedLoop() {
+    if (!closedLoop.isActive() || homing.isBusy()) return;
+    
+    // Microstepping or the gear ratio may have changed
+    static int64_t scale = 0;
+    if (scale != getStepsPerRevNumerator()) {
+        scale = getStepsPerRevNumerator();
+        configureClosedLoop();
+    }
+    
+    if (!closedLoop.service()) return;
+    
+    Serial.print("Position lost, following error ");
+    Serial.print(closedLoop.getError());
+    Serial.println(" steps");
+    
+    if (closedLoop.isCorrecting()) {
+        abandonMotion();
+        motorRunning = true;
+        lastMotorActivityTime = millis();
+        update_ui_labels();
+    }
+}
+
+// Handle an "ENC ..." command: "ENC" prints the closed-loop status,
+// "ENC SYNC" takes the current step position as right, "ENC CLEAR" resets
+// the fault, "ENC LIMIT <steps>" and "ENC AUTO ON|OFF" change the settings
+void handleEncoderCommand(char* args) {
+    if (!closedLoop.isActive()) {
+        Serial.println("Shaft encoder not configured");
+        return;
+    }
+    
+    char* op = args ? strtok(args, " ") : NULL;
+    char* valueArg = op ? strtok(NULL, " ") : NULL;
+    
+    if (op == NULL) {
+        Serial.print("Encoder ");
+        Serial.print((long)closedLoop.getEncoderCount());
+        Serial.print(" counts, measured ");
+        Serial.print(closedLoop.getMeasuredPosition());
+        Serial.print(", commanded ");
+        Serial.print(controller.getCurrentPosition());
+        Serial.print(", error ");
+        Serial.print(closedLoop.getError());
+        Serial.print(" (max ");
+        Serial.print(closedLoop.getMaxError());
+        Serial.print(", limit ");
+        Serial.print(closedLoop.getErrorLimit());
+        Serial.println(")");
+        Serial.print(closedLoop.isPositionLost() ? "Position lost" : "Position good");
+        Serial.print(", stalls ");
+        Serial.print(closedLoop.getStallCount());
+        Serial.print(", make-up moves ");
+        Serial.print(closedLoop.getCorrectionCount());
+        Serial.println(closedLoop.isAutoCorrect() ? ", auto-correct on" : ", auto-correct off");
+    } else if (strcasecmp(op, "SYNC") == 0) {
+        closedLoop.anchor(controller.getCurrentPosition());
+        closedLoop.clearFault();
+    } else if (strcasecmp(op, "CLEAR") == 0) {
+        closedLoop.clearFault();
+    } else if (strcasecmp(op, "LIMIT") == 0 && valueArg != NULL) {
+        closedLoop.setErrorLimit(atol(valueArg));
+    } else if (strcasecmp(op, "AUTO") == 0 && valueArg != NULL) {
+        closedLoop.setAutoCorrect(strcasecmp(valueArg, "ON") == 0, 0);
+    } else {
+        Serial.print("Unknown ENC command: ");
+        Serial.println(op);
+    }
+}
+
+// Check the indexer can move and wake the motor for it
+bool prepareIndexMove() {
+    if (!indexer.isConfigured()) {
+        Serial.println("Set the divisions first: INDEX <N>");
+        return false;
+    }
+    if (indexer.getStepsPerRevNumerator() != getStepsPerRevNumerator()) {
+        Serial.println("Step scale changed, set the divisions again");
+        return false;
+    }
+    if (controller.isRunning()) {
+        Serial.println("Motor busy");
+        return false;
+    }
+    
+    #if USE_DRV8825_DRIVER
+    controller.wake();
+    #endif
+    
+    motorRunning = true;
+    lastMotorActivityTime = millis();
+    return true;
+}
+
+// Print the indexer station and where the motor is relative to it
+void printIndexStatus() {
+    if (!indexer.isConfigured()) {
+        Serial.println("Indexer not set up");
+        return;
+    }
+    Serial.print("Station ");
+    Serial.print(indexer.getStation());
+    Serial.print(" of ");
+    Serial.print(indexer.getDivisions());
+    Serial.print(", target: ");
+    Serial.print(indexer.indexToPosition(indexer.getIndex()));
+    Serial.print(", position: ");
+    Serial.println(controller.getCurrentPosition());
+}
+
+// Handle an "INDEX ..." command: "INDEX <N>" sets N stations with station 0
+// here, "INDEX NEXT", "INDEX PREV", "INDEX GOTO <station> [CW|CCW|SHORT]"
+// or "INDEX" for the status
+void handleIndexCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+    
+    if (op == NULL) {
+        printIndexStatus();
+    } else if (strcasecmp(op, "NEXT") == 0 || strcasecmp(op, "PREV") == 0) {
+        bool clockwise = strcasecmp(op, "NEXT") == 0;
+        if (prepareIndexMove()) {
+            indexer.next(INVERT_STEP_MODE_DIRECTION ? !clockwise : clockwise, speedSetting);
+            printIndexStatus();
+        }
+    } else if (strcasecmp(op, "GOTO") == 0) {
+        char* stationArg = strtok(NULL, " ");
+        char* directionArg = strtok(NULL, " ");
+        if (stationArg == NULL) {
+            Serial.println("Usage: INDEX GOTO <station> [CW|CCW|SHORT]");
+            return;
+        }
+        
+        IndexDirection direction = INDEX_SHORTEST;
+        if (directionArg != NULL && strcasecmp(directionArg, "CW") == 0) {
+            direction = INVERT_STEP_MODE_DIRECTION ? INDEX_REVERSE : INDEX_FORWARD;
+        } else if (directionArg != NULL && strcasecmp(directionArg, "CCW") == 0) {
+            direction = INVERT_STEP_MODE_DIRECTION ? INDEX_FORWARD : INDEX_REVERSE;
+        }
+        
+        if (prepareIndexMove()) {
+            if (!indexer.goTo(atoi(stationArg), direction, speedSetting)) {
+                Serial.println("Invalid station");
+            }
+            printIndexStatus();
+        }
+    } else {
+        int divisions = atoi(op);
+        if (controller.isRunning()) {
+            Serial.println("Stop the motor before setting divisions");
+        } else if (indexer.configure(divisions, getStepsPerRevNumerator(), GEAR_RATIO_SCALE,
+                                     controller.getCurrentPosition())) {
+            Serial.print("Indexing ");
+            Serial.print(divisions);
+            Serial.println(" stations, station 0 is the current position");
+        }
+    }
+}
+
+// Start oscillating around the current position, or change amplitude and
+// frequency on the fly when already running
+bool startOscillation(float amplitudeDegrees, float frequencyHz) {
+    if (amplitudeDegrees <= 0.0f || frequencyHz <= 0.0f) {
+        Serial.println("Amplitude and frequency must be positive");
+        return false;
+    }
+    
+    long amplitude = labs(rotationUnitsToSteps(lroundf(amplitudeDegrees * POSITION_UNITS_PER_REV / 360.0f)));
+    int maxSpeed = safeRoundStepsPerSec(rpmToSteps(getMaxRpmForCurrentMicrostepping(), gearRatio));
+    
+    // Peak speed is A*w and peak acceleration A*w^2 of the sine
+    float omega = 2.0f * (float)M_PI * frequencyHz;
+    if (amplitude * omega > maxSpeed) {
+        Serial.println("Warning: oscillation is faster than the speed limit, it will be clipped");
+    }
+    if (amplitude * omega * omega > accelerationSetting) {
+        Serial.println("Warning: oscillation needs more than the set acceleration, it will be clipped");
+    }
+    
+    oscillator.setFrequency(frequencyHz);
+    oscillator.setAmplitude(amplitude);
+    if (oscillating) return true;
+    
+    if (motorRunning) {
+        safelyStopAndResetMotor();
+    }
+    
+    #if USE_DRV8825_DRIVER
+    controller.wake();
+    #endif
+    
+    oscillator.start(controller.getCurrentPosition());
+    controller.setTrackingSource(&oscillator);
+    
+    // Speed is only a limit here, the oscillator sets the pace
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_START_TRACKING;
+    cmd.speed = maxSpeed;
+    cmd.acceleration = accelerationSetting;
+    if (!controller.sendCommand(&cmd)) return false;
+    
+    oscillating = true;
+    motorRunning = true;
+    lastMotorActivityTime = millis();
+    return true;
+}
+
+// Finish oscillating once the amplitude has ramped down at the center
+void serviceOscillation() {
+    if (!oscillating) return;
+    
+    // Something else stopped the motor
+    if (!motorRunning) {
+        oscillating = false;
+        return;
+    }
+    
+    lastMotorActivityTime = millis();
+    if (oscillator.isStopped() && controller.getCurrentPosition() == oscillator.getCenter()) {
+        oscillating = false;
+        stopMotor();
+        Serial.print("Oscillation stopped after ");
+        Serial.print(oscillator.getCycles());
+        Serial.println(" cycles");
+    }
+}
+
+// Handle an "OSC ..." command: "OSC <amplitude degrees> <frequency Hz>",
+// "OSC STOP" or "OSC" for the status
+void handleOscillateCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+    
+    if (op == NULL) {
+        Serial.print("Oscillating: ");
+        Serial.print(oscillating ? "yes" : "no");
+        Serial.print(", ");
+        Serial.print(oscillator.getFrequency());
+        Serial.print(" Hz, cycles: ");
+        Serial.print(oscillator.getCycles());
+        Serial.print(", position from center: ");
+        Serial.println(controller.getCurrentPosition() - oscillator.getCenter());
+    } else if (strcasecmp(op, "STOP") == 0) {
+        if (oscillating) {
+            oscillator.stop();
+        }
+    } else {
+        char* frequencyArg = strtok(NULL, " ");
+        if (frequencyArg == NULL) {
+            Serial.println("Usage: OSC <amplitude degrees> <frequency Hz>");
+            return;
+        }
+        if (startOscillation(atof(op), atof(frequencyArg))) {
+            Serial.println("Oscillating");
+            update_ui_labels();
+        }
+    }
+}
+
+// Follow the opened recording from its start position
+void beginPlaybackTracking() {
+    controller.setTrackingSource(activePlayer);
+    activePlayer->start();
+    
+    // Speed is only a limit here, the recording sets the pace
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_START_TRACKING;
+    cmd.speed = safeRoundStepsPerSec(rpmToSteps(getMaxRpmForCurrentMicrostepping(), gearRatio));
+    cmd.acceleration = accelerationSetting;
+    controller.sendCommand(&cmd);
+    
+    playbackState = PLAYBACK_PLAYING;
+    Serial.println("Playback started");
+}
+
+// Move to the start of an opened player and then play it back
+void startPlayback(SamplePlayer* player, int timeScalePercent, uint32_t smoothingMs) {
+    activePlayer = player;
+    activePlayer->setTimeScale(timeScalePercent);
+    activePlayer->setSmoothing(smoothingMs);
+    
+    #if USE_DRV8825_DRIVER
+    controller.wake();
+    #endif
+    
+    motorRunning = true;
+    lastMotorActivityTime = millis();
+    
+    if (controller.getCurrentPosition() == activePlayer->getStartPosition()) {
+        beginPlaybackTracking();
+        return;
+    }
+    
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_MOVE_TO;
+    cmd.position = activePlayer->getStartPosition();
+    cmd.speed = speedSetting;
+    controller.sendCommand(&cmd);
+    playbackState = PLAYBACK_MOVING_TO_START;
+}
+
+// Play the teach-and-replay recording
+bool startPathPlayback(int timeScalePercent, uint32_t smoothingMs) {
+    stopPlayback();
+    if (motorRunning) {
+        safelyStopAndResetMotor();
+    }
+    if (pathRecorder.isRecording()) {
+        pathRecorder.stop();
+    }
+    if (!pathPlayer.open(PATH_RECORDING_FILE)) return false;
+    
+    startPlayback(&pathPlayer, timeScalePercent, smoothingMs);
+    return true;
+}
+
+// Stop playback and report how streaming kept up
+void stopPlayback() {
+    if (playbackState == PLAYBACK_IDLE) return;
+    
+    playbackState = PLAYBACK_IDLE;
+    stopMotor();
+    activePlayer->close();
+    
+    Serial.print("Playback ended, buffer underruns: ");
+    Serial.print(activePlayer->getUnderruns());
+    Serial.print(", minimum buffered ahead: ");
+    Serial.print(activePlayer->getMinMarginMs());
+    Serial.println(" ms");
+}
+
+// Step playback along (called from the main loop)
+void servicePlayback() {
+    switch (playbackState) {
+        case PLAYBACK_MOVING_TO_START:
+            if (controller.isRunning()) break;
+            
+            // Stopped short of the start means the move was cancelled
+            if (controller.getCurrentPosition() == activePlayer->getStartPosition()) {
+                beginPlaybackTracking();
+            } else {
+                stopPlayback();
+            }
+            break;
+            
+        case PLAYBACK_PLAYING:
+            activePlayer->service();
+            lastMotorActivityTime = millis();
+            if (!motorRunning || (activePlayer->isFinished() &&
+                controller.getCurrentPosition() == activePlayer->getFinalPosition())) {
+                stopPlayback();
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+
+// Handle a "PATH ..." command: "PATH REC", "PATH STOP",
+// "PATH PLAY [percent] [smoothing ms]"
+void handlePathCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+    
+    if (op == NULL) {
+        Serial.println("PATH commands: REC, STOP, PLAY [percent] [smoothing ms]");
+    } else if (strcasecmp(op, "REC") == 0) {
+        stopPlayback();
+        if (pathRecorder.start(PATH_RECORDING_FILE, controller.getCurrentPosition())) {
+            Serial.println("Recording path, jog the motor to teach it");
+        }
+    } else if (strcasecmp(op, "STOP") == 0) {
+        pathRecorder.stop();
+        stopPlayback();
+    } else if (strcasecmp(op, "PLAY") == 0) {
+        char* scaleArg = strtok(NULL, " ");
+        char* smoothingArg = strtok(NULL, " ");
+        startPathPlayback(scaleArg ? atoi(scaleArg) : 100, smoothingArg ? atol(smoothingArg) : 0);
+        update_ui_labels();
+    } else {
+        Serial.print("Unknown PATH command: ");
+        Serial.println(op);
+    }
+}
+
+// Read the whole keyframe file to check it and measure streaming speed
+void printTrajectoryInfo() {
+    if (playbackState != PLAYBACK_IDLE) {
+        Serial.println("Stop playback first");
+        return;
+    }
+    
+    unsigned long keyframes = 0;
+    uint32_t durationMs = 0;
+    unsigned long startTime = micros();
+    bool valid = trajectoryPlayer.scan(TRAJECTORY_FILE, &keyframes, &durationMs);
+    unsigned long elapsed = max(micros() - startTime, 1UL);
+    if (!valid) return;
+    
+    Serial.print("Trajectory: ");
+    Serial.print(keyframes);
+    Serial.print(" keyframes over ");
+    Serial.print(durationMs);
+    Serial.println(" ms");
+    
+    // Streaming has to beat the rate keyframes are used at during playback
+    Serial.print("Read ");
+    Serial.print(keyframes * 1000000.0f / elapsed, 0);
+    Serial.print(" keyframes/s, playback needs ");
+    Serial.print(durationMs > 0 ? keyframes * 1000.0f / durationMs : 0.0f, 1);
+    Serial.println(" keyframes/s at 100%");
+}
+
+// Handle a "TRAJ ..." command for keyframe tables:
+// "TRAJ NEW [LINEAR|CUBIC]", "TRAJ ADD <ms> <steps>", "TRAJ INFO",
+// "TRAJ PLAY [percent]", "TRAJ STOP"
+void handleTrajectoryCommand(char* args) {
+    static uint32_t lastKeyframeTime = 0;
+    static bool hasKeyframes = false;
+    
+    char* op = args ? strtok(args, " ") : NULL;
+    
+    if (op == NULL) {
+        Serial.println("TRAJ commands: NEW [LINEAR|CUBIC], ADD <ms> <steps>, INFO, PLAY [percent], STOP");
+    } else if (strcasecmp(op, "NEW") == 0) {
+        char* mode = strtok(NULL, " ");
+        PlayerInterpolation interpolation = (mode && strcasecmp(mode, "CUBIC") == 0) ?
+            PLAYER_INTERPOLATE_CUBIC : PLAYER_INTERPOLATE_LINEAR;
+        if (TrajectoryPlayer::createFile(&LittleFS, TRAJECTORY_FILE, interpolation)) {
+            hasKeyframes = false;
+        } else {
+            Serial.println("Can't create keyframe file");
+        }
+    } else if (strcasecmp(op, "ADD") == 0) {
+        char* timeArg = strtok(NULL, " ");
+        char* positionArg = strtok(NULL, " ");
+        if (!timeArg || !positionArg) {
+            Serial.println("Usage: TRAJ ADD <ms> <steps>");
+            return;
+        }
+        uint32_t timeMs = strtoul(timeArg, NULL, 10);
+        if (hasKeyframes && timeMs <= lastKeyframeTime) {
+            Serial.println("Keyframe times must increase");
+            return;
+        }
+        if (TrajectoryPlayer::appendKeyframe(&LittleFS, TRAJECTORY_FILE, timeMs, atol(positionArg))) {
+            lastKeyframeTime = timeMs;
+            hasKeyframes = true;
+        }
+    } else if (strcasecmp(op, "INFO") == 0) {
+        printTrajectoryInfo();
+    } else if (strcasecmp(op, "PLAY") == 0) {
+        char* scaleArg = strtok(NULL, " ");
+        stopPlayback();
+        if (motorRunning) {
+            safelyStopAndResetMotor();
+        }
+        if (trajectoryPlayer.open(TRAJECTORY_FILE)) {
+            startPlayback(&trajectoryPlayer, scaleArg ? atoi(scaleArg) : 100, 0);
+            update_ui_labels();
+        }
+    } else if (strcasecmp(op, "STOP") == 0) {
+        stopPlayback();
+    } else {
+        Serial.print("Unknown TRAJ command: ");
+        Serial.println(op);
+    }
+}
+
+// Extra axis by number (from 0) on whichever backend drives them
+StepperAxis* getAuxAxis(int index) {
+#if AUX_AXES_STEP_STREAM
+    return auxStream.getAxis(index);
+#else
+    return auxAxes.getAxis(index);
+#endif
+}
+
+#if AUX_AXES_STEP_STREAM
+// Print the extra axes and how the DMA stream is keeping up
+void printAxisReport() {
+    if (auxStream.getAxisCount() == 0) {
+        Serial.println("No extra axes configured");
+        return;
+    }
+
+    for (int i = 0; i < auxStream.getAxisCount(); i++) {
+        StepperAxis* axis = auxStream.getAxis(i);
+        Serial.print("Axis ");
+        Serial.print(i + 1);
+        Serial.print(": position ");
+        Serial.print(axis->getPosition());
+        Serial.print(", ");
+        Serial.print(axis->getSpeed(), 0);
+        Serial.println(" steps/s");
+    }
+
+    Serial.print("Stream: ");
+    Serial.print(auxStream.getSliceCount());
+    Serial.print(" buffers, ");
+    Serial.print(auxStream.getUnderrunCount());
+    Serial.print(" underruns, render max ");
+    Serial.print(auxStream.getMaxRenderUs());
+    Serial.print(" us of ");
+    Serial.print(STEP_STREAM_SLICE_US);
+    Serial.println(" us");
+}
+#else
+// Print the extra axes and how well their steps kept time
+void printAxisReport() {
+    if (auxAxes.getAxisCount() == 0) {
+        Serial.println("No extra axes configured");
+        return;
+    }
+
+    for (int i = 0; i < auxAxes.getAxisCount(); i++) {
+        StepperAxis* axis = auxAxes.getAxis(i);
+        AxisTiming_t timing;
+        auxAxes.getTiming(i, &timing);
+
+        Serial.print("Axis ");
+        Serial.print(i + 1);
+        Serial.print(": position ");
+        Serial.print(axis->getPosition());
+        Serial.print(", ");
+        Serial.print(axis->getSpeed(), 0);
+        Serial.print(" steps/s, ");
+        Serial.print(timing.steps);
+        Serial.print(" steps, late max ");
+        Serial.print(timing.maxLateUs);
+        Serial.print(" us mean ");
+        Serial.print(timing.steps > 0 ? (float)timing.totalLateUs / timing.steps : 0.0f, 2);
+        Serial.print(" us, ");
+        Serial.print(axis->getBurst());
+        Serial.print(" pulses per interrupt, burst error max ");
+        Serial.print(timing.maxBurstErrorUs);
+        Serial.println(" us");
+    }
+
+    Serial.print("Burst mode ");
+    Serial.print(auxAxes.isBurstMode() ? "on" : "off");
+    Serial.print(" at ");
+    for (int level = 0; level < AXIS_BURST_LEVELS; level++) {
+        Serial.print(level > 0 ? " / " : "");
+        Serial.print(auxAxes.getBurstRate(level), 0);
+    }
+    Serial.println(" steps/s");
+
+    Serial.print("Interrupts: ");
+    Serial.print(auxAxes.getInterruptCount());
+    Serial.print(", mean ");
+    Serial.print(auxAxes.getMeanInterruptCycles());
+    Serial.print(" cycles, max ");
+    Serial.print(auxAxes.getMaxInterruptCycles());
+    Serial.print(" cycles, at most ");
+    Serial.print(auxAxes.getMaxInterruptPulses());
+    Serial.println(" pulses");
+}
+#endif
+
+// Run one axis at a range of step rates with single pulses and with bursts
+// and print the interrupt rate, the pulses each interrupt put out, the CPU
+// time spent in the interrupt and the pulse timing. Blocks for the length
+// of the run; leave the other axes idle so the interrupts are all this
+// axis's.
+void runAxisBenchmark(int index) {
+    static const long rates[] = { 2000, 5000, 10000, 20000, 40000 };
+    StepperAxis* axis = auxAxes.getAxis(index);
+    bool burstMode = auxAxes.isBurstMode();
+    float acceleration = axis->getAcceleration();
+
+    AxisCommand_t cmd = {};
+    cmd.type = AXIS_CMD_SET_ACCELERATION;
+    cmd.acceleration = AXIS_BENCH_ACCELERATION;
+    axis->sendCommand(&cmd);
+
+    Serial.println("Steps/s  Mode    Int/s  Pulses/int  CPU %  Late max us  Burst error max/mean us");
+    for (int mode = 0; mode < 2; mode++) {
+        auxAxes.setBurstMode(mode == 1);
+
+        for (int i = 0; i < (int)(sizeof(rates) / sizeof(rates[0])); i++) {
+            cmd.type = AXIS_CMD_RUN;
+            cmd.forward = true;
+            cmd.speed = rates[i];
+            axis->sendCommand(&cmd);
+            delay(AXIS_BENCH_SETTLE_MS);
+
+            auxAxes.resetTiming();
+            unsigned long start = micros();
+            delay(AXIS_BENCH_MEASURE_MS);
+            unsigned long elapsed = micros() - start;
+
+            AxisTiming_t timing;
+            auxAxes.getTiming(index, &timing);
+            float seconds = elapsed / 1000000.0f;
+            float interruptRate = auxAxes.getInterruptCount() / seconds;
+            float pulsesPerInterrupt = auxAxes.getInterruptCount() > 0 ?
+                                       (float)timing.steps / auxAxes.getInterruptCount() : 0.0f;
+            float cpuLoad = 100.0f * auxAxes.getMeanInterruptCycles() * auxAxes.getInterruptCount() /
+                            (elapsed * (float)getCpuFrequencyMhz());
+
+            Serial.printf("%7ld  %-6s %6.0f  %10.2f  %5.1f  %11lu  %lu / %.2f\n",
+                          rates[i], mode == 1 ? "burst" : "single", interruptRate, pulsesPerInterrupt, cpuLoad,
+                          (unsigned long)timing.maxLateUs, (unsigned long)timing.maxBurstErrorUs,
+                          timing.steps > 0 ? (float)timing.totalBurstErrorUs / timing.steps : 0.0f);
+        }
+    }
+
+    cmd.type = AXIS_CMD_STOP;
+    axis->sendCommand(&cmd);
+    while (axis->isRunning()) delay(10);
+
+    cmd.type = AXIS_CMD_SET_ACCELERATION;
+    cmd.acceleration = (int)acceleration;
+    axis->sendCommand(&cmd);
+    auxAxes.setBurstMode(burstMode);
+}
+
+// Handle an "AXIS ..." command for the extra axes:
+// "AXIS <n> MOVE <position> [speed]", "AXIS <n> BY <steps> [speed]",
+// "AXIS <n> RUN CW|CCW [speed]", "AXIS <n> STOP", "AXIS <n> ACCEL <steps/s²>",
+// "AXIS RESET" clears the timing and "AXIS" prints the report.
+// "AXIS BURST ON|OFF" switches burst mode, "AXIS BURST <r2> <r4> <r8>" sets
+// its rates and "AXIS BENCH <n>" benchmarks an axis with and without it
+// (per-step interrupts only).
+void handleAxisCommand(char* args) {
+    char* first = args ? strtok(args, " ") : NULL;
+
+    if (first == NULL) {
+        printAxisReport();
+        return;
+    }
+    if (strcasecmp(first, "RESET") == 0) {
+#if AUX_AXES_STEP_STREAM
+        auxStream.resetStats();
+#else
+        auxAxes.resetTiming();
+#endif
+        Serial.println("Axis timing reset");
+        return;
+    }
+#if !AUX_AXES_STEP_STREAM
+    if (strcasecmp(first, "BURST") == 0) {
+        char* rate2 = strtok(NULL, " ");
+        char* rate4 = strtok(NULL, " ");
+        char* rate8 = strtok(NULL, " ");
+        if (rate2 == NULL) {
+            Serial.println("Usage: AXIS BURST ON|OFF|<rate2> <rate4> <rate8>");
+        } else if (strcasecmp(rate2, "ON") == 0 || strcasecmp(rate2, "OFF") == 0) {
+            auxAxes.setBurstMode(strcasecmp(rate2, "ON") == 0);
+        } else {
+            auxAxes.setBurstRates(atof(rate2), rate4 ? atof(rate4) : 0.0f, rate8 ? atof(rate8) : 0.0f);
+        }
+        printAxisReport();
+        return;
+    }
+    if (strcasecmp(first, "BENCH") == 0) {
+        char* indexArg = strtok(NULL, " ");
+        int index = indexArg ? atoi(indexArg) - 1 : 0;
+        if (auxAxes.getAxis(index) == NULL) {
+            Serial.println("No such axis");
+            return;
+        }
+        runAxisBenchmark(index);
+        return;
+    }
+#endif
+
+    StepperAxis* axis = getAuxAxis(atoi(first) - 1);
+    char* op = strtok(NULL, " ");
+    if (axis == NULL || op == NULL) {
+        Serial.println("Usage: AXIS <n> MOVE|BY|RUN|STOP|ACCEL ...");
+        return;
+    }
+
+    char* valueArg = strtok(NULL, " ");
+    char* speedArg = strtok(NULL, " ");
+
+    AxisCommand_t cmd;
+    cmd.position = 0;
+    cmd.speed = 0;
+    cmd.forward = true;
+    cmd.acceleration = 0;
+
+    if (strcasecmp(op, "MOVE") == 0 || strcasecmp(op, "BY") == 0) {
+        if (valueArg == NULL) {
+            Serial.println("Missing position");
+            return;
+        }
+        cmd.type = (strcasecmp(op, "MOVE") == 0) ? AXIS_CMD_MOVE_TO : AXIS_CMD_MOVE_BY;
+        cmd.position = atol(valueArg);
+        if (speedArg != NULL) cmd.speed = atoi(speedArg);
+    } else if (strcasecmp(op, "RUN") == 0) {
+        cmd.type = AXIS_CMD_RUN;
+        cmd.forward = !(valueArg != NULL && strcasecmp(valueArg, "CCW") == 0);
+        if (speedArg != NULL) cmd.speed = atoi(speedArg);
+    } else if (strcasecmp(op, "STOP") == 0) {
+        cmd.type = AXIS_CMD_STOP;
+    } else if (strcasecmp(op, "ACCEL") == 0) {
+        if (valueArg == NULL) {
+            Serial.println("Missing acceleration");
+            return;
+        }
+        cmd.type = AXIS_CMD_SET_ACCELERATION;
+        cmd.acceleration = atoi(valueArg);
+    } else {
+        Serial.print("Unknown AXIS command: ");
+        Serial.println(op);
+        return;
+    }
+
+    if (!axis->sendCommand(&cmd)) {
+        Serial.println("Axis command queue full");
+    }
+}
+
+#if USE_TMC2209_DRIVER
+// Handle a "TMC ..." command: "TMC" prints the driver status and StallGuard
+// reading, "TMC CURRENT <mA> [hold %]" and "TMC STALL <threshold>" change it
+void handleTmcCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+    char* valueArg = op ? strtok(NULL, " ") : NULL;
+    
+    if (op == NULL) {
+        Serial.print(driver.isConnected() ? "TMC2209 connected" : "TMC2209 not responding");
+        Serial.print(", register writes ");
+        Serial.print(driver.getWriteCount());
+        Serial.print(", errors ");
+        Serial.print(driver.getErrorCount());
+        Serial.print(", StallGuard ");
+        Serial.println(driver.readStallGuardResult());
+    } else if (strcasecmp(op, "CURRENT") == 0 && valueArg != NULL) {
+        char* holdArg = strtok(NULL, " ");
+        driver.setCurrent(atoi(valueArg), holdArg ? atoi(holdArg) : TMC2209_HOLD_CURRENT_PERCENT);
+    } else if (strcasecmp(op, "STALL") == 0 && valueArg != NULL) {
+        driver.setStallGuard(constrain(atoi(valueArg), 0, 255), TMC2209_STALL_MIN_RPM * BASE_STEPS_PER_REVOLUTION / 60.0f);
+    } else {
+        Serial.print("Unknown TMC command: ");
+        Serial.println(op);
+    }
+}
+#endif
+
+// Handle a "FEED ..." command: "FEED <percent>" sets the feed override of
+// the run in progress (it goes back to 100% when the run ends), "FEED"
+// prints it
+void handleFeedCommand(char* args) {
+    char* percentArg = args ? strtok(args, " ") : NULL;
+    if (percentArg != NULL) {
+        controller.setFeedOverride(atoi(percentArg));
+    }
+    Serial.print("Feed override: ");
+    Serial.print(controller.getFeedOverride());
+    Serial.println("%");
+}
+
+// Handle a "TELEM ..." command: "TELEM ON" and "TELEM OFF" start and stop
+// the binary stream, "TELEM" prints its statistics
+void handleTelemetryCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+
+    if (op == NULL) {
+        Serial.printf("Telemetry %s at %d Hz, budget %lu B/s: %lu frames (%lu key), %lu bytes, dropped %lu over budget, %lu port full\n",
+                      telemetry.isStreaming() ? "on" : "off", telemetry.getRate(),
+                      (unsigned long)telemetry.getBudget(), telemetry.getFrameCount(),
+                      telemetry.getKeyFrameCount(), telemetry.getByteCount(),
+                      telemetry.getBudgetDrops(), telemetry.getPortDrops());
+    } else if (strcasecmp(op, "ON") == 0) {
+        telemetry.resetStats();
+        telemetry.setStreaming(true);
+    } else if (strcasecmp(op, "OFF") == 0) {
+        telemetry.setStreaming(false);
+    } else {
+        Serial.print("Unknown TELEM command: ");
+        Serial.println(op);
+    }
+}
+
+// Handle a "SETTINGS ..." command: "SETTINGS SAVE" writes pending changes
+// now, "SETTINGS DEFAULTS" goes back to the defaults, "SETTINGS" prints the
+// store's state
+void handleSettingsCommand(char* args) {
+    char* op = args ? strtok(args, " ") : NULL;
+
+    if (op == NULL) {
+        Serial.printf("Settings: %s, %lu writes, %lu failed\n",
+                      settingsStore.isPending() ? "changes pending" : "saved",
+                      settingsStore.getWriteCount(), settingsStore.getWriteErrors());
+    } else if (strcasecmp(op, "SAVE") == 0) {
+        if (motorRunning || controller.isRunning()) {
+            Serial.println("Settings: stop the motor first");
+            return;
+        }
+        serviceSettings(millis());
+        if (!settingsStore.flush()) {
+            Serial.println("Settings: write failed");
+        }
+    } else if (strcasecmp(op, "DEFAULTS") == 0) {
+        if (motorRunning || controller.isRunning()) {
+            Serial.println("Settings: stop the motor first");
+            return;
+        }
+        controller.setMicrostepMode(DEFAULT_MICROSTEP_MODE);
+        StoredSettings_t defaults;
+        defaultSettings(&defaults);
+        applySettings(&defaults);
+        controller.setAcceleration(accelerationSetting);
+        update_ui_labels();
+        updateSequencePositionLabels();
+    } else {
+        Serial.print("Unknown SETTINGS command: ");
+        Serial.println(op);
+    }
+}
+
+// Dispatch one complete command line
+void processSerialCommand(char* line) {
+    char* command = strtok(line, " ");
+    if (command == NULL) return;
+    
+    char* args = strtok(NULL, "");
+    
+    if (strcasecmp(command, "SEQ") == 0) {
+        handleSequenceCommand(args);
+    } else if (strcasecmp(command, "SHAPER") == 0) {
+        handleShaperCommand(args);
+    } else if (strcasecmp(command, "TRIG") == 0) {
+        handleTriggerCommand(args);
+    } else if (strcasecmp(command, "FOLLOW") == 0) {
+        handleFollowCommand(args);
+    } else if (strcasecmp(command, "PATH") == 0) {
+        handlePathCommand(args);
+    } else if (strcasecmp(command, "TRAJ") == 0) {
+        handleTrajectoryCommand(args);
+    } else if (strcasecmp(command, "OSC") == 0) {
+        handleOscillateCommand(args);
+    } else if (strcasecmp(command, "INDEX") == 0) {
+        handleIndexCommand(args);
+    } else if (strcasecmp(command, "HOME") == 0) {
+        handleHomeCommand(args);
+    } else if (strcasecmp(command, "LIMITS") == 0) {
+        handleLimitsCommand(args);
+    } else if (strcasecmp(command, "FEED") == 0) {
+        handleFeedCommand(args);
+    } else if (strcasecmp(command, "AXIS") == 0) {
+        handleAxisCommand(args);
+    } else if (strcasecmp(command, "TELEM") == 0) {
+        handleTelemetryCommand(args);
+    } else if (strcasecmp(command, "SETTINGS") == 0) {
+        handleSettingsCommand(args);
+    } else if (strcasecmp(command, "ENC") == 0) {
+        handleEncoderCommand(args);
+    #if USE_TMC2209_DRIVER
+    } else if (strcasecmp(command, "TMC") == 0) {
+        handleTmcCommand(args);
+    #endif
+    } else if (strcasecmp(command, "ESTOP") == 0) {
+        // Same path as the input, clearing is only possible from the UI
+        controller.emergencyStop();
+    } else {
+        Serial.print("Unknown command: ");
+        Serial.println(command);
+    }
+}
+
+// Read serial input without blocking and run complete lines
+void handleSerialCommands() {
+    static char buffer[SERIAL_COMMAND_BUFFER_SIZE];
+    static int length = 0;
+    
+    while (Serial.available() > 0) {
+        char c = Serial.read();
+        
+        if (c == '\n' || c == '\r') {
+            if (length > 0) {
+                buffer[length] = '\0';
+                processSerialCommand(buffer);
+                length = 0;
+            }
+        } else if (length < SERIAL_COMMAND_BUFFER_SIZE - 1) {
+            buffer[length++] = c;
+        }
+    }
+}
+
+//===============================================
+// SETUP & LOOP
+//===============================================
+// Boot stage timestamps (micros() since start-up), printed once setup is done
+#define BOOT_MAX_STAGES 12
+static const char* bootStageNames[BOOT_MAX_STAGES];
+static unsigned long bootStageTimes[BOOT_MAX_STAGES];
+static int bootStageCount = 0;
+
+void bootMark(const char* stage) {
+    if (bootStageCount >= BOOT_MAX_STAGES) return;
+    bootStageTimes[bootStageCount] = micros();
+    bootStageNames[bootStageCount] = stage;
+    bootStageCount++;
+}
+
+void printBootProfile() {
+    Serial.println("Boot profile (ms since start-up, stage time):");
+    for (int i = 0; i < bootStageCount; i++) {
+        unsigned long stageUs = (i > 0) ? bootStageTimes[i] - bootStageTimes[i - 1] : 0;
+        Serial.printf("  %-12s %8.1f %8.1f\n", bootStageNames[i],
+                      bootStageTimes[i] / 1000.0f, stageUs / 1000.0f);
+    }
+}
+
+void setup() {
+    bootMark("start");
+    
+    // Initialize serial communication
+    Serial.begin(115200);
+    
+    // Start the panel reset, its waits run while the motor is set up
+    LCD_Begin();
+    bootMark("lcd reset");
+
+    // Initialize our timer-based motor controller first so the motor is
+    // usable before any of the UI exists
+    if (!controller.init()) {
+        Serial.println("ERROR: motor controller failed to start, the motor will not move");
+    }
+    
+    // Set microstepping mode (both drivers support it)
+    controller.setMicrostepMode(DEFAULT_MICROSTEP_MODE);
+    controller.setAutoMicrostep(AUTO_MICROSTEP_ENABLED, AUTO_MICROSTEP_MAX_SCALE);
+    controller.setInputShaper(INPUT_SHAPER_TYPE, INPUT_SHAPER_FREQUENCY, INPUT_SHAPER_DAMPING);
+    controller.setTriggerOutput(TRIGGER_OUTPUT_PIN, TRIGGER_PULSE_WIDTH_US);
+    controller.setEmergencyStopInput(ESTOP_PIN, ESTOP_ACTIVE_LOW, ESTOP_DECELERATION);
+    controller.setEmergencyStopHook(stopAuxAxes, NULL);
+
+    #if USE_TMC2209_DRIVER
+    // Current and chopper settings, written over the UART in one batch
+    driver.setCurrent(TMC2209_RUN_CURRENT_MA, TMC2209_HOLD_CURRENT_PERCENT);
+    driver.setSpreadCycleThreshold(TMC2209_SPREADCYCLE_RPM * BASE_STEPS_PER_REVOLUTION / 60.0f);
+    driver.setStallGuard(TMC2209_STALL_THRESHOLD, TMC2209_STALL_MIN_RPM * BASE_STEPS_PER_REVOLUTION / 60.0f);
+    driver.flush();
+    #endif
+    
+    #if USE_L298N_DRIVER
+    // Reduced current while holding position during dwells
+    driver.setHoldCurrent(L298N_HOLD_CURRENT_PERCENT);
+    #endif
+    
+    #if USE_DRV8825_DRIVER
+    // Explicitly wake the driver
+    controller.wake();
+    #endif
+
+    // Restore the saved settings with one NVS read, the defaults cover
+    // anything missing or damaged
+    StoredSettings_t defaults;
+    StoredSettings_t settings;
+    defaultSettings(&defaults);
+    SettingsLoadResult loaded = settingsStore.begin(&defaults, &settings,
+                                                    SETTINGS_SAVE_DELAY_MS, SETTINGS_MAX_SAVE_DELAY_MS);
+    applySettings(&settings);
+    if (loaded == SETTINGS_MIGRATED) {
+        Serial.println("Settings: upgraded from an older version");
+    }
+    
+    // Take up the position from before a reset when that is safe, in the
+    // microstep mode just restored
+    PositionCheckpoint_t checkpoint;
+    reportCheckpointRestore(controller.restoreCheckpoint(&checkpoint), &checkpoint);
+
+    // Set acceleration
+    MotorCommand_t cmd;
+    cmd.cmd_type = CMD_SET_ACCELERATION;
+    cmd.acceleration = accelerationSetting;
+    controller.sendCommand(&cmd);
+    bootMark("motor ready");
+
+    // File system for path recordings
+    if (!LittleFS.begin(true)) {
+        Serial.println("LittleFS mount failed, path recording unavailable");
+    }
+    bootMark("littlefs");
+    
+    // Panel registers, then the UI is built while it comes out of sleep
+    LCD_Configure();
+    bootMark("lcd config");
+    Lvgl_Init();
+    bootMark("lvgl");
+    ui_init();
+    update_ui_labels();
+
+    // Attach event handlers to UI elements
+    attach_event_handlers();
+    createLiveReadouts();
+    bootMark("ui");
+    
+    LCD_DisplayOn();
+    Set_Backlight(50); // Set LCD backlight to 50%
+    bootMark("display on");
+
+    // Initialize the rotary encoder
+    setupEncoder();
+
+    // Closed-loop position checks with the shaft encoder
+    if (SHAFT_ENCODER_A_PIN >= 0 && closedLoop.begin()) {
+        closedLoop.setErrorLimit(SHAFT_ENCODER_ERROR_LIMIT);
+        closedLoop.setAutoCorrect(SHAFT_ENCODER_AUTO_CORRECT,
+                                  safeRoundStepsPerSec(rpmToSteps(SHAFT_ENCODER_CORRECTION_RPM, gearRatio)));
+    }
+
+    // Telemetry sampling, off until TELEM ON
+    telemetry.begin(TELEMETRY_RATE_HZ, TELEMETRY_BUDGET_BYTES_PER_SEC);
+
+    // Extra axes get their own timer or the DMA stream, only the ones that
+    // are wired up
+#if AUX_AXES_STEP_STREAM
+    if (AUX_AXIS_1_STEP_PIN >= 0) auxStream.addAxis(&auxAxis1);
+    if (AUX_AXIS_2_STEP_PIN >= 0) auxStream.addAxis(&auxAxis2);
+    if (auxStream.getAxisCount() > 0) auxStream.begin();
+#else
+    if (AUX_AXIS_1_STEP_PIN >= 0) auxAxes.addAxis(&auxAxis1);
+    if (AUX_AXIS_2_STEP_PIN >= 0) auxAxes.addAxis(&auxAxis2);
+    if (auxAxes.getAxisCount() > 0) auxAxes.begin();
+#endif
+    bootMark("peripherals");
+    
+    Serial.println("System ready!");
+    printBootProfile();
+}
+
+void loop() {
+    // Current time tracking
+    unsigned long currentMillis = millis();
+    
+    // Handle UI updates
+    Timer_Loop();
+    ui_tick();
+    updateLiveReadout(currentMillis);
+    
+    // Handle encoder input (includes UI navigation and value adjustment),
+    // the e-stop overlay takes the button until the fault is cleared
+    if (!serviceEmergencyStop()) {
+        handleEncoder();
+    }
+    
+    // Check if a long press was detected for toggling fine/coarse adjustment
+    if (longPressDetected) {
+        longPressDetected = false;
+        
+        // Only toggle if in value adjustment mode
+        if (valueAdjustmentMode) {
+            toggleAdjustmentPrecision();
+        }
+    }
+    
+    if (motorRunning && encoderJogMode) {
+        checkEncoderJogMode();
+    }
+
+    // Keep the sequence engine's segment queue topped up
+    if (sequenceData.isRunning) {
+        sequenceEngine.service();
+        sequenceData.currentStep = sequenceEngine.getSegmentsStarted();
+        
+        // Program finished
+        if (!sequenceEngine.isRunning()) {
+            stopSequence();
+        }
+    }
+    
+    // Teach-and-replay
+    pathRecorder.service(controller.getCurrentPosition());
+    servicePlayback();
+    
+    // Agitation mode
+    serviceOscillation();
+    
+    // Reference search
+    serviceHoming();
+    
+    // Closed-loop position verification
+    serviceClosedLoop();
+    
+    // Handle commands from the serial port
+    handleSerialCommands();
+    
+    // Save changed settings once they settle
+    serviceSettings(currentMillis);
+    
+    #if USE_TMC2209_DRIVER
+    // Register writes for the driver, kept out of the step path
+    driver.service();
+    #endif
+    
+    // Check for motor idle timeout - automatic shutdown after inactivity
+    if (enableMotorPowerSave && motorRunning && 
+        !encoderJogMode && !continuousMode && 
+        controller.isRunning() == false &&
+        currentMillis - lastMotorActivityTime > MOTOR_IDLE_TIMEOUT_MS) {
+        // Motor has been idle too long, disable it
+        motorRunning = false;
+        controller.sleep();
+        update_ui_labels();
+    }
+
+    // Poll for motor status updates (completed movements)
+    if (motorRunning && !encoderJogMode && !sequenceData.isRunning &&
+        playbackState == PLAYBACK_IDLE && !homing.isBusy() && !closedLoop.isCorrecting() &&
+        !controller.isRunning()) {
+        motorRunning = false;
+        Serial.println("Motor stopped (reached target)");
+        update_ui_labels();
+    }
+
+    // A feed trim lasts for the run it was made in, the next move,
+    // sequence or homing cycle starts at the speed that was set
+    if (!motorRunning && controller.getFeedOverride() != 100) {
+        controller.setFeedOverride(100);
         update_ui_labels();
     }
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+// Arduino.h - the parts of the Arduino-ESP32 core the motor code uses,
+// backed by the simulated clock and pins in host.cpp
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 3
+#define RISING 4
+#define FALLING 5
+#define HEX 16
+#define SERIAL_8N1 0
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+int digitalPinToInterrupt(int pin);
+void attachInterrupt(int interrupt, void (*handler)(), int mode);
+void attachInterruptArg(int interrupt, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(int interrupt);
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+static inline uint32_t getCpuFrequencyMhz() { return 160; }
+
+bool ledcAttach(int pin, uint32_t frequency, uint8_t resolution);
+bool ledcWrite(int pin, uint32_t duty);
+
+template <class T, class L, class H>
+T constrain(T x, L low, H high) { return x < low ? low : (x > high ? high : x); }
+
+// Text output is thrown away unless a test captures it (see host.h)
+class Print {
+public:
+    virtual ~Print() {}
+    size_t print(const char* text);
+    size_t print(char c);
+    size_t print(int value, int base = 10);
+    size_t print(unsigned value, int base = 10);
+    size_t print(long value, int base = 10);
+    size_t print(unsigned long value, int base = 10);
+    size_t print(long long value, int base = 10);
+    size_t print(unsigned long long value, int base = 10);
+    size_t print(double value, int digits = 2);
+    size_t println();
+    size_t println(const char* text);
+    size_t println(char c);
+    size_t println(int value, int base = 10);
+    size_t println(unsigned value, int base = 10);
+    size_t println(long value, int base = 10);
+    size_t println(unsigned long value, int base = 10);
+    size_t println(long long value, int base = 10);
+    size_t println(unsigned long long value, int base = 10);
+    size_t println(double value, int digits = 2);
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t write(uint8_t byte);
+    size_t write(const uint8_t* data, size_t size);
+    int availableForWrite();
+};
+
+class Stream : public Print {
+public:
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t readBytes(uint8_t* buffer, size_t length);
+    void setTimeout(unsigned long ms);
+};
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+    void end() {}
+    void setTxBufferSize(size_t) {}
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,43 @@
+// FS.h - an in-memory file system
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File {
+public:
+    size_t write(const uint8_t* data, size_t size);
+    size_t read(uint8_t* buffer, size_t size);
+    int read();
+    bool seek(uint32_t position);
+    size_t position() { return _position; }
+    size_t size();
+    int available() { return (int)(size() - _position); }
+    void flush() {}
+    void close() { _name = NULL; }
+    operator bool() const { return _name != NULL; }
+
+private:
+    friend class FS;
+    const char* _name = NULL;  // Key in the file table, NULL when closed
+    size_t _position = 0;
+};
+
+class FS {
+public:
+    File open(const char* path, const char* mode = FILE_READ, bool create = false);
+    bool exists(const char* path);
+    bool remove(const char* path);
+};
+
+} // namespace fs
+
+using fs::File;
+
+#endif // HOST_FS_H
@@ -0,0 +1,42 @@
+// Preferences.h - NVS namespaces kept in a map that outlives the objects,
+// so a test can "reboot" by opening the namespace again
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+extern std::map<std::string, std::vector<uint8_t>> hostNvs;
+extern bool hostNvsFailWrites;   // putBytes fails, as with a full partition
+extern int hostNvsReads;
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false) {
+        (void)readOnly;
+        _name = name;
+        return true;
+    }
+    size_t getBytes(const char* key, void* buffer, size_t maxLength) {
+        hostNvsReads++;
+        auto entry = hostNvs.find(_name + "/" + key);
+        if (entry == hostNvs.end() || entry->second.size() > maxLength) return 0;
+        memcpy(buffer, entry->second.data(), entry->second.size());
+        return entry->second.size();
+    }
+    size_t putBytes(const char* key, const void* data, size_t length) {
+        if (hostNvsFailWrites) return 0;
+        const uint8_t* bytes = (const uint8_t*)data;
+        hostNvs[_name + "/" + key].assign(bytes, bytes + length);
+        return length;
+    }
+
+private:
+    std::string _name;
+};
+
+#endif // HOST_PREFERENCES_H
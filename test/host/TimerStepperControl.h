@@ -0,0 +1,3 @@
+// TimerStepperControl.h - the sources include the controller by this name,
+// the file in the tree is lower case
+#include "../../timersteppercontrol.h"
@@ -0,0 +1,57 @@
+// driver/parlio_tx.h - transmissions are accepted and dropped; tests call
+// StepStream::renderSlice() to see the waveform
+#ifndef HOST_PARLIO_TX_H
+#define HOST_PARLIO_TX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int gpio_num_t;
+typedef struct parlio_tx_unit_t* parlio_tx_unit_handle_t;
+
+typedef enum { PARLIO_CLK_SRC_DEFAULT } parlio_clock_source_t;
+typedef enum { PARLIO_SAMPLE_EDGE_NEG, PARLIO_SAMPLE_EDGE_POS } parlio_sample_edge_t;
+typedef enum { PARLIO_BIT_PACK_ORDER_LSB, PARLIO_BIT_PACK_ORDER_MSB } parlio_bit_pack_order_t;
+
+typedef struct {
+    parlio_clock_source_t clk_src;
+    gpio_num_t clk_in_gpio_num;
+    uint32_t input_clk_src_freq_hz;
+    uint32_t output_clk_freq_hz;
+    size_t data_width;
+    gpio_num_t data_gpio_nums[16];
+    gpio_num_t clk_out_gpio_num;
+    gpio_num_t valid_gpio_num;
+    size_t trans_queue_depth;
+    size_t max_transfer_size;
+    parlio_sample_edge_t sample_edge;
+    parlio_bit_pack_order_t bit_pack_order;
+    struct {
+        uint32_t clk_gate_en : 1;
+        uint32_t io_loop_back : 1;
+    } flags;
+} parlio_tx_unit_config_t;
+
+typedef struct {
+    int unused;
+} parlio_tx_done_event_data_t;
+
+typedef bool (*parlio_tx_done_callback_t)(parlio_tx_unit_handle_t unit, const parlio_tx_done_event_data_t* event,
+                                          void* arg);
+
+typedef struct {
+    parlio_tx_done_callback_t on_trans_done;
+} parlio_tx_event_callbacks_t;
+
+typedef struct {
+    uint32_t idle_value;
+} parlio_transmit_config_t;
+
+int parlio_new_tx_unit(const parlio_tx_unit_config_t* config, parlio_tx_unit_handle_t* unit);
+int parlio_tx_unit_enable(parlio_tx_unit_handle_t unit);
+int parlio_tx_unit_register_event_callbacks(parlio_tx_unit_handle_t unit, const parlio_tx_event_callbacks_t* callbacks,
+                                            void* arg);
+int parlio_tx_unit_transmit(parlio_tx_unit_handle_t unit, const void* data, size_t bits,
+                            const parlio_transmit_config_t* config);
+
+#endif // HOST_PARLIO_TX_H
@@ -0,0 +1,2 @@
+// esp_attr.h - section attributes are defined in Arduino.h
+#include <Arduino.h>
@@ -0,0 +1,11 @@
+// esp_cpu.h
+#ifndef HOST_ESP_CPU_H
+#define HOST_ESP_CPU_H
+
+#include <stdint.h>
+
+// Cycles at 160 MHz of the simulated clock, or of the host's own clock
+// when hostRealCycles is set
+uint32_t esp_cpu_get_cycle_count();
+
+#endif // HOST_ESP_CPU_H
@@ -0,0 +1,15 @@
+// esp_heap_caps.h
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline void* heap_caps_calloc(size_t count, size_t size, unsigned caps) {
+    (void)caps;
+    return calloc(count, size);
+}
+
+#endif // HOST_ESP_HEAP_CAPS_H
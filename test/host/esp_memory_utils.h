@@ -0,0 +1,8 @@
+// esp_memory_utils.h - everything is "internal RAM" on the host
+#ifndef HOST_ESP_MEMORY_UTILS_H
+#define HOST_ESP_MEMORY_UTILS_H
+
+static inline bool esp_ptr_in_iram(const void*) { return true; }
+static inline bool esp_ptr_internal(const void*) { return true; }
+
+#endif // HOST_ESP_MEMORY_UTILS_H
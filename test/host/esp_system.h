@@ -0,0 +1,24 @@
+// esp_system.h
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO
+} esp_reset_reason_t;
+
+// What esp_reset_reason() reports, set by the test before a "boot"
+extern esp_reset_reason_t hostResetReason;
+
+static inline esp_reset_reason_t esp_reset_reason() { return hostResetReason; }
+
+#endif // HOST_ESP_SYSTEM_H
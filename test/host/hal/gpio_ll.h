@@ -0,0 +1,16 @@
+// hal/gpio_ll.h - register reads and writes go to the simulated pins
+#ifndef HOST_GPIO_LL_H
+#define HOST_GPIO_LL_H
+
+#include <stdint.h>
+
+typedef struct {
+    int unused;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+void gpio_ll_set_level(gpio_dev_t* hw, uint32_t gpioNum, uint32_t level);
+int gpio_ll_get_level(gpio_dev_t* hw, uint32_t gpioNum);
+
+#endif // HOST_GPIO_LL_H
@@ -0,0 +1,387 @@
+// host.cpp - the Arduino core, FreeRTOS and ESP-IDF calls behind the
+// headers in this directory
+#include "host.h"
+#include <stdarg.h>
+#include <chrono>
+#include <deque>
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "driver/pulse_cnt.h"
+#include "driver/parlio_tx.h"
+#include "hal/gpio_ll.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include <LittleFS.h>
+#include <Preferences.h>
+
+unsigned long hostUs = 0;
+int hostPins[64];
+uint32_t hostLedcDuty[64];
+bool hostRealCycles = false;
+std::vector<uint8_t>* hostSerialCapture = NULL;
+int hostSerialRoom = 4096;
+HostUart* hostSerial1 = NULL;
+int hostFailures = 0;
+
+esp_reset_reason_t hostResetReason = ESP_RST_SW;
+std::map<std::string, std::vector<uint8_t>> hostNvs;
+bool hostNvsFailWrites = false;
+int hostNvsReads = 0;
+int64_t hostPcntCount = 0;
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+gpio_dev_t GPIO;
+fs::LittleFSFS LittleFS;
+
+//===============================================
+// Arduino core
+//===============================================
+
+unsigned long micros() { return hostUs; }
+unsigned long millis() { return hostUs / 1000; }
+void delay(unsigned long ms) { hostUs += ms * 1000; }
+void delayMicroseconds(unsigned int us) { hostUs += us; }
+
+void pinMode(int, int) {}
+void digitalWrite(int pin, int value) { hostPins[pin] = value; }
+int digitalRead(int pin) { return hostPins[pin]; }
+int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterrupt(int, void (*)(), int) {}
+
+// Pin interrupts attached with an argument, run by hostSetPin()
+static struct {
+    void (*handler)(void*);
+    void* arg;
+    int mode;
+} pinInterrupts[64];
+
+void attachInterruptArg(int pin, void (*handler)(void*), void* arg, int mode) {
+    pinInterrupts[pin].handler = handler;
+    pinInterrupts[pin].arg = arg;
+    pinInterrupts[pin].mode = mode;
+}
+
+void detachInterrupt(int pin) { pinInterrupts[pin].handler = NULL; }
+
+void hostSetPin(int pin, int level) {
+    int previous = hostPins[pin];
+    hostPins[pin] = level;
+    if (pinInterrupts[pin].handler == NULL || level == previous) return;
+
+    int mode = pinInterrupts[pin].mode;
+    if (mode == CHANGE || (mode == RISING && level) || (mode == FALLING && !level)) {
+        pinInterrupts[pin].handler(pinInterrupts[pin].arg);
+    }
+}
+
+bool ledcAttach(int, uint32_t, uint8_t) { return true; }
+bool ledcWrite(int pin, uint32_t duty) {
+    hostLedcDuty[pin] = duty;
+    return true;
+}
+
+// Only the raw bytes are kept, formatted output goes through write()
+size_t Print::write(const uint8_t* data, size_t size) {
+    if (this == &Serial1 && hostSerial1) hostSerial1->receive(data, size);
+    if (this == &Serial && hostSerialCapture) hostSerialCapture->insert(hostSerialCapture->end(), data, data + size);
+    return size;
+}
+size_t Print::write(uint8_t byte) { return write(&byte, 1); }
+int Print::availableForWrite() { return hostSerialRoom; }
+
+static size_t printText(Print* port, const char* text) { return port->write((const uint8_t*)text, strlen(text)); }
+
+static size_t printNumber(Print* port, long long value, bool isUnsigned, int base) {
+    char text[72];
+    if (base == 16) snprintf(text, sizeof(text), "%llX", (unsigned long long)value);
+    else if (isUnsigned) snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+    else snprintf(text, sizeof(text), "%lld", value);
+    return printText(port, text);
+}
+
+size_t Print::print(const char* text) { return printText(this, text); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(int value, int base) { return printNumber(this, value, false, base); }
+size_t Print::print(unsigned value, int base) { return printNumber(this, value, true, base); }
+size_t Print::print(long value, int base) { return printNumber(this, value, false, base); }
+size_t Print::print(unsigned long value, int base) { return printNumber(this, value, true, base); }
+size_t Print::print(long long value, int base) { return printNumber(this, value, false, base); }
+size_t Print::print(unsigned long long value, int base) { return printNumber(this, (long long)value, true, base); }
+size_t Print::print(double value, int digits) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return printText(this, text);
+}
+size_t Print::println() { return printText(this, "\r\n"); }
+size_t Print::println(const char* text) { return print(text) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int value, int base) { return print(value, base) + println(); }
+size_t Print::println(unsigned value, int base) { return print(value, base) + println(); }
+size_t Print::println(long value, int base) { return print(value, base) + println(); }
+size_t Print::println(unsigned long value, int base) { return print(value, base) + println(); }
+size_t Print::println(long long value, int base) { return print(value, base) + println(); }
+size_t Print::println(unsigned long long value, int base) { return print(value, base) + println(); }
+size_t Print::println(double value, int digits) { return print(value, digits) + println(); }
+
+size_t Print::printf(const char* format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return printText(this, text);
+}
+
+int Stream::available() { return (this == &Serial1 && hostSerial1) ? hostSerial1->available() : 0; }
+int Stream::read() { return (this == &Serial1 && hostSerial1) ? hostSerial1->read() : -1; }
+int Stream::peek() { return -1; }
+void Stream::flush() {}
+void Stream::setTimeout(unsigned long) {}
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length && available() > 0) buffer[count++] = (uint8_t)read();
+    return count;
+}
+
+void HardwareSerial::begin(unsigned long, uint32_t, int8_t, int8_t) {}
+
+//===============================================
+// ESP-IDF
+//===============================================
+
+int64_t esp_timer_get_time() { return hostUs; }
+
+uint32_t esp_cpu_get_cycle_count() {
+    if (!hostRealCycles) return (uint32_t)(hostUs * 160);
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (uint32_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() * 160 / 1000);
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    if (!hostRealCycles) hostUs += us;
+}
+
+// Register writes run pin interrupts like any other edge, so a test can
+// watch the pins a step interrupt drives
+void gpio_ll_set_level(gpio_dev_t*, uint32_t gpioNum, uint32_t level) { hostSetPin(gpioNum, (int)level); }
+int gpio_ll_get_level(gpio_dev_t*, uint32_t gpioNum) { return hostPins[gpioNum]; }
+
+// General purpose timers
+#define HOST_TIMERS 4
+
+struct HostTimerState {
+    gptimer_alarm_cb_t callback;
+    void* arg;
+    uint64_t alarm;
+    bool autoReload;
+};
+
+static HostTimerState timers[HOST_TIMERS];
+static int timerCount = 0;
+
+static HostTimerState* timerState(gptimer_handle_t timer) {
+    return &timers[(intptr_t)timer - 1];
+}
+
+esp_err_t gptimer_new_timer(const gptimer_config_t*, gptimer_handle_t* timer) {
+    if (timerCount >= HOST_TIMERS) timerCount = 0;  // Earlier tests' timers are gone
+    timers[timerCount] = HostTimerState{NULL, NULL, UINT64_MAX, false};
+    *timer = (gptimer_handle_t)(intptr_t)(++timerCount);
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t* config) {
+    timerState(timer)->alarm = config ? config->alarm_count : UINT64_MAX;
+    timerState(timer)->autoReload = config && config->flags.auto_reload_on_alarm;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t* callbacks,
+                                           void* arg) {
+    timerState(timer)->callback = callbacks->on_alarm;
+    timerState(timer)->arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t) { return ESP_OK; }
+esp_err_t gptimer_start(gptimer_handle_t) { return ESP_OK; }
+esp_err_t gptimer_stop(gptimer_handle_t) { return ESP_OK; }
+
+esp_err_t gptimer_get_raw_count(gptimer_handle_t, uint64_t* count) {
+    *count = hostUs;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_raw_count(gptimer_handle_t, uint64_t) { return ESP_OK; }
+
+bool hostFireTimer(gptimer_handle_t timer) {
+    HostTimerState* state = timerState(timer);
+    gptimer_alarm_event_data_t event = {hostUs, state->alarm};
+    if (!state->autoReload) state->alarm = UINT64_MAX;
+    return state->callback(timer, &event, state->arg);
+}
+
+uint64_t hostTimerAlarm(gptimer_handle_t timer) { return timerState(timer)->alarm; }
+
+// Pulse counter
+esp_err_t pcnt_new_unit(const pcnt_unit_config_t*, pcnt_unit_handle_t* unit) {
+    *unit = (pcnt_unit_handle_t)1;
+    return ESP_OK;
+}
+esp_err_t pcnt_del_unit(pcnt_unit_handle_t) { return ESP_OK; }
+esp_err_t pcnt_unit_set_glitch_filter(pcnt_unit_handle_t, const pcnt_glitch_filter_config_t*) { return ESP_OK; }
+esp_err_t pcnt_new_channel(pcnt_unit_handle_t, const pcnt_chan_config_t*, pcnt_channel_handle_t* channel) {
+    *channel = (pcnt_channel_handle_t)1;
+    return ESP_OK;
+}
+esp_err_t pcnt_channel_set_edge_action(pcnt_channel_handle_t, pcnt_channel_edge_action_t, pcnt_channel_edge_action_t) {
+    return ESP_OK;
+}
+esp_err_t pcnt_channel_set_level_action(pcnt_channel_handle_t, pcnt_channel_level_action_t,
+                                        pcnt_channel_level_action_t) {
+    return ESP_OK;
+}
+esp_err_t pcnt_unit_add_watch_point(pcnt_unit_handle_t, int) { return ESP_OK; }
+esp_err_t pcnt_unit_enable(pcnt_unit_handle_t) { return ESP_OK; }
+esp_err_t pcnt_unit_disable(pcnt_unit_handle_t) { return ESP_OK; }
+esp_err_t pcnt_unit_start(pcnt_unit_handle_t) { return ESP_OK; }
+esp_err_t pcnt_unit_stop(pcnt_unit_handle_t) { return ESP_OK; }
+esp_err_t pcnt_unit_clear_count(pcnt_unit_handle_t) {
+    hostPcntCount = 0;
+    return ESP_OK;
+}
+
+// The hardware count is 32 bits wide with accumulation on
+esp_err_t pcnt_unit_get_count(pcnt_unit_handle_t, int* count) {
+    *count = (int)(uint32_t)(hostPcntCount & 0xFFFFFFFF);
+    return ESP_OK;
+}
+
+// Parallel IO
+int parlio_new_tx_unit(const parlio_tx_unit_config_t*, parlio_tx_unit_handle_t* unit) {
+    *unit = (parlio_tx_unit_handle_t)1;
+    return ESP_OK;
+}
+int parlio_tx_unit_enable(parlio_tx_unit_handle_t) { return ESP_OK; }
+int parlio_tx_unit_register_event_callbacks(parlio_tx_unit_handle_t, const parlio_tx_event_callbacks_t*, void*) {
+    return ESP_OK;
+}
+int parlio_tx_unit_transmit(parlio_tx_unit_handle_t, const void*, size_t, const parlio_transmit_config_t*) {
+    return ESP_OK;
+}
+
+//===============================================
+// FreeRTOS
+//===============================================
+
+struct HostQueue {
+    size_t length;
+    size_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    return new HostQueue{length, itemSize, {}};
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t) {
+    HostQueue* queue = (HostQueue*)handle;
+    if (queue->items.size() >= queue->length) return pdFALSE;
+    const uint8_t* bytes = (const uint8_t*)item;
+    queue->items.emplace_back(bytes, bytes + queue->itemSize);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t handle, const void* item, BaseType_t*) {
+    return xQueueSend(handle, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t) {
+    HostQueue* queue = (HostQueue*)handle;
+    if (queue->items.empty()) return pdFALSE;
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) { return ((HostQueue*)handle)->items.size(); }
+
+// Counting semaphores are never waited on, the tests render slices directly
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t, UBaseType_t) { return (SemaphoreHandle_t)1; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t, BaseType_t*) { return pdTRUE; }
+
+BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* handle) {
+    if (handle) *handle = (TaskHandle_t)1;
+    return pdPASS;
+}
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, int) {
+    return xTaskCreate(function, name, stackDepth, arg, priority, handle);
+}
+void vTaskDelay(TickType_t) {}
+void vTaskDelayUntil(TickType_t*, TickType_t) {}
+void vTaskDelete(TaskHandle_t) {}
+TickType_t xTaskGetTickCount() { return hostUs / 1000; }
+
+//===============================================
+// File system
+//===============================================
+
+static std::map<std::string, std::vector<uint8_t>> files;
+
+fs::File fs::FS::open(const char* path, const char* mode, bool) {
+    File file;
+    auto entry = files.find(path);
+    if (mode[0] == 'w') {
+        entry = files.insert_or_assign(path, std::vector<uint8_t>()).first;
+    } else if (mode[0] == 'a') {
+        entry = files.emplace(path, std::vector<uint8_t>()).first;
+    } else if (entry == files.end()) {
+        return file;
+    }
+    file._name = entry->first.c_str();
+    file._position = mode[0] == 'a' ? entry->second.size() : 0;
+    return file;
+}
+
+bool fs::FS::exists(const char* path) { return files.count(path) != 0; }
+bool fs::FS::remove(const char* path) { return files.erase(path) != 0; }
+
+size_t fs::File::write(const uint8_t* data, size_t size) {
+    std::vector<uint8_t>& contents = files[_name];
+    contents.insert(contents.end(), data, data + size);
+    _position = contents.size();
+    return size;
+}
+
+size_t fs::File::read(uint8_t* buffer, size_t size) {
+    std::vector<uint8_t>& contents = files[_name];
+    size_t count = 0;
+    while (count < size && _position < contents.size()) buffer[count++] = contents[_position++];
+    return count;
+}
+
+int fs::File::read() {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+bool fs::File::seek(uint32_t position) {
+    if (position > size()) return false;
+    _position = position;
+    return true;
+}
+
+size_t fs::File::size() { return files[_name].size(); }
+
+bool fs::LittleFSFS::begin(bool, const char*, uint8_t, const char*) { return true; }
+
+size_t fs::LittleFSFS::usedBytes() {
+    size_t used = 0;
+    for (auto& file : files) used += file.second.size();
+    return used;
+}
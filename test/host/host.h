@@ -0,0 +1,130 @@
+// host.h - shared pieces of the host tests: the simulated clock and pins,
+// a counting driver and helpers that stand in for the controller's timer
+// interrupt and command task
+#ifndef HOST_H
+#define HOST_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/gptimer.h"
+
+// The tests check the controllers' internal state next to what they report
+#define private public
+#include "TimerStepperControl.h"
+#undef private
+
+// Simulated time in microseconds, micros(), millis() and the timer count
+extern unsigned long hostUs;
+
+// Levels last written to each GPIO and LEDC duty per pin
+extern int hostPins[64];
+extern uint32_t hostLedcDuty[64];
+
+// Drive an input pin, running its interrupt on a matching edge
+void hostSetPin(int pin, int level);
+
+// esp_cpu_get_cycle_count() reads the host's own clock instead of the
+// simulated one (for timing the code itself)
+extern bool hostRealCycles;
+
+// Bytes written to Serial are appended here when set
+extern std::vector<uint8_t>* hostSerialCapture;
+
+// availableForWrite() of every port
+extern int hostSerialRoom;
+
+// A device on the other end of Serial1
+class HostUart {
+public:
+    virtual ~HostUart() {}
+    virtual void receive(const uint8_t* data, size_t size) = 0;  // Bytes the code sent
+    virtual int available() = 0;                                  // Bytes waiting for the code
+    virtual int read() = 0;
+};
+extern HostUart* hostSerial1;
+
+// Call the alarm callback of a timer as its interrupt would, returns its result
+bool hostFireTimer(gptimer_handle_t timer);
+
+// Alarm count a timer is set to, UINT64_MAX when it has none pending. A
+// one-shot alarm is cleared when it fires.
+uint64_t hostTimerAlarm(gptimer_handle_t timer);
+
+// Counts pulses and keeps the position in 1/32 steps, so moves in any
+// microstep mode can be compared with what reached the motor
+class HostDriver : public StepperDriver {
+public:
+    long position = 0;     // 1/32 steps
+    long pulses = 0;
+    int microstepMode = 1;
+
+    void init() override {}
+    void setDirection(bool clockwise) override { _direction = clockwise; }
+    void setSpeed(int speed) override { _speed = speed; }
+    void step() override {
+        if (!_enabled) return;
+        pulses++;
+        position += (_direction ? 1 : -1) * (32 / microstepMode);
+    }
+    void enable() override { _enabled = true; }
+    void disable() override { _enabled = false; }
+    void setMicrostepMode(int mode) override { microstepMode = mode; }
+    int getMicrostepMode() override { return microstepMode; }
+};
+
+// Run everything the command task would have received
+static inline void hostDrain(TimerStepperControl& controller) {
+    MotorCommand_t cmd;
+    while (xQueueReceive(controller._commandQueue, &cmd, 0) == pdTRUE) {
+        controller.handleCommand(&cmd);
+    }
+}
+
+// One 250 us timer tick
+static inline void hostTick(TimerStepperControl& controller) {
+    hostUs += 250;
+    hostFireTimer(controller._gptimer);
+}
+
+// Tick for a while, with the command task running every millisecond
+static inline void hostRun(TimerStepperControl& controller, unsigned long us) {
+    unsigned long end = hostUs + us;
+    while (hostUs < end) {
+        hostTick(controller);
+        if (hostUs % 1000 == 0) hostDrain(controller);
+    }
+}
+
+// Send a command and have the task take it at once
+static inline void hostCommand(TimerStepperControl& controller, MotorCommand_t cmd) {
+    controller.sendCommand(&cmd);
+    hostDrain(controller);
+}
+
+// Checks count failures and the test carries on, so one run shows them all
+extern int hostFailures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            hostFailures++; \
+        } \
+    } while (0)
+
+// Print the verdict, returns the exit status for main()
+static inline int hostReport(const char* name) {
+    printf("%s: %s\n", name, hostFailures ? "FAIL" : "PASS");
+    return hostFailures ? 1 : 0;
+}
+
+#endif // HOST_H
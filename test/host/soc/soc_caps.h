@@ -0,0 +1,7 @@
+// soc/soc_caps.h - the ESP32-C6 has the parallel IO peripheral
+#ifndef HOST_SOC_CAPS_H
+#define HOST_SOC_CAPS_H
+
+#define SOC_PARLIO_SUPPORTED 1
+
+#endif // HOST_SOC_CAPS_H
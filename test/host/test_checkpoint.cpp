@@ -0,0 +1,250 @@
+// test_checkpoint.cpp - the RTC position checkpoint: when it is trusted,
+// how positions convert between microstep modes, where the motor lands
+// when the driver's indexer comes back at home, and resets of a running
+// controller
+#include "host.h"
+#include "esp_system.h"
+
+static PositionCheckpoint_t makeCheckpoint(long position, long origin, int microstepMode,
+                                           uint8_t mode = 0, uint8_t flags = CHECKPOINT_DEENERGIZED) {
+    PositionCheckpoint_t checkpoint = {};
+    checkpoint.magic = CHECKPOINT_MAGIC;
+    checkpoint.count = 7;
+    checkpoint.position = position;
+    checkpoint.electricalOrigin = origin;
+    checkpoint.mode = mode;
+    checkpoint.flags = flags;
+    checkpoint.microstepMode = microstepMode;
+    checkpoint.crc = checkpointCrc32(&checkpoint);
+    return checkpoint;
+}
+
+// Only a checkpoint from rest with the driver off is taken up
+static void testEvaluate() {
+    long position = 0;
+    long origin = 0;
+
+    PositionCheckpoint_t checkpoint = makeCheckpoint(-1234, 6, 4);
+    CHECK(checkpointEvaluate(&checkpoint, 4, &position, &origin) == CHECKPOINT_RESTORED);
+    CHECK(position == -1234 && origin == 6);
+
+    // Finer now: scaled up
+    CHECK(checkpointEvaluate(&checkpoint, 32, &position, &origin) == CHECKPOINT_RESTORED);
+    CHECK(position == -1234 * 8 && origin == 6 * 8);
+
+    // Coarser now: only when both land on its steps
+    CHECK(checkpointEvaluate(&checkpoint, 2, &position, &origin) == CHECKPOINT_RESTORED);
+    CHECK(position == -617 && origin == 3);
+    position = origin = 99;
+    CHECK(checkpointEvaluate(&checkpoint, 1, &position, &origin) == CHECKPOINT_RESOLUTION);
+    CHECK(position == 99 && origin == 99);
+    checkpoint = makeCheckpoint(-1232, 6, 4);
+    CHECK(checkpointEvaluate(&checkpoint, 1, &position, &origin) == CHECKPOINT_RESOLUTION);
+    checkpoint = makeCheckpoint(-1232, 8, 4);
+    CHECK(checkpointEvaluate(&checkpoint, 1, &position, &origin) == CHECKPOINT_RESTORED);
+    CHECK(position == -308 && origin == 2);
+
+    // Moving or holding at the reset: the rotor could be anywhere nearby
+    checkpoint = makeCheckpoint(500, 0, 1, 1);
+    CHECK(checkpointEvaluate(&checkpoint, 1, &position, &origin) == CHECKPOINT_MOVING);
+    checkpoint = makeCheckpoint(500, 0, 1, 0, CHECKPOINT_REFERENCED);
+    CHECK(checkpointEvaluate(&checkpoint, 1, &position, &origin) == CHECKPOINT_HOLDING);
+    checkpoint = makeCheckpoint(500, 0, 1, 3, CHECKPOINT_DEENERGIZED);
+    CHECK(checkpointEvaluate(&checkpoint, 1, &position, &origin) == CHECKPOINT_MOVING);
+
+    // Nothing usable stored
+    checkpoint = makeCheckpoint(500, 0, 0);
+    CHECK(checkpointEvaluate(&checkpoint, 1, &position, &origin) == CHECKPOINT_NONE);
+    checkpoint = makeCheckpoint(500, 0, 1);
+    CHECK(checkpointEvaluate(&checkpoint, 0, &position, &origin) == CHECKPOINT_NONE);
+    checkpoint.magic ^= 1;
+    checkpoint.crc = checkpointCrc32(&checkpoint);
+    CHECK(checkpointEvaluate(&checkpoint, 1, &position, &origin) == CHECKPOINT_NONE);
+
+    // A reset in the middle of a write: any one bit wrong is no checkpoint
+    PositionCheckpoint_t good = makeCheckpoint(123456, -40, 16, 0, CHECKPOINT_DEENERGIZED | CHECKPOINT_REFERENCED);
+    int rejected = 0;
+    for (size_t bit = 0; bit < 8 * sizeof(good); bit++) {
+        PositionCheckpoint_t damaged = good;
+        ((uint8_t*)&damaged)[bit / 8] ^= 1 << (bit % 8);
+        if (checkpointEvaluate(&damaged, 16, &position, &origin) == CHECKPOINT_NONE) rejected++;
+    }
+    CHECK(rejected == (int)(8 * sizeof(good)));
+
+    // Noise in RTC memory after power-on
+    srand(50);
+    for (int trial = 0; trial < 10000; trial++) {
+        PositionCheckpoint_t noise;
+        for (size_t i = 0; i < sizeof(noise); i++) {
+            ((uint8_t*)&noise)[i] = rand();
+        }
+        CHECK(checkpointEvaluate(&noise, 16, &position, &origin) == CHECKPOINT_NONE);
+    }
+}
+
+// The indexer's home is the nearest position a whole number of electrical
+// cycles (four full steps) from the old origin
+static void testIndexerHome() {
+    CHECK(checkpointIndexerHome(0, 0, 1) == 0);
+    CHECK(checkpointIndexerHome(1, 0, 1) == 0);
+    CHECK(checkpointIndexerHome(2, 0, 1) == 0);   // Half a cycle goes back
+    CHECK(checkpointIndexerHome(3, 0, 1) == 4);
+    CHECK(checkpointIndexerHome(-1, 0, 1) == 0);
+    CHECK(checkpointIndexerHome(-3, 0, 1) == -4);
+    CHECK(checkpointIndexerHome(103, 5, 16) == 133);  // 98 into 64-microstep cycles
+    CHECK(checkpointIndexerHome(-100, -37, 8) == -101);
+
+    for (int microstepMode = 1; microstepMode <= 32; microstepMode *= 2) {
+        long cycle = 4L * microstepMode;
+        for (long origin = -2 * cycle; origin <= 2 * cycle; origin += 3) {
+            for (long position = -5 * cycle; position <= 5 * cycle; position++) {
+                long home = checkpointIndexerHome(position, origin, microstepMode);
+                long offset = position - home;
+                CHECK(((home - origin) % cycle) == 0);
+                CHECK(offset > -cycle / 2 && offset <= cycle / 2);
+            }
+        }
+    }
+}
+
+// A driver whose indexer is reset with the ESP32 (DRV8825 with its
+// sleep/reset line wired) or keeps its place (TMC2209)
+class IndexerDriver : public HostDriver {
+public:
+    bool resets = true;
+    bool indexerResetsWithHost() override { return resets; }
+};
+
+// A controller after a reset, with the checkpoint the last one left behind
+struct Boot {
+    IndexerDriver driver;
+    TimerStepperControl controller{&driver};
+    PositionCheckpoint_t checkpoint;
+    CheckpointRestore result;
+
+    Boot(esp_reset_reason_t reason, int microstepMode = 1, bool indexerResets = true) {
+        hostResetReason = reason;
+        driver.resets = indexerResets;
+        controller.init();
+        controller.setMicrostepMode(microstepMode);
+        result = controller.restoreCheckpoint(&checkpoint);
+        hostRun(controller, 1000);  // The first checkpoint of this boot
+    }
+
+    void moveTo(long position) {
+        hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, position, 4000, true, false, 0});
+        hostRun(controller, 6000000);
+        CHECK(!controller.isRunning());
+    }
+};
+
+// Resets of a controller at rest, moving and holding
+static void testResets() {
+    {
+        Boot boot(ESP_RST_POWERON);
+        CHECK(boot.result == CHECKPOINT_NONE);
+        boot.controller.setReferenced(true);
+        boot.moveTo(12345);
+    }
+    {
+        // Panic at rest: back where the indexer's home puts it
+        Boot boot(ESP_RST_PANIC);
+        CHECK(boot.result == CHECKPOINT_RESTORED);
+        CHECK(boot.checkpoint.position == 12345);
+        CHECK(boot.controller.getCurrentPosition() == 12344);
+        CHECK(boot.controller.isReferenced());
+        boot.moveTo(-203);
+    }
+    {
+        // Power cycled: RTC memory is not trusted whatever it holds
+        Boot boot(ESP_RST_POWERON);
+        CHECK(boot.result == CHECKPOINT_NONE);
+        CHECK(boot.controller.getCurrentPosition() == 0);
+        CHECK(!boot.controller.isReferenced());
+        boot.moveTo(-203);
+    }
+    {
+        Boot boot(ESP_RST_INT_WDT);
+        CHECK(boot.result == CHECKPOINT_RESTORED);
+        CHECK(boot.controller.getCurrentPosition() == -204);
+
+        // Watchdog in the middle of a move
+        hostCommand(boot.controller, MotorCommand_t{CMD_MOVE_TO, 5000, 4000, true, false, 0});
+        hostRun(boot.controller, 200000);
+        CHECK(boot.controller.isRunning());
+    }
+    {
+        Boot boot(ESP_RST_TASK_WDT);
+        CHECK(boot.result == CHECKPOINT_MOVING);
+        CHECK(boot.checkpoint.mode != 0);
+        CHECK(boot.controller.getCurrentPosition() == 0);
+
+        // Holding torque on at rest
+        boot.moveTo(800);
+        boot.driver.enable();
+        boot.controller.setReferenced(false);
+        hostRun(boot.controller, 1000);
+    }
+    {
+        Boot boot(ESP_RST_SW);
+        CHECK(boot.result == CHECKPOINT_HOLDING);
+        CHECK(boot.controller.getCurrentPosition() == 0);
+    }
+}
+
+// The checkpoint is kept in the microstep mode it was written in
+static void testMicrostepModes() {
+    {
+        Boot boot(ESP_RST_POWERON, 16);
+        boot.moveTo(1602);
+    }
+    {
+        // Finer now: 1602/16 steps is 3204/32, home is a multiple of 128 away
+        Boot boot(ESP_RST_SW, 32);
+        CHECK(boot.result == CHECKPOINT_RESTORED);
+        CHECK(boot.checkpoint.microstepMode == 16);
+        CHECK(boot.controller.getCurrentPosition() == checkpointIndexerHome(3204, 0, 32));
+        CHECK(boot.controller.getCurrentPosition() % 128 == 0);
+        boot.moveTo(3210);
+    }
+    {
+        // Coarser now and between its steps
+        Boot boot(ESP_RST_SW, 4);
+        CHECK(boot.result == CHECKPOINT_RESOLUTION);
+        CHECK(boot.controller.getCurrentPosition() == 0);
+    }
+}
+
+// A driver that kept its indexer through the reset gets the stored
+// position back unchanged, still referenced
+static void testKeptIndexer() {
+    {
+        Boot boot(ESP_RST_POWERON, 16, false);
+        boot.controller.setReferenced(true);
+        boot.moveTo(12345);
+    }
+    {
+        Boot boot(ESP_RST_PANIC, 16, false);
+        CHECK(boot.result == CHECKPOINT_RESTORED);
+        CHECK(boot.controller.getCurrentPosition() == 12345);
+        CHECK(boot.controller._electricalOrigin == 0);
+        CHECK(boot.controller.isReferenced());
+        boot.moveTo(-77);
+    }
+    {
+        // Finer now: scaled, never snapped
+        Boot boot(ESP_RST_SW, 32, false);
+        CHECK(boot.result == CHECKPOINT_RESTORED);
+        CHECK(boot.controller.getCurrentPosition() == -154);
+        CHECK(boot.controller._electricalOrigin == 0);
+    }
+}
+
+int main() {
+    testEvaluate();
+    testIndexerHome();
+    testResets();
+    testMicrostepModes();
+    testKeptIndexer();
+    return hostReport("test_checkpoint");
+}
@@ -0,0 +1,128 @@
+// test_closedloop.cpp - closed-loop check against a simulated load that
+// slips: the stall is caught within a few checks and the make-up move
+// still puts the shaft on the target
+#include "host.h"
+#include "ClosedLoopMonitor.h"
+
+#define ENCODER_COUNTS_PER_STEP 2
+
+// A motor whose shaft misses steps while the load holds it
+class SlippingDriver : public HostDriver {
+public:
+    long shaft = 0;           // Steps the shaft really turned
+    long slipFrom = LONG_MAX; // Shaft position where the load grabs
+    long slipSteps = 0;       // Pulses it swallows there (-1 = jammed for good)
+    long slipped = 0;
+
+    void step() override {
+        if (!_enabled) return;
+        HostDriver::step();
+        bool grabbed = _direction && shaft >= slipFrom && (slipSteps < 0 || slipped < slipSteps);
+        if (grabbed) {
+            slipped++;
+            return;
+        }
+        shaft += _direction ? 1 : -1;
+    }
+};
+
+struct Rig {
+    SlippingDriver driver;
+    TimerStepperControl controller{&driver};
+    ClosedLoopMonitor monitor{&controller, 4, 5};
+
+    Rig() {
+        controller.init();
+        CHECK(monitor.begin());
+        CHECK(monitor.setScale(1, ENCODER_COUNTS_PER_STEP));
+        monitor.setErrorLimit(20);
+    }
+
+    // Main loop: the encoder follows the shaft, the monitor checks
+    void run(unsigned long ms, long* worstError = NULL) {
+        for (unsigned long i = 0; i < ms; i++) {
+            hostRun(controller, 1000);
+            hostPcntCount = driver.shaft * ENCODER_COUNTS_PER_STEP;
+            monitor.service();
+            if (worstError) *worstError = max(*worstError, labs(controller.getCurrentPosition() - driver.shaft));
+        }
+    }
+};
+
+// Without slip the commanded and measured positions agree at every check
+static void testNoSlip() {
+    Rig rig;
+    hostCommand(rig.controller, MotorCommand_t{CMD_MOVE_TO, 8000, 3000, true, false, 0});
+    rig.run(6000);
+    CHECK(rig.monitor.getMaxError() <= 1);
+    CHECK(rig.monitor.getStallCount() == 0);
+    CHECK(rig.driver.shaft == 8000);
+}
+
+// 60 steps lost mid-move: caught once, made up, shaft ends on the target
+static void testSlipAndRecover() {
+    Rig rig;
+    rig.monitor.setAutoCorrect(true, 1500);
+    rig.driver.slipFrom = 3000;
+    rig.driver.slipSteps = 60;
+    hostCommand(rig.controller, MotorCommand_t{CMD_MOVE_TO, 8000, 3000, true, false, 0});
+
+    // Error crosses the limit after 20 swallowed pulses; at 3000 steps/s
+    // the stall is confirmed within three 10 ms checks of that
+    unsigned long overMs = 0, detectedMs = 0;
+    for (int ms = 0; ms < 10000; ms++) {
+        rig.run(1);
+        if (overMs == 0 && rig.driver.slipped > 20) overMs = ms;
+        if (detectedMs == 0 && rig.monitor.getStallCount() > 0) detectedMs = ms;
+    }
+    printf("slip: %ld steps swallowed, stall seen %lu ms after the error passed the limit, %lu make-up moves, "
+           "shaft %ld, position %ld\n", rig.driver.slipped, detectedMs - overMs, rig.monitor.getCorrectionCount(),
+           rig.driver.shaft, rig.controller.getCurrentPosition());
+    CHECK(detectedMs - overMs <= (CLOSED_LOOP_STALL_CHECKS + 1) * CLOSED_LOOP_CHECK_INTERVAL_MS);
+    CHECK(rig.monitor.getStallCount() == 1);
+    CHECK(rig.monitor.getCorrectionCount() == 1);
+    CHECK(rig.monitor.isPositionLost());
+    CHECK(rig.driver.shaft == 8000);
+    CHECK(rig.controller.getCurrentPosition() == 8000);
+    CHECK(!rig.monitor.isCorrecting());
+}
+
+// Without auto-correct the stall is only reported, and the step count is
+// left as it is
+static void testReportOnly() {
+    Rig rig;
+    rig.driver.slipFrom = 1000;
+    rig.driver.slipSteps = 100;
+    hostCommand(rig.controller, MotorCommand_t{CMD_MOVE_TO, 4000, 3000, true, false, 0});
+    rig.run(4000);
+    CHECK(rig.monitor.getStallCount() == 1);
+    CHECK(rig.monitor.getCorrectionCount() == 0);
+    CHECK(rig.controller.getCurrentPosition() == 4000);
+    CHECK(rig.driver.shaft == 3900);
+    CHECK(rig.monitor.getError() == 100);
+}
+
+// A jammed load gets a limited number of tries and no more
+static void testJammed() {
+    Rig rig;
+    rig.monitor.setAutoCorrect(true, 1500);
+    rig.driver.slipFrom = 2000;
+    rig.driver.slipSteps = -1;
+    hostCommand(rig.controller, MotorCommand_t{CMD_MOVE_TO, 5000, 3000, true, false, 0});
+    rig.run(20000);
+    printf("jammed: %lu stalls, %lu make-up moves, shaft %ld\n", rig.monitor.getStallCount(),
+           rig.monitor.getCorrectionCount(), rig.driver.shaft);
+    CHECK(rig.monitor.getCorrectionCount() == CLOSED_LOOP_MAX_CORRECTIONS);
+    CHECK(rig.monitor.getStallCount() == CLOSED_LOOP_MAX_CORRECTIONS + 1);
+    CHECK(!rig.controller.isRunning());
+    CHECK(rig.driver.shaft == 2000);
+    CHECK(rig.controller.getCurrentPosition() == 2000);
+}
+
+int main() {
+    testNoSlip();
+    testSlipAndRecover();
+    testReportOnly();
+    testJammed();
+    return hostReport("test_closedloop");
+}
@@ -0,0 +1,121 @@
+// test_estop.cpp - steps that still reach the motor after an e-stop, in the
+// worst case over many stop times, and the command race it must survive
+#include "host.h"
+
+#define ESTOP_PIN 9
+#define TRIALS 300
+
+// Target that runs away at a steady rate
+class RunawayTarget : public TrackingSource {
+public:
+    long getTrackingTarget() override { return (long)(micros() / 200); }
+};
+
+enum Mode { MODE_MOVE, MODE_CONTINUOUS, MODE_TRACKING, MODE_COUNT };
+static const char* modeNames[MODE_COUNT] = {"move", "continuous", "tracking"};
+
+// Pulses after the e-stop edge, and how far past the bound the speed at
+// the edge allows
+struct Trial {
+    long pulsesAfter;
+    long excess;
+};
+
+static Trial runTrial(Mode mode, int deceleration, unsigned long stopAfterUs) {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    RunawayTarget runaway;
+    hostPins[ESTOP_PIN] = HIGH;
+    controller.setEmergencyStopInput(ESTOP_PIN, true, deceleration);
+    hostCommand(controller, MotorCommand_t{CMD_SET_ACCELERATION, 0, 0, true, false, 20000});
+
+    long target = 1000000;
+    switch (mode) {
+        case MODE_MOVE:
+            hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, target, 4000, true, false, 0});
+            break;
+        case MODE_CONTINUOUS:
+            hostCommand(controller, MotorCommand_t{CMD_START_CONTINUOUS, 0, 4000, true, true, 0});
+            break;
+        default:
+            controller.setTrackingSource(&runaway);
+            hostCommand(controller, MotorCommand_t{CMD_START_TRACKING, 0, 4000, true, false, 20000});
+            break;
+    }
+    hostRun(controller, stopAfterUs);
+
+    // The edge lands between two ticks
+    float speed = min(controller._currentSpeed, 1000000.0f / STEP_TIMER_INTERVAL_US);
+    long pulses = driver.pulses;
+    hostSetPin(ESTOP_PIN, LOW);
+    CHECK(controller.isFaulted());
+
+    // Commands keep coming, as they would from the main loop
+    MotorCommand_t move = {CMD_MOVE_STEPS, 1000, 4000, true, false, 0};
+    for (int ms = 0; ms < 2000; ms++) {
+        controller.sendCommand(&move);
+        hostRun(controller, 1000);
+    }
+    CHECK(!controller.isRunning());
+
+    Trial trial;
+    trial.pulsesAfter = driver.pulses - pulses;
+    long bound = deceleration > 0 ? (long)ceilf(speed * speed / (2.0f * deceleration)) + 1 : 0;
+    trial.excess = trial.pulsesAfter - bound;
+    return trial;
+}
+
+static void testWorstCase() {
+    srand(38);
+    const int decelerations[] = {0, 40000};
+    for (int deceleration : decelerations) {
+        for (int mode = 0; mode < MODE_COUNT; mode++) {
+            long worst = 0, worstExcess = LONG_MIN;
+            for (int trial = 0; trial < TRIALS; trial++) {
+                // Anywhere from the first steps to well into the cruise,
+                // at any point between two ticks
+                unsigned long stopAfter = 1000 + (rand() % 1500) * 1000 + (rand() % 4) * 62;
+                Trial result = runTrial((Mode)mode, deceleration, stopAfter);
+                worst = max(worst, result.pulsesAfter);
+                worstExcess = max(worstExcess, result.excess);
+            }
+            printf("%-10s decel %5d: worst %ld steps after the e-stop, %ld over the braking bound\n",
+                   modeNames[mode], deceleration, worst, worstExcess);
+            CHECK(worstExcess <= 0);
+            if (deceleration == 0) CHECK(worst == 0);
+        }
+    }
+}
+
+// A command that had passed the fault check when the e-stop hit still
+// marks the motor running. The step ISR must not pulse for it.
+static void testCommandRace() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.emergencyStop();
+    CHECK(controller.isFaulted());
+
+    // What the rest of an interrupted CMD_MOVE_TO would have done
+    controller._targetPosition = 5000;
+    controller._speed = 4000;
+    controller._isRunning = true;
+    driver.enable();
+    hostRun(controller, 100000);
+    CHECK(driver.pulses == 0);
+    CHECK(!controller.isRunning());
+    CHECK(!driver.isEnabled());
+
+    // Once cleared, motion works again
+    CHECK(controller.clearFault());
+    hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, 500, 4000, true, false, 0});
+    hostRun(controller, 2000000);
+    CHECK(controller.getCurrentPosition() == 500);
+}
+
+int main() {
+    testWorstCase();
+    testCommandRace();
+    return hostReport("test_estop");
+}
@@ -0,0 +1,103 @@
+// test_feed.cpp - feed override: the speed follows the override under the
+// acceleration limit, never runs ahead of the tick rate, moves still end on
+// their exact target, and fixed-speed moves are left alone
+#include "host.h"
+
+// Pulses in each 10 ms window while the controller runs
+static std::vector<long> pulseRate(TimerStepperControl& controller, HostDriver& driver, int windows,
+                                   float* worstAccumulator) {
+    std::vector<long> rates;
+    for (int window = 0; window < windows; window++) {
+        long before = driver.pulses;
+        for (int tick = 0; tick < 40; tick++) {
+            hostTick(controller);
+            *worstAccumulator = max(*worstAccumulator, controller._stepAccumulator);
+            if (hostUs % 1000 == 0) hostDrain(controller);
+        }
+        rates.push_back((driver.pulses - before) * 100);
+    }
+    return rates;
+}
+
+// 4000 steps/s at 200%, then down to 25%: the motor has to slow to 1000
+// steps/s in the time the acceleration takes, not carry on at 4000
+static void testSlowDown() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    hostCommand(controller, MotorCommand_t{CMD_SET_ACCELERATION, 0, 0, true, false, 8000});
+    hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, 100000, 4000, true, false, 0});
+    controller.setFeedOverride(200);
+
+    float worstAccumulator = 0.0f;
+    std::vector<long> fast = pulseRate(controller, driver, 100, &worstAccumulator);
+    controller.setFeedOverride(25);
+    std::vector<long> slow = pulseRate(controller, driver, 100, &worstAccumulator);
+
+    // (4000 - 1000) / 8000 = 375 ms to slow down
+    long settled = 0;
+    for (size_t i = 40; i < slow.size(); i++) settled = max(settled, labs(slow[i] - 1000));
+    long worstChange = 0;
+    std::vector<long> all = fast;
+    all.insert(all.end(), slow.begin(), slow.end());
+    for (size_t i = 1; i < all.size(); i++) worstChange = max(worstChange, labs(all[i] - all[i - 1]));
+
+    printf("200%%: %ld steps/s, 25%% after 400 ms: within %ld of 1000, worst window change %ld, "
+           "accumulator %.2f\n", fast.back(), settled, worstChange, worstAccumulator);
+    CHECK(fast.back() == 4000);
+    CHECK(settled <= 100);
+    CHECK(worstAccumulator < 2.0f * controller._stepScale + 0.001f);
+
+    // 10 ms windows at 8000 steps/s² change by at most 80 steps/s, plus a
+    // pulse either window can gain or lose at its edges
+    CHECK(worstChange <= 80 + 200);
+}
+
+// Overrides thrown in at random never cost the move its exact end
+static void testExactEnd() {
+    srand(39);
+    for (int trial = 0; trial < 20; trial++) {
+        HostDriver driver;
+        TimerStepperControl controller(&driver);
+        controller.init();
+        long target = (rand() % 40000) - 20000;
+        hostCommand(controller, MotorCommand_t{CMD_SET_ACCELERATION, 0, 0, true, false, 16000});
+        hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, target, 3000, true, false, 0});
+        for (int ms = 0; ms < 60000 && controller.isRunning(); ms++) {
+            if (ms % 50 == 0) controller.setFeedOverride(FEED_OVERRIDE_MIN + rand() % (FEED_OVERRIDE_MAX - FEED_OVERRIDE_MIN + 1));
+            hostRun(controller, 1000);
+        }
+        CHECK(!controller.isRunning());
+        CHECK(controller.getCurrentPosition() == target);
+        CHECK(driver.position == target * 32);
+    }
+}
+
+// A move sent with fixedSpeed (homing, closed-loop make-up) runs at its
+// own speed whatever the override, the next plain move takes it up again
+static void testFixedSpeed() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    hostCommand(controller, MotorCommand_t{CMD_SET_ACCELERATION, 0, 0, true, false, 8000});
+    controller.setFeedOverride(40);
+
+    MotorCommand_t fixed = {CMD_MOVE_TO, 100000, 2000, true, false, 0, true};
+    hostCommand(controller, fixed);
+    float worstAccumulator = 0.0f;
+    std::vector<long> rates = pulseRate(controller, driver, 50, &worstAccumulator);
+    CHECK(rates.back() == 2000);
+    CHECK(controller.getCommandedSpeed() == 2000);
+
+    hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, 200000, 2000, true, false, 0});
+    rates = pulseRate(controller, driver, 50, &worstAccumulator);
+    CHECK(rates.back() == 800);
+    CHECK(controller.getCommandedSpeed() == 800);
+}
+
+int main() {
+    testSlowDown();
+    testExactEnd();
+    testFixedSpeed();
+    return hostReport("test_feed");
+}
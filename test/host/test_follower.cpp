@@ -0,0 +1,134 @@
+// test_follower.cpp - step/dir follower: pulse trains up to 100 kHz scaled,
+// smoothed by the tracking profile and followed to the exact step
+#include "host.h"
+#define private public
+#include "StepDirFollower.h"
+#undef private
+
+// Input pulses as the counter sees them, at a steady rate
+struct PulseTrain {
+    double rate = 0.0;      // Pulses per second, negative with DIR low
+    double fraction = 0.0;
+
+    void tick(unsigned long us) {
+        fraction += rate * us / 1000000.0;
+        long whole = (long)fraction;
+        hostPcntCount += whole;
+        fraction -= whole;
+    }
+};
+
+// Run the controller with the pulse train feeding the counter
+static void run(TimerStepperControl& controller, PulseTrain& train, unsigned long us, long* worstLag = NULL,
+                StepDirFollower* follower = NULL) {
+    unsigned long end = hostUs + us;
+    while (hostUs < end) {
+        train.tick(250);
+        hostTick(controller);
+        if (worstLag && follower) {
+            *worstLag = max(*worstLag, labs(follower->getTrackingTarget() - controller.getCurrentPosition()));
+        }
+    }
+}
+
+static void startFollowing(TimerStepperControl& controller, StepDirFollower& follower) {
+    follower.anchor(controller.getCurrentPosition());
+    controller.setTrackingSource(&follower);
+    hostCommand(controller, MotorCommand_t{CMD_START_TRACKING, 0, 4000, true, false, 200000});
+}
+
+// 100 kHz in, 1/32 out, then the input stops and the motor lands on it
+static void testFastTrain() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    StepDirFollower follower(10, 11);
+    CHECK(follower.begin());
+    CHECK(follower.setScale(1, 32));
+    startFollowing(controller, follower);
+
+    PulseTrain train;
+    train.rate = 100000;
+    long lag = 0;
+    run(controller, train, 3000000, &lag, &follower);
+    train.rate = 0;
+    run(controller, train, 500000);
+
+    int64_t pulses = follower.getInputCount();
+    printf("100 kHz: %lld pulses, worst lag %ld steps\n", (long long)pulses, lag);
+    CHECK(pulses >= 299999 && pulses <= 300000);
+    CHECK(controller.getCurrentPosition() == scaleRounded(pulses, 1, 32));
+    CHECK(driver.position == controller.getCurrentPosition() * 32);
+    CHECK(lag < 100);
+
+    // And back the other way at 50 kHz
+    train.rate = -50000;
+    run(controller, train, 4000000);
+    train.rate = 0;
+    run(controller, train, 500000);
+    CHECK(controller.getCurrentPosition() == scaleRounded(follower.getInputCount(), 1, 32));
+    CHECK(controller.isTracking());
+}
+
+// The hardware count wraps at 32 bits, the follower's doesn't
+static void testCounterWrap() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    StepDirFollower follower(10, 11);
+    CHECK(follower.begin());
+    hostPcntCount = 0xFFFFFF00LL;
+    follower._counter._lastRawCount = (int)0xFFFFFF00;
+    follower.anchor(0);
+    controller.setTrackingSource(&follower);
+    hostCommand(controller, MotorCommand_t{CMD_START_TRACKING, 0, 4000, true, false, 200000});
+
+    PulseTrain train;
+    train.rate = 3000;
+    run(controller, train, 1000000);
+    train.rate = 0;
+    run(controller, train, 1000000);
+    CHECK(follower.getInputCount() - follower._anchorCount == 3000);
+    CHECK(controller.getCurrentPosition() == 3000);
+}
+
+// Retuning while following keeps the target where it was and scales only
+// the pulses after it
+static void testRetune() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    StepDirFollower follower(10, 11);
+    CHECK(follower.begin());
+    CHECK(follower.setScale(1, 64));
+    startFollowing(controller, follower);
+
+    PulseTrain train;
+    train.rate = 100000;
+    long worstJump = 0;
+    long lastTarget = follower.getTrackingTarget();
+    for (int i = 0; i < 20; i++) {
+        run(controller, train, 100000);
+        long before = follower.getTrackingTarget();
+        CHECK(follower.setScale(i % 2 ? 1 : 3, i % 2 ? 64 : 128));
+        CHECK(follower.getTrackingTarget() == before);
+        worstJump = max(worstJump, before - lastTarget);
+        lastTarget = before;
+    }
+    int64_t count = follower.getInputCount();
+    long target = follower.getTrackingTarget();
+    train.rate = 0;
+    run(controller, train, 1000000);
+    CHECK(follower.getInputCount() == count);
+    CHECK(controller.getCurrentPosition() == target);
+
+    // Between retunes the target moves by the 10000 pulses of 100 ms, scaled
+    CHECK(worstJump <= scaleRounded(10000, 3, 128) + 1);
+}
+
+int main() {
+    testFastTrain();
+    testCounterWrap();
+    testRetune();
+    return hostReport("test_follower");
+}
@@ -0,0 +1,114 @@
+// test_homing.cpp - homing against a simulated switch: the zero lands on
+// the same physical step from any start, and the cycle is timed
+#include "host.h"
+#include "Homing.h"
+
+#define SWITCH_PIN 7
+#define SWITCH_HYSTERESIS 3  // Steps past the closing point before it opens
+
+// An active-low switch that closes at physical step 0 and below
+struct Switch {
+    HostDriver* driver;
+    long offset;  // Physical position of driver step 0
+    bool closed = false;
+
+    long physical() { return offset + driver->position / 32; }
+
+    void update() {
+        long position = physical();
+        if (!closed && position <= 0) closed = true;
+        if (closed && position > SWITCH_HYSTERESIS) closed = false;
+        hostSetPin(SWITCH_PIN, closed ? LOW : HIGH);
+    }
+};
+
+struct Result {
+    bool done;
+    long zeroError;      // Logical minus physical position after homing
+    long overshoot;
+    unsigned long totalMs;
+};
+
+// Home from a physical start position, the controller thinks it is at 12345
+static Result home(long start, bool singlePass = false) {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setCurrentPosition(12345);
+    Switch limit{&driver, start};
+    hostPins[SWITCH_PIN] = HIGH;
+    limit.update();
+
+    Homing homing(&controller, SWITCH_PIN, true);
+    homing.setSpeeds(1600, 100);
+    homing.setDistances(400, 100000);
+    homing.setSinglePass(singlePass);
+    CHECK(homing.start());
+    for (int ms = 0; ms < 120000 && homing.isBusy(); ms++) {
+        for (int tick = 0; tick < 4; tick++) {
+            hostTick(controller);
+            limit.update();
+        }
+        hostDrain(controller);
+        homing.service();
+    }
+
+    Result result;
+    result.done = homing.getState() == HOMING_DONE;
+    result.zeroError = controller.getCurrentPosition() - limit.physical();
+    result.overshoot = homing.getSeekOvershoot();
+    result.totalMs = homing.getTotalTime();
+    CHECK(controller.isReferenced() == result.done);
+    return result;
+}
+
+// Every start gives the same zero, to the step
+static void testRepeatability() {
+    const long starts[] = {5000, 12345, 401, 40, 2, 0, -2, -150};
+    for (long start : starts) {
+        Result result = home(start);
+        printf("from %6ld: %s, zero error %ld, seek overshoot %ld, %lu ms\n",
+               start, result.done ? "done" : "failed", result.zeroError, result.overshoot, result.totalMs);
+        CHECK(result.done);
+        CHECK(result.zeroError == 0);
+
+        // The fast stop runs past the switch by no more than the braking
+        // distance, and the cycle takes the seek, the back-off and a slow
+        // approach over the back-off distance
+        CHECK(result.overshoot >= 0 && result.overshoot <= 1600L * 1600 / (2 * 3200) + 2);
+        CHECK(result.totalMs <= (unsigned long)(max(start, 0L) * 1000 / 1600) + 2 * 400 * 1000 / 1600 +
+                                400 * 1000 / 100 + 1000);
+    }
+
+    // Single pass (stall sensing) takes the zero at seek speed
+    for (long start : {5000L, 777L}) {
+        Result result = home(start, true);
+        printf("single pass from %ld: zero error %ld, %lu ms\n", start, result.zeroError, result.totalMs);
+        CHECK(result.done);
+        CHECK(result.zeroError == 0);
+    }
+}
+
+// No switch within the travel limit fails instead of running on
+static void testNotFound() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    hostSetPin(SWITCH_PIN, HIGH);
+    Homing homing(&controller, SWITCH_PIN, true);
+    homing.setDistances(400, 2000);
+    CHECK(homing.start());
+    for (int ms = 0; ms < 10000 && homing.isBusy(); ms++) {
+        hostRun(controller, 1000);
+        homing.service();
+    }
+    CHECK(homing.getState() == HOMING_FAILED);
+    CHECK(controller.getCurrentPosition() == -2000);
+    CHECK(!homing.isHomed());
+}
+
+int main() {
+    testRepeatability();
+    testNotFound();
+    return hostReport("test_homing");
+}
@@ -0,0 +1,130 @@
+// test_l298n.cpp - L298N sine table and the phase currents put out per step
+#include "host.h"
+#define private public
+#include "L298NDriver.h"
+#undef private
+
+#define PIN1 1
+#define PIN2 2
+#define PIN3 3
+#define PIN4 4
+#define ENABLE_A 5
+#define ENABLE_B 6
+
+// Signed phase currents as the bridge pins and PWM duty show them
+static int bridgeA() { return (hostPins[PIN1] && !hostPins[PIN2] ? 1 : -1) * (int)hostLedcDuty[ENABLE_A]; }
+static int bridgeB() { return (hostPins[PIN3] && !hostPins[PIN4] ? 1 : -1) * (int)hostLedcDuty[ENABLE_B]; }
+
+// Quarter wave: exact ends, rising, and within a count of the real sine
+static void testTable() {
+    CHECK(L298N_SINE_TABLE[0] == 0);
+    CHECK(L298N_SINE_TABLE[L298N_MAX_MICROSTEP] == L298N_PWM_MAX);
+    for (int i = 0; i <= L298N_MAX_MICROSTEP; i++) {
+        double expected = L298N_PWM_MAX * sin(i * M_PI / (2 * L298N_MAX_MICROSTEP));
+        CHECK(fabs(L298N_SINE_TABLE[i] - expected) <= 1.0);
+        if (i > 0) CHECK(L298N_SINE_TABLE[i] > L298N_SINE_TABLE[i - 1]);
+    }
+
+    // Over a whole electrical cycle the current vector keeps its length and
+    // turns the same way by the same angle each table position
+    double lastAngle = atan2(L298NDriver::phaseBCurrent(0), L298NDriver::phaseACurrent(0));
+    for (int index = 0; index < L298N_PHASE_STEPS; index++) {
+        int a = L298NDriver::phaseACurrent(index);
+        int b = L298NDriver::phaseBCurrent(index);
+        double length = sqrt((double)a * a + (double)b * b);
+        CHECK(fabs(length - L298N_PWM_MAX) <= 2.0);
+
+        double angle = atan2(b, a);
+        if (index > 0) {
+            double turn = remainder(angle - lastAngle, 2 * M_PI);
+            CHECK(fabs(turn - 2 * M_PI / L298N_PHASE_STEPS) < 0.002);
+        }
+        lastAngle = angle;
+    }
+
+    // Full steps land on the two-phase-on diagonals
+    for (int step = 0; step < 4; step++) {
+        int index = step * L298N_MAX_MICROSTEP;
+        CHECK(abs(L298NDriver::phaseACurrent(index)) == abs(L298NDriver::phaseBCurrent(index)));
+    }
+}
+
+// What the bridge sees step by step in each mode
+static void testStepSequence() {
+    L298NDriver driver(PIN1, PIN2, PIN3, PIN4, ENABLE_A, ENABLE_B);
+    driver.init();
+    CHECK(hostLedcDuty[ENABLE_A] == 0 && hostLedcDuty[ENABLE_B] == 0);
+
+    // Full steps are the classic full-current sequence: A+B+, A-B+, A-B-, A+B-
+    driver.setMicrostepMode(1);
+    driver.enable();
+    driver.setDirection(true);
+    const int fullA[4] = {-1, -1, 1, 1};
+    const int fullB[4] = {1, -1, -1, 1};
+    int startA = bridgeA() > 0 ? 1 : -1, startB = bridgeB() > 0 ? 1 : -1;
+    CHECK(startA == 1 && startB == 1);
+    for (int i = 0; i < 8; i++) {
+        driver.step();
+        CHECK(bridgeA() == fullA[i % 4] * L298N_PWM_MAX);
+        CHECK(bridgeB() == fullB[i % 4] * L298N_PWM_MAX);
+    }
+
+    // Each microstep mode walks the table in its own stride, a full cycle is
+    // four full steps and a reversal retraces the same currents
+    for (int mode = 2; mode <= L298N_MAX_MICROSTEP; mode *= 2) {
+        driver.setMicrostepMode(mode);
+        CHECK(driver.getMicrostepMode() == mode);
+        driver.enable();  // Full steps were forced to full current, put out the table value
+        driver.setDirection(true);
+        std::vector<std::pair<int, int>> forward;
+        for (int i = 0; i < 4 * mode; i++) {
+            forward.push_back({bridgeA(), bridgeB()});
+            driver.step();
+            int index = driver._phaseIndex;
+            CHECK(bridgeA() == L298NDriver::phaseACurrent(index));
+            CHECK(bridgeB() == L298NDriver::phaseBCurrent(index));
+            CHECK(index % (L298N_MAX_MICROSTEP / mode) == 0);
+        }
+        CHECK(bridgeA() == forward[0].first && bridgeB() == forward[0].second);
+
+        driver.setDirection(false);
+        for (int i = 4 * mode - 1; i >= 0; i--) {
+            driver.step();
+            CHECK(bridgeA() == forward[i].first && bridgeB() == forward[i].second);
+        }
+    }
+
+    // Unsupported modes fall back to full steps
+    driver.setMicrostepMode(3);
+    CHECK(driver.getMicrostepMode() == 1);
+}
+
+// Holding scales the amplitude, the next step is at full current again
+static void testHoldCurrent() {
+    L298NDriver driver(PIN1, PIN2, PIN3, PIN4, ENABLE_A, ENABLE_B);
+    driver.init();
+    driver.setMicrostepMode(16);
+    driver.enable();
+    driver.setDirection(true);
+    for (int i = 0; i < 5; i++) driver.step();
+    int a = bridgeA(), b = bridgeB();
+
+    driver.setHoldCurrent(40);
+    driver.setStandstill(true);
+    CHECK(bridgeA() == a * 40 / 100 && bridgeB() == b * 40 / 100);
+
+    driver.step();
+    CHECK(abs(bridgeA()) == abs(L298NDriver::phaseACurrent(driver._phaseIndex)));
+
+    driver.disable();
+    CHECK(hostLedcDuty[ENABLE_A] == 0 && hostLedcDuty[ENABLE_B] == 0);
+    driver.step();
+    CHECK(hostLedcDuty[ENABLE_A] == 0 && hostLedcDuty[ENABLE_B] == 0);
+}
+
+int main() {
+    testTable();
+    testStepSequence();
+    testHoldCurrent();
+    return hostReport("test_l298n");
+}
@@ -0,0 +1,80 @@
+// test_microstep.cpp - automatic microstep switching keeps the position
+// exact and only goes coarser where the indexer is aligned
+#include "host.h"
+
+// Checks each mode switch against the indexer position
+class SwitchDriver : public HostDriver {
+public:
+    long switches = 0;
+    long misaligned = 0;
+    int coarsest = 32;
+
+    void setMicrostepMode(int mode) override {
+        // A coarser step from an angle it can't reach would skip the grid
+        if (position % (32 / mode) != 0) misaligned++;
+        if (mode != microstepMode) switches++;
+        coarsest = min(coarsest, mode);
+        HostDriver::setMicrostepMode(mode);
+    }
+};
+
+// Moves at speeds across the bands, back and forth
+static void testMovesAcrossBands() {
+    SwitchDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setMicrostepMode(16);
+    controller.setAutoMicrostep(true, 8);
+    controller.setAcceleration(20000);
+
+    const long targets[] = {40000, 39993, 12345, -20001, -20000, 7, 0, 64001, 3};
+    const int speeds[] = {30000, 2000, 16000, 32000, 500, 9000, 24000, 32000, 8000};
+    for (int i = 0; i < (int)(sizeof(targets) / sizeof(targets[0])); i++) {
+        hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, targets[i], speeds[i], true, false, 0});
+        unsigned long start = hostUs;
+        while (controller.isRunning() && hostUs - start < 30000000) hostRun(controller, 1000);
+        CHECK(!controller.isRunning());
+        CHECK(controller.getCurrentPosition() == targets[i]);
+        CHECK(driver.position == targets[i] * 2);
+        CHECK(controller.getStepScale() == 1);
+    }
+
+    printf("moves: %ld mode switches, coarsest 1/%d, %ld misaligned\n",
+           driver.switches, driver.coarsest, driver.misaligned);
+    CHECK(driver.switches > 10);
+    CHECK(driver.coarsest == 2);
+    CHECK(driver.misaligned == 0);
+}
+
+// Continuous rotation speeding up and slowing down through the feed override
+static void testContinuousRamp() {
+    SwitchDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setMicrostepMode(16);
+    controller.setAutoMicrostep(true, 8);
+    controller.setAcceleration(40000);
+
+    // Start off the coarse grid, the first switch has to wait for it
+    hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, 5, 1000, true, false, 0});
+    hostRun(controller, 100000);
+    CHECK(driver.position == 10);
+
+    hostCommand(controller, MotorCommand_t{CMD_START_CONTINUOUS, 0, 20000, false, true, 0});
+    for (int i = 0; i < 20; i++) {
+        controller.setFeedOverride(i % 2 ? FEED_OVERRIDE_MIN : FEED_OVERRIDE_MAX);
+        hostRun(controller, 500000);
+        CHECK(driver.position == controller.getCurrentPosition() * 2);
+    }
+    hostCommand(controller, MotorCommand_t{CMD_STOP_MOTOR, 0, 0, true, false, 0});
+
+    CHECK(driver.switches > 10);
+    CHECK(driver.misaligned == 0);
+    CHECK(driver.position == controller.getCurrentPosition() * 2);
+}
+
+int main() {
+    testMovesAcrossBands();
+    testContinuousRamp();
+    return hostReport("test_microstep");
+}
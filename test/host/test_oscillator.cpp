@@ -0,0 +1,116 @@
+// test_oscillator.cpp - oscillation mode: exact frequency, amplitude and
+// center however long it runs, and no jumps when it is retuned
+#include "host.h"
+#include "Oscillator.h"
+
+// A million cycles straight from the oscillator, at 125 Hz so a cycle is
+// exactly 32 ticks: the cycle count matches, and every tick of the last
+// cycle of each hundred thousand, up to the millionth, lands where the same
+// tick of the first full cycle did, so neither phase nor center has drifted
+#define LONG_RUN_CYCLES 1000000UL
+#define LONG_RUN_TICKS_PER_CYCLE 32
+
+static void testLongRun() {
+    Oscillator oscillator;
+    oscillator.setFrequency(125.0f);
+    oscillator.setAmplitude(1000);
+    oscillator.setAmplitudeRamp(100000000);
+    oscillator.start(-250);
+    oscillator.getTrackingTarget();
+
+    long low = LONG_MAX, high = LONG_MIN;
+    long reference[LONG_RUN_TICKS_PER_CYCLE];
+    long worstDrift = 0;
+    unsigned long compared = 0;
+    const unsigned long ticks = LONG_RUN_CYCLES * LONG_RUN_TICKS_PER_CYCLE;
+    for (unsigned long tick = 1; tick <= ticks; tick++) {
+        hostUs += 250;
+        long target = oscillator.getTrackingTarget();
+        low = min(low, target);
+        high = max(high, target);
+
+        unsigned long cycle = tick / LONG_RUN_TICKS_PER_CYCLE;
+        int phase = tick % LONG_RUN_TICKS_PER_CYCLE;
+        if (cycle == 1) {
+            reference[phase] = target;
+        } else if (cycle % 100000 == 99999) {
+            worstDrift = max(worstDrift, labs(target - reference[phase]));
+            compared++;
+        }
+    }
+    double expectedCycles = (double)oscillator.getFrequency() * ticks * 250e-6;
+    printf("%lu ticks at %.1f Hz: %lu cycles (expected %.0f), swing %ld..%ld, "
+           "worst same-phase drift %ld over %lu ticks\n", ticks, oscillator.getFrequency(),
+           oscillator.getCycles(), expectedCycles, low, high, worstDrift, compared);
+    CHECK(oscillator.getCycles() >= LONG_RUN_CYCLES - 1 && oscillator.getCycles() <= LONG_RUN_CYCLES);
+    CHECK(compared == LONG_RUN_CYCLES / 100000 * LONG_RUN_TICKS_PER_CYCLE);
+    CHECK(worstDrift == 0);
+    CHECK(low >= -1250 && low <= -1249);
+    CHECK(high >= 749 && high <= 750);
+}
+
+// Changing frequency and amplitude mid-swing keeps the target continuous
+static void testRetune() {
+    Oscillator oscillator;
+    oscillator.setFrequency(1.0f);
+    oscillator.setAmplitude(800);
+    oscillator.start(0);
+    long previous = oscillator.getTrackingTarget();
+
+    long worstJump = 0;
+    for (int tick = 1; tick <= 40000; tick++) {
+        hostUs += 250;
+        if (tick % 1000 == 0) {
+            oscillator.setFrequency(0.5f + (tick / 1000) % 5);
+            oscillator.setAmplitude(200 + 150 * ((tick / 1000) % 4));
+        }
+        long target = oscillator.getTrackingTarget();
+        worstJump = max(worstJump, labs(target - previous));
+        previous = target;
+    }
+
+    // At most 2 pi f A per second at the highest setting (4.5 Hz, 650 steps)
+    long limit = lround(2.0 * M_PI * 4.5 * 650 * 250e-6) + 1;
+    printf("retune: worst tick-to-tick change %ld steps (limit %ld)\n", worstJump, limit);
+    CHECK(worstJump <= limit);
+}
+
+// Ten minutes through the controller, then a stop that lands on the center
+static void testMotor() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    Oscillator oscillator;
+    oscillator.setFrequency(2.0f);
+    oscillator.setAmplitude(400);
+    oscillator.start(controller.getCurrentPosition());
+    controller.setTrackingSource(&oscillator);
+    hostCommand(controller, MotorCommand_t{CMD_START_TRACKING, 0, 4000, true, false, 200000});
+
+    long low = LONG_MAX, high = LONG_MIN;
+    for (int second = 0; second < 600; second++) {
+        for (int ms = 0; ms < 1000; ms++) {
+            hostRun(controller, 1000);
+            if (second >= 590) {
+                low = min(low, controller.getCurrentPosition());
+                high = max(high, controller.getCurrentPosition());
+            }
+        }
+    }
+    printf("motor: %lu cycles, last swing %ld..%ld\n", oscillator.getCycles(), low, high);
+    CHECK(oscillator.getCycles() == 1199 || oscillator.getCycles() == 1200);
+    CHECK(labs(low + 400) <= 2 && labs(high - 400) <= 2);
+
+    oscillator.stop();
+    hostRun(controller, 1000000);
+    CHECK(oscillator.isStopped());
+    CHECK(controller.getCurrentPosition() == 0);
+    CHECK(driver.position == 0);
+}
+
+int main() {
+    testLongRun();
+    testRetune();
+    testMotor();
+    return hostReport("test_oscillator");
+}
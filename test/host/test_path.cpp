@@ -0,0 +1,170 @@
+// test_path.cpp - teach and replay: the codec round trip, a recording made
+// from real moves and its playback through the controller
+#include "host.h"
+#include <LittleFS.h>
+#include "PathRecorder.h"
+#include "PathPlayer.h"
+
+#define RECORDING "/path.bin"
+
+// Every varint and zigzag value decodes to what was encoded, truncated
+// records are refused rather than misread
+static void testCodec() {
+    const int32_t values[] = {0, 1, -1, 63, -64, 64, -65, 8191, -8192, 1 << 20, -(1 << 20), INT32_MAX, INT32_MIN};
+    for (int32_t value : values) {
+        uint8_t buffer[PATH_MAX_VARINT_BYTES];
+        size_t length = varintEncode(zigzagEncode(value), buffer);
+        CHECK(length <= PATH_MAX_VARINT_BYTES);
+        uint32_t decoded = 0;
+        CHECK(varintDecode(buffer, length, &decoded) == length);
+        CHECK(zigzagDecode(decoded) == value);
+        if (length > 1) CHECK(varintDecode(buffer, length - 1, &decoded) == 0);
+    }
+
+    // Small moves fit in one byte each
+    PathSample_t previous = {1000, 5000};
+    PathSample_t sample = {1010, 4990};
+    uint8_t record[PATH_MAX_RECORD_BYTES];
+    CHECK(pathEncodeRecord(&previous, &sample, record) == 2);
+
+    // A random walk of samples through encode and decode
+    srand(7);
+    std::vector<uint8_t> stream;
+    std::vector<PathSample_t> samples;
+    PathSample_t last = {0, -123456};
+    for (int i = 0; i < 100000; i++) {
+        PathSample_t next;
+        next.timeMs = last.timeMs + 10 + rand() % (i % 100 == 0 ? 100000 : 20);
+        next.position = last.position + (rand() % 2001 - 1000) * (i % 1000 == 0 ? 10000 : 1);
+        size_t length = pathEncodeRecord(&last, &next, record);
+        stream.insert(stream.end(), record, record + length);
+        samples.push_back(next);
+        last = next;
+    }
+    PathSample_t decoded = {0, -123456};
+    size_t offset = 0;
+    size_t mismatches = 0;
+    for (const PathSample_t& expected : samples) {
+        PathSample_t next;
+        size_t used = pathDecodeRecord(&stream[offset], stream.size() - offset, &decoded, &next);
+        if (used == 0 || next.timeMs != expected.timeMs || next.position != expected.position) mismatches++;
+        offset += used;
+        decoded = next;
+    }
+    printf("codec: %zu samples in %zu bytes, %zu mismatches\n", samples.size(), stream.size(), mismatches);
+    CHECK(mismatches == 0);
+    CHECK(offset == stream.size());
+
+    // Header round trip, and a wrong magic is refused
+    uint8_t header[PATH_HEADER_SIZE];
+    long start = 0;
+    pathEncodeHeader(-987654, header);
+    CHECK(pathDecodeHeader(header, &start) && start == -987654);
+    header[0] ^= 1;
+    CHECK(!pathDecodeHeader(header, &start));
+}
+
+// Positions the motor passed through, one per millisecond
+static std::vector<long> moveAndRecord(PathRecorder& recorder) {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setCurrentPosition(1000);
+
+    std::vector<long> log;
+    CHECK(recorder.start(RECORDING, controller.getCurrentPosition()));
+    const long targets[] = {4000, 2500, 2500, -3000, 1000};
+    for (long target : targets) {
+        hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, target, 3000, true, false, 20000});
+        // Run the move and then hold for a while
+        for (int ms = 0; ms < 3000; ms++) {
+            hostRun(controller, 1000);
+            recorder.service(controller.getCurrentPosition());
+            log.push_back(controller.getCurrentPosition());
+        }
+    }
+    recorder.stop();
+    return log;
+}
+
+// Record moves, check the file holds them exactly, then play it back
+static void testRecordAndPlay() {
+    PathRecorder recorder(&LittleFS);
+    std::vector<long> log = moveAndRecord(recorder);
+
+    // Every stored sample is where the motor was at that time
+    File file = LittleFS.open(RECORDING, FILE_READ);
+    std::vector<uint8_t> bytes(file.size());
+    file.read(bytes.data(), bytes.size());
+    file.close();
+    long start = 0;
+    CHECK(pathDecodeHeader(bytes.data(), &start) && start == 1000);
+    PathSample_t sample = {0, start};
+    size_t offset = PATH_HEADER_SIZE;
+    unsigned long count = 0;
+    size_t wrong = 0;
+    while (offset < bytes.size()) {
+        PathSample_t next;
+        size_t used = pathDecodeRecord(&bytes[offset], bytes.size() - offset, &sample, &next);
+        if (used == 0) break;
+        offset += used;
+        if (next.timeMs > 0 && log[next.timeMs - 1] != next.position) wrong++;
+        sample = next;
+        count++;
+    }
+    printf("recording: %lu samples, %zu bytes for %zu ms\n", count, bytes.size(), log.size());
+    CHECK(count == recorder.getSampleCount());
+    CHECK(offset == bytes.size());
+    CHECK(wrong == 0);
+    CHECK(sample.position == log.back());
+
+    // Play it back on a motor sitting at the start
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setCurrentPosition(start);
+    PathPlayer player(&LittleFS);
+    CHECK(player.open(RECORDING));
+    CHECK(player.getStartPosition() == 1000);
+    CHECK(player.getFinalPosition() != 0);
+    controller.setTrackingSource(&player);
+    player.start();
+    hostCommand(controller, MotorCommand_t{CMD_START_TRACKING, 0, 4000, true, false, 200000});
+
+    // The replay follows the original within the 10 ms sampling
+    long worst = 0;
+    for (size_t ms = 0; ms < log.size() + 200; ms++) {
+        hostRun(controller, 1000);
+        player.service();
+        if (ms < log.size()) worst = max(worst, labs(controller.getCurrentPosition() - log[ms]));
+    }
+    printf("replay: worst %ld steps from the recording, %lu underruns\n", worst, player.getUnderruns());
+    CHECK(player.isFinished());
+    CHECK(player.getUnderruns() == 0);
+    CHECK(controller.getCurrentPosition() == log.back());
+    CHECK(driver.position == (log.back() - start) * 32);
+    CHECK(worst <= 3000 * PATH_SAMPLE_INTERVAL_MS / 1000 + 5);
+    player.close();
+
+    // Half speed takes twice as long and ends in the same place
+    controller.setCurrentPosition(start);
+    CHECK(player.open(RECORDING));
+    player.setTimeScale(50);
+    player.start();
+    bool finishedEarly = false;
+    for (size_t ms = 0; ms < 2 * log.size() + 200; ms++) {
+        hostRun(controller, 1000);
+        player.service();
+        if (ms < 2 * log.size() - 100 && player.isFinished()) finishedEarly = true;
+    }
+    CHECK(!finishedEarly);
+    CHECK(player.getUnderruns() == 0);
+    CHECK(player.isFinished());
+    CHECK(controller.getCurrentPosition() == log.back());
+}
+
+int main() {
+    testCodec();
+    testRecordAndPlay();
+    return hostReport("test_path");
+}
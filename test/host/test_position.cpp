@@ -0,0 +1,109 @@
+// test_position.cpp - integer position targets never drift, however many
+// moves are made from them
+#include "host.h"
+#include "SequenceEngine.h"
+#include "Indexer.h"
+
+#define LONG_RUN_CYCLES 100000
+
+// A looping sequence on a gear ratio that makes a revolution 200.6 steps.
+// Every pass has to end exactly on round(k * 200.6) steps from the start.
+static void testSequenceLongRun() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    SequenceEngine engine(&controller);
+
+    // 200 steps per motor revolution, 1.003 gear (numerator / denominator
+    // steps per position unit, as the sketch sets it)
+    int64_t numerator = 200LL * 1003;
+    int64_t denominator = GEAR_RATIO_SCALE * POSITION_UNITS_PER_REV;
+    engine.setUnitScale(numerator, denominator);
+    engine.addInstruction(SEQ_OP_LOOP, 0);
+    engine.addInstruction(SEQ_OP_MOVE_BY, 1001);   // 10.01%
+    engine.addInstruction(SEQ_OP_MOVE_BY, 2332);   // to 33.33%
+    engine.addInstruction(SEQ_OP_MOVE_BY, 3674);   // to 70.07%
+    engine.addInstruction(SEQ_OP_MOVE_BY, 2993);   // to 100%
+    engine.addInstruction(SEQ_OP_END_LOOP);
+    CHECK(engine.compile(controller.getCurrentPosition(), 4000, 4000000));
+    CHECK(engine.start());
+
+    long worst = 0;
+    unsigned long checkedPasses = 0;
+    while (controller.getStartedSegments() < LONG_RUN_CYCLES * 4UL) {
+        hostRun(controller, 1000);
+        engine.service();
+
+        // Whenever the motor sits between passes, it must be on the exact target
+        unsigned long started = controller.getStartedSegments();
+        if (started % 4 == 0 && controller.getCurrentPosition() == controller.getTargetPosition()) {
+            long expected = scaleRounded((int64_t)(started / 4) * POSITION_UNITS_PER_REV, numerator, denominator);
+            worst = max(worst, labs(controller.getCurrentPosition() - expected));
+            checkedPasses++;
+        }
+    }
+
+    // Let the segment in progress finish and stop there
+    unsigned long started = controller.getStartedSegments();
+    engine.stop();
+    hostRun(controller, 100000);
+    const int64_t passUnits[4] = {0, 1001, 3333, 7007};
+    int64_t units = (int64_t)(started / 4) * POSITION_UNITS_PER_REV + passUnits[started % 4];
+    long expected = scaleRounded(units, numerator, denominator);
+
+    printf("sequence: %d passes, end %ld (expected %ld), worst pass error %ld steps over %lu checks\n",
+           LONG_RUN_CYCLES, controller.getCurrentPosition(), expected, worst, checkedPasses);
+    CHECK(worst == 0);
+    CHECK(checkedPasses > 0);
+    CHECK(controller.getCurrentPosition() == expected);
+    CHECK(driver.position == expected * 32);
+}
+
+// 7 stations on a 5:1 gear with 1/8 microsteps: 8000 steps don't split
+// evenly, every revolution must still end where it started
+static void testIndexerLongRun() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    Indexer indexer(&controller);
+
+    CHECK(indexer.configure(7, 200 * 8 * 5, 1, 123));
+    for (long revolution = 0; revolution < LONG_RUN_CYCLES; revolution++) {
+        CHECK(indexer.indexToPosition(revolution * 7) == 123 + revolution * 8000);
+    }
+
+    // Spacing between neighbouring stations differs by at most one step
+    long smallest = LONG_MAX, largest = 0;
+    for (int k = 0; k < 7; k++) {
+        long gap = indexer.indexToPosition(k + 1) - indexer.indexToPosition(k);
+        smallest = min(smallest, gap);
+        largest = max(largest, gap);
+    }
+    CHECK(largest - smallest <= 1);
+
+    // A revolution that isn't whole steps (gear 5.333): 7 * 3 revolutions
+    // later the indexer is exactly 3 revolutions on, rounded once
+    CHECK(indexer.configure(7, 200 * 8 * 5333, 1000, 0));
+    for (long revolution = 0; revolution < LONG_RUN_CYCLES; revolution++) {
+        long expected = scaleRounded(revolution, 200 * 8 * 5333, 1000);
+        CHECK(indexer.indexToPosition(revolution * 7) == expected);
+    }
+
+    // And moving there for real, both ways round
+    CHECK(indexer.configure(7, 200 * 8 * 5, 1, 0));
+    controller.setAcceleration(4000000);
+    for (int i = 0; i < 70; i++) {
+        CHECK(indexer.next(i < 35, 4000));
+        hostDrain(controller);
+        while (controller.isRunning()) hostRun(controller, 1000);
+        CHECK(controller.getCurrentPosition() == indexer.indexToPosition(indexer.getIndex()));
+    }
+    CHECK(controller.getCurrentPosition() == 0);
+    CHECK(driver.position == 0);
+}
+
+int main() {
+    testSequenceLongRun();
+    testIndexerLongRun();
+    return hostReport("test_position");
+}
@@ -0,0 +1,352 @@
+// test_scheduler.cpp - the multi-axis scheduler on the simulated timer:
+// moves end exactly with and without bursts, and the cost and timing of its
+// interrupt as axes are added and as bursts take over
+#include "host.h"
+#define private public
+#include "MultiAxisScheduler.h"
+#undef private
+
+// Interrupt entry latency drawn at random up to this
+#define ENTRY_LATENCY_US 2
+
+// Run the timer and the command task for a while. The interrupt fires at
+// its alarm plus a random latency; commands are taken every millisecond.
+static void runScheduler(MultiAxisScheduler& scheduler, unsigned long us) {
+    unsigned long end = hostUs + us;
+    unsigned long nextService = (hostUs / 1000 + 1) * 1000;
+    while (hostUs < end) {
+        uint64_t alarm = hostTimerAlarm(scheduler._timer);
+        if (alarm != UINT64_MAX && alarm < nextService) {
+            hostUs = max((unsigned long)alarm + rand() % (ENTRY_LATENCY_US + 1), hostUs);
+            hostFireTimer(scheduler._timer);
+        } else {
+            hostUs = nextService;
+            nextService += 1000;
+            scheduler.serviceCommands(hostUs);
+        }
+    }
+}
+
+static void sendMove(StepperAxis* axis, AxisCommandType type, long position, int speed, bool forward = true) {
+    AxisCommand_t cmd = {};
+    cmd.type = type;
+    cmd.position = position;
+    cmd.speed = speed;
+    cmd.forward = forward;
+    CHECK(axis->sendCommand(&cmd));
+}
+
+// Moves and retargets on every axis at once end on their exact targets
+static void testExactMoves(bool burst) {
+    srand(40);
+    HostDriver drivers[MULTI_AXIS_MAX];
+    StepperAxis* axes[MULTI_AXIS_MAX];
+    MultiAxisScheduler scheduler;
+    scheduler.setBurstMode(burst);
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) {
+        axes[i] = new StepperAxis(&drivers[i]);
+        CHECK(scheduler.addAxis(axes[i]) == i);
+    }
+    CHECK(scheduler.begin());
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) {
+        AxisCommand_t cmd = {};
+        cmd.type = AXIS_CMD_SET_ACCELERATION;
+        cmd.acceleration = 50000;
+        CHECK(axes[i]->sendCommand(&cmd));
+    }
+
+    long targets[MULTI_AXIS_MAX] = {0};
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < MULTI_AXIS_MAX; i++) {
+            targets[i] = rand() % 20001 - 10000;
+            sendMove(axes[i], AXIS_CMD_MOVE_TO, targets[i], 8000 + rand() % 24000);
+        }
+        // Retarget some of them halfway
+        runScheduler(scheduler, 100000 + rand() % 200000);
+        for (int i = 0; i < MULTI_AXIS_MAX; i += 2) {
+            targets[i] = rand() % 20001 - 10000;
+            sendMove(axes[i], AXIS_CMD_MOVE_TO, targets[i], 0);
+        }
+        runScheduler(scheduler, 4000000);
+        for (int i = 0; i < MULTI_AXIS_MAX; i++) {
+            CHECK(!axes[i]->isRunning());
+            CHECK(axes[i]->getPosition() == targets[i]);
+            CHECK(drivers[i].position == targets[i] * 32);
+        }
+    }
+    CHECK(scheduler._heapSize == 0);
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) delete axes[i];
+}
+
+// An emergency stop lands between bursts, so the position is exactly the
+// pulses that went out
+static void testEmergencyStop() {
+    srand(41);
+    for (int trial = 0; trial < 50; trial++) {
+        HostDriver drivers[2];
+        StepperAxis first(&drivers[0]);
+        StepperAxis second(&drivers[1]);
+        MultiAxisScheduler scheduler;
+        scheduler.addAxis(&first);
+        scheduler.addAxis(&second);
+        scheduler.begin();
+        AxisCommand_t cmd = {};
+        cmd.type = AXIS_CMD_SET_ACCELERATION;
+        cmd.acceleration = 200000;
+        first.sendCommand(&cmd);
+        second.sendCommand(&cmd);
+        sendMove(&first, AXIS_CMD_RUN, 0, 40000);
+        sendMove(&second, AXIS_CMD_MOVE_TO, -100000, 20000);
+
+        runScheduler(scheduler, 100000 + rand() % 400000);
+        scheduler.emergencyStop();
+        runScheduler(scheduler, 10000);
+        CHECK(!first.isRunning() && !second.isRunning());
+        CHECK(drivers[0].position == first.getPosition() * 32);
+        CHECK(drivers[1].position == second.getPosition() * 32);
+        AxisTiming_t timing;
+        scheduler.getTiming(0, &timing);
+        CHECK(timing.bursts > 0);
+    }
+}
+
+// A step/direction driver on pins 20 up, three per axis, read back by a
+// pin interrupt on its STEP line the way the driver chip would
+class PinDriver : public HostDriver {
+public:
+    int basePin = 20;
+    long edges = 0;
+    long pinPosition = 0;
+
+    static void onStep(void* arg) {
+        PinDriver* driver = (PinDriver*)arg;
+        driver->edges++;
+        driver->pinPosition += hostPins[driver->basePin + 1] ? 1 : -1;
+    }
+
+    void init() override {
+        attachInterruptArg(basePin, onStep, this, RISING);
+        hostSetPin(basePin + 2, 1);
+    }
+    void setDirection(bool clockwise) override {
+        _direction = clockwise;
+        hostSetPin(basePin + 1, clockwise ? 1 : 0);
+    }
+    void enable() override {
+        _enabled = true;
+        hostSetPin(basePin + 2, 0);
+    }
+    void disable() override {
+        _enabled = false;
+        hostSetPin(basePin + 2, 1);
+    }
+    bool getStepPins(StepPins_t* pins) override {
+        pins->stepPin = basePin;
+        pins->dirPin = basePin + 1;
+        pins->enablePin = basePin + 2;
+        pins->pulseWidthUs = 2;
+        return true;
+    }
+};
+
+// With step pins the interrupt never calls the driver: the edges on the
+// pins add up to the position, with and without bursts, and the driver
+// is off at the end of each move and after an emergency stop
+static void testPinStepping() {
+    srand(42);
+    PinDriver drivers[2];
+    StepperAxis* axes[2];
+    MultiAxisScheduler scheduler;
+    for (int i = 0; i < 2; i++) {
+        drivers[i].basePin = 20 + 3 * i;
+        axes[i] = new StepperAxis(&drivers[i]);
+        CHECK(scheduler.addAxis(axes[i]) == i);
+        CHECK(axes[i]->_pinStepping);
+    }
+    CHECK(scheduler.begin());
+    for (int i = 0; i < 2; i++) {
+        AxisCommand_t cmd = {};
+        cmd.type = AXIS_CMD_SET_ACCELERATION;
+        cmd.acceleration = 100000;
+        CHECK(axes[i]->sendCommand(&cmd));
+    }
+
+    for (int round = 0; round < 20; round++) {
+        scheduler.setBurstMode(round % 2 == 1);
+        long targets[2];
+        for (int i = 0; i < 2; i++) {
+            targets[i] = rand() % 20001 - 10000;
+            sendMove(axes[i], AXIS_CMD_MOVE_TO, targets[i], 5000 + rand() % 35000);
+        }
+        runScheduler(scheduler, 50000 + rand() % 100000);
+        targets[0] = rand() % 20001 - 10000;
+        sendMove(axes[0], AXIS_CMD_MOVE_TO, targets[0], 0);
+        runScheduler(scheduler, 4000000);
+        for (int i = 0; i < 2; i++) {
+            CHECK(!axes[i]->isRunning());
+            CHECK(axes[i]->getPosition() == targets[i]);
+            CHECK(drivers[i].pinPosition == targets[i]);
+            CHECK(hostPins[drivers[i].basePin + 2] == 1 && !drivers[i].isEnabled());
+        }
+    }
+
+    sendMove(axes[0], AXIS_CMD_RUN, 0, 30000);
+    sendMove(axes[1], AXIS_CMD_RUN, 0, 20000, false);
+    runScheduler(scheduler, 200000);
+    scheduler.emergencyStop();
+    long edges[2] = {drivers[0].edges, drivers[1].edges};
+    runScheduler(scheduler, 10000);
+    for (int i = 0; i < 2; i++) {
+        CHECK(drivers[i].edges == edges[i]);
+        CHECK(drivers[i].pinPosition == axes[i]->getPosition());
+        CHECK(hostPins[drivers[i].basePin + 2] == 1 && !drivers[i].isEnabled());
+        CHECK(drivers[i].pulses == 0);  // The virtual step() was never used
+    }
+    for (int i = 0; i < 2; i++) delete axes[i];
+}
+
+// Every axis bursting at once shares one interrupt's pulses: the lock is
+// never held for more than the budget (plus the first pulse of each axis
+// due after it ran out), and every axis keeps its step rate
+static void testPulseBudget() {
+    HostDriver drivers[MULTI_AXIS_MAX];
+    StepperAxis* axes[MULTI_AXIS_MAX];
+    MultiAxisScheduler scheduler;
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) {
+        axes[i] = new StepperAxis(&drivers[i]);
+        scheduler.addAxis(axes[i]);
+        AxisCommand_t cmd = {};
+        cmd.type = AXIS_CMD_SET_ACCELERATION;
+        cmd.acceleration = 400000;
+        axes[i]->sendCommand(&cmd);
+        sendMove(axes[i], AXIS_CMD_RUN, 0, 40000 - 1000 * i);
+    }
+    scheduler.begin();
+    runScheduler(scheduler, 500000);
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) {
+        CHECK(axes[i]->getBurst() == 8);
+    }
+
+    scheduler.resetTiming();
+    long pulses[MULTI_AXIS_MAX];
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) pulses[i] = drivers[i].pulses;
+    unsigned long start = hostUs;
+    runScheduler(scheduler, 1000000);
+    float seconds = (hostUs - start) / 1000000.0f;
+
+    printf("budget: %d axes, at most %d pulses per interrupt, %.0f interrupts/s\n", MULTI_AXIS_MAX,
+           scheduler.getMaxInterruptPulses(), scheduler.getInterruptCount() / seconds);
+    CHECK(scheduler.getMaxInterruptPulses() <= AXIS_BURST_MAX_PULSES + MULTI_AXIS_MAX - 1);
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) {
+        float rate = (drivers[i].pulses - pulses[i]) / seconds;
+        float expected = 1000000.0f / (1000000 / (40000 - 1000 * i));  // Whole microsecond intervals
+        CHECK(fabsf(rate - expected) < 100.0f);
+    }
+    for (int i = 0; i < MULTI_AXIS_MAX; i++) delete axes[i];
+}
+
+// Interrupt rate, time per interrupt on this host and step lateness with
+// one to four axes running at unrelated rates
+static void benchmark() {
+    printf("Axes  Steps/s  Int/s  Host ns/int mean  Late max/mean us\n");
+    for (int count = 1; count <= MULTI_AXIS_MAX; count++) {
+        HostDriver drivers[MULTI_AXIS_MAX];
+        StepperAxis* axes[MULTI_AXIS_MAX];
+        MultiAxisScheduler scheduler;
+        scheduler.setBurstMode(false);
+        for (int i = 0; i < count; i++) {
+            axes[i] = new StepperAxis(&drivers[i]);
+            scheduler.addAxis(axes[i]);
+            sendMove(axes[i], AXIS_CMD_RUN, 0, 3000 + 1700 * i);
+        }
+        scheduler.begin();
+        runScheduler(scheduler, 3000000);
+
+        scheduler.resetTiming();
+        unsigned long start = hostUs;
+        hostRealCycles = true;
+        runScheduler(scheduler, 2000000);
+        hostRealCycles = false;
+        float seconds = (hostUs - start) / 1000000.0f;
+
+        unsigned long steps = 0;
+        uint32_t maxLate = 0;
+        uint64_t totalLate = 0;
+        for (int i = 0; i < count; i++) {
+            AxisTiming_t timing;
+            scheduler.getTiming(i, &timing);
+            steps += timing.steps;
+            maxLate = max(maxLate, timing.maxLateUs);
+            totalLate += timing.totalLateUs;
+        }
+        printf("%4d  %7.0f  %5.0f  %16.0f  %lu / %.2f\n", count, steps / seconds,
+               scheduler.getInterruptCount() / seconds, scheduler.getMeanInterruptCycles() / 0.16f,
+               (unsigned long)maxLate, steps > 0 ? (float)totalLate / steps : 0.0f);
+
+        // Axes due together share an interrupt, and a step is never later
+        // than the entry latency plus the alarm's minimum lead
+        CHECK(scheduler.getInterruptCount() <= steps);
+        CHECK(maxLate <= ENTRY_LATENCY_US + AXIS_MIN_LEAD_US);
+        for (int i = 0; i < count; i++) delete axes[i];
+    }
+}
+
+// One axis at a range of rates with single pulses and with bursts: the
+// interrupt rate falls by the burst size, the step rate stays the same and
+// no pulse is further from its single-pulse time than the burst's length
+static void burstBenchmark() {
+    static const long rates[] = { 2000, 5000, 10000, 20000, 40000 };
+    float stepRates[2][5];
+    printf("Steps/s  Mode    Int/s  Host ns/int mean  Burst error max/mean us\n");
+    for (int mode = 0; mode < 2; mode++) {
+        for (int i = 0; i < 5; i++) {
+            HostDriver driver;
+            StepperAxis axis(&driver);
+            MultiAxisScheduler scheduler;
+            scheduler.setBurstMode(mode == 1);
+            scheduler.addAxis(&axis);
+            scheduler.begin();
+            AxisCommand_t cmd = {};
+            cmd.type = AXIS_CMD_SET_ACCELERATION;
+            cmd.acceleration = 200000;
+            axis.sendCommand(&cmd);
+            sendMove(&axis, AXIS_CMD_RUN, 0, rates[i]);
+            runScheduler(scheduler, 500000);
+
+            scheduler.resetTiming();
+            unsigned long start = hostUs;
+            hostRealCycles = true;
+            runScheduler(scheduler, 1000000);
+            hostRealCycles = false;
+            float seconds = (hostUs - start) / 1000000.0f;
+
+            AxisTiming_t timing;
+            scheduler.getTiming(0, &timing);
+            float interruptRate = scheduler.getInterruptCount() / seconds;
+            stepRates[mode][i] = timing.steps / seconds;
+            printf("%7ld  %-6s %6.0f  %16.0f  %lu / %.2f\n", rates[i], mode == 1 ? "burst" : "single",
+                   interruptRate, scheduler.getMeanInterruptCycles() / 0.16f,
+                   (unsigned long)timing.maxBurstErrorUs,
+                   timing.steps > 0 ? (float)timing.totalBurstErrorUs / timing.steps : 0.0f);
+
+            int burst = mode == 1 ? axis.getBurst() : 1;
+            CHECK(fabsf(interruptRate * burst - stepRates[mode][i]) <= 2.0f);
+            CHECK(timing.maxBurstErrorUs <= (uint32_t)(burst * 1000000L / rates[i]));
+            if (mode == 1 && rates[i] >= AXIS_BURST_RATE_8) CHECK(burst == 8);
+        }
+    }
+    for (int i = 0; i < 5; i++) {
+        CHECK(fabsf(stepRates[0][i] - stepRates[1][i]) <= 2.0f);
+    }
+}
+
+int main() {
+    testExactMoves(false);
+    testExactMoves(true);
+    testEmergencyStop();
+    testPinStepping();
+    testPulseBudget();
+    benchmark();
+    burstBenchmark();
+    return hostReport("test_scheduler");
+}
@@ -0,0 +1,158 @@
+// test_sequence.cpp - sequence programs run against the simulated controller
+#include "host.h"
+#include "SequenceEngine.h"
+
+// Run the controller and keep the engine fed every millisecond until the
+// program ends, returns false on timeout
+static bool runProgram(TimerStepperControl& controller, SequenceEngine& engine, unsigned long timeoutUs) {
+    unsigned long end = hostUs + timeoutUs;
+    while (engine.isRunning() && hostUs < end) {
+        hostRun(controller, 1000);
+        engine.service();
+    }
+    return !engine.isRunning();
+}
+
+// Loops longer than any unrolled program could be
+static void testLongLoops() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    SequenceEngine engine(&controller);
+
+    engine.addInstruction(SEQ_OP_SPEED, 4000);
+    engine.addInstruction(SEQ_OP_ACCEL, 200000);
+    engine.addInstruction(SEQ_OP_LOOP, 50);
+    engine.addInstruction(SEQ_OP_LOOP, 40);
+    engine.addInstruction(SEQ_OP_MOVE_BY, 3);
+    engine.addInstruction(SEQ_OP_MOVE_BY, -1);
+    engine.addInstruction(SEQ_OP_END_LOOP);
+    engine.addInstruction(SEQ_OP_END_LOOP);
+    CHECK(engine.compile(controller.getCurrentPosition(), 1000, 1000));
+    CHECK(engine.start());
+
+    CHECK(runProgram(controller, engine, 60000000));
+    CHECK(controller.getStartedSegments() == 4000);
+    CHECK(controller.getCurrentPosition() == 4000);
+    CHECK(driver.position == 4000 * 32);
+}
+
+// Dwells hold before their move, a trailing dwell before the end
+static void testDwell() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    SequenceEngine engine(&controller);
+
+    engine.addInstruction(SEQ_OP_MOVE_TO, 100);
+    engine.addInstruction(SEQ_OP_DWELL, 200);
+    engine.addInstruction(SEQ_OP_MOVE_TO, 0);
+    engine.addInstruction(SEQ_OP_DWELL, 300);
+    CHECK(engine.compile(controller.getCurrentPosition(), 4000, 100000));
+    CHECK(engine.start());
+
+    // Wait for the first move to end, then watch the hold
+    unsigned long start = hostUs;
+    while (controller.getCurrentPosition() != 100 && hostUs - start < 1000000) {
+        hostRun(controller, 1000);
+        engine.service();
+    }
+    CHECK(controller.getCurrentPosition() == 100);
+    unsigned long arrived = hostUs;
+    while (controller.getCurrentPosition() == 100 && hostUs - arrived < 1000000) {
+        hostRun(controller, 250);
+        engine.service();
+    }
+    // The first step of the next move comes 4.5 ms after the dwell, at
+    // 100000 steps/sec² from standstill
+    CHECK(hostUs - arrived >= 200000 && hostUs - arrived <= 206000);
+
+    // Back at zero, the program ends after the trailing dwell
+    while (controller.getCurrentPosition() != 0 && hostUs - start < 2000000) {
+        hostRun(controller, 1000);
+        engine.service();
+    }
+    arrived = hostUs;
+    CHECK(runProgram(controller, engine, 1000000));
+    CHECK(hostUs - arrived >= 300000);
+    CHECK(controller.getStartedSegments() == 3);
+}
+
+// Each endless pass starts where the last one ended, the queue never runs dry
+static void testEndlessLoop() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setCurrentPosition(1000);
+    SequenceEngine engine(&controller);
+
+    // 7 steps per unit over 3, a pass of 3 units is exactly 7 steps
+    engine.setUnitScale(7, 3);
+    engine.addInstruction(SEQ_OP_LOOP, 0);
+    engine.addInstruction(SEQ_OP_MOVE_BY, 1);
+    engine.addInstruction(SEQ_OP_MOVE_BY, 2);
+    engine.addInstruction(SEQ_OP_END_LOOP);
+    CHECK(engine.compile(controller.getCurrentPosition(), 4000, 1000000));
+    CHECK(engine.start());
+
+    for (int i = 0; i < 5000; i++) {
+        hostRun(controller, 1000);
+        engine.service();
+    }
+    CHECK(engine.isRunning());
+    CHECK(controller.isRunning());
+
+    // The segment running when the engine stops is the last, a whole pass
+    // is exactly 7 steps and its first move 2
+    unsigned long segments = controller.getStartedSegments();
+    engine.stop();
+    hostRun(controller, 100000);
+    CHECK(!controller.isRunning());
+    CHECK(segments > 1000);
+    long moved = controller.getCurrentPosition() - 1000;
+    CHECK(moved == (long)(segments / 2) * 7 + (segments % 2 ? 2 : 0));
+}
+
+// Programs the engine must refuse
+static void testCompileErrors() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    SequenceEngine engine(&controller);
+
+    // Endless loop inside a finite one
+    engine.addInstruction(SEQ_OP_LOOP, 2);
+    engine.addInstruction(SEQ_OP_LOOP, 0);
+    engine.addInstruction(SEQ_OP_MOVE_BY, 1);
+    engine.addInstruction(SEQ_OP_END_LOOP);
+    engine.addInstruction(SEQ_OP_END_LOOP);
+    CHECK(!engine.compile(0, 1000, 1000));
+
+    // Endless loop that queues nothing
+    engine.clearProgram();
+    engine.addInstruction(SEQ_OP_MOVE_BY, 1);
+    engine.addInstruction(SEQ_OP_LOOP, 0);
+    engine.addInstruction(SEQ_OP_SPEED, 100);
+    engine.addInstruction(SEQ_OP_END_LOOP);
+    CHECK(!engine.compile(0, 1000, 1000));
+
+    // Unbalanced and too deep
+    engine.clearProgram();
+    engine.addInstruction(SEQ_OP_LOOP, 2);
+    engine.addInstruction(SEQ_OP_MOVE_BY, 1);
+    CHECK(!engine.compile(0, 1000, 1000));
+    engine.clearProgram();
+    for (int i = 0; i <= SEQ_MAX_LOOP_DEPTH; i++) engine.addInstruction(SEQ_OP_LOOP, 2);
+    engine.addInstruction(SEQ_OP_MOVE_BY, 1);
+    for (int i = 0; i <= SEQ_MAX_LOOP_DEPTH; i++) engine.addInstruction(SEQ_OP_END_LOOP);
+    CHECK(!engine.compile(0, 1000, 1000));
+    CHECK(!engine.start());
+}
+
+int main() {
+    testLongLoops();
+    testDwell();
+    testEndlessLoop();
+    testCompileErrors();
+    return hostReport("test_sequence");
+}
@@ -0,0 +1,259 @@
+// test_settings.cpp - the settings blob and its store: round trips, older
+// and newer schemas, every kind of damage rejected, and the write-behind
+// costing one flash write per burst of changes
+#include "host.h"
+#include "SettingsStore.h"
+
+static StoredSettings_t defaults() {
+    StoredSettings_t settings = {};
+    settings.speed = 1000;
+    settings.rotationUnits = 10000;
+    settings.acceleration = 3200;
+    settings.microstepMode = 1;
+    for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+        settings.sequencePositions[i] = 2000 * i;
+    }
+    return settings;
+}
+
+static StoredSettings_t randomSettings() {
+    StoredSettings_t settings;
+    settings.speed = (int32_t)(rand() * 2654435761u);
+    settings.rotationUnits = rand() - RAND_MAX / 2;
+    settings.acceleration = rand();
+    settings.microstepMode = 1 << (rand() % 6);
+    for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+        settings.sequencePositions[i] = rand() % 20001 - 10000;
+    }
+    return settings;
+}
+
+// A valid blob of any version holding the first length payload bytes of
+// the current layout, padded with extra bytes past it for a newer version
+static size_t buildBlob(const StoredSettings_t* settings, uint8_t version, size_t length, uint8_t* out) {
+    uint8_t current[SETTINGS_BLOB_SIZE];
+    settingsEncode(settings, current);
+    out[0] = current[0];
+    out[1] = current[1];
+    out[2] = version;
+    out[3] = (uint8_t)length;
+    for (size_t i = 0; i < length; i++) {
+        out[SETTINGS_HEADER_SIZE + i] = i < SETTINGS_PAYLOAD_SIZE ? current[SETTINGS_HEADER_SIZE + i] : (uint8_t)(0xA5 ^ i);
+    }
+    size_t size = SETTINGS_HEADER_SIZE + length;
+    settingsPut32(out + size, crc32Ieee(out, size));
+    return size + SETTINGS_CRC_SIZE;
+}
+
+static void storeBlob(const uint8_t* blob, size_t size) {
+    hostNvs["motor/settings"].assign(blob, blob + size);
+}
+
+// CRC32 check value, and random settings survive a round trip
+static void testRoundTrip() {
+    CHECK(crc32Ieee((const uint8_t*)"123456789", 9) == 0xCBF43926UL);
+
+    srand(49);
+    StoredSettings_t fallback = defaults();
+    for (int trial = 0; trial < 10000; trial++) {
+        StoredSettings_t settings = randomSettings();
+        uint8_t blob[SETTINGS_BLOB_SIZE];
+        CHECK(settingsEncode(&settings, blob) == SETTINGS_BLOB_SIZE);
+        StoredSettings_t decoded;
+        CHECK(settingsDecode(blob, SETTINGS_BLOB_SIZE, &fallback, &decoded) == SETTINGS_LOADED);
+        CHECK(settingsEqual(&settings, &decoded));
+    }
+}
+
+// An older blob gives the fields it has and defaults for the rest; a newer
+// one gives every field this version knows
+static void testMigration() {
+    StoredSettings_t fallback = defaults();
+    StoredSettings_t settings = randomSettings();
+    uint8_t blob[SETTINGS_MAX_BLOB_SIZE];
+
+    for (size_t length = 0; length < SETTINGS_PAYLOAD_SIZE; length++) {
+        size_t size = buildBlob(&settings, SETTINGS_VERSION, length, blob);
+        StoredSettings_t decoded;
+        CHECK(settingsDecode(blob, size, &fallback, &decoded) == SETTINGS_MIGRATED);
+        CHECK(decoded.speed == (length >= 4 ? settings.speed : fallback.speed));
+        CHECK(decoded.rotationUnits == (length >= 8 ? settings.rotationUnits : fallback.rotationUnits));
+        CHECK(decoded.acceleration == (length >= 12 ? settings.acceleration : fallback.acceleration));
+        CHECK(decoded.microstepMode == (length >= 13 ? settings.microstepMode : fallback.microstepMode));
+        for (int i = 0; i < SETTINGS_SEQUENCE_POSITIONS; i++) {
+            bool has = length >= (size_t)(17 + 4 * i);
+            CHECK(decoded.sequencePositions[i] == (has ? settings.sequencePositions[i] : fallback.sequencePositions[i]));
+        }
+    }
+
+    for (size_t length = SETTINGS_PAYLOAD_SIZE; length <= 255; length += 11) {
+        size_t size = buildBlob(&settings, SETTINGS_VERSION + 1, length, blob);
+        StoredSettings_t decoded;
+        CHECK(settingsDecode(blob, size, &fallback, &decoded) == SETTINGS_LOADED);
+        CHECK(settingsEqual(&settings, &decoded));
+    }
+}
+
+// Every bit flip, every truncation and a bad header fall back to defaults
+static void testCorruption() {
+    StoredSettings_t fallback = defaults();
+    StoredSettings_t settings = randomSettings();
+    uint8_t blob[SETTINGS_BLOB_SIZE];
+    settingsEncode(&settings, blob);
+
+    StoredSettings_t decoded;
+    CHECK(settingsDecode(blob, 0, &fallback, &decoded) == SETTINGS_EMPTY);
+    CHECK(settingsEqual(&decoded, &fallback));
+
+    int rejected = 0;
+    for (size_t bit = 0; bit < 8 * SETTINGS_BLOB_SIZE; bit++) {
+        uint8_t damaged[SETTINGS_BLOB_SIZE];
+        memcpy(damaged, blob, sizeof(damaged));
+        damaged[bit / 8] ^= 1 << (bit % 8);
+        if (settingsDecode(damaged, sizeof(damaged), &fallback, &decoded) == SETTINGS_CORRUPT &&
+            settingsEqual(&decoded, &fallback)) {
+            rejected++;
+        }
+    }
+    CHECK(rejected == 8 * SETTINGS_BLOB_SIZE);
+
+    for (size_t size = 1; size < SETTINGS_BLOB_SIZE; size++) {
+        CHECK(settingsDecode(blob, size, &fallback, &decoded) == SETTINGS_CORRUPT);
+        CHECK(settingsEqual(&decoded, &fallback));
+    }
+
+    // Version 0 never existed, even with a good CRC
+    uint8_t zero[SETTINGS_MAX_BLOB_SIZE];
+    size_t size = buildBlob(&settings, 0, SETTINGS_PAYLOAD_SIZE, zero);
+    CHECK(settingsDecode(zero, size, &fallback, &decoded) == SETTINGS_CORRUPT);
+
+    // Erased flash
+    uint8_t erased[SETTINGS_BLOB_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    CHECK(settingsDecode(erased, sizeof(erased), &fallback, &decoded) == SETTINGS_CORRUPT);
+}
+
+// Booting with an older or damaged blob rewrites it in the current layout
+static void testStoreMigration() {
+    StoredSettings_t fallback = defaults();
+    StoredSettings_t settings = randomSettings();
+    uint8_t blob[SETTINGS_MAX_BLOB_SIZE];
+
+    hostNvs.clear();
+    storeBlob(blob, buildBlob(&settings, SETTINGS_VERSION, 13, blob));
+    {
+        SettingsStore store("motor");
+        StoredSettings_t loaded;
+        hostNvsReads = 0;
+        CHECK(store.begin(&fallback, &loaded, 2000, 10000) == SETTINGS_MIGRATED);
+        CHECK(hostNvsReads == 1);
+        CHECK(store.isPending());
+        CHECK(store.flush());
+        CHECK(hostNvs["motor/settings"].size() == SETTINGS_BLOB_SIZE);
+    }
+    {
+        SettingsStore store("motor");
+        StoredSettings_t loaded;
+        CHECK(store.begin(&fallback, &loaded, 2000, 10000) == SETTINGS_LOADED);
+        CHECK(!store.isPending());
+        CHECK(loaded.speed == settings.speed && loaded.microstepMode == settings.microstepMode);
+        CHECK(loaded.sequencePositions[0] == fallback.sequencePositions[0]);
+    }
+
+    settingsEncode(&settings, blob);
+    blob[10] ^= 0x40;
+    storeBlob(blob, SETTINGS_BLOB_SIZE);
+    {
+        SettingsStore store("motor");
+        StoredSettings_t loaded;
+        CHECK(store.begin(&fallback, &loaded, 2000, 10000) == SETTINGS_CORRUPT);
+        CHECK(settingsEqual(&loaded, &fallback));
+        CHECK(store.flush());
+    }
+    {
+        SettingsStore store("motor");
+        StoredSettings_t loaded;
+        CHECK(store.begin(&fallback, &loaded, 2000, 10000) == SETTINGS_LOADED);
+        CHECK(settingsEqual(&loaded, &fallback));
+    }
+}
+
+// Writes happen once changes settle with the motor idle, and a failed
+// write is kept and tried again
+static void testWriteBehind() {
+    hostNvs.clear();
+    StoredSettings_t fallback = defaults();
+    SettingsStore store("motor");
+    StoredSettings_t settings;
+    CHECK(store.begin(&fallback, &settings, 2000, 10000) == SETTINGS_EMPTY);
+    CHECK(!store.isPending());
+
+    // A knob turned through a hundred values, then left
+    unsigned long now = 0;
+    for (int i = 0; i < 100; i++, now += 50) {
+        settings.speed = 1000 + 10 * i;
+        store.update(&settings, now, true);
+    }
+    now -= 50;  // The last change
+    CHECK(store.getWriteCount() == 0);
+    store.update(&settings, now + 1999, true);
+    CHECK(store.getWriteCount() == 0);
+    store.update(&settings, now + 2000, true);
+    CHECK(store.getWriteCount() == 1);
+    now += 2000;
+
+    // There and back again costs nothing
+    settings.speed = 5;
+    store.update(&settings, now += 100, true);
+    settings.speed = 1990;
+    store.update(&settings, now += 100, true);
+    store.update(&settings, now += 5000, true);
+    CHECK(store.getWriteCount() == 1);
+    CHECK(!store.isPending());
+
+    // Never while running, however long it has waited
+    settings.acceleration = 9000;
+    store.update(&settings, now, false);
+    store.update(&settings, now + 20000, false);
+    CHECK(store.getWriteCount() == 1);
+    store.update(&settings, now + 20000, true);
+    CHECK(store.getWriteCount() == 2);
+    now += 20000;
+
+    // Kept changing: written once the longest delay is up
+    unsigned long start = now;
+    while (store.getWriteCount() == 2) {
+        settings.rotationUnits += 1;
+        now += 500;
+        store.update(&settings, now, true);
+    }
+    CHECK(now - (start + 500) == 10000);  // From the first change
+
+    // A failed write counts and is tried again after another settle time
+    hostNvsFailWrites = true;
+    settings.microstepMode = 8;
+    store.update(&settings, now, true);
+    store.update(&settings, now += 2000, true);
+    CHECK(store.getWriteErrors() == 1);
+    CHECK(store.isPending());
+    hostNvsFailWrites = false;
+    store.update(&settings, now += 1000, true);
+    CHECK(store.getWriteCount() == 3);
+    store.update(&settings, now += 1000, true);
+    CHECK(store.getWriteCount() == 4);
+    CHECK(!store.isPending());
+
+    SettingsStore reboot("motor");
+    StoredSettings_t loaded;
+    CHECK(reboot.begin(&fallback, &loaded, 2000, 10000) == SETTINGS_LOADED);
+    CHECK(settingsEqual(&loaded, &settings));
+}
+
+int main() {
+    testRoundTrip();
+    testMigration();
+    testCorruption();
+    testStoreMigration();
+    testWriteBehind();
+    return hostReport("test_settings");
+}
@@ -0,0 +1,201 @@
+// test_stepstream.cpp - the rendered STEP/DIR waveform, decoded back the way
+// a driver would read it: every pulse is a pulse width long, steps and DIR
+// changes keep their spacing, and the edges add up to the exact position
+#include "host.h"
+#define private public
+#include "StepStream.h"
+#undef private
+
+// A driver whose step and direction are plain pins
+class PinDriver : public HostDriver {
+public:
+    bool getStepPins(StepPins_t* pins) override {
+        pins->stepPin = 10;
+        pins->dirPin = 11;
+        pins->enablePin = 12;
+        pins->pulseWidthUs = 2;
+        return true;
+    }
+};
+
+// Reads one axis's two bus lines sample by sample
+struct Decoder {
+    uint8_t stepMask;
+    uint8_t dirMask;
+    long position = 0;
+    long pulses = 0;
+    bool step = false;
+    bool dir = false;
+    long sample = 0;
+    long lastRise = -1000;
+    long lastFall = -1000;
+    long lastDirChange = -1000;
+    long minSpacing = LONG_MAX;  // Between rising edges
+    int badWidth = 0;            // Pulses not exactly a pulse width long
+    int badDirTiming = 0;        // DIR changed while high, too soon after or too close before a pulse
+    std::vector<long> rises;
+
+    Decoder(int axis, bool dirLevel) : stepMask(1 << (2 * axis)), dirMask(1 << (2 * axis + 1)), dir(dirLevel) {}
+
+    void feed(const uint8_t* samples, int count) {
+        for (int i = 0; i < count; i++, sample++) {
+            bool stepLevel = samples[i] & stepMask;
+            bool dirLevel = samples[i] & dirMask;
+            if (dirLevel != dir) {
+                if (step || sample - lastFall < 1) badDirTiming++;
+                dir = dirLevel;
+                lastDirChange = sample;
+            }
+            if (stepLevel && !step) {
+                if (sample - lastDirChange < STEP_STREAM_PULSE_SAMPLES) badDirTiming++;
+                minSpacing = min(minSpacing, sample - lastRise);
+                lastRise = sample;
+                rises.push_back(sample);
+                position += dir ? 1 : -1;
+                pulses++;
+            } else if (!stepLevel && step) {
+                if (sample - lastRise != STEP_STREAM_PULSE_SAMPLES) badWidth++;
+                lastFall = sample;
+            }
+            step = stepLevel;
+        }
+    }
+};
+
+struct Rig {
+    PinDriver drivers[2];
+    StepperAxis* axes[2];
+    StepStream stream;
+    std::vector<Decoder> decoders;
+    uint8_t samples[STEP_STREAM_SLICE_SAMPLES];
+
+    Rig() {
+        for (int i = 0; i < 2; i++) {
+            axes[i] = new StepperAxis(&drivers[i]);
+            CHECK(stream.addAxis(axes[i]) == i);
+            decoders.push_back(Decoder(i, drivers[i].getDirection()));
+        }
+    }
+    ~Rig() {
+        for (int i = 0; i < 2; i++) delete axes[i];
+    }
+
+    // The render task: commands, then one slice
+    void run(int slices) {
+        for (int i = 0; i < slices; i++) {
+            stream.serviceCommands();
+            stream.renderSlice(samples);
+            for (Decoder& decoder : decoders) {
+                decoder.feed(samples, STEP_STREAM_SLICE_SAMPLES);
+            }
+        }
+    }
+
+    void send(int axis, AxisCommandType type, long position, int speed, int acceleration = 0) {
+        AxisCommand_t cmd = {};
+        cmd.type = type;
+        cmd.position = position;
+        cmd.speed = speed;
+        cmd.forward = true;
+        cmd.acceleration = acceleration;
+        CHECK(axes[axis]->sendCommand(&cmd));
+    }
+};
+
+// Random moves and retargets, some faster than the bus can show: the
+// waveform is always well formed and lands on the target
+static void testMoves() {
+    srand(45);
+    Rig rig;
+    for (int i = 0; i < 2; i++) {
+        rig.send(i, AXIS_CMD_SET_ACCELERATION, 0, 0, 400000);
+    }
+
+    long targets[2] = {0, 0};
+    for (int round = 0; round < 30; round++) {
+        for (int i = 0; i < 2; i++) {
+            targets[i] = rand() % 40001 - 20000;
+            rig.send(i, AXIS_CMD_MOVE_TO, targets[i], 20000 + rand() % 180000);
+        }
+        rig.run(20 + rand() % 100);
+        targets[0] = rand() % 40001 - 20000;
+        rig.send(0, AXIS_CMD_MOVE_TO, targets[0], 0);
+        rig.run(1500);
+
+        for (int i = 0; i < 2; i++) {
+            CHECK(!rig.axes[i]->isRunning());
+            CHECK(rig.axes[i]->getPosition() == targets[i]);
+            CHECK(rig.decoders[i].position == targets[i]);
+        }
+    }
+
+    for (Decoder& decoder : rig.decoders) {
+        printf("moves: %ld pulses, closest %ld samples apart, %d bad widths, %d bad DIR changes\n",
+               decoder.pulses, decoder.minSpacing, decoder.badWidth, decoder.badDirTiming);
+        CHECK(decoder.minSpacing >= 2 * STEP_STREAM_PULSE_SAMPLES);
+        CHECK(decoder.badWidth == 0);
+        CHECK(decoder.badDirTiming == 0);
+    }
+}
+
+// At a steady rate the pulses are where the profile puts them, across
+// slice boundaries too
+static void testSpacing() {
+    Rig rig;
+    rig.send(0, AXIS_CMD_SET_ACCELERATION, 0, 0, 400000);
+    rig.send(0, AXIS_CMD_RUN, 0, 7000);
+    rig.run(50);
+
+    Decoder& decoder = rig.decoders[0];
+    size_t from = decoder.rises.size();
+    rig.run(200);
+    long interval = 1000000 / 7000;  // 142 us
+    long worst = 0;
+    for (size_t i = from + 1; i < decoder.rises.size(); i++) {
+        long us = (decoder.rises[i] - decoder.rises[i - 1]) * STEP_STREAM_SAMPLE_US;
+        worst = max(worst, labs(us - interval));
+    }
+    float rate = (decoder.rises.size() - from) / (200 * STEP_STREAM_SLICE_US / 1000000.0f);
+    printf("spacing: %.0f steps/s, worst %ld us off %ld\n", rate, worst, interval);
+    CHECK(worst <= STEP_STREAM_SAMPLE_US);
+    CHECK(fabsf(rate - 1000000.0f / interval) < 10.0f);
+    CHECK(decoder.badWidth == 0);
+}
+
+// An emergency stop ends the pulses at the next slice, finishing only a
+// pulse already started, and the position is what went out
+static void testEmergencyStop() {
+    srand(46);
+    for (int trial = 0; trial < 20; trial++) {
+        Rig rig;
+        rig.send(0, AXIS_CMD_SET_ACCELERATION, 0, 0, 400000);
+        rig.send(1, AXIS_CMD_SET_ACCELERATION, 0, 0, 400000);
+        rig.send(0, AXIS_CMD_RUN, 0, 100000);
+        rig.send(1, AXIS_CMD_MOVE_TO, -50000, 30000);
+        rig.run(10 + rand() % 200);
+
+        rig.stream.emergencyStop();
+        long pulsesBefore[2] = {rig.decoders[0].pulses, rig.decoders[1].pulses};
+        rig.send(0, AXIS_CMD_RUN, 0, 5000);  // Dropped while faulted
+        rig.run(20);
+        for (int i = 0; i < 2; i++) {
+            CHECK(!rig.axes[i]->isRunning());
+            CHECK(rig.decoders[i].pulses == pulsesBefore[i]);
+            CHECK(rig.decoders[i].position == rig.axes[i]->getPosition());
+            CHECK(!rig.drivers[i].isEnabled());
+        }
+
+        rig.stream.clearFault();
+        rig.send(1, AXIS_CMD_MOVE_TO, 0, 30000);
+        rig.run(1000);
+        CHECK(rig.axes[1]->getPosition() == 0);
+        CHECK(rig.decoders[1].position == 0);
+    }
+}
+
+int main() {
+    testMoves();
+    testSpacing();
+    testEmergencyStop();
+    return hostReport("test_stepstream");
+}
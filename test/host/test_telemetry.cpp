@@ -0,0 +1,340 @@
+// test_telemetry.cpp - the telemetry frames: a sample stream with text on
+// the same port decodes to exactly what was sent, lost bytes show as gaps
+// and resync on the next key frame, and a delta that doesn't fit falls
+// back to a key frame
+#include "host.h"
+#include "TelemetryCodec.h"
+
+static bool sameSample(const TelemetrySample_t* a, const TelemetrySample_t* b) {
+    return a->timeUs == b->timeUs && a->position == b->position && a->stepRate == b->stepRate &&
+           a->commandedSpeed == b->commandedSpeed && a->queueDepth == b->queueDepth &&
+           a->isrLoad == b->isrLoad && a->flags == b->flags;
+}
+
+// The sending side the way Telemetry::sendFrame runs it: a key frame for
+// the first sample and every TELEMETRY_KEY_INTERVAL frames, deltas between
+struct Sender {
+    std::vector<uint8_t> stream;
+    std::vector<TelemetrySample_t> sent;
+    std::vector<bool> keys;
+    TelemetrySample_t last = {};
+    uint8_t sequence = 0;
+    int framesSinceKey = 0;
+
+    void send(const TelemetrySample_t& sample) {
+        uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+        bool key = sent.empty() || framesSinceKey >= TELEMETRY_KEY_INTERVAL - 1;
+        size_t size = telemetryEncode(sent.empty() ? NULL : &last, &sample, sequence++, key, frame);
+        stream.insert(stream.end(), frame, frame + size);
+        sent.push_back(sample);
+        keys.push_back(frame[0] == TELEMETRY_KEY_FRAME);
+        framesSinceKey = frame[0] == TELEMETRY_KEY_FRAME ? 0 : framesSinceKey + 1;
+        last = sample;
+    }
+
+    void text(const char* line) {
+        stream.insert(stream.end(), line, line + strlen(line));
+    }
+};
+
+// A motor wandering about: mostly small steps, now and then a jump in
+// position, rate or time too big for a delta, or a new commanded speed
+static TelemetrySample_t nextSample(const TelemetrySample_t& previous) {
+    TelemetrySample_t sample = previous;
+    sample.timeUs += 1000 + rand() % 9000;
+    sample.stepRate += rand() % 2001 - 1000;
+    sample.position += sample.stepRate / 200;
+    switch (rand() % 40) {
+    case 0: sample.position += (rand() % 2 ? 1 : -1) * (32768 + rand() % 100000); break;
+    case 1: sample.stepRate += (rand() % 2 ? 1 : -1) * (32768 + rand() % 100000); break;
+    case 2: sample.timeUs += 65536 + rand() % 1000000; break;
+    case 3: sample.commandedSpeed = rand() % 65536; break;
+    }
+    sample.queueDepth = rand() % 16;
+    sample.isrLoad = rand() % 201;
+    sample.flags = rand() % 16;
+    return sample;
+}
+
+// Everything decodable in the stream, fed in pieces of random size the way
+// a serial port hands them over
+struct Receiver {
+    TelemetryDecoder_t decoder;
+    std::vector<TelemetrySample_t> samples;
+    std::vector<uint8_t> sequences;
+    std::vector<uint8_t> pending;
+
+    Receiver() { telemetryDecoderReset(&decoder); }
+
+    void feed(const std::vector<uint8_t>& stream) {
+        size_t from = 0;
+        while (from < stream.size()) {
+            size_t count = min(stream.size() - from, (size_t)(1 + rand() % 40));
+            pending.insert(pending.end(), stream.begin() + from, stream.begin() + from + count);
+            from += count;
+
+            size_t used = 0;
+            while (true) {
+                bool produced = false;
+                size_t size = telemetryDecode(&decoder, pending.data() + used, pending.size() - used, &produced);
+                if (size == 0) break;
+                if (produced) {
+                    samples.push_back(decoder.sample);
+                    sequences.push_back((uint8_t)(decoder.nextSequence - 1));
+                }
+                used += size;
+            }
+            pending.erase(pending.begin(), pending.begin() + used);
+        }
+    }
+};
+
+// Console lines of the kind the sketch prints between frames
+static const char* const TEXT[] = {
+    "Moving to 12000 steps, speed: 4000 steps/s\r\n",
+    "DIR pin 11, STEP pin 10\r\n",
+    "Done\r\n",
+    "Keyframes: 120 keyframes over 1500 ms\r\n",
+    "ISR 312 cycles, max 880 cycles\r\n",
+    "Driver: DRV8825\r\n",
+};
+
+// Samples with the console's text between the frames come out exactly as
+// they went in, none lost and no gaps (none of the lines happens to carry
+// a good CRC after its frame type bytes, see testStrayFrames())
+static void testInterleavedText() {
+    srand(51);
+    Sender sender;
+    TelemetrySample_t sample = {};
+    sample.commandedSpeed = 4000;
+    for (int i = 0; i < 5000; i++) {
+        sample = nextSample(sample);
+        sender.send(sample);
+        if (rand() % 5 == 0) sender.text(TEXT[rand() % (sizeof(TEXT) / sizeof(TEXT[0]))]);
+    }
+
+    Receiver receiver;
+    receiver.feed(sender.stream);
+
+    int keyFrames = 0;
+    for (bool key : sender.keys) keyFrames += key;
+    printf("text: %zu samples, %d key frames, %zu bytes\n", sender.sent.size(), keyFrames, sender.stream.size());
+    CHECK(keyFrames > (int)sender.sent.size() / TELEMETRY_KEY_INTERVAL);
+    CHECK(receiver.samples.size() == sender.sent.size());
+    CHECK(receiver.decoder.frames == sender.sent.size());
+    CHECK(receiver.decoder.gaps == 0);
+    bool same = receiver.samples.size() == sender.sent.size();
+    for (size_t i = 0; same && i < sender.sent.size(); i++) {
+        same = sameSample(&receiver.samples[i], &sender.sent[i]);
+    }
+    CHECK(same);
+}
+
+// Runs of bytes lost on the link, each far enough from the last for the
+// decoder to have resynced: every one is a gap, the deltas after it are
+// held back until a key frame, and nothing decoded is ever wrong
+static void testDroppedBytes() {
+    srand(52);
+    Sender sender;
+    TelemetrySample_t sample = {};
+    sample.commandedSpeed = 1000;
+    for (int i = 0; i < 20000; i++) {
+        sample = nextSample(sample);
+        sender.send(sample);
+    }
+
+    // Frame starts, to drop from a random point inside a frame
+    std::vector<size_t> starts;
+    for (size_t at = 0, i = 0; i < sender.sent.size(); i++) {
+        starts.push_back(at);
+        at += sender.keys[i] ? TELEMETRY_KEY_FRAME_SIZE : TELEMETRY_DELTA_FRAME_SIZE;
+    }
+
+    std::vector<uint8_t> damaged;
+    int drops = 0;
+    size_t copied = 0;
+    for (size_t frame = 2 * TELEMETRY_KEY_INTERVAL; frame + 10 < sender.sent.size(); frame += 3 * TELEMETRY_KEY_INTERVAL) {
+        size_t at = starts[frame] + rand() % TELEMETRY_KEY_FRAME_SIZE;
+        size_t length = 1 + rand() % 60;
+        damaged.insert(damaged.end(), sender.stream.begin() + copied, sender.stream.begin() + at);
+        copied = at + length;
+        drops++;
+    }
+    damaged.insert(damaged.end(), sender.stream.begin() + copied, sender.stream.end());
+
+    Receiver receiver;
+    receiver.feed(damaged);
+
+    // Match each decoded sample to the sent one with its sequence number
+    size_t index = 0;
+    int wrong = 0;
+    int resyncs = 0;
+    long lost = 0;
+    for (size_t i = 0; i < receiver.samples.size(); i++) {
+        size_t next = index + (uint8_t)(receiver.sequences[i] - (uint8_t)index);
+        if (i > 0 && next != index) {
+            // Frames missing: the first one back must be a key frame
+            if (next < sender.sent.size() && !sender.keys[next]) wrong++;
+            resyncs++;
+            lost += next - index;
+        }
+        if (next >= sender.sent.size() || !sameSample(&receiver.samples[i], &sender.sent[next])) wrong++;
+        index = next + 1;
+    }
+
+    printf("dropped: %d drops, %lu gaps, %zu of %zu samples decoded, %ld held back\n",
+           drops, receiver.decoder.gaps, receiver.samples.size(), sender.sent.size(), lost);
+    CHECK(wrong == 0);
+    CHECK((int)receiver.decoder.gaps == drops);
+    CHECK(resyncs == drops);
+    CHECK(lost <= (long)drops * TELEMETRY_KEY_INTERVAL);
+    CHECK(index == sender.sent.size());
+}
+
+// Text holding a frame type byte is only taken for a frame when the CRC8
+// of what follows it matches, about one time in 256. A frame taken that way
+// is one wrong sample: the real frame after it breaks the sequence and the
+// decoder is back on the stream at the next key frame.
+static void testStrayFrames() {
+    srand(53);
+    const int trials = 200000;
+    int accepted = 0;
+    for (int trial = 0; trial < trials; trial++) {
+        uint8_t junk[TELEMETRY_MAX_FRAME_SIZE];
+        junk[0] = rand() % 2 ? TELEMETRY_KEY_FRAME : TELEMETRY_DELTA_FRAME;
+        for (int i = 1; i < TELEMETRY_MAX_FRAME_SIZE; i++) junk[i] = rand();
+        TelemetryDecoder_t decoder;
+        telemetryDecoderReset(&decoder);
+        bool produced = false;
+        if (telemetryDecode(&decoder, junk, sizeof(junk), &produced) != 1) accepted++;
+    }
+
+    // A key frame with a good CRC but nothing to do with the stream, in
+    // the middle of a run of deltas
+    Sender sender;
+    TelemetrySample_t sample = {};
+    for (int i = 0; i < 4 * TELEMETRY_KEY_INTERVAL; i++) {
+        sample.timeUs += 5000;
+        sample.position += 20;
+        sample.stepRate = 4000;
+        sender.send(sample);
+    }
+    TelemetrySample_t stray = sample;
+    stray.position = 999999;
+    uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+    size_t size = telemetryEncode(NULL, &stray, 77, true, frame);
+    size_t at = TELEMETRY_KEY_FRAME_SIZE + (TELEMETRY_KEY_INTERVAL / 2) * TELEMETRY_DELTA_FRAME_SIZE;
+    sender.stream.insert(sender.stream.begin() + at, frame, frame + size);
+
+    Receiver receiver;
+    receiver.feed(sender.stream);
+
+    size_t before = TELEMETRY_KEY_INTERVAL / 2 + 1;  // Samples ahead of the stray frame
+    size_t after = TELEMETRY_KEY_INTERVAL;  // The next key frame
+    printf("stray: %d of %d frame type bytes taken for a frame, %zu samples decoded around one\n",
+           accepted, trials, receiver.samples.size());
+    CHECK(accepted > trials / 512 && accepted < trials / 128);
+    CHECK(receiver.decoder.gaps == 2);
+    CHECK(receiver.samples.size() == before + 1 + (sender.sent.size() - after));
+    bool same = receiver.samples.size() == before + 1 + (sender.sent.size() - after);
+    for (size_t i = 0; same && i < before; i++) {
+        same = sameSample(&receiver.samples[i], &sender.sent[i]);
+    }
+    for (size_t i = after; same && i < sender.sent.size(); i++) {
+        same = sameSample(&receiver.samples[before + 1 + i - after], &sender.sent[i]);
+    }
+    CHECK(same);
+    CHECK(same && sameSample(&receiver.samples[before], &stray));
+}
+
+// Decode one frame on its own from a synced decoder at previous
+static bool decodeOne(TelemetryDecoder_t* decoder, const uint8_t* frame, size_t size, TelemetrySample_t* out) {
+    bool produced = false;
+    CHECK(telemetryDecode(decoder, frame, size, &produced) == size);
+    *out = decoder->sample;
+    return produced;
+}
+
+// A delta that is just out of range is sent as a key frame, one just in
+// range as a delta, and both decode to the sample
+static void testKeyFallback() {
+    TelemetrySample_t previous = {};
+    previous.timeUs = 0xFFFFFF00UL;
+    previous.position = -5000;
+    previous.stepRate = 1200;
+    previous.commandedSpeed = 2000;
+
+    struct Case {
+        uint32_t deltaTime;
+        int32_t deltaPosition;
+        int32_t deltaRate;
+        uint16_t commandedSpeed;
+        size_t size;
+    } cases[] = {
+        {0x200, 10, -10, 2000, TELEMETRY_DELTA_FRAME_SIZE},      // Time wraps
+        {UINT16_MAX, 0, 0, 2000, TELEMETRY_DELTA_FRAME_SIZE},
+        {UINT16_MAX + 1, 0, 0, 2000, TELEMETRY_KEY_FRAME_SIZE},
+        {100, INT16_MAX, 0, 2000, TELEMETRY_DELTA_FRAME_SIZE},
+        {100, INT16_MAX + 1, 0, 2000, TELEMETRY_KEY_FRAME_SIZE},
+        {100, INT16_MIN, 0, 2000, TELEMETRY_DELTA_FRAME_SIZE},
+        {100, INT16_MIN - 1, 0, 2000, TELEMETRY_KEY_FRAME_SIZE},
+        {100, 0, INT16_MAX, 2000, TELEMETRY_DELTA_FRAME_SIZE},
+        {100, 0, INT16_MAX + 1, 2000, TELEMETRY_KEY_FRAME_SIZE},
+        {100, 0, INT16_MIN, 2000, TELEMETRY_DELTA_FRAME_SIZE},
+        {100, 0, INT16_MIN - 1, 2000, TELEMETRY_KEY_FRAME_SIZE},
+        {100, 0, 0, 2001, TELEMETRY_KEY_FRAME_SIZE},
+    };
+
+    for (const Case& c : cases) {
+        TelemetrySample_t sample = previous;
+        sample.timeUs += c.deltaTime;
+        sample.position += c.deltaPosition;
+        sample.stepRate += c.deltaRate;
+        sample.commandedSpeed = c.commandedSpeed;
+        sample.isrLoad = 77;
+
+        uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+        size_t size = telemetryEncode(&previous, &sample, 9, false, frame);
+        CHECK(size == c.size);
+
+        TelemetryDecoder_t decoder;
+        telemetryDecoderReset(&decoder);
+        uint8_t key[TELEMETRY_MAX_FRAME_SIZE];
+        TelemetrySample_t decoded;
+        CHECK(decodeOne(&decoder, key, telemetryEncode(NULL, &previous, 8, false, key), &decoded));
+        CHECK(decodeOne(&decoder, frame, size, &decoded));
+        CHECK(sameSample(&decoded, &sample));
+        CHECK(decoder.gaps == 0);
+    }
+
+    // Asked for a key frame, or nothing to take a delta from
+    uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+    CHECK(telemetryEncode(&previous, &previous, 0, true, frame) == TELEMETRY_KEY_FRAME_SIZE);
+    CHECK(telemetryEncode(NULL, &previous, 0, false, frame) == TELEMETRY_KEY_FRAME_SIZE);
+
+    // A delta with no key frame before it is used up without a sample
+    TelemetrySample_t sample = previous;
+    sample.position += 1;
+    TelemetryDecoder_t decoder;
+    telemetryDecoderReset(&decoder);
+    TelemetrySample_t decoded;
+    size_t size = telemetryEncode(&previous, &sample, 3, false, frame);
+    CHECK(size == TELEMETRY_DELTA_FRAME_SIZE);
+    CHECK(!decodeOne(&decoder, frame, size, &decoded));
+    CHECK(decoder.frames == 1 && !decoder.synced);
+
+    // A frame not all there yet waits, one with a bad CRC is skipped a byte
+    bool produced = true;
+    CHECK(telemetryDecode(&decoder, frame, size - 1, &produced) == 0 && !produced);
+    frame[6] ^= 0x01;
+    CHECK(telemetryDecode(&decoder, frame, size, &produced) == 1 && !produced);
+    CHECK(decoder.frames == 1);
+}
+
+int main() {
+    testInterleavedText();
+    testDroppedBytes();
+    testStrayFrames();
+    testKeyFallback();
+    return hostReport("test_telemetry");
+}
@@ -0,0 +1,318 @@
+// test_tmc2209.cpp - the TMC2209 UART against a simulated chip on the single
+// wire: every datagram is checked for sync, address and CRC8, the chip
+// keeps its registers and IFCNT, and lost or rejected writes are sent again
+#include "host.h"
+#define private public
+#include "TMC2209Driver.h"
+#undef private
+#include <deque>
+
+#define UART_BYTE_US 87  // One byte at 115200 baud, 8N1
+
+// CRC-8, polynomial 0x07, initial 0, MSB first. The chip takes each byte
+// LSB first, which is the same thing on bit-reversed bytes.
+static uint8_t reverseBits(uint8_t value) {
+    uint8_t reversed = 0;
+    for (int bit = 0; bit < 8; bit++) {
+        reversed = (reversed << 1) | ((value >> bit) & 1);
+    }
+    return reversed;
+}
+
+static uint8_t referenceCrc(const uint8_t* data, int length) {
+    uint8_t crc = 0;
+    for (int i = 0; i < length; i++) {
+        crc ^= reverseBits(data[i]);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// A TMC2209 on the other end of Serial1. TX and RX share the wire, so every
+// byte sent comes back first, then the chip's reply to a read.
+class ChipMock : public HostUart {
+public:
+    uint8_t address = 0;
+    uint32_t registers[128];
+    bool present = true;      // Off = only the echo comes back
+    int rejectWrites = 0;     // Writes the chip sees with a bad CRC (line noise)
+    int breakEchoes = 0;      // Bytes that come back changed
+    int breakReplies = 0;     // Read replies with a broken CRC
+    int badFrames = 0;        // Datagrams that failed sync, address or CRC
+    int goodWrites = 0;
+    std::vector<uint8_t> written;  // Register of every accepted write
+
+    ChipMock() { powerCycle(); }
+
+    // Supply off and on: back to reset values with GSTAT.reset set
+    void powerCycle() {
+        memset(registers, 0, sizeof(registers));
+        registers[TMC2209_GSTAT] = TMC2209_GSTAT_RESET;
+        registers[TMC2209_IOIN] = (uint32_t)TMC2209_VERSION << TMC2209_IOIN_VERSION_SHIFT;
+        registers[TMC2209_CHOPCONF] = TMC2209_DEFAULT_CHOPCONF;
+        registers[TMC2209_PWMCONF] = TMC2209_DEFAULT_PWMCONF;
+        registers[TMC2209_TPOWERDOWN] = TMC2209_DEFAULT_TPOWERDOWN;
+        _frame.clear();
+    }
+
+    void receive(const uint8_t* data, size_t size) override {
+        for (size_t i = 0; i < size; i++) {
+            hostUs += UART_BYTE_US;
+            uint8_t echo = data[i];
+            if (breakEchoes > 0) {
+                breakEchoes--;
+                echo ^= 0x10;
+            }
+            _toCode.push_back(echo);
+            if (present) parse(data[i]);
+        }
+    }
+
+    int available() override {
+        if (_toCode.empty()) hostUs += 10;  // Time passes while the driver waits
+        return (int)_toCode.size();
+    }
+
+    int read() override {
+        if (_toCode.empty()) return -1;
+        uint8_t byte = _toCode.front();
+        _toCode.pop_front();
+        return byte;
+    }
+
+private:
+    std::vector<uint8_t> _frame;
+    std::deque<uint8_t> _toCode;
+
+    void parse(uint8_t byte) {
+        if (_frame.empty() && byte != TMC2209_SYNC) {
+            badFrames++;
+            return;
+        }
+        _frame.push_back(byte);
+        if (_frame.size() < TMC2209_READ_REQUEST_LENGTH) return;
+
+        bool write = _frame[2] & TMC2209_WRITE_BIT;
+        size_t length = write ? TMC2209_WRITE_LENGTH : TMC2209_READ_REQUEST_LENGTH;
+        if (_frame.size() < length) return;
+
+        bool good = _frame[1] == address && _frame[length - 1] == referenceCrc(_frame.data(), length - 1);
+        if (write && rejectWrites > 0) {
+            rejectWrites--;
+            good = false;
+        }
+        if (!good) {
+            badFrames++;
+        } else if (write) {
+            accept(_frame[2] & 0x7F, ((uint32_t)_frame[3] << 24) | ((uint32_t)_frame[4] << 16) |
+                                     ((uint32_t)_frame[5] << 8) | _frame[6]);
+        } else {
+            reply(_frame[2]);
+        }
+        _frame.clear();
+    }
+
+    void accept(uint8_t reg, uint32_t value) {
+        if (reg == TMC2209_GSTAT) {
+            registers[reg] &= ~value;  // Write 1 to clear
+        } else {
+            registers[reg] = value;
+        }
+        registers[TMC2209_IFCNT] = (registers[TMC2209_IFCNT] + 1) & 0xFF;
+        written.push_back(reg);
+        goodWrites++;
+    }
+
+    void reply(uint8_t reg) {
+        uint32_t value = registers[reg & 0x7F];
+        uint8_t frame[TMC2209_READ_REPLY_LENGTH] = {
+            TMC2209_SYNC, TMC2209_MASTER_ADDRESS, reg,
+            (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value, 0
+        };
+        frame[7] = referenceCrc(frame, 7);
+        if (breakReplies > 0) {
+            breakReplies--;
+            frame[7] ^= 0x01;
+        }
+        for (uint8_t byte : frame) {
+            _toCode.push_back(byte);
+        }
+    }
+};
+
+static const uint8_t CACHED[TMC2209_CACHE_COUNT] = {
+    TMC2209_GCONF, TMC2209_IHOLD_IRUN, TMC2209_TPOWERDOWN, TMC2209_TPWMTHRS,
+    TMC2209_TCOOLTHRS, TMC2209_SGTHRS, TMC2209_CHOPCONF, TMC2209_PWMCONF
+};
+
+// The chip holds what the driver thinks it holds
+static bool chipMatches(ChipMock& chip, TMC2209Driver& driver) {
+    for (int i = 0; i < TMC2209_CACHE_COUNT; i++) {
+        if (chip.registers[CACHED[i]] != driver._registers[i]) return false;
+    }
+    return driver._dirty == 0;
+}
+
+// CRC-8/0x07 of "123456789" is 0xF4; fed LSB first that is the reversed bytes
+static void testCrc() {
+    const char* check = "123456789";
+    uint8_t reversed[9];
+    for (int i = 0; i < 9; i++) {
+        reversed[i] = reverseBits(check[i]);
+    }
+    CHECK(TMC2209Driver::crc8(reversed, 9) == 0xF4);
+    CHECK(referenceCrc(reversed, 9) == 0xF4);
+
+    uint32_t seed = 7;
+    for (int trial = 0; trial < 10000; trial++) {
+        uint8_t frame[7];
+        for (int i = 0; i < 7; i++) {
+            seed = seed * 1103515245u + 12345u;
+            frame[i] = seed >> 16;
+        }
+        CHECK(TMC2209Driver::crc8(frame, 7) == referenceCrc(frame, 7));
+    }
+}
+
+// init finds the chip and writes the whole configuration in one checked batch
+static void testInit() {
+    ChipMock chip;
+    hostSerial1 = &chip;
+    TMC2209Driver driver(2, 3, 4, &Serial1, 5, 6);
+    driver.init();
+
+    CHECK(driver.isConnected());
+    CHECK(chip.badFrames == 0);
+    CHECK(chip.goodWrites == TMC2209_CACHE_COUNT);
+    CHECK(driver.getWriteCount() == TMC2209_CACHE_COUNT);
+    CHECK(driver.getErrorCount() == 0);
+    CHECK(chipMatches(chip, driver));
+    CHECK((chip.registers[TMC2209_GCONF] & TMC2209_GCONF_PDN_DISABLE) != 0);
+    hostSerial1 = NULL;
+}
+
+// Only what changed goes out, and setting the same value again sends nothing
+static void testDirtyOnly() {
+    ChipMock chip;
+    hostSerial1 = &chip;
+    TMC2209Driver driver(2, 3, 4, &Serial1, 5, 6);
+    driver.init();
+    chip.written.clear();
+
+    driver.setMicrostepMode(16);
+    CHECK(driver.flush());
+    CHECK(chip.written.size() == 1 && chip.written[0] == TMC2209_CHOPCONF);
+    CHECK(((chip.registers[TMC2209_CHOPCONF] & TMC2209_CHOPCONF_MRES_MASK) >> TMC2209_CHOPCONF_MRES_SHIFT) == 4);
+
+    driver.setMicrostepMode(16);
+    CHECK(driver.flush());
+    CHECK(chip.written.size() == 1);
+
+    // Stepping never touches the UART
+    driver.enable();
+    for (int i = 0; i < 1000; i++) {
+        driver.step();
+    }
+    CHECK(chip.written.size() == 1);
+    CHECK(chip.badFrames == 0);
+    CHECK(chipMatches(chip, driver));
+    hostSerial1 = NULL;
+}
+
+// A write the chip threw away shows in IFCNT and is sent again
+static void testRejectedWrite() {
+    ChipMock chip;
+    hostSerial1 = &chip;
+    TMC2209Driver driver(2, 3, 4, &Serial1, 5, 6);
+    driver.init();
+
+    driver.setCurrent(800, 50);
+    driver.setSpreadCycleThreshold(300);
+    chip.rejectWrites = 1;
+    CHECK(!driver.flush());
+    CHECK(driver.getErrorCount() == 1);
+    CHECK(chip.badFrames == 1);
+    CHECK(!chipMatches(chip, driver));
+
+    CHECK(driver.flush());
+    CHECK(chipMatches(chip, driver));
+    hostSerial1 = NULL;
+}
+
+// A byte changed on the wire is caught by the echo, a bad reply by its CRC
+static void testBrokenLine() {
+    ChipMock chip;
+    hostSerial1 = &chip;
+    TMC2209Driver driver(2, 3, 4, &Serial1, 5, 6);
+    driver.init();
+
+    driver.setStallGuard(60, 50);
+    chip.breakEchoes = 1;
+    CHECK(!driver.flush());
+    CHECK(driver.flush());
+    CHECK(chipMatches(chip, driver));
+
+    uint32_t value = 0;
+    chip.breakReplies = 1;
+    CHECK(!driver.readRegister(TMC2209_IOIN, &value));
+    CHECK(driver.readRegister(TMC2209_IOIN, &value));
+    CHECK((value >> TMC2209_IOIN_VERSION_SHIFT) == TMC2209_VERSION);
+    CHECK(driver.getErrorCount() == 2);
+    hostSerial1 = NULL;
+}
+
+// No chip: the echo alone comes back, init gives up after the timeout
+static void testNoChip() {
+    ChipMock chip;
+    chip.present = false;
+    hostSerial1 = &chip;
+    TMC2209Driver driver(2, 3, 4, &Serial1, 5, 6);
+    unsigned long start = hostUs;
+    driver.init();
+    CHECK(!driver.isConnected());
+    CHECK(hostUs - start < 2 * TMC2209_REPLY_TIMEOUT_US);
+    CHECK(!driver.flush());
+    hostSerial1 = NULL;
+}
+
+// A reset of the chip is noticed on the next check and everything rewritten
+static void testChipReset() {
+    ChipMock chip;
+    hostSerial1 = &chip;
+    TMC2209Driver driver(2, 3, 4, &Serial1, 5, 6);
+    driver.init();
+    driver.setMicrostepMode(32);
+    CHECK(driver.service());
+
+    // The power-up flag is cleared by the first check
+    hostUs += TMC2209_CHECK_INTERVAL_MS * 1000UL;
+    CHECK(driver.service());
+    CHECK(chip.registers[TMC2209_GSTAT] == 0);
+
+    chip.powerCycle();
+    CHECK(!chipMatches(chip, driver));
+    chip.written.clear();
+    CHECK(driver.service());  // Not due yet
+    CHECK(chip.written.empty());
+
+    hostUs += TMC2209_CHECK_INTERVAL_MS * 1000UL;
+    CHECK(driver.service());
+    CHECK(chip.registers[TMC2209_GSTAT] == 0);
+    CHECK(chip.written.size() == TMC2209_CACHE_COUNT + 1);  // GSTAT clear and the cache
+    CHECK(chipMatches(chip, driver));
+    CHECK(chip.badFrames == 0);
+    hostSerial1 = NULL;
+}
+
+int main() {
+    testCrc();
+    testInit();
+    testDirtyOnly();
+    testRejectedWrite();
+    testBrokenLine();
+    testNoChip();
+    testChipReset();
+    return hostReport("test_tmc2209");
+}
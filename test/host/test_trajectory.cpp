@@ -0,0 +1,195 @@
+// test_trajectory.cpp - keyframe playback: the cubic curve passes through
+// every keyframe without overshooting, the motor ends on the last one, and
+// a table many times the ring buffer survives the main loop falling behind
+#include "host.h"
+#include <LittleFS.h>
+#include "TrajectoryPlayer.h"
+
+#define TRAJECTORY "/traj.bin"
+
+// Reversals, plateaus, a sharp step and uneven spacing
+static const PathSample_t keyframes[] = {
+    {0, 0}, {500, 2000}, {750, 2100}, {1000, 2100}, {1100, 6000}, {2000, 6100},
+    {2500, -1500}, {2600, -1500}, {4000, -1400}, {4250, 3000}, {5000, 0}
+};
+static const int keyframeCount = sizeof(keyframes) / sizeof(keyframes[0]);
+
+static void writeFile(PlayerInterpolation interpolation) {
+    CHECK(TrajectoryPlayer::createFile(&LittleFS, TRAJECTORY, interpolation));
+    for (const PathSample_t& keyframe : keyframes) {
+        CHECK(TrajectoryPlayer::appendKeyframe(&LittleFS, TRAJECTORY, keyframe.timeMs, keyframe.position));
+    }
+}
+
+// Target every tick over the whole table, straight from the player
+static std::vector<long> sampleTargets(PlayerInterpolation interpolation) {
+    writeFile(interpolation);
+    TrajectoryPlayer player(&LittleFS);
+    CHECK(player.open(TRAJECTORY));
+    player.start();
+    player.getTrackingTarget();
+
+    std::vector<long> targets;
+    for (uint32_t us = 0; us <= keyframes[keyframeCount - 1].timeMs * 1000; us += 250) {
+        if (us > 0) {
+            hostUs += 250;
+            if (us % 1000 == 0) player.service();
+        }
+        targets.push_back(player.getTrackingTarget());
+    }
+    CHECK(player.isFinished() || targets.back() == keyframes[keyframeCount - 1].position);
+    player.close();
+    return targets;
+}
+
+static void testInterpolation() {
+    std::vector<long> linear = sampleTargets(PLAYER_INTERPOLATE_LINEAR);
+    std::vector<long> cubic = sampleTargets(PLAYER_INTERPOLATE_CUBIC);
+
+    long linearError = 0, overshoot = 0, reversals = 0, keyframeError = 0;
+    for (int k = 0; k + 1 < keyframeCount; k++) {
+        const PathSample_t& from = keyframes[k];
+        const PathSample_t& to = keyframes[k + 1];
+        long low = min(from.position, to.position);
+        long high = max(from.position, to.position);
+        size_t first = from.timeMs * 4;
+        size_t last = to.timeMs * 4;
+        keyframeError = max(keyframeError, labs(cubic[first] - from.position));
+        for (size_t i = first; i <= last; i++) {
+            double s = (double)(i - first) / (last - first);
+            long expected = lround(from.position + (to.position - from.position) * s);
+            linearError = max(linearError, labs(linear[i] - expected));
+
+            // The curve stays between the keyframes and moves one way only
+            overshoot = max(overshoot, max(low - cubic[i], cubic[i] - high));
+            if (i > first && (cubic[i] - cubic[i - 1]) * (to.position - from.position) < 0) reversals++;
+        }
+    }
+    keyframeError = max(keyframeError, labs(cubic.back() - keyframes[keyframeCount - 1].position));
+
+    // Velocity changes at keyframes: linear jumps, cubic blends
+    long linearJerk = 0, cubicJerk = 0;
+    for (size_t i = 2; i < cubic.size(); i++) {
+        linearJerk = max(linearJerk, labs(linear[i] - 2 * linear[i - 1] + linear[i - 2]));
+        cubicJerk = max(cubicJerk, labs(cubic[i] - 2 * cubic[i - 1] + cubic[i - 2]));
+    }
+
+    printf("cubic: overshoot %ld, %ld reversals, keyframe error %ld; linear error %ld; "
+           "largest tick-to-tick speed change linear %ld, cubic %ld\n",
+           overshoot, reversals, keyframeError, linearError, linearJerk, cubicJerk);
+    CHECK(linearError <= 1);
+    CHECK(overshoot <= 0);
+    CHECK(reversals == 0);
+    CHECK(keyframeError == 0);
+    CHECK(cubicJerk < linearJerk);
+}
+
+// The motor plays the table and stops on the final keyframe
+static void testPlayback() {
+    writeFile(PLAYER_INTERPOLATE_CUBIC);
+    unsigned long count = 0;
+    uint32_t duration = 0;
+    TrajectoryPlayer player(&LittleFS);
+    CHECK(player.scan(TRAJECTORY, &count, &duration));
+    CHECK(count == (unsigned long)keyframeCount);
+    CHECK(duration == keyframes[keyframeCount - 1].timeMs);
+
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    CHECK(player.open(TRAJECTORY));
+    controller.setTrackingSource(&player);
+    player.start();
+    hostCommand(controller, MotorCommand_t{CMD_START_TRACKING, 0, 8000, true, false, 400000});
+    for (int ms = 0; ms < 7000; ms++) {
+        hostRun(controller, 1000);
+        player.service();
+    }
+    CHECK(player.isFinished());
+    CHECK(controller.getCurrentPosition() == keyframes[keyframeCount - 1].position);
+    CHECK(driver.position == keyframes[keyframeCount - 1].position * 32);
+    player.close();
+
+    // Times that don't increase are reported
+    CHECK(TrajectoryPlayer::appendKeyframe(&LittleFS, TRAJECTORY, 4000, 10));
+    CHECK(!player.scan(TRAJECTORY, &count, &duration));
+}
+
+// A long table, 10 ms a keyframe, zig-zagging so a skipped stretch shows
+#define LONG_KEYFRAMES (25 * TRAJECTORY_READ_KEYFRAMES)
+
+static long longPosition(int k) {
+    return (k * 37) % 1000 - 500;
+}
+
+// The table streamed through the ring with the main loop servicing it
+// every serviceMs. Serviced often the ring never runs dry; serviced less
+// often than the ring lasts, the clock waits at the last sample each time
+// instead of jumping, and playback still goes through every keyframe in
+// order and ends on the last one.
+static void streamLongTable(int serviceMs) {
+    TrajectoryPlayer player(&LittleFS);
+    CHECK(player.open(TRAJECTORY));
+    player.start();
+
+    std::vector<long> targets;
+    targets.push_back(player.getTrackingTarget());
+    unsigned long ticks = 0;
+    while (!player.isFinished() && ticks < 200000) {
+        hostUs += 250;
+        ticks++;
+        if (ticks % (4 * serviceMs) == 0) player.service();
+        targets.push_back(player.getTrackingTarget());
+    }
+
+    int reached = 0;
+    long worstStep = 0;
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (reached < LONG_KEYFRAMES && targets[i] == longPosition(reached)) reached++;
+        if (i > 0) worstStep = max(worstStep, labs(targets[i] - targets[i - 1]));
+    }
+    uint32_t durationMs = (LONG_KEYFRAMES - 1) * 10;
+    printf("streamed every %d ms: %lu underruns, least margin %ld ms, %d of %d keyframes, "
+           "%lu ms for %lu ms of table, largest tick step %ld\n", serviceMs, player.getUnderruns(),
+           player.getMinMarginMs(), reached, LONG_KEYFRAMES, ticks / 4, (unsigned long)durationMs, worstStep);
+
+    CHECK(player.isFinished());
+    CHECK(reached == LONG_KEYFRAMES);
+    CHECK(targets.back() == longPosition(LONG_KEYFRAMES - 1));
+    CHECK(worstStep <= 1000 / 40 + 1);  // Never more than one tick along the steepest segment
+
+    if (serviceMs * 10 < PLAYER_BUFFER_SIZE * 10 / 2) {
+        CHECK(player.getUnderruns() == 0);
+        CHECK(player.getMinMarginMs() >= (PLAYER_BUFFER_SIZE - 3) * 10 - serviceMs);
+    } else {
+        // Each refill is a ring's worth of keyframes, and each runs dry
+        unsigned long refills = (LONG_KEYFRAMES - 1) / (PLAYER_BUFFER_SIZE - 1);
+        CHECK(player.getUnderruns() >= refills - 1 && player.getUnderruns() <= refills + 1);
+        CHECK(player.getMinMarginMs() == 0);
+        CHECK(ticks / 4 >= durationMs + player.getUnderruns() * (serviceMs - PLAYER_BUFFER_SIZE * 10));
+    }
+    player.close();
+}
+
+static void testStarvedRing() {
+    CHECK(LONG_KEYFRAMES >= 6 * PLAYER_BUFFER_SIZE);
+    CHECK(TrajectoryPlayer::createFile(&LittleFS, TRAJECTORY, PLAYER_INTERPOLATE_LINEAR));
+    for (int k = 0; k < LONG_KEYFRAMES; k++) {
+        CHECK(TrajectoryPlayer::appendKeyframe(&LittleFS, TRAJECTORY, 10 * k, longPosition(k)));
+    }
+    unsigned long count = 0;
+    uint32_t duration = 0;
+    TrajectoryPlayer scanner(&LittleFS);
+    CHECK(scanner.scan(TRAJECTORY, &count, &duration));
+    CHECK(count == LONG_KEYFRAMES);
+
+    streamLongTable(1);
+    streamLongTable(900);
+}
+
+int main() {
+    testInterpolation();
+    testPlayback();
+    testStarvedRing();
+    return hostReport("test_trajectory");
+}
@@ -0,0 +1,102 @@
+// test_trigger.cpp - position triggers fire at their compare positions at
+// the highest step rate, in both directions
+#include "host.h"
+
+#define TRIGGER_PIN 9
+
+// Position reached on each tick a trigger fired
+static std::vector<long> runMove(TimerStepperControl& controller, long target, int speed) {
+    std::vector<long> fired;
+    hostCommand(controller, MotorCommand_t{CMD_MOVE_TO, target, speed, true, false, 0});
+    unsigned long count = controller.getTriggerCount();
+    while (controller.isRunning()) {
+        hostTick(controller);
+        while (controller.getTriggerCount() > count) {
+            fired.push_back(controller.getCurrentPosition());
+            count++;
+        }
+    }
+    return fired;
+}
+
+// Every 100 steps at one pulse per tick (4000 steps/sec, the timer's limit)
+static void testIntervalAtMaxRate() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setAcceleration(10000000);
+    CHECK(controller.setTriggerOutput(TRIGGER_PIN, 5));
+    CHECK(controller.setTriggerInterval(50, 100));
+
+    // Out: 50, 150, ... 9950. Back: the same compares in reverse order
+    std::vector<long> fired = runMove(controller, 10000, 4000);
+    CHECK(fired.size() == 100);
+    for (size_t i = 0; i < fired.size(); i++) CHECK(fired[i] == 50 + (long)i * 100);
+    CHECK(hostPins[TRIGGER_PIN] == 0);
+
+    fired = runMove(controller, 0, 4000);
+    CHECK(fired.size() == 100);
+    for (size_t i = 0; i < fired.size(); i++) CHECK(fired[i] == 9950 - (long)i * 100);
+    CHECK(controller.getTriggerCount() == 200);
+}
+
+// A list, starting on one of its compares, and a long pulse timed by ticks
+static void testListAndLongPulse() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setAcceleration(10000000);
+    controller.setCurrentPosition(10);
+    const long positions[] = {-7, 10, 11, 500, 501, 2999};
+    CHECK(controller.setTriggerPositions(positions, 6));
+    CHECK(controller.setTriggerOutput(TRIGGER_PIN, 1000));
+
+    // The compare the move starts on doesn't fire
+    std::vector<long> fired = runMove(controller, 3000, 4000);
+    CHECK(fired.size() == 4);
+    CHECK(fired == std::vector<long>({11, 500, 501, 2999}));
+
+    // Pulse is high for its width, then back low with the motor stopped
+    CHECK(hostPins[TRIGGER_PIN] == 1);
+    for (int i = 0; i < 4; i++) hostTick(controller);
+    CHECK(hostPins[TRIGGER_PIN] == 0);
+
+    fired = runMove(controller, -100, 4000);
+    CHECK(fired == std::vector<long>({2999, 501, 500, 11, 10, -7}));
+
+    // Unsorted lists are refused
+    const long unsorted[] = {5, 5};
+    CHECK(!controller.setTriggerPositions(unsorted, 2));
+}
+
+// Coarse pulses under automatic microstepping cover several compares at
+// once, each pulse fires at most once and within one pulse of the compare
+static void testCoarsePulses() {
+    HostDriver driver;
+    TimerStepperControl controller(&driver);
+    controller.init();
+    controller.setMicrostepMode(16);
+    controller.setAutoMicrostep(true, 8);
+    controller.setAcceleration(200000);
+    CHECK(controller.setTriggerOutput(TRIGGER_PIN, 2));
+    CHECK(controller.setTriggerInterval(0, 37));
+
+    std::vector<long> fired = runMove(controller, 37 * 2000, 32000);
+    CHECK(controller.getCurrentPosition() == 37 * 2000);
+    CHECK(fired.size() == 2000);
+    long worst = 0;
+    for (size_t i = 0; i < fired.size(); i++) {
+        long compare = 37 * (long)(i + 1);
+        CHECK(fired[i] >= compare);
+        worst = max(worst, fired[i] - compare);
+    }
+    printf("coarse: %zu triggers, worst %ld microsteps past the compare\n", fired.size(), worst);
+    CHECK(worst < 8);
+}
+
+int main() {
+    testIntervalAtMaxRate();
+    testListAndLongPulse();
+    testCoarsePulses();
+    return hostReport("test_trigger");
+}
@@ -1,5 +1,25 @@
 // TimerStepperControl.cpp
 #include "TimerStepperControl.h"
+#include <limits.h>
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_memory_utils.h"
+#include "hal/gpio_ll.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "StepMath.h"
+
+// Survives any reset but a power cycle, see PositionCheckpoint.h
+RTC_NOINIT_ATTR static PositionCheckpoint_t rtcCheckpoint;
+
+// Time base of the step ISR. micros(), digitalWrite() and
+// delayMicroseconds() are only in IRAM when the core is built with
+// CONFIG_ARDUINO_ISR_IRAM, so the ISR uses esp_timer, the GPIO registers and
+// the ROM delay instead. micros() reads the same clock.
+static inline unsigned long IRAM_ATTR stepMicros() {
+    return (unsigned long)esp_timer_get_time();
+}
 
 // Initialize static instance pointer
 TimerStepperControl* TimerStepperControl::instance = nullptr;
@@ -7,14 +27,26 @@ TimerStepperControl* TimerStepperControl::instance = nullptr;
 // Constructor
 TimerStepperControl::TimerStepperControl(StepperDriver* driver) :
     _driver(driver),
+    _stepPins(),
+    _pinStepping(false),
     _isRunning(false),
     _isContinuous(false),
     _direction(true),
+    _plannedForward(true),
     _speed(0),
     _currentPosition(0),
     _targetPosition(0),
     _acceleration(6400), // Default acceleration
     _gptimer(nullptr),
+    _isrCycles(0),
+    _snapshot(),
+    _snapshotSequence(0),
+    _snapshotTicks(0),
+    _checkpointArmed(false),
+    _checkpointRequested(false),
+    _checkpointMode(MOTION_IDLE),
+    _checkpointCount(0),
+    _referenced(false),
     _commandQueue(nullptr),
     _motorTaskHandle(nullptr),
     _minStepInterval(1000),
@@ -22,17 +54,83 @@ TimerStepperControl::TimerStepperControl(StepperDriver* driver) :
     _stepAccumulator(0.0f),
     _stepsPerMs(0.0f),
     _currentSpeed(0.0f),
+    _feedOverride(100),
     _lastAccelUpdateTime(0),
-    _jogMode(false)  // Initialize jog mode flag
+    _jogMode(false),  // Initialize jog mode flag
+    _fixedSpeed(false),
+    _segmentHead(0),
+    _segmentTail(0),
+    _startedSegments(0),
+    _dwellStartTime(0),
+    _dwellMs(0),
+    _baseMicrostep(1),
+    _stepScale(1),
+    _autoMicrostep(false),
+    _maxStepScale(8),
+    _electricalOrigin(0),
+    _plannedPosition(0),
+    _shaperType(SHAPER_NONE),
+    _shaperCount(1),
+    _shaperHead(0),
+    _shaperQuietTicks(0),
+    _trackingSource(nullptr),
+    _isTracking(false),
+    _trackingVelocity(0.0f),
+    _softLimitsEnabled(false),
+    _softLimitMin(LONG_MIN),
+    _softLimitMax(LONG_MAX),
+    _softLimitHits(0),
+    _estopPin(-1),
+    _estopActiveLow(true),
+    _estopDeceleration(0),
+    _estopBounded(false),
+    _estopLimit(0),
+    _faultLatched(false),
+    _emergencyStopping(false),
+    _estopHook(nullptr),
+    _estopHookArg(nullptr),
+    _triggerPin(-1),
+    _triggerPulseWidth(0),
+    _triggerInterval(false),
+    _triggerStart(0),
+    _triggerStep(1),
+    _triggerTotal(0),
+    _triggerIndex(0),
+    _triggerActive(false),
+    _triggerPulseStart(0),
+    _triggerCount(0)
 {
+    portMUX_INITIALIZE(&_estopLock);
+    
     // Store instance pointer for ISR
     instance = this;
+    
+    // Start without shaping
+    setInputShaper(SHAPER_NONE, 0.0f, 0.0f);
 }
 
 // Initialize hardware timer and FreeRTOS components
-void TimerStepperControl::init() {
+bool TimerStepperControl::init() {
     // Initialize the driver
     _driver->init();
+    _pinStepping = _driver->getStepPins(&_stepPins);
+    
+    // The ISR only writes DIR when it changes, so it has to match now
+    if (_pinStepping) {
+        _driver->setDirection(_driver->getDirection());
+    }
+    
+#if CONFIG_GPTIMER_ISR_IRAM_SAFE
+    // A cache-safe interrupt running code from flash crashes on the first
+    // flash write, better not to start at all: no task, no queue, and
+    // every command is refused
+    if (!checkStepPath()) {
+        Serial.println("Step path not in IRAM, motor controller not started");
+        return false;
+    }
+#else
+    checkStepPath();
+#endif
     
     // Create command queue
     _commandQueue = xQueueCreate(10, sizeof(MotorCommand_t));
@@ -48,16 +146,16 @@ void TimerStepperControl::init() {
     );
     
     // Configure timer
-    gptimer_config_t timer_config;
+    gptimer_config_t timer_config = {};
     timer_config.clk_src = GPTIMER_CLK_SRC_DEFAULT;
     timer_config.direction = GPTIMER_COUNT_UP;
     timer_config.resolution_hz = 1000000;  // 1MHz = 1us resolution
     ESP_ERROR_CHECK(gptimer_new_timer(&timer_config, &_gptimer));
     
     // Configure timer alarm
-    gptimer_alarm_config_t alarm_config;
+    gptimer_alarm_config_t alarm_config = {};
     alarm_config.reload_count = 0;
-    alarm_config.alarm_count = 250; // 1ms intervals
+    alarm_config.alarm_count = STEP_TIMER_INTERVAL_US;
     alarm_config.flags.auto_reload_on_alarm = true;
     ESP_ERROR_CHECK(gptimer_set_alarm_action(_gptimer, &alarm_config));
     
@@ -70,6 +168,7 @@ void TimerStepperControl::init() {
     // Start the timer
     ESP_ERROR_CHECK(gptimer_enable(_gptimer));
     ESP_ERROR_CHECK(gptimer_start(_gptimer));
+    return true;
 }
 
 // Function for clearing move queue
@@ -77,9 +176,12 @@ void TimerStepperControl::clearCommandQueue() {
     // Stop the motor immediately
     _isRunning = false;
     _isContinuous = false;
+    _isTracking = false;
     _jogMode = false;
     _currentSpeed = 0;
     _stepAccumulator = 0.0f;
+    clearSegments();
+    resetShaper();
     
     // Empty the queue if it exists
     if (_commandQueue != NULL) {
@@ -94,12 +196,18 @@ void TimerStepperControl::clearCommandQueue() {
 }
 
 void TimerStepperControl::resetMotorState() {
+    // An emergency ramp-down finishes on its own
+    if (_emergencyStopping) return;
+    
     // Reset all state variables
     _isRunning = false;
     _isContinuous = false;
+    _isTracking = false;
     _jogMode = false;
     _currentSpeed = 0.0f;
     _stepAccumulator = 0.0f;
+    _dwellMs = 0;
+    resetShaper();
     
     // Very important: reset the timestamp to prevent elapsed time jumps
     _lastAccelUpdateTime = micros();
@@ -112,43 +220,138 @@ bool IRAM_ATTR TimerStepperControl::timerCallback(gptimer_handle_t timer,
         void *user_data) {
     // Get instance pointer
     TimerStepperControl* obj = (TimerStepperControl*)user_data;
+    uint32_t startCycles = esp_cpu_get_cycle_count();
+
+    // A move is marked in the checkpoint before its first step
+    if (obj->_isRunning && obj->_checkpointArmed && obj->_checkpointMode == MOTION_IDLE) {
+        obj->writeCheckpoint(obj->motionMode());
+    }
+
+    // End a long trigger pulse on the first tick after its width has
+    // passed, also when the move that fired it has ended
+    if (obj->_triggerActive && stepMicros() - obj->_triggerPulseStart >= obj->_triggerPulseWidth) {
+        gpio_ll_set_level(&GPIO, obj->_triggerPin, 0);
+        obj->_triggerActive = false;
+    }
 
     // If running, process a step if needed
     if (obj->_isRunning) {
     obj->processStep();
     }
 
+    // Publish the motion state every millisecond and on a mode change
+    uint8_t mode = obj->motionMode();
+    if (++obj->_snapshotTicks >= SNAPSHOT_INTERVAL_TICKS || mode != obj->_snapshot.mode) {
+        obj->publishSnapshot(mode);
+    }
+
+    // The motor has come to rest, or something the checkpoint holds changed
+    if (obj->_checkpointArmed &&
+        ((mode == MOTION_IDLE && obj->_checkpointMode != MOTION_IDLE) || obj->_checkpointRequested)) {
+        obj->writeCheckpoint(mode);
+    }
+
+    obj->_isrCycles += esp_cpu_get_cycle_count() - startCycles;
+
     // Return false to avoid waking up a high-priority task
     return false;
 }
 
 // Process a single step if needed
-void TimerStepperControl::processStep() {
+void IRAM_ATTR TimerStepperControl::processStep() {
     // Only process if we're supposed to be running
     if (!_isRunning) return;
     
+    // With the fault latched only the e-stop ramp may step, anything else
+    // that has the motor running stops here without a pulse
+    if (_faultLatched && !_emergencyStopping) {
+        _isRunning = false;
+        _isContinuous = false;
+        _isTracking = false;
+        _targetPosition = _plannedPosition;
+        driverDisable();
+        return;
+    }
+    
+    runPlanner();
+    if (_shaperCount == 1 || !_isRunning) return;
+    
+    shapeOutput();
+    
+    // The shaped output trails the planner, stop once it has settled
+    if (!_isContinuous && !_isTracking && _plannedPosition == _targetPosition && _dwellMs == 0 &&
+        _segmentTail == _segmentHead && _currentPosition == _plannedPosition &&
+        _shaperQuietTicks > _shaperDelay[_shaperCount - 1]) {
+        _isRunning = false;
+        driverDisable();
+    }
+}
+
+// Advance the speed profile and the planned position by one timer tick
+void IRAM_ATTR TimerStepperControl::runPlanner() {
     // Get current time
-    unsigned long currentTime = micros();
+    unsigned long currentTime = stepMicros();
     unsigned long elapsedTime = currentTime - _lastAccelUpdateTime;
     
     // Update acceleration timestamp
     _lastAccelUpdateTime = currentTime;
     
+    // Emergency ramp-down, carry on the same way until the speed reaches
+    // zero, but never past the end of the move or a soft limit
+    if (_emergencyStopping) {
+        _currentSpeed -= _estopDeceleration * (elapsedTime / 1000000.0f);
+        if (_currentSpeed > 0) {
+            _stepAccumulator += _currentSpeed * (elapsedTime / 1000000.0f);
+            if (_stepAccumulator < _stepScale) return;
+            _stepAccumulator -= _stepScale;
+            
+            long next = _direction ? _plannedPosition + _stepScale : _plannedPosition - _stepScale;
+            if (!_estopBounded || (_direction ? next <= _estopLimit : next >= _estopLimit)) {
+                planPulse(_direction);
+                return;
+            }
+        }
+        _currentSpeed = 0;
+        _emergencyStopping = false;
+        _targetPosition = _plannedPosition;
+        _isRunning = false;
+        driverDisable();
+        return;
+    }
+    
+    // Hold position while a segment dwell is in progress
+    if (_dwellMs > 0) {
+        if (currentTime - _dwellStartTime < _dwellMs * 1000UL) return;
+        _dwellMs = 0;
+    }
+    
+    // Tracking mode has its own speed profile
+    if (_isTracking) {
+        runTracking(elapsedTime / 1000000.0f);
+        return;
+    }
+    
+    // One pulse a tick is as fast as the motor can go in this microstep mode
+    float tickRate = _stepScale * (1000000.0f / STEP_TIMER_INTERVAL_US);
+    
     // Update speed based on acceleration (but not in jog mode)
     if (!_jogMode) {
-        // Existing acceleration logic...
-        if (_currentSpeed < _speed && _acceleration > 0) {
+        // Commanded speed scaled by the feed override
+        float speed = _fixedSpeed ? _speed : _speed * (_feedOverride / 100.0f);
+        if (speed > tickRate) speed = tickRate;
+        
+        if (_currentSpeed < speed && _acceleration > 0) {
             // Accelerating
             _currentSpeed += _acceleration * (elapsedTime / 1000000.0f);
-            if (_currentSpeed > _speed) _currentSpeed = _speed; // Cap at target speed
-        } else if (_currentSpeed > _speed && _acceleration > 0) {
-            // Decelerating 
+            if (_currentSpeed > speed) _currentSpeed = speed; // Cap at target speed
+        } else if (_currentSpeed > speed && _acceleration > 0) {
+            // Decelerating, settle on the new speed rather than going past it
             _currentSpeed -= _acceleration * (elapsedTime / 1000000.0f);
-            if (_currentSpeed < 0) _currentSpeed = 0; // Don't go negative
+            if (_currentSpeed < speed) _currentSpeed = speed;
         }
     } else {
         // In jog mode, use target speed directly - no acceleration
-        _currentSpeed = _speed;
+        _currentSpeed = min((float)_speed, tickRate);
     }
     
     // Update acceleration timestamp
@@ -160,48 +363,810 @@ void TimerStepperControl::processStep() {
     // Add step accumulation based on current speed and timer interval
     _stepAccumulator += _currentSpeed * (elapsedTime / 1000000.0f);
     
-    // Check if we've accumulated enough for a step
-    if (_stepAccumulator >= 1.0f) {
+    // A late tick may owe one more pulse, never a backlog that would keep
+    // the motor going at the old speed after a slow-down
+    if (_stepAccumulator > 2.0f * _stepScale) _stepAccumulator = 2.0f * _stepScale;
+    
+    // Check if we've accumulated enough for a step (one driver pulse moves
+    // _stepScale base microsteps)
+    if (_stepAccumulator >= _stepScale) {
+        // Switch microstep mode between pulses if the speed band changed
+        updateStepScale();
+        
         // Reset accumulator but keep the fractional part
-        _stepAccumulator -= 1.0f;
+        _stepAccumulator -= _stepScale;
         
         // For continuous rotation mode
         if (_isContinuous) {
-            // Apply direction and take step
-            _driver->setDirection(_direction);
-            _driver->step();
-            
-            // Update position counter
-            if (_direction) {
-                _currentPosition++;
-            } else {
-                _currentPosition--;
-            }
+            planPulse(_direction);
             return;
         }
         
         // For position control mode, check if we've reached the target
-        if (_currentPosition == _targetPosition) {
-            _isRunning = false;
-            _driver->disable();
-            return;
+        if (_plannedPosition == _targetPosition) {
+            // Chain straight into the next queued segment if there is one
+            if (!loadNextSegment()) {
+                // A shaped move finishes once the output has caught up
+                if (_shaperCount > 1) return;
+                _isRunning = false;
+                driverDisable();
+                return;
+            }
+            
+            // New segment starts with a dwell or is already at its target
+            if (_dwellMs > 0 || _plannedPosition == _targetPosition) return;
+            
+            // Make sure a coarse pulse can't overshoot the new target
+            updateStepScale();
         }
         
         // Determine direction based on position difference
-        if (_currentPosition < _targetPosition) {
-            _driver->setDirection(true);
-            _driver->step();
-            _currentPosition++;
-        } else {
-            _driver->setDirection(false);
-            _driver->step();
-            _currentPosition--;
+        planPulse(_plannedPosition < _targetPosition);
+    }
+}
+
+// Chase the tracking target. The speed toward the target is limited to what
+// can still stop on it with the current acceleration, and changes by at most
+// the acceleration each tick, so jumps in the target are smoothed out. The
+// source's own speed is added on top so a moving target is followed closely.
+void IRAM_ATTR TimerStepperControl::runTracking(float elapsedSeconds) {
+    long target = _trackingSource->getTrackingTarget();
+    if (_softLimitsEnabled) {
+        target = constrain(target, _softLimitMin, _softLimitMax);
+    }
+    long error = target - _plannedPosition;
+    
+    // Desired signed speed
+    float correction = stepSqrtf(2.0f * _acceleration * labs(error));
+    float desired = _trackingSource->getTrackingVelocity() + (error < 0 ? -correction : correction);
+    desired = constrain(desired, -(float)_speed, (float)_speed);
+    
+    // Ramp toward it under the acceleration limit
+    float change = _acceleration * elapsedSeconds;
+    if (_trackingVelocity < desired) {
+        _trackingVelocity = min(desired, _trackingVelocity + change);
+    } else {
+        _trackingVelocity = max(desired, _trackingVelocity - change);
+    }
+    
+    // Microstep switching and the step accumulator work on plain speed
+    _targetPosition = target;
+    _currentSpeed = fabsf(_trackingVelocity);
+    _stepAccumulator += _currentSpeed * elapsedSeconds;
+    if (_stepAccumulator < _stepScale) return;
+    
+    updateStepScale();
+    _stepAccumulator -= _stepScale;
+    
+    // Never step past the target, the speed catches up on the next ticks
+    if (_trackingVelocity > 0 && _plannedPosition < target) {
+        planPulse(true);
+    } else if (_trackingVelocity < 0 && _plannedPosition > target) {
+        planPulse(false);
+    }
+}
+
+// Set where tracking mode gets its target from
+void TimerStepperControl::setTrackingSource(TrackingSource* source) {
+    if (_isRunning) return;
+    _trackingSource = source;
+}
+
+// Set the soft limit range and enable it
+void TimerStepperControl::setSoftLimits(long minPosition, long maxPosition) {
+    if (minPosition > maxPosition) return;
+    _softLimitMin = minPosition;
+    _softLimitMax = maxPosition;
+    _softLimitsEnabled = true;
+}
+
+// Clamp a move target to the soft limits
+long IRAM_ATTR TimerStepperControl::applySoftLimits(long target) {
+    if (!_softLimitsEnabled) return target;
+    if (target < _softLimitMin) {
+        _softLimitHits++;
+        return _softLimitMin;
+    }
+    if (target > _softLimitMax) {
+        _softLimitHits++;
+        return _softLimitMax;
+    }
+    return target;
+}
+
+// Watch an emergency stop input
+bool TimerStepperControl::setEmergencyStopInput(int pin, bool activeLow, int deceleration) {
+    if (_estopPin >= 0) {
+        detachInterrupt(digitalPinToInterrupt(_estopPin));
+    }
+    _estopPin = pin;
+    _estopActiveLow = activeLow;
+    _estopDeceleration = max(deceleration, 0);
+    if (pin < 0) return false;
+    
+    pinMode(pin, activeLow ? INPUT_PULLUP : INPUT);
+    attachInterruptArg(digitalPinToInterrupt(pin), emergencyStopISR, this, activeLow ? FALLING : RISING);
+    
+    // Already pressed at start-up
+    if (isEmergencyStopActive()) {
+        _faultLatched = true;
+    }
+    return true;
+}
+
+// E-stop input edge
+void IRAM_ATTR TimerStepperControl::emergencyStopISR(void* arg) {
+    ((TimerStepperControl*)arg)->emergencyStop();
+}
+
+// Latch the fault and stop stepping. Runs with interrupts masked so the step
+// ISR sees either the old state or the stopped one, never half of each.
+void IRAM_ATTR TimerStepperControl::emergencyStop() {
+    portENTER_CRITICAL_SAFE(&_estopLock);
+    _faultLatched = true;
+    
+    if (_isRunning && !_emergencyStopping) {
+        // Nothing may chain on after this
+        _segmentTail = _segmentHead;
+        _dwellMs = 0;
+        _jogMode = false;
+        
+        if (_estopDeceleration > 0 && _currentSpeed > 0) {
+            // Ramp down from the speed actually reached (at most one pulse a
+            // tick), dropping any backlog the accumulator has built up
+            float tickRate = _stepScale * (1000000.0f / STEP_TIMER_INTERVAL_US);
+            if (_currentSpeed > tickRate) _currentSpeed = tickRate;
+            _stepAccumulator = 0.0f;
+            
+            // Ramp down in the direction the motor is already going
+            if (_isTracking) {
+                _direction = _trackingVelocity > 0;
+            } else if (!_isContinuous) {
+                _direction = _targetPosition > _plannedPosition;
+            }
+            
+            // The ramp ends where the move would have ended, or at the soft
+            // limit ahead, whichever comes first
+            _estopBounded = false;
+            if (!_isContinuous && !_isTracking) {
+                _estopBounded = true;
+                _estopLimit = _targetPosition;
+            }
+            if (_softLimitsEnabled) {
+                long edge = _direction ? _softLimitMax : _softLimitMin;
+                if (!_estopBounded || (_direction ? edge < _estopLimit : edge > _estopLimit)) {
+                    _estopLimit = edge;
+                }
+                _estopBounded = true;
+            }
+            _isTracking = false;
+            _isContinuous = false;
+            
+            float stopDistance = _currentSpeed * _currentSpeed / (2.0f * _estopDeceleration);
+            long room = _direction ? _estopLimit - _plannedPosition : _plannedPosition - _estopLimit;
+            _emergencyStopping = !_estopBounded || stopDistance <= room;
+        }
+        
+        // Hard cut when there's no ramp, or it wouldn't fit
+        if (!_emergencyStopping) {
+            _isRunning = false;
+            _isTracking = false;
+            _isContinuous = false;
+            _targetPosition = _plannedPosition;
+            driverDisable();
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&_estopLock);
+    
+    if (_estopHook != nullptr) _estopHook(_estopHookArg);
+}
+
+// E-stop input still asserted
+bool TimerStepperControl::isEmergencyStopActive() {
+    if (_estopPin < 0) return false;
+    return digitalRead(_estopPin) == (_estopActiveLow ? LOW : HIGH);
+}
+
+// Clear the latched fault once the input is released and the motor stopped
+bool TimerStepperControl::clearFault() {
+    if (!_faultLatched) return true;
+    if (isEmergencyStopActive() || _emergencyStopping) return false;
+    
+    resetMotorState();
+    _targetPosition = _currentPosition;
+    _faultLatched = false;
+    return true;
+}
+
+// Stop where the planner is now, the next tick sees the target reached
+void IRAM_ATTR TimerStepperControl::stopFromISR() {
+    _isContinuous = false;
+    _isTracking = false;
+    _segmentTail = _segmentHead;
+    _dwellMs = 0;
+    _targetPosition = _plannedPosition;
+}
+
+// One pulse on the driver. Step/direction drivers are driven through the
+// GPIO registers, the others only through their virtual step().
+void IRAM_ATTR TimerStepperControl::driverStep(bool forward) {
+    if (!_pinStepping) {
+        _driver->setDirection(forward);
+        _driver->step();
+        return;
+    }
+    
+    // DIR only changes on a reversal, and then has to settle before the
+    // step edge (650 ns on the DRV8825)
+    bool turned = forward != _driver->_direction;
+    if (turned) {
+        _driver->_direction = forward;
+        gpio_ll_set_level(&GPIO, _stepPins.dirPin, forward ? 1 : 0);
+    }
+    if (!_driver->_enabled) return;
+    
+    if (turned) esp_rom_delay_us(1);
+    gpio_ll_set_level(&GPIO, _stepPins.stepPin, 1);
+    esp_rom_delay_us(_stepPins.pulseWidthUs);
+    gpio_ll_set_level(&GPIO, _stepPins.stepPin, 0);
+}
+
+// Turn the driver off at the end of a move (enable is active low)
+void IRAM_ATTR TimerStepperControl::driverDisable() {
+    if (!_pinStepping) {
+        _driver->disable();
+        return;
+    }
+    
+    if (_stepPins.enablePin >= 0) {
+        gpio_ll_set_level(&GPIO, _stepPins.enablePin, 1);
+    }
+    _driver->_enabled = false;
+}
+
+// Address of a member function's code (GCC extension)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpmf-conversions"
+#define STEP_PATH_CODE(name) ((const void*)(this->*(&TimerStepperControl::name)))
+
+// The Arduino build has no link step a placement check could hook into, so
+// the step path is checked once at start-up instead
+bool TimerStepperControl::checkStepPath() {
+    const void* code[] = {
+        (const void*)timerCallback,
+        STEP_PATH_CODE(processStep),
+        STEP_PATH_CODE(runPlanner),
+        STEP_PATH_CODE(runTracking),
+        STEP_PATH_CODE(planPulse),
+        STEP_PATH_CODE(outputPulse),
+        STEP_PATH_CODE(shapeOutput),
+        STEP_PATH_CODE(updateStepScale),
+        STEP_PATH_CODE(getMaxStepScale),
+        STEP_PATH_CODE(loadNextSegment),
+        STEP_PATH_CODE(applySoftLimits),
+        STEP_PATH_CODE(triggerPosition),
+        STEP_PATH_CODE(checkTrigger),
+        STEP_PATH_CODE(driverStep),
+        STEP_PATH_CODE(driverDisable),
+        STEP_PATH_CODE(stopFromISR),
+        STEP_PATH_CODE(motionMode),
+        STEP_PATH_CODE(publishSnapshot),
+        STEP_PATH_CODE(writeCheckpoint),
+        STEP_PATH_CODE(getStepRate),
+        STEP_PATH_CODE(emergencyStop),
+        (const void*)esp_timer_get_time,
+    };
+    bool ok = true;
+    
+    for (int i = 0; i < (int)(sizeof(code) / sizeof(code[0])); i++) {
+        if (!esp_ptr_in_iram(code[i])) {
+            Serial.print("Step path function ");
+            Serial.print(i);
+            Serial.println(" is not in IRAM");
+            ok = false;
         }
     }
+    if (!esp_ptr_internal(this) || !esp_ptr_internal(_driver)) {
+        Serial.println("Step path data is not in internal RAM");
+        ok = false;
+    }
+    // The L298N's sine microstepping writes the bridge through the LEDC
+    // driver, it is one of these
+    if (!_pinStepping) {
+        Serial.println("Driver has no step pins, it is stepped through flash");
+        ok = false;
+    }
+    
+#if !CONFIG_GPTIMER_ISR_IRAM_SAFE
+    Serial.println("Step interrupt is not cache safe, stepping pauses during flash writes");
+#endif
+    return ok;
+}
+
+#undef STEP_PATH_CODE
+#pragma GCC diagnostic pop
+
+// Advance the planned position by one pulse
+void IRAM_ATTR TimerStepperControl::planPulse(bool forward) {
+    _plannedForward = forward;
+    if (forward) {
+        _plannedPosition += _stepScale;
+    } else {
+        _plannedPosition -= _stepScale;
+    }
+    
+    // Without a shaper the planner drives the motor directly
+    if (_shaperCount == 1) {
+        outputPulse(forward);
+    }
+}
+
+// Send one pulse to the driver and update the position counter
+void IRAM_ATTR TimerStepperControl::outputPulse(bool forward) {
+    driverStep(forward);
+    
+    long previous = _currentPosition;
+    if (forward) {
+        _currentPosition += _stepScale;
+    } else {
+        _currentPosition -= _stepScale;
+    }
+    
+    if (_triggerTotal > 0) {
+        checkTrigger(previous, _currentPosition);
+    }
+}
+
+// Compare position number index
+long IRAM_ATTR TimerStepperControl::triggerPosition(long index) {
+    if (_triggerInterval) {
+        return _triggerStart + index * _triggerStep;
+    }
+    return _triggerPositions[index];
+}
+
+// Check the compares next to the current one after a pulse. _triggerIndex
+// counts the compares below the position, so only the entries on either
+// side of it can have been crossed. A coarse pulse that jumps over several
+// compares fires once.
+void IRAM_ATTR TimerStepperControl::checkTrigger(long from, long to) {
+    long index = _triggerIndex;
+    bool crossed = false;
+    
+    if (to > from) {
+        // Moving up, skip a compare we were already sitting on
+        if (index < _triggerTotal && triggerPosition(index) == from) index++;
+        crossed = index < _triggerTotal && triggerPosition(index) <= to;
+        while (_triggerIndex < _triggerTotal && triggerPosition(_triggerIndex) < to) _triggerIndex++;
+    } else {
+        crossed = index > 0 && triggerPosition(index - 1) >= to;
+        while (_triggerIndex > 0 && triggerPosition(_triggerIndex - 1) >= to) _triggerIndex--;
+    }
+    
+    if (!crossed || _triggerPin < 0) return;
+    
+    gpio_ll_set_level(&GPIO, _triggerPin, 1);
+    _triggerCount++;
+    
+    if (_triggerPulseWidth <= TRIGGER_INLINE_PULSE_MAX_US) {
+        esp_rom_delay_us(_triggerPulseWidth);
+        gpio_ll_set_level(&GPIO, _triggerPin, 0);
+    } else {
+        _triggerPulseStart = stepMicros();
+        _triggerActive = true;
+    }
+}
+
+// Count the compares below the current position
+void TimerStepperControl::armTriggers() {
+    long position = _currentPosition;
+    long index = 0;
+    
+    if (_triggerInterval) {
+        // Round up so a compare at the current position isn't counted
+        if (position > _triggerStart) {
+            index = (position - _triggerStart + _triggerStep - 1) / _triggerStep;
+        }
+        if (index > _triggerTotal) index = _triggerTotal;
+    } else {
+        while (index < _triggerTotal && _triggerPositions[index] < position) index++;
+    }
+    
+    _triggerIndex = index;
+}
+
+// Set the output pin and pulse width for position triggers
+bool TimerStepperControl::setTriggerOutput(int pin, uint32_t pulseWidthUs) {
+    if (_isRunning) return false;
+    
+    if (_triggerPin >= 0) {
+        digitalWrite(_triggerPin, LOW);
+    }
+    _triggerActive = false;
+    _triggerPin = pin;
+    _triggerPulseWidth = max(pulseWidthUs, (uint32_t)1);
+    
+    if (_triggerPin >= 0) {
+        pinMode(_triggerPin, OUTPUT);
+        digitalWrite(_triggerPin, LOW);
+    }
+    return true;
+}
+
+// Fire at each position of a strictly increasing list
+bool TimerStepperControl::setTriggerPositions(const long* positions, int count) {
+    if (_isRunning || count < 0 || count > TRIGGER_MAX_POSITIONS) return false;
+    
+    for (int i = 1; i < count; i++) {
+        if (positions[i] <= positions[i - 1]) {
+            Serial.println("Trigger positions must be strictly increasing");
+            return false;
+        }
+    }
+    
+    _triggerTotal = 0;
+    for (int i = 0; i < count; i++) {
+        _triggerPositions[i] = positions[i];
+    }
+    _triggerInterval = false;
+    _triggerCount = 0;
+    _triggerTotal = count;
+    armTriggers();
+    return true;
+}
+
+// Fire every interval steps starting at start
+bool TimerStepperControl::setTriggerInterval(long start, long interval, long count) {
+    if (_isRunning || interval <= 0 || count < 0) return false;
+    
+    _triggerTotal = 0;
+    _triggerInterval = true;
+    _triggerStart = start;
+    _triggerStep = interval;
+    _triggerCount = 0;
+    _triggerTotal = count > 0 ? count : LONG_MAX / 2 / interval;
+    armTriggers();
+    return true;
+}
+
+// Remove all compares
+void TimerStepperControl::clearTriggers() {
+    _triggerTotal = 0;
+    _triggerIndex = 0;
+}
+
+// Record this tick's planned position and step toward the shaped position,
+// which is the planned position history weighted by the shaper impulses.
+// The gains add up to exactly one, so once the planner stops the output
+// lands on the planned position without any rounding error.
+void IRAM_ATTR TimerStepperControl::shapeOutput() {
+    long planned = _plannedPosition;
+    uint16_t previous = _shaperHead;
+    _shaperHead = (_shaperHead + 1) & (SHAPER_HISTORY_SIZE - 1);
+    _shaperHistory[_shaperHead] = planned;
+    
+    if (_shaperHistory[previous] != planned) {
+        _shaperQuietTicks = 0;
+    } else if (_shaperQuietTicks < 0xFFFF) {
+        _shaperQuietTicks++;
+    }
+    
+    int64_t weighted = 0;
+    for (int i = 0; i < _shaperCount; i++) {
+        long sample = _shaperHistory[(_shaperHead - _shaperDelay[i]) & (SHAPER_HISTORY_SIZE - 1)];
+        weighted += (int64_t)_shaperGain[i] * sample;
+    }
+    
+    // Round to the nearest step (arithmetic shift floors negative values)
+    long shaped = (long)((weighted + (1 << 14)) >> 15);
+    
+    // The shaped position moves at most one step per tick
+    if (_currentPosition < shaped) {
+        outputPulse(true);
+    } else if (_currentPosition > shaped) {
+        outputPulse(false);
+    }
+}
+
+// Fill the history with the current position so shaping starts from rest
+void TimerStepperControl::resetShaper() {
+    _plannedPosition = _currentPosition;
+    for (int i = 0; i < SHAPER_HISTORY_SIZE; i++) {
+        _shaperHistory[i] = _currentPosition;
+    }
+    _shaperQuietTicks = 0xFFFF;
+}
+
+// Configure the input shaper. Impulse times are rounded to whole timer ticks
+// and amplitudes to Q15, the stored impulses reflect what is actually applied.
+bool TimerStepperControl::setInputShaper(ShaperType type, float frequencyHz, float damping) {
+    if (_isRunning) return false;
+    
+    ShaperImpulses_t impulses;
+    if (!computeShaperImpulses(type, frequencyHz, damping, &impulses)) {
+        Serial.println("Invalid input shaper settings");
+        return false;
+    }
+    
+    float tickSeconds = STEP_TIMER_INTERVAL_US / 1000000.0f;
+    long lastDelay = lroundf(impulses.times[impulses.count - 1] / tickSeconds);
+    if (lastDelay >= SHAPER_HISTORY_SIZE) {
+        Serial.print("Input shaper frequency too low, minimum delay is ");
+        Serial.print(SHAPER_HISTORY_SIZE - 1);
+        Serial.println(" ticks");
+        return false;
+    }
+    
+    quantizeShaperImpulses(&impulses, tickSeconds, _shaperDelay, _shaperGain, &_shaperImpulses);
+    _shaperCount = impulses.count;
+    _shaperType = type;
+    
+    // Shaped output needs single microsteps
+    if (_stepScale != 1) {
+        _stepScale = 1;
+        _driver->setMicrostepMode(_baseMicrostep);
+    }
+    
+    resetShaper();
+    return true;
+}
+
+// Choose the microstep mode for the current speed. Coarser modes are only
+// entered on positions that are whole steps of the new mode, measured from
+// where the indexer was last reset, so the electrical angle stays aligned
+// with the position counter. Going finer is always aligned.
+void IRAM_ATTR TimerStepperControl::updateStepScale() {
+    int maxScale = getMaxStepScale();
+    if (maxScale == 1 && _stepScale == 1) return;
+    
+    int scale = _stepScale;
+    int newScale = scale;
+    float pulseRate = _currentSpeed / scale;
+    
+    if (maxScale == 1) {
+        newScale = 1;
+    } else if (pulseRate > AUTO_MICROSTEP_UP_RATE && scale * 2 <= maxScale) {
+        newScale = scale * 2;
+    } else if (scale > 1 && pulseRate * 2 < AUTO_MICROSTEP_DOWN_RATE) {
+        newScale = scale / 2;
+    }
+    
+    // Position moves drop to finer steps rather than overshoot the target
+    if (!_isContinuous) {
+        long remaining = labs(_targetPosition - _currentPosition);
+        while (newScale > 1 && remaining < newScale) {
+            newScale /= 2;
+        }
+    }
+    
+    // Wait for an aligned position before going coarser
+    if (newScale > scale && ((_currentPosition - _electricalOrigin) % newScale) != 0) {
+        newScale = scale;
+    }
+    
+    if (newScale != scale) {
+        _stepScale = newScale;
+        _driver->setMicrostepMode(_baseMicrostep / newScale);
+    }
+}
+
+// Set the base microstep mode (only while stopped)
+void TimerStepperControl::setMicrostepMode(int mode) {
+    if (_isRunning) return;
+    
+    _driver->setMicrostepMode(mode);
+    _baseMicrostep = _driver->getMicrostepMode();
+    _stepScale = 1;
+    _checkpointRequested = true;
+}
+
+// Coarsest scale automatic mode can reach (never coarser than full steps)
+int IRAM_ATTR TimerStepperControl::getMaxStepScale() {
+    if (!_autoMicrostep || _shaperCount > 1) return 1;
+    
+    int scale = 1;
+    while (scale * 2 <= _maxStepScale && scale * 2 <= _baseMicrostep) {
+        scale *= 2;
+    }
+    return scale;
+}
+
+// Enable or disable automatic microstep switching
+void TimerStepperControl::setAutoMicrostep(bool enabled, int maxStepScale) {
+    if (_isRunning) return;
+    
+    _autoMicrostep = enabled;
+    _maxStepScale = maxStepScale;
+    
+    // Always stop in the base mode
+    if (_stepScale != 1) {
+        _stepScale = 1;
+        _driver->setMicrostepMode(_baseMicrostep);
+    }
+}
+
+// Load the next queued segment into the active move (called from the ISR)
+bool IRAM_ATTR TimerStepperControl::loadNextSegment() {
+    if (_segmentTail == _segmentHead) return false;
+    
+    // Pairs with the release in queueSegment(), the slot is read only after
+    // the head that published it
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    MotionSegment_t* segment = &_segments[_segmentTail];
+    
+    long target = applySoftLimits(segment->targetPosition);
+    
+    // Reversing direction has to start again from standstill
+    bool wasClockwise = _targetPosition >= _plannedPosition;
+    bool newClockwise = target >= _plannedPosition;
+    if (wasClockwise != newClockwise || segment->dwellMs > 0) {
+        _currentSpeed = 0;
+        _stepAccumulator = 0.0f;
+    }
+    
+    _targetPosition = target;
+    _speed = segment->speed;
+    if (segment->acceleration > 0) {
+        _acceleration = segment->acceleration;
+    }
+    
+    // Start the dwell timer for this segment
+    _dwellMs = segment->dwellMs;
+    _dwellStartTime = stepMicros();
+    
+    // Hold at reduced current while dwelling, the next step restores it
+    // (step/direction drivers have no standstill setting)
+    if (_dwellMs > 0 && !_pinStepping) {
+        _driver->setStandstill(true);
+    }
+    
+    _segmentTail = (_segmentTail + 1) & (SEGMENT_QUEUE_SIZE - 1);
+    _startedSegments++;
+    return true;
+}
+
+// Add a segment to the queue (called from the main loop)
+bool TimerStepperControl::queueSegment(const MotionSegment_t* segment) {
+    uint8_t nextHead = (_segmentHead + 1) & (SEGMENT_QUEUE_SIZE - 1);
+    if (nextHead == _segmentTail) return false; // Queue full
+    
+    _segments[_segmentHead] = *segment;
+    
+    // The slot has to be written before the ISR can see the new head
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    _segmentHead = nextHead;
+    return true;
+}
+
+// Number of segments that can still be queued
+int TimerStepperControl::getFreeSegmentSlots() {
+    return (SEGMENT_QUEUE_SIZE - 1) - ((_segmentHead - _segmentTail) & (SEGMENT_QUEUE_SIZE - 1));
+}
+
+// Drop all queued segments. The tail belongs to the ISR, so it is moved
+// with interrupts masked: the ISR sees the queue either as it was or
+// cleared, never the tail moved with the rest of its state left over.
+void TimerStepperControl::clearSegments() {
+    portENTER_CRITICAL(&_estopLock);
+    _segmentTail = _segmentHead;
+    _startedSegments = 0;
+    _dwellMs = 0;
+    portEXIT_CRITICAL(&_estopLock);
+}
+
+// What the step generator is doing
+uint8_t IRAM_ATTR TimerStepperControl::motionMode() {
+    if (_emergencyStopping) return MOTION_STOPPING;
+    if (!_isRunning) return MOTION_IDLE;
+    if (_isTracking) return MOTION_TRACKING;
+    if (_isContinuous) return MOTION_CONTINUOUS;
+    if (_jogMode) return MOTION_JOG;
+    return MOTION_MOVE;
+}
+
+// Seqlock write: the counter is odd while the fields are changing
+void IRAM_ATTR TimerStepperControl::publishSnapshot(uint8_t mode) {
+    _snapshotTicks = 0;
+    _snapshotSequence = _snapshotSequence + 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    _snapshot.timeUs = stepMicros();
+    _snapshot.position = _currentPosition;
+    _snapshot.targetPosition = _targetPosition;
+    _snapshot.velocity = getStepRate();
+    _snapshot.commandedSpeed = _fixedSpeed ? _speed : _speed * _feedOverride / 100;
+    _snapshot.mode = mode;
+    _snapshot.faults = _faultLatched ? MOTION_FAULT_ESTOP : 0;
+    _snapshot.segmentsStarted = _startedSegments;
+    _snapshot.isrCycles = _isrCycles;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    _snapshotSequence = _snapshotSequence + 1;
+}
+
+// Record where the motor is in RTC memory
+void IRAM_ATTR TimerStepperControl::writeCheckpoint(uint8_t mode) {
+    _checkpointRequested = false;
+    _checkpointMode = mode;
+
+    PositionCheckpoint_t* checkpoint = &rtcCheckpoint;
+    checkpoint->magic = CHECKPOINT_MAGIC;
+    checkpoint->count = ++_checkpointCount;
+    checkpoint->position = _currentPosition;
+    checkpoint->electricalOrigin = _electricalOrigin;
+    checkpoint->segmentsStarted = _startedSegments;
+    checkpoint->mode = mode;
+    checkpoint->flags = (_driver->_enabled ? 0 : CHECKPOINT_DEENERGIZED) |
+                        (_referenced ? CHECKPOINT_REFERENCED : 0);
+    checkpoint->microstepMode = _baseMicrostep;
+    checkpoint->reserved = 0;
+    checkpoint->crc = checkpointCrc32(checkpoint);
+}
+
+// Take up the checkpointed position if it is safe, then start checkpointing
+CheckpointRestore TimerStepperControl::restoreCheckpoint(PositionCheckpoint_t* checkpoint) {
+    *checkpoint = rtcCheckpoint;
+    if (_checkpointArmed) return CHECKPOINT_NONE;
+
+    // RTC memory holds noise after power-on
+    CheckpointRestore result = CHECKPOINT_NONE;
+    long position = 0;
+    long electricalOrigin = 0;
+    if (esp_reset_reason() != ESP_RST_POWERON && !_isRunning) {
+        result = checkpointEvaluate(checkpoint, _baseMicrostep, &position, &electricalOrigin);
+    }
+
+    if (result == CHECKPOINT_RESTORED) {
+        // A driver whose indexer was reset with the ESP32 pulls the motor to
+        // where its home state is; one that kept its indexer (a TMC2209
+        // keeps MSCNT) leaves it where it was
+        if (_driver->indexerResetsWithHost()) {
+            position = checkpointIndexerHome(position, electricalOrigin, _baseMicrostep);
+            electricalOrigin = position;
+        }
+        setCurrentPosition(position);
+        _electricalOrigin = electricalOrigin;
+        _referenced = (checkpoint->flags & CHECKPOINT_REFERENCED) != 0;
+        _checkpointCount = checkpoint->count;
+    }
+
+    // Anything else is replaced by the state as it is now
+    _checkpointMode = MOTION_IDLE;
+    _checkpointRequested = true;
+    _checkpointArmed = true;
+    return result;
+}
+
+// Seqlock read: copy, then start again if a publish began or ended meanwhile
+void TimerStepperControl::getSnapshot(MotionSnapshot_t* snapshot) {
+    uint32_t sequence;
+    do {
+        sequence = _snapshotSequence;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        *snapshot = _snapshot;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    } while ((sequence & 1) || sequence != _snapshotSequence);
+}
+
+// Signed speed of the planner, zero when stopped
+float IRAM_ATTR TimerStepperControl::getStepRate() {
+    if (!_isRunning) return 0.0f;
+    if (_isTracking) return _trackingVelocity;
+    // _direction is only the requested one for continuous runs, moves and
+    // segments plan theirs pulse by pulse
+    return _plannedForward ? _currentSpeed : -_currentSpeed;
+}
+
+// Work waiting for the step generator
+int TimerStepperControl::getQueueDepth() {
+    int commands = _commandQueue ? uxQueueMessagesWaiting(_commandQueue) : 0;
+    return commands + (SEGMENT_QUEUE_SIZE - 1) - getFreeSegmentSlots();
 }
 
 // Send a command to the motor control task
 bool TimerStepperControl::sendCommand(MotorCommand_t* cmd) {
+    if (_commandQueue == NULL) return false;
+    
     // Send command to queue with timeout
     return xQueueSend(_commandQueue, cmd, pdMS_TO_TICKS(100)) == pdTRUE;
 }
@@ -224,9 +1189,19 @@ void TimerStepperControl::motorControlTask(void* pvParameters) {
 
 // Handle a command
 void TimerStepperControl::handleCommand(MotorCommand_t* cmd) {
+    // The fault check and the state change happen with the step ISR and the
+    // e-stop masked, so an e-stop can't land between them and be undone
+    portENTER_CRITICAL(&_estopLock);
+    
+    // Nothing moves (or cuts a ramp-down short) until the e-stop is cleared
+    if (_faultLatched && cmd->cmd_type != CMD_SET_SPEED && cmd->cmd_type != CMD_SET_ACCELERATION) {
+        portEXIT_CRITICAL(&_estopLock);
+        return;
+    }
+    
     switch (cmd->cmd_type) {
         case CMD_MOVE_TO:
-            _targetPosition = cmd->position;
+            _targetPosition = applySoftLimits(cmd->position);
             _speed = cmd->speed;
             _driver->setSpeed(_speed);
             _minStepInterval = _speed > 0 ? 1000000 / _speed : 1000000;
@@ -235,11 +1210,15 @@ void TimerStepperControl::handleCommand(MotorCommand_t* cmd) {
             _isRunning = true;
             _isContinuous = false;
             _driver->enable();
+            _currentSpeed = 0; // Start from standstill
+            _lastAccelUpdateTime = micros(); // Initialize timestamp
             _jogMode = false;  // Clear jog mode flag
+            _isTracking = false;
+            _fixedSpeed = cmd->fixedSpeed;
             break;
             
         case CMD_MOVE_STEPS:
-            _targetPosition = _currentPosition + cmd->position;
+            _targetPosition = applySoftLimits(_plannedPosition + cmd->position);
             _speed = cmd->speed;
             _driver->setSpeed(_speed);
             _minStepInterval = _speed > 0 ? 1000000 / _speed : 1000000;
@@ -251,6 +1230,8 @@ void TimerStepperControl::handleCommand(MotorCommand_t* cmd) {
             _currentSpeed = 0; // Start from standstill
             _lastAccelUpdateTime = micros(); // Initialize timestamp
             _jogMode = false;  // Clear jog mode flag
+            _isTracking = false;
+            _fixedSpeed = cmd->fixedSpeed;
             break;
             
         case CMD_SET_SPEED:
@@ -270,12 +1251,13 @@ void TimerStepperControl::handleCommand(MotorCommand_t* cmd) {
             _isRunning = true;
             _isContinuous = false;
             _jogMode = true;  // Set jog mode flag
+            _isTracking = false;
             _driver->enable();
             break;
         
         case CMD_MOVE_JOG:
             // Make sure the new command completely replaces any pending movement
-            _targetPosition = _currentPosition + cmd->position;
+            _targetPosition = applySoftLimits(_plannedPosition + cmd->position);
             _speed = cmd->speed;
             _driver->setSpeed(_speed);
             _minStepInterval = _speed > 0 ? 1000000 / _speed : 1000000;
@@ -284,6 +1266,7 @@ void TimerStepperControl::handleCommand(MotorCommand_t* cmd) {
             _isRunning = true;
             _isContinuous = false;
             _jogMode = true;  // Important - ensures we bypass acceleration
+            _isTracking = false;
             _driver->enable();
             break;
             
@@ -297,22 +1280,77 @@ void TimerStepperControl::handleCommand(MotorCommand_t* cmd) {
             _isRunning = true;
             _isContinuous = true;
             _driver->setDirection(_direction);
+            
+            // With soft limits continuous rotation stops at the limit
+            if (_softLimitsEnabled) {
+                _isContinuous = false;
+                _targetPosition = _direction ? _softLimitMax : _softLimitMin;
+            }
             _driver->enable();
             _currentSpeed = 0; // Start from standstill
             _lastAccelUpdateTime = micros(); // Initialize timestamp
             _jogMode = false;  // Clear jog mode flag
+            _isTracking = false;
+            _fixedSpeed = false;
             break;
             
         case CMD_STOP_MOTOR:
             _isRunning = false;
             _isContinuous = false;
+            _isTracking = false;
             _driver->disable();
             _jogMode = false;  // Clear jog mode flag
+            clearSegments();
+            resetShaper();
+            break;
+            
+        case CMD_SET_ACCELERATION:
+            _acceleration = cmd->acceleration;
+            break;
+            
+        case CMD_RUN_SEGMENTS:
+            // Start from standstill with the first queued segment, the ISR
+            // chains the rest in as each one reaches its target
+            _targetPosition = _plannedPosition;
+            if (loadNextSegment()) {
+                _stepAccumulator = 0.0f;
+                _currentSpeed = 0;
+                _lastAccelUpdateTime = micros();
+                _isContinuous = false;
+                _jogMode = false;
+                _isTracking = false;
+                _fixedSpeed = false;
+                _driver->enable();
+                _isRunning = true;
+            }
+            break;
+            
+        case CMD_START_TRACKING:
+            if (_trackingSource == nullptr) break;
+            _speed = cmd->speed;
+            if (cmd->acceleration > 0) {
+                _acceleration = cmd->acceleration;
+            }
+            clearSegments();
+            _targetPosition = _plannedPosition;
+            _trackingVelocity = 0.0f;
+            _stepAccumulator = 0.0f;
+            _currentSpeed = 0;
+            _lastAccelUpdateTime = micros();
+            _isContinuous = false;
+            _jogMode = false;
+            _isTracking = true;
+            _driver->enable();
+            _isRunning = true;
             break;
             
         default:
             break;
     }
+    portEXIT_CRITICAL(&_estopLock);
+    
+    // The driver may have been switched on or off
+    _checkpointRequested = true;
 }
 
 // Check if motor is currently running
@@ -322,19 +1360,26 @@ bool TimerStepperControl::isRunning() {
 
 // Set current position
 void TimerStepperControl::setCurrentPosition(long position) {
+    _electricalOrigin += position - _currentPosition;
     _currentPosition = position;
     _targetPosition = position;
-}
-
-// Get current position
-long TimerStepperControl::getCurrentPosition() {
-    return _currentPosition;
+    resetShaper();
+    armTriggers();
+    _checkpointRequested = true;
 }
 
 // For power management
 void TimerStepperControl::sleep() {
     _driver->disable();
     
+    // The indexer goes back to its home state when the driver wakes up
+    _electricalOrigin = _currentPosition;
+    if (_stepScale != 1) {
+        _stepScale = 1;
+        _driver->setMicrostepMode(_baseMicrostep);
+    }
+    _checkpointRequested = true;
+    
     #if USE_DRV8825_DRIVER
     // If using DRV8825, we can safely call sleep directly
     DRV8825Driver* drv8825 = static_cast<DRV8825Driver*>(_driver);
@@ -9,6 +9,8 @@
 #include "freertos/queue.h"
 #include "StepperDriver.h"
 #include "DRV8825Driver.h"  // For DRV8825-specific features
+#include "InputShaper.h"
+#include "PositionCheckpoint.h"
 
 // Define command types for motor control
 typedef enum {
@@ -20,7 +22,9 @@ typedef enum {
     CMD_MOVE_JOG,       // Move jog steps (no acceleration)
     CMD_START_CONTINUOUS, // Start continuous rotation
     CMD_STOP_MOTOR,      // Stop any motion
-    CMD_SET_ACCELERATION // New command to set acceleration
+    CMD_SET_ACCELERATION, // New command to set acceleration
+    CMD_RUN_SEGMENTS,    // Start executing the queued motion segments
+    CMD_START_TRACKING   // Follow the tracking source (speed = max speed)
 } MotorCommandType;
 
 // Define command structure
@@ -31,16 +35,96 @@ typedef struct {
     bool direction;          // Direction (true = clockwise)
     bool continuous;         // Whether in continuous mode
     int acceleration;        // New field: Acceleration setting
+    bool fixedSpeed = false; // Move at speed whatever the feed override (homing, make-up moves)
 } MotorCommand_t;
 
+// Automatic microstep switching bands (driver pulses per second). Above the
+// up rate the driver drops to a coarser mode, below the down rate it goes
+// back to a finer one. The gap between the two gives hysteresis.
+#define AUTO_MICROSTEP_UP_RATE 3000
+#define AUTO_MICROSTEP_DOWN_RATE 1200
+
+// Feed override range (percent of the commanded speed)
+#define FEED_OVERRIDE_MIN 10
+#define FEED_OVERRIDE_MAX 200
+
+// Step timer period in microseconds
+#define STEP_TIMER_INTERVAL_US 250
+
+// Planned positions kept for input shaping, one per timer tick (must be a
+// power of two). This limits the longest shaper to about a quarter second.
+#define SHAPER_HISTORY_SIZE 1024
+
+// Position triggers
+#define TRIGGER_MAX_POSITIONS 64       // Entries in a trigger position list
+#define TRIGGER_INLINE_PULSE_MAX_US 20 // Shorter pulses are timed inside the ISR
+
+// The step ISR publishes a MotionSnapshot_t this often (timer ticks) and
+// whenever the mode changes
+#define SNAPSHOT_INTERVAL_TICKS 4  // 1 ms
+
+// What the step generator is doing, as seen in a snapshot
+typedef enum {
+    MOTION_IDLE = 0,
+    MOTION_MOVE,          // Point-to-point move or segments
+    MOTION_JOG,
+    MOTION_CONTINUOUS,
+    MOTION_TRACKING,
+    MOTION_STOPPING       // Emergency ramp-down
+} MotionMode;
+
+// Snapshot fault flags
+#define MOTION_FAULT_ESTOP 0x01        // Emergency stop latched
+
+// Motion state as one consistent set. The step ISR writes it under a
+// sequence counter (seqlock), readers copy it and retry if the ISR
+// published in the middle, so a reader never sees a position from one
+// tick next to a speed from another and never holds the ISR off.
+typedef struct {
+    uint32_t timeUs;               // When it was published
+    long position;
+    long targetPosition;
+    float velocity;                // Signed steps/sec
+    int commandedSpeed;            // Steps/sec after the feed override
+    uint8_t mode;                  // MotionMode
+    uint8_t faults;                // MOTION_FAULT_*
+    unsigned long segmentsStarted; // Sequence progress
+    uint32_t isrCycles;            // Step ISR cycle count (wraps)
+} MotionSnapshot_t;
+
+// Size of the pre-loaded segment queue (must be a power of two)
+#define SEGMENT_QUEUE_SIZE 8
+
+// A single pre-queued move. The step generator chains straight from one
+// segment into the next, so there is no gap between consecutive moves.
+typedef struct {
+    long targetPosition;     // Absolute target position (in steps)
+    int speed;               // Speed for this segment (steps/sec)
+    int acceleration;        // Acceleration for this segment (0 = keep current)
+    uint32_t dwellMs;        // Time to hold position before this segment starts
+} MotionSegment_t;
+
+// Supplies the target in tracking mode. Polled once per timer tick from the
+// step ISR, so it must be quick and must not block.
+class TrackingSource {
+public:
+    virtual ~TrackingSource() {}
+    virtual long getTrackingTarget() = 0;
+    
+    // Speed the target is moving at (steps/sec) as of the last
+    // getTrackingTarget() call, fed forward so a moving target isn't lagged
+    virtual float getTrackingVelocity() { return 0.0f; }
+};
+
 // Timer control class
 class TimerStepperControl {
 public:
     // Constructor
     TimerStepperControl(StepperDriver* driver);
     
-    // Initialize hardware timer and FreeRTOS components
-    void init();
+    // Initialize hardware timer and FreeRTOS components. Fails, starting
+    // nothing, if the step path isn't in IRAM where it has to be.
+    bool init();
 
     void clearCommandQueue();
     void resetMotorState();
@@ -54,10 +138,16 @@ public:
     // Set current position
     void setCurrentPosition(long position);
     
-    // Get current position
-    long getCurrentPosition();
+    // Get current position (inline, so interrupt handlers can read it
+    // without calling out of IRAM)
+    long getCurrentPosition() { return _currentPosition; }
+    
+    // Where the current move is going (only meaningful for point-to-point moves)
+    long getTargetPosition() { return _targetPosition; }
+    bool isContinuous() { return _isContinuous; }
     
-    // Public static method that will be called by the timer ISR
+    // Public static method that will be called by the timer ISR, kept in
+    // IRAM with the rest of the step path (see checkStepPath())
     static bool IRAM_ATTR timerCallback(gptimer_handle_t timer, 
                                         const gptimer_alarm_event_data_t *edata, 
                                         void *user_data);
@@ -74,6 +164,103 @@ public:
 
     // Getter for current acceleration
     int getAcceleration() { return _acceleration; }
+
+    // Feed override in percent of the commanded speed. The step generator
+    // reads it every tick and eases into it under the acceleration limit,
+    // so moves, continuous rotation and sequences change pace without being
+    // restarted. Jog, tracking and moves sent with fixedSpeed set their own
+    // pace and ignore it. It stays set until changed, the caller puts it
+    // back to 100 when the operator's run is over.
+    void setFeedOverride(int percent) { _feedOverride = constrain(percent, FEED_OVERRIDE_MIN, FEED_OVERRIDE_MAX); }
+    int getFeedOverride() { return _feedOverride; }
+
+    // Position checkpoint in RTC memory (see PositionCheckpoint.h). Call
+    // once after init() and setMicrostepMode(), before anything moves: it
+    // takes up the checkpointed position if that is safe, copies what was
+    // stored for the caller and only then starts writing checkpoints. With
+    // a driver whose indexer resets with the ESP32 the position is moved to
+    // where its home phase pulls the motor, otherwise it is kept as stored.
+    CheckpointRestore restoreCheckpoint(PositionCheckpoint_t* checkpoint);
+    // Position is relative to a home reference, kept in the checkpoint
+    void setReferenced(bool referenced) { _referenced = referenced; _checkpointRequested = true; }
+    bool isReferenced() { return _referenced; }
+
+    // Consistent copy of the motion state, at most a millisecond old.
+    // Constant time, never blocks and doesn't disable interrupts.
+    void getSnapshot(MotionSnapshot_t* snapshot);
+
+    // Live readings for telemetry
+    float getStepRate();                // Signed steps/sec the planner is running at
+    int getCommandedSpeed() { return _fixedSpeed ? _speed : _speed * _feedOverride / 100; }
+    int getQueueDepth();                // Commands waiting plus segments queued
+    uint32_t getIsrCycles() { return _isrCycles; } // CPU cycles spent in the step ISR (wraps)
+
+    // Segment queue (filled from the main loop, drained by the step ISR)
+    bool queueSegment(const MotionSegment_t* segment);
+    int getFreeSegmentSlots();
+    void clearSegments();
+    unsigned long getStartedSegments() { return _startedSegments; }
+
+    // Microstepping. Positions and speeds are always in base microsteps, in
+    // automatic mode the driver runs coarser at speed and each pulse then
+    // counts as several base microsteps.
+    void setMicrostepMode(int mode);
+    int getMicrostepMode() { return _baseMicrostep; }
+    void setAutoMicrostep(bool enabled, int maxStepScale = 8);
+    bool isAutoMicrostep() { return _autoMicrostep; }
+    int getMaxStepScale();
+    int getStepScale() { return _stepScale; }
+
+    // Input shaping of the planned position stream (only while stopped).
+    // Shaping runs at full microstep resolution, so it overrides automatic
+    // microstep switching while enabled.
+    bool setInputShaper(ShaperType type, float frequencyHz, float damping);
+    ShaperType getInputShaper() { return _shaperType; }
+    const ShaperImpulses_t* getShaperImpulses() { return &_shaperImpulses; }
+
+    // Position triggers. An output pulse fires when the motor reaches each
+    // compare position, in either direction. Compares are set up while the
+    // motor is stopped, the ISR only ever looks at the neighbouring entries.
+    bool setTriggerOutput(int pin, uint32_t pulseWidthUs);
+    bool setTriggerPositions(const long* positions, int count);  // Strictly increasing
+    bool setTriggerInterval(long start, long interval, long count = 0); // count 0 = no end
+    void clearTriggers();
+    unsigned long getTriggerCount() { return _triggerCount; }
+
+    // Tracking mode. The motor chases the source's target as fast as the
+    // speed and acceleration limits allow and slows down in time to stop on
+    // it. Set the source while stopped, then send CMD_START_TRACKING.
+    void setTrackingSource(TrackingSource* source);
+    bool isTracking() { return _isTracking; }
+    
+    // Soft limits. Move targets are clamped to the range when a command or
+    // segment is started, so the step ISR never has to check them. Continuous
+    // rotation becomes a move to the limit in its direction.
+    void setSoftLimits(long minPosition, long maxPosition);
+    void setSoftLimitsEnabled(bool enabled) { _softLimitsEnabled = enabled && _softLimitMin <= _softLimitMax; }
+    bool areSoftLimitsEnabled() { return _softLimitsEnabled; }
+    long getSoftLimitMin() { return _softLimitMin; }
+    long getSoftLimitMax() { return _softLimitMax; }
+    unsigned long getSoftLimitHits() { return _softLimitHits; }
+    
+    // Stop at the position reached so far without waiting for the command
+    // task, safe to call from a GPIO interrupt (limit or home switch)
+    void stopFromISR();
+    
+    // Emergency stop. The input's interrupt stops step generation right in
+    // the stepper state and latches a fault, motion commands are ignored
+    // until clearFault(). Deceleration 0 cuts the steps at once, otherwise
+    // the motor ramps down at that rate (steps/sec²) first. The driver is
+    // disabled either way.
+    bool setEmergencyStopInput(int pin, bool activeLow, int deceleration = 0);
+    void emergencyStop();           // Same as the input, safe from any context
+    bool isFaulted() { return _faultLatched; }
+    bool isEmergencyStopActive();   // Input is still asserted
+    bool clearFault();              // Fails while the input is active or still stopping
+    
+    // Called from emergencyStop() with the fault latched, to stop whatever
+    // else moves. Runs in the input's interrupt, so it has to be IRAM safe.
+    void setEmergencyStopHook(void (*hook)(void*), void* arg) { _estopHookArg = arg; _estopHook = hook; }
     
 private:
     // Static pointer for ISR to access instance
@@ -81,23 +268,65 @@ private:
     
     // Motor driver
     StepperDriver* _driver;
+    StepPins_t _stepPins;   // Pins the ISR drives itself
+    bool _pinStepping;      // Driver has step pins
+    
+    // Driver calls from the step ISR
+    void driverStep(bool forward);
+    void driverDisable();
+    
+    // Check that the step path is in IRAM and its data in internal RAM.
+    // Everything timerCallback runs, down to the pin writes, is placed
+    // there. With CONFIG_GPTIMER_ISR_IRAM_SAFE in the core's sdkconfig the
+    // gptimer driver registers the interrupt as cache safe and stepping
+    // carries on through flash writes (NVS, LittleFS); without it the
+    // interrupt is held off for the length of each write. Drivers without
+    // step pins (the L298N and its sine microstepping among them), tracking
+    // sources and automatic microstep switching are reached through a
+    // vtable in flash, so only plain moves and segments on a step/direction
+    // driver are covered.
+    bool checkStepPath();
     
     // Motor state
     volatile bool _isRunning;
     volatile bool _isContinuous;
     volatile bool _direction;
+    volatile bool _plannedForward;  // Direction of the last planned pulse
     volatile int _speed;
     volatile long _currentPosition;
     volatile long _targetPosition;
     bool _jogMode;  // Flag to indicate we're in jog mode (bypass acceleration)
+    volatile bool _fixedSpeed;  // Current move ignores the feed override
 
     // Acceleration tracking
     int _acceleration = 3200; // Default value, no need to share constants
     float _currentSpeed;     // Current instantaneous speed in steps/sec
+    volatile int _feedOverride; // Percent of _speed to run at
     unsigned long _lastAccelUpdateTime; // Last time we updated acceleration
     
     // Hardware timer handle
     gptimer_handle_t _gptimer;
+    volatile uint32_t _isrCycles;  // Running total for the load figure
+
+    // Published motion state, odd sequence = being written
+    MotionSnapshot_t _snapshot;
+    volatile uint32_t _snapshotSequence;
+    uint8_t _snapshotTicks;          // Ticks since the last publish
+
+    // Mode for the snapshot (called from the ISR)
+    uint8_t motionMode();
+    // Write the snapshot (called from the ISR)
+    void publishSnapshot(uint8_t mode);
+
+    // Checkpoint state, only the ISR writes the checkpoint itself
+    bool _checkpointArmed;             // Restore decided, checkpoints may be written
+    volatile bool _checkpointRequested; // Rewrite at the next tick
+    uint8_t _checkpointMode;           // Mode in the last checkpoint
+    uint32_t _checkpointCount;
+    bool _referenced;
+
+    // Write the checkpoint (called from the ISR)
+    void writeCheckpoint(uint8_t mode);
     
     // Command queue
     QueueHandle_t _commandQueue;
@@ -110,6 +339,102 @@ private:
     unsigned long _lastStepTime;    // Time of last step
     float _stepAccumulator;        // Tracks fractional steps
     float _stepsPerMs;             // Steps per millisecond (for timer-based stepping)
+
+    // Segment queue state (single producer, single consumer)
+    MotionSegment_t _segments[SEGMENT_QUEUE_SIZE];
+    volatile uint8_t _segmentHead;             // Next free slot (written by producer)
+    volatile uint8_t _segmentTail;             // Next segment to run (written by ISR)
+    volatile unsigned long _startedSegments; // Segments started since last clear
+    unsigned long _dwellStartTime;             // When the current dwell began
+    uint32_t _dwellMs;                         // Remaining dwell for the active segment
+    
+    // Load the next queued segment, returns false if the queue is empty.
+    // Called from the ISR, or elsewhere with _estopLock held.
+    bool loadNextSegment();
+
+    // Microstep switching state
+    int _baseMicrostep;          // User selected microstep mode (position units)
+    volatile int _stepScale;     // Base microsteps per driver pulse
+    bool _autoMicrostep;         // Switch modes by speed band
+    int _maxStepScale;           // Coarsest scale automatic mode may use (limit)
+    long _electricalOrigin;      // Position where the driver indexer was last at home
+
+    // Pick the driver microstep mode for the current speed (called from the ISR)
+    void updateStepScale();
+
+    // Input shaper state. The planner moves _plannedPosition, the shaped
+    // output steps _currentPosition after it. Without a shaper both are equal.
+    volatile long _plannedPosition;
+    ShaperType _shaperType;
+    ShaperImpulses_t _shaperImpulses;        // Impulses as applied (rounded to ticks)
+    uint8_t _shaperCount;                    // Number of impulses (1 = no shaping)
+    uint16_t _shaperDelay[SHAPER_MAX_IMPULSES]; // Impulse delays in timer ticks
+    int32_t _shaperGain[SHAPER_MAX_IMPULSES];   // Impulse amplitudes (Q15)
+    long _shaperHistory[SHAPER_HISTORY_SIZE];   // Planned position per tick
+    uint16_t _shaperHead;                    // Newest history entry
+    uint16_t _shaperQuietTicks;              // Ticks since the planned position last changed
+
+    // Planner pulse, goes straight to the driver unless shaping is active
+    void planPulse(bool forward);
+    // Send one pulse to the driver and count it
+    void outputPulse(bool forward);
+    // Step the output toward the shaped position (called from the ISR)
+    void shapeOutput();
+    // Restart the shaper history at the current position
+    void resetShaper();
+    // Speed profile and segment handling for one tick
+    void runPlanner();
+
+    // Tracking mode state
+    TrackingSource* _trackingSource;
+    volatile bool _isTracking;
+    float _trackingVelocity;          // Signed speed in steps/sec
+
+    // Chase the tracking target for one tick
+    void runTracking(float elapsedSeconds);
+
+    // Soft limit state
+    bool _softLimitsEnabled;
+    long _softLimitMin;
+    long _softLimitMax;
+    volatile unsigned long _softLimitHits; // Targets clamped since start-up
+
+    // Clamp a move target to the soft limits
+    long applySoftLimits(long target);
+
+    // Emergency stop state
+    int _estopPin;                    // Input pin (-1 = none)
+    bool _estopActiveLow;
+    int _estopDeceleration;           // Steps/sec² (0 = cut at once)
+    bool _estopBounded;               // The ramp-down has to stop at _estopLimit
+    long _estopLimit;                 // Move target or soft limit ahead of the ramp
+    volatile bool _faultLatched;      // Stopped by the e-stop, not cleared yet
+    volatile bool _emergencyStopping; // Ramping down after an e-stop
+    portMUX_TYPE _estopLock;          // Masks the step ISR for state changed from outside it
+    void (*_estopHook)(void*);
+    void* _estopHookArg;
+
+    static void emergencyStopISR(void* arg);
+
+    // Position trigger state
+    int _triggerPin;                  // Output pin (-1 = none)
+    uint32_t _triggerPulseWidth;      // Pulse width in microseconds
+    bool _triggerInterval;            // Compares are start + k * interval
+    long _triggerPositions[TRIGGER_MAX_POSITIONS];
+    long _triggerStart;               // First compare in interval mode
+    long _triggerStep;                // Distance between compares in interval mode
+    long _triggerTotal;               // Number of compares (0 = none)
+    volatile long _triggerIndex;      // Compares below the current position
+    volatile bool _triggerActive;     // Output pulse in progress
+    unsigned long _triggerPulseStart; // When the output pulse started
+    volatile unsigned long _triggerCount; // Pulses fired since the compares were set
+
+    // Compare position number index
+    long triggerPosition(long index);
+    // Fire the output if a compare was crossed moving from one position to another
+    void checkTrigger(long from, long to);
+    // Find the first compare at or above the current position
+    void armTriggers();
     
     // Static task function
     static void motorControlTask(void* pvParameters);
@@ -0,0 +1,135 @@
+// shaper_timing.cpp
+//
+// Shows what an input shaper (see InputShaper.h) does to a move before it is
+// tried on the machine. The move is planned the way the step ISR plans it,
+// on the same 250 us tick, and shaped with the impulses rounded the same
+// way. One CSV line per output step goes to standard output, the impulses,
+// move times and predicted residual vibration to standard error.
+//
+//   shaper_timing ZVD 12.5 0.1 3200 4000 20000 > move.csv
+//   (shaper, resonance Hz, damping, steps, steps/sec, steps/sec²)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "../InputShaper.h"
+
+// Step timer tick and shaper history of TimerStepperControl
+#define TICK_US 250
+#define HISTORY_SIZE 1024
+
+int main(int argc, char** argv) {
+    if (argc != 7) {
+        fprintf(stderr, "usage: %s <ZV|ZVD|EI|OFF> <Hz> <damping> <steps> <steps/sec> <steps/sec^2>\n", argv[0]);
+        return 2;
+    }
+
+    ShaperType type;
+    if (strcasecmp(argv[1], "ZV") == 0) {
+        type = SHAPER_ZV;
+    } else if (strcasecmp(argv[1], "ZVD") == 0) {
+        type = SHAPER_ZVD;
+    } else if (strcasecmp(argv[1], "EI") == 0) {
+        type = SHAPER_EI;
+    } else if (strcasecmp(argv[1], "OFF") == 0) {
+        type = SHAPER_NONE;
+    } else {
+        fprintf(stderr, "unknown shaper %s\n", argv[1]);
+        return 2;
+    }
+    float frequency = atof(argv[2]);
+    float damping = atof(argv[3]);
+    long distance = atol(argv[4]);
+    float speed = atof(argv[5]);
+    float acceleration = atof(argv[6]);
+    if (distance == 0 || speed <= 0.0f || acceleration <= 0.0f) {
+        fprintf(stderr, "steps, speed and acceleration must be non-zero\n");
+        return 2;
+    }
+
+    ShaperImpulses_t impulses;
+    if (!computeShaperImpulses(type, frequency, damping, &impulses)) {
+        fprintf(stderr, "invalid shaper settings\n");
+        return 2;
+    }
+    float tickSeconds = TICK_US / 1000000.0f;
+    if (lroundf(impulses.times[impulses.count - 1] / tickSeconds) >= HISTORY_SIZE) {
+        fprintf(stderr, "shaper frequency too low, longest delay is %d ticks\n", HISTORY_SIZE - 1);
+        return 2;
+    }
+
+    uint16_t delays[SHAPER_MAX_IMPULSES];
+    int32_t gains[SHAPER_MAX_IMPULSES];
+    ShaperImpulses_t applied;
+    quantizeShaperImpulses(&impulses, tickSeconds, delays, gains, &applied);
+
+    fprintf(stderr, "Shaper %s:", shaperName(type));
+    for (int i = 0; i < applied.count; i++) {
+        fprintf(stderr, " %.3f@%.2fms", applied.amplitudes[i], applied.times[i] * 1000.0f);
+    }
+    fprintf(stderr, "\n");
+
+    // The planner: ramp up under the acceleration limit, one pulse each time
+    // a whole step has accumulated, stop on the target
+    static long history[HISTORY_SIZE];
+    int head = 0;
+    long target = labs(distance);
+    int sign = distance > 0 ? 1 : -1;
+    long planned = 0;
+    long shaped = 0;
+    float currentSpeed = 0.0f;
+    float accumulator = 0.0f;
+    unsigned long tick = 0;
+    unsigned long plannedEndUs = 0;
+    unsigned long lastStepUs = 0;
+    int quietTicks = 0;
+
+    printf("time_us,planned,shaped,interval_us\n");
+    while (shaped != target || planned != target || quietTicks <= delays[applied.count - 1]) {
+        tick++;
+        unsigned long timeUs = tick * TICK_US;
+
+        if (planned != target) {
+            currentSpeed += acceleration * tickSeconds;
+            if (currentSpeed > speed) currentSpeed = speed;
+            accumulator += currentSpeed * tickSeconds;
+            if (accumulator >= 1.0f) {
+                accumulator -= 1.0f;
+                planned++;
+                if (planned == target) plannedEndUs = timeUs;
+            }
+        }
+
+        // Weighted history, then at most one output step per tick
+        int previous = head;
+        head = (head + 1) & (HISTORY_SIZE - 1);
+        history[head] = planned;
+        quietTicks = history[previous] != planned ? 0 : quietTicks + 1;
+
+        int64_t weighted = 0;
+        for (int i = 0; i < applied.count; i++) {
+            weighted += (int64_t)gains[i] * history[(head - delays[i]) & (HISTORY_SIZE - 1)];
+        }
+        long goal = (long)((weighted + (1 << 14)) >> 15);
+        if (shaped == goal) continue;
+
+        shaped += shaped < goal ? 1 : -1;
+        printf("%lu,%ld,%ld,%lu\n", timeUs, planned * sign, shaped * sign, lastStepUs ? timeUs - lastStepUs : 0);
+        lastStepUs = timeUs;
+    }
+    fflush(stdout);
+
+    fprintf(stderr, "Planned move ends at %.2f ms, shaped at %.2f ms (+%.2f ms)\n",
+            plannedEndUs / 1000.0f, lastStepUs / 1000.0f, (lastStepUs - plannedEndUs) / 1000.0f);
+
+    // Sweep around the resonance to show how forgiving the shaper is
+    if (type != SHAPER_NONE) {
+        for (int percent = 50; percent <= 150; percent += 10) {
+            float f = frequency * percent / 100.0f;
+            fprintf(stderr, "  %.2f Hz: %.1f%% residual vibration\n", f,
+                    shaperResidualVibration(&applied, f, damping) * 100.0f);
+        }
+    }
+    return 0;
+}
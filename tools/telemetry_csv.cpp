@@ -0,0 +1,68 @@
+// telemetry_csv.cpp
+//
+// Turns the binary telemetry stream (see TelemetryCodec.h) into CSV on the
+// host. Reads a capture file, a serial port set up beforehand (stty raw)
+// or standard input, and writes one line per sample to standard output.
+// Text the sketch prints on the same port is skipped.
+//
+//   telemetry_csv /dev/ttyACM0 > run.csv
+//   telemetry_csv capture.bin > run.csv
+
+#include <stdio.h>
+#include <string.h>
+#include "../TelemetryCodec.h"
+
+int main(int argc, char** argv) {
+    FILE* in = stdin;
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "-h") == 0)) {
+        fprintf(stderr, "usage: %s [capture file or serial port]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2 && strcmp(argv[1], "-") != 0) {
+        in = fopen(argv[1], "rb");
+        if (in == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    TelemetryDecoder_t decoder;
+    telemetryDecoderReset(&decoder);
+    printf("%s\n", TELEMETRY_CSV_HEADER);
+
+    uint8_t buffer[4096];
+    size_t length = 0;
+    unsigned long samples = 0;
+    unsigned long skipped = 0;
+
+    while (true) {
+        size_t got = fread(buffer + length, 1, sizeof(buffer) - length, in);
+        length += got;
+
+        size_t offset = 0;
+        while (offset < length) {
+            bool produced;
+            size_t used = telemetryDecode(&decoder, buffer + offset, length - offset, &produced);
+            if (used == 0) break;
+            if (used == 1 && !produced) skipped++;
+            offset += used;
+
+            if (produced) {
+                char line[128];
+                telemetryFormatCsv(&decoder.sample, line, sizeof(line));
+                printf("%s\n", line);
+                samples++;
+            }
+        }
+        memmove(buffer, buffer + offset, length - offset);
+        length -= offset;
+
+        if (got == 0) break;
+    }
+    fflush(stdout);
+
+    fprintf(stderr, "%lu samples from %lu frames, %lu gaps, %lu bytes skipped\n",
+            samples, decoder.frames, decoder.gaps, skipped + (unsigned long)length);
+    if (in != stdin) fclose(in);
+    return 0;
+}